@@ -27,11 +27,18 @@
 
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstdarg>
+#include <climits>
 #include <cmath> 
 #include <string>
 #include <sstream>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <functional>
+#include <type_traits>
 #include <algorithm>
 #include <chrono>
 #include <iostream>
@@ -40,7 +47,28 @@
 #include <thread>
 #include <future>
 #include <mutex> 
+#include <atomic>
+#include <deque>
+#include <condition_variable>
+
+// SSE2 is used by the audio mixer when it's available (which it always is on x64)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PLAY_SSE2
+#include <emmintrin.h>
+#endif
+
+// The profiler reads the time stamp counter on x86, which is much quicker than asking for the time
+#if defined(_M_X64) || defined(_M_IX86)
+#define PLAY_PROFILE_TSC
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#define PLAY_PROFILE_TSC
+#include <x86intrin.h>
+#endif
 
+// A headless build (#define PLAY_HEADLESS before including Play.h) has no window, display or sound device, and doesn't use any
+// Windows headers so it builds on other platforms: main() runs the game, Present only counts frames and input is scripted
+#ifndef PLAY_HEADLESS
 // Exclude rarely-used content from the Windows headers
 #ifndef WIN32_LEAN_AND_MEAN
 #define WIN32_LEAN_AND_MEAN 
@@ -78,6 +106,17 @@ namespace Gdiplus
 }
 #include <GdiPlus.h>
 #pragma warning(pop)
+#elif !defined(_MSC_VER)
+#define __debugbreak() __builtin_trap()
+#endif // PLAY_HEADLESS
+
+// Headless builds map sound files into memory with the POSIX calls, where there are any
+#if defined(PLAY_HEADLESS) && !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 // Macros for Assertion and Tracing
 void TracePrintf(const char* file, int line, const char* fmt, ...);
@@ -86,11 +125,11 @@ void DebugOutput( const char* s );
 void DebugOutput( std::string s );
 
 #ifdef _DEBUG
-#define PLAY_TRACE(fmt, ...) TracePrintf(__FILE__, __LINE__, fmt, __VA_ARGS__);
+#define PLAY_TRACE(...) TracePrintf(__FILE__, __LINE__, __VA_ARGS__);
 #define PLAY_ASSERT(x) if(!(x)){ PLAY_TRACE(" *** ASSERT FAIL *** !("#x")\n\n"); AssertFailMessage(#x, __FILE__, __LINE__), __debugbreak(); }
 #define PLAY_ASSERT_MSG(x,y) if(!(x)){ PLAY_TRACE(" *** ASSERT FAIL *** !("#x")\n\n"); AssertFailMessage(y, __FILE__, __LINE__), __debugbreak(); }
 #else
-#define PLAY_TRACE(fmt, ...)
+#define PLAY_TRACE(...)
 #define PLAY_ASSERT(x) if(!(x)){ AssertFailMessage(#x, __FILE__, __LINE__);  }
 #define PLAY_ASSERT_MSG(x,y) if(!(x)){ AssertFailMessage(y, __FILE__, __LINE__); }
 #endif // _DEBUG
@@ -105,7 +144,12 @@ void DebugOutput( std::string s );
 // Platform:	Independent
 // Description:	Declaration for a simple memory tracker to prevent leaks
 //********************************************************************************************************************************
-#ifdef _DEBUG
+// The tracker uses DbgHelp for its stack traces, so it's only included in Windows debug builds
+#if defined(_DEBUG) && !defined(PLAY_HEADLESS)
+#define PLAY_MEMORY_TRACKER
+#endif
+
+#ifdef PLAY_MEMORY_TRACKER
 	// Prints out all the currently allocated memory to the debug output
 namespace Play
 {
@@ -201,7 +245,7 @@ namespace Play
 		{
 			float v[3];
 			struct { float x; float y; float w; };
-			struct { float width; float height; float w; };
+			struct { float width; float height; };
 		};
 
 		// Returns the 2D part of the 3D vector
@@ -883,6 +927,15 @@ namespace Play
 		bool preMultiplied = false;
 	};
 
+	// A rectangle of pixels within a PixelData buffer, in buffer co-ordinates (top row first) and excluding the right and bottom edges
+	struct PixelRect
+	{
+		int left{ 0 };
+		int top{ 0 };
+		int right{ 0 };
+		int bottom{ 0 };
+	};
+
 	struct BlendColour
 	{
 		float alpha{ 1.0f };
@@ -916,7 +969,7 @@ namespace Play
 //********************************************************************************************************************************
 // File:		PlayWindow.h
 // Description:	Platform specific code to provide a window to draw into
-// Platform:	Windows
+// Platform:	Windows (or headless on any platform, with PLAY_HEADLESS)
 // Notes:		Uses a 32-bit ARGB display buffer
 //********************************************************************************************************************************
 
@@ -939,6 +992,7 @@ namespace Play::Window
 	// Destroys the Window Manager
 	bool DestroyManager();
 
+#ifndef PLAY_HEADLESS
 	// Windows functions
 	//********************************************************************************************************************************
 
@@ -946,12 +1000,80 @@ namespace Play::Window
 	int HandleWindows( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR pCmdLine, int nCmdShow, LPCWSTR windowName );
 	// Handles Windows messages for the PlayWindow  
 	static LRESULT CALLBACK WndProc( HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam );
+#else
+	// Headless functions
+	//********************************************************************************************************************************
+
+	// Called by main() to run the game loop with a fixed elapsed time of 1/FRAMES_PER_SECOND for every frame
+	// > Runs until MainGameUpdate returns true, the frame script returns false or the frame limit is reached
+	// > --capture=DIR on the command line saves every frame into DIR (see PlayCapture.h)
+	// > --trace=FILE saves a profile trace of the whole run to FILE when the game exits (see PlayProfile.h)
+	int HandleHeadless( int argc, char* argv[] );
+	// Stops the game after the given number of frames (0 for no limit), which can also be set with --frames=N on the command line
+	void SetFrameLimit( int frames );
+	// Sets a function which is called before each update to script the input for that frame
+	// > Returning false from the script stops the game
+	void SetFrameScript( std::function<bool( int frame )> script );
+	// Sets a function which Present calls with the display buffer, e.g. to capture or check frames
+	// > With a display scale above 1 it's called with the upscaled pixels which a window would show
+	void SetPresentCallback( std::function<void( const PixelData& display, int frame )> callback );
+	// Gets the number of frames which have been presented
+	int GetFrameCount();
+#endif // PLAY_HEADLESS
 	// Copies the display buffer pixels to the window
 	// > Returns the time taken for the present in seconds
 	double Present();
+	// Copies the pixels of the given buffer (the same size as the display buffer) to the window
+	// > Used by the render thread to present its back buffer, so in headless builds the present callback is called from there
+	double Present( const PixelData& display );
+	// Copies just the given rectangles of the buffer to the window, as the rest hasn't changed since the last present
+	double Present( const PixelData& display, const std::vector<PixelRect>& vDirty );
 	// Sets the pointer to write mouse input data to
 	void RegisterMouse(Play::MouseData* pMouseData);
 
+	// Frame pacing functions
+	//********************************************************************************************************************************
+
+	// Statistics on the time between frames, over the last FRAME_STATS_HISTORY frames
+	struct FrameStats
+	{
+		int frames{ 0 }; // The number of frames the statistics cover
+		float averageMs{ 0.0f };
+		float minMs{ 0.0f };
+		float maxMs{ 0.0f };
+		float jitterMs{ 0.0f }; // The standard deviation of the time between frames
+		int lateFrames{ 0 }; // Frames which started more than a millisecond after they were due
+		float sleepMs{ 0.0f }; // The average time each frame spent waiting for the next: sleeping, then spinning for the last part
+		float spinMs{ 0.0f };
+	};
+	constexpr int FRAME_STATS_HISTORY = 256;
+
+	// Sets the frame rate which the game loop is paced to (0 runs each frame as soon as the last one has finished)
+	// > Windowed builds start at FRAMES_PER_SECOND, while headless builds start at 0 so they run as fast as they can
+	void SetFrameRate( int framesPerSecond );
+	// Gets the frame rate which the game loop is paced to
+	int GetFrameRate();
+	// Waits until the next frame is due, sleeping for as much of the wait as can be timed accurately and spinning for the rest
+	// > Returns the time since the last frame started in seconds. Called by the game loop, so games don't need to call it.
+	double WaitForNextFrame();
+	// Gets the statistics on the time between frames
+	FrameStats GetFrameStats();
+
+	// Upscaling functions
+	//********************************************************************************************************************************
+
+	enum class UpscaleFilter
+	{
+		NEAREST, // Each pixel becomes a square block of pixels
+		SCALE2X, // Smooths the diagonal edges of pixel art with the Scale2x algorithm first: only used for even scales
+	};
+
+	// Sets how Present upscales the display buffer by the display scale
+	void SetUpscaleFilter( UpscaleFilter filter );
+	// Upscales the source pixels into the destination, which must be scale times the width and height of the source
+	// > Large images are split into bands of rows and spread across the job system's threads, once it has been created
+	void Upscale( const PixelData& source, PixelData& dest, int scale, UpscaleFilter filter = UpscaleFilter::NEAREST );
+
 	// Getter functions
 	//********************************************************************************************************************************
 
@@ -985,7 +1107,8 @@ namespace Play::Render
 {
 	// The pre-multiplied alpha buffers store the number of subsequent pixels which are also transparent 
 	// so they can be skipped. This works for any blend mode which uses the pre-multiplied alpha buffer. 
-	inline void Skip(uint32_t*& srcPixels, uint32_t*& destPixels, const uint32_t* destRowEnd)
+	// > The destination can also be the counts in an overdraw map, to skip the same pixels as the blend did
+	template< typename TDest > inline void Skip(uint32_t*& srcPixels, TDest*& destPixels, const TDest* destRowEnd)
 	{
 		// If this is a fully transparent pixel then the low bits store how many there are in a row
 		// This means we can skip straight to the next pixel which isn't fully transparent
@@ -999,26 +1122,37 @@ namespace Play::Render
 	class AlphaBlendPolicy
 	{
 	public:
+		static constexpr int COUNTER_INDEX = 0; // Where the render counters count its draws
+		static constexpr bool SKIPS_TRANSPARENT_RUNS = true; // Whether BlendFastSkip and BlendSkip use the Skip function above
+
+		// Whether a source pixel is one which the blends don't draw
+		static inline bool IsTransparent( uint32_t src ) { return src > 0xFF000000; }
+
 		// Standard alpha blending using a pre-multiplied srcAlpha buffer: (src * srcAlpha)+(dest * (1-srcAlpha)
-		static inline void BlendFastSkip(uint32_t*& srcPixels, uint32_t*& destPixels, const uint32_t* destRowEnd)
+		// > Returns true if a pixel was drawn, or false if a run of transparent pixels was skipped
+		static inline bool BlendFastSkip(uint32_t*& srcPixels, uint32_t*& destPixels, const uint32_t* destRowEnd)
 		{
 			// Optimal alpha blend approach performed on all channels simultaneously! 
 			// Fully transparent pixels can be skipped in the optimal way using the Skip function above  
-			if (BlendFast(srcPixels, destPixels))
+			bool drawn = BlendFast(srcPixels, destPixels);
+			if (drawn)
 				srcPixels++, destPixels++;
 			else
 				Skip(srcPixels, destPixels, destRowEnd);
+			return drawn;
 		}
 
 		// Standard alpha blending, but with an additional global alpha multiply
-		static inline void BlendSkip( uint32_t*& srcPixels, uint32_t*& destPixels, BlendColour globalMultiply, const uint32_t* destRowEnd )
+		static inline bool BlendSkip( uint32_t*& srcPixels, uint32_t*& destPixels, BlendColour globalMultiply, const uint32_t* destRowEnd )
 		{
 			// A slower blend calculation is required for semi-transparent pixels with a global multiply
 			// Fully transparent pixels can be skipped in the optimal way using the Skip function above   
-			if( Blend( srcPixels, destPixels, globalMultiply ) )
+			bool drawn = Blend( srcPixels, destPixels, globalMultiply );
+			if( drawn )
 				srcPixels++, destPixels++;
 			else
 				Skip( srcPixels, destPixels, destRowEnd );
+			return drawn;
 		}
 
 		// *******************************************************************************************************************************************************
@@ -1028,7 +1162,7 @@ namespace Play::Render
 		// *******************************************************************************************************************************************************
 		static inline bool Blend(uint32_t*& srcPixels, uint32_t*& destPixels, BlendColour globalMultiply)
 		{
-			if (*srcPixels > 0xFF000000) return false; // No pixels to draw( fully transparent )
+			if (IsTransparent(*srcPixels)) return false; // No pixels to draw( fully transparent )
 
 			uint32_t src = *srcPixels;
 			uint32_t dest = *destPixels;
@@ -1067,7 +1201,7 @@ namespace Play::Render
 		// *******************************************************************************************************************************************************
 		static inline bool BlendFast(uint32_t*& srcPixels, uint32_t*& destPixels)
 		{
-			if (*srcPixels > 0xFF000000) return false; // No pixels to draw( fully transparent )
+			if (IsTransparent(*srcPixels)) return false; // No pixels to draw( fully transparent )
 
 			// This performs the dest*(1-srcAlpha) calculation for all channels in parallel with minor accuracy loss in dest colour.
 			// It does this by shifting all the destination channels down by 4 bits in order to "make room" for the later multiplication.
@@ -1087,22 +1221,29 @@ namespace Play::Render
 	class AdditiveBlendPolicy
 	{
 	public:
+		static constexpr int COUNTER_INDEX = 1;
+		static constexpr bool SKIPS_TRANSPARENT_RUNS = true;
+
+		static inline bool IsTransparent( uint32_t src ) { return src > 0xFF000000; }
+
 		// Standard additive blending using pre-multiplied srcAlpha buffer: src*srcAlpha + dest*destAlpha
 		// This isn't actually a very common requirement, so we default to the same global multiply approach below 
-		static inline void BlendFastSkip(uint32_t*& srcPixels, uint32_t*& destPixels, const uint32_t* destRowEnd)
+		static inline bool BlendFastSkip(uint32_t*& srcPixels, uint32_t*& destPixels, const uint32_t* destRowEnd)
 		{
-			BlendSkip( srcPixels, destPixels, { 1.0f, 1.0f, 1.0f, 1.0f }, destRowEnd );
+			return BlendSkip( srcPixels, destPixels, { 1.0f, 1.0f, 1.0f, 1.0f }, destRowEnd );
 		}
 
 		// Standard additive blending, with a global alpha multiply. This is the most common requirement for particle effects.
-		static inline void BlendSkip( uint32_t*& srcPixels, uint32_t*& destPixels, BlendColour globalMultiply, const uint32_t* destRowEnd )
+		static inline bool BlendSkip( uint32_t*& srcPixels, uint32_t*& destPixels, BlendColour globalMultiply, const uint32_t* destRowEnd )
 		{
 			// A full blend calculation is required for semi-transparent pixels with a global multiply
 			// Fully transparent pixels can be skipped in the optimal way using the Skip function above   
-			if( Blend( srcPixels, destPixels, globalMultiply ) )
+			bool drawn = Blend( srcPixels, destPixels, globalMultiply );
+			if( drawn )
 				srcPixels++, destPixels++;
 			else
 				Skip( srcPixels, destPixels, destRowEnd );
+			return drawn;
 		}
 
 		// *******************************************************************************************************************************************************
@@ -1112,7 +1253,7 @@ namespace Play::Render
 		// *******************************************************************************************************************************************************
 		static inline bool Blend(uint32_t*& srcPixels, uint32_t*& destPixels, BlendColour globalMultiply)
 		{
-			if (*srcPixels > 0xFF000000) return false; // No pixels to draw( fully transparent )
+			if (IsTransparent(*srcPixels)) return false; // No pixels to draw( fully transparent )
 
 			uint32_t src = *srcPixels;
 			uint32_t dest = *destPixels;
@@ -1152,21 +1293,28 @@ namespace Play::Render
 	class MultiplyBlendPolicy
 	{
 	public:
+		static constexpr int COUNTER_INDEX = 2;
+		static constexpr bool SKIPS_TRANSPARENT_RUNS = false;
+
+		// Uses the unmodified alpha rather than the pre-multiplied inverse alpha
+		static inline bool IsTransparent( uint32_t src ) { return src < 0x00FFFFFF; }
 
 		// Standard multipy blend using an unmodified srcAlpha buffer (the original canvas buffer): dest* invSrcAlpha + (src * dest) * srcAlpha
-		static inline void BlendSkip(uint32_t*& srcPixels, uint32_t*& destPixels, BlendColour globalMultiply, const uint32_t*)
+		static inline bool BlendSkip(uint32_t*& srcPixels, uint32_t*& destPixels, BlendColour globalMultiply, const uint32_t*)
 		{
 			// Transparent pixels still need to be multiplied, so we have only one route
-			Blend(srcPixels, destPixels, globalMultiply);
+			bool drawn = Blend(srcPixels, destPixels, globalMultiply);
 			srcPixels++, destPixels++;
+			return drawn;
 		}
 
 		// Standard additive blending, with a global alpha multiply. This is the most common requirement for particle effects.
-		static inline void BlendFastSkip(uint32_t*& srcPixels, uint32_t*& destPixels, const uint32_t*)
+		static inline bool BlendFastSkip(uint32_t*& srcPixels, uint32_t*& destPixels, const uint32_t*)
 		{
 			// Transparent pixels still need to be multiplied, so we have only one route
-			Blend(srcPixels, destPixels, { 1.0f, 1.0f, 1.0f, 1.0f });
+			bool drawn = Blend(srcPixels, destPixels, { 1.0f, 1.0f, 1.0f, 1.0f });
 			srcPixels++, destPixels++;
+			return drawn;
 		}
 
 		// *******************************************************************************************************************************************************
@@ -1174,9 +1322,9 @@ namespace Play::Render
 		// Has the advantage that a global alpha multiplication can be easily added over the top, so we use this method when a global multiply is required
 		// Notes: Requires a source buffer which has the source alpha unmodified
 		// *******************************************************************************************************************************************************
-		static inline void Blend(uint32_t*& srcPixels, uint32_t*& destPixels, BlendColour globalMultiply)
+		static inline bool Blend(uint32_t*& srcPixels, uint32_t*& destPixels, BlendColour globalMultiply)
 		{
-			if (*srcPixels < 0x00FFFFFF) return; // No pixels to draw( fully transparent )
+			if (IsTransparent(*srcPixels)) return false; // No pixels to draw( fully transparent )
 
 			uint32_t src = *srcPixels;
 			uint32_t dest = *destPixels;
@@ -1212,6 +1360,8 @@ namespace Play::Render
 
 			// Put ARGB components back together again
 			*destPixels = (destAlpha << 24) | (blendRed << 16) | (blendGreen << 8) | blendBlue;
+
+			return true;
 		}
 	};
 }
@@ -1222,15 +1372,133 @@ namespace Play::Render
 // File:		PlayRender.h
 // Description:	A software pixel renderer for drawing 2D primitives into a PixelData buffer
 // Platform:	Independent
-// Notes:		The only internal state/data stored by the renderer is a pointer to the render target
+// Notes:		The only internal state/data stored by the renderer is a pointer to the render target, which each thread has its own of,
+//				optionally the dirty rectangles and overdraw map which drawing into it adds to, and the render counters
 //********************************************************************************************************************************
+
+// Adds to one of the calling thread's render counters: #define PLAY_DISABLE_RENDER_COUNTERS before including Play.h to compile them out
+#ifndef PLAY_DISABLE_RENDER_COUNTERS
+#define PLAY_RENDER_COUNT( counter, amount ) ( Play::Render::m_renderCounters.counter += ( amount ) )
+#else
+#define PLAY_RENDER_COUNT( counter, amount ) ( ( void )( amount ) )
+#endif
+
 namespace Play::Render
 {
-	// Set the render target for all subsequent drawing operations
+	// Set the render target for all subsequent drawing operations on the calling thread
 	// Returns a pointer to any previous render target
 	PixelData* SetRenderTarget( PixelData* pRenderTarget );
 
-	extern PixelData* m_pRenderTarget;
+	extern thread_local PixelData* m_pRenderTarget;
+
+	// Dirty rectangle functions
+	//********************************************************************************************************************************
+
+	// The parts of a buffer which have been drawn into, as a short list of rectangles which don't overlap
+	// > Rectangles near each other are merged together, so the list can cover some pixels which weren't actually drawn
+	class DirtyRects
+	{
+	public:
+		static constexpr int MAX_RECTS = 16;
+		static constexpr int MERGE_DISTANCE = 8; // Rectangles this many pixels apart or closer are merged
+
+		// Adds a rectangle (which should already be clipped to the buffer)
+		void Add( PixelRect rect );
+		// Adds all of the rectangles from another list
+		void Add( const DirtyRects& other );
+		void Clear() { m_vRects.clear(); }
+		bool IsEmpty() const { return m_vRects.empty(); }
+		const std::vector<PixelRect>& GetRects() const { return m_vRects; }
+		// Gets the number of pixels the rectangles cover
+		int GetPixelCount() const;
+
+	private:
+		std::vector<PixelRect> m_vRects;
+	};
+
+	// Sets the dirty rectangles which drawing into the given render target on the calling thread adds to (nullptr to stop)
+	void SetDirtyRects( const PixelData* pTarget, DirtyRects* pDirtyRects );
+
+	extern thread_local DirtyRects* m_pDirtyRects;
+	extern thread_local const PixelData* m_pDirtyTarget;
+
+	// Whether drawing into the current render target is adding to its dirty rectangles
+	inline bool IsTrackingDirtyRects() { return m_pDirtyRects && m_pRenderTarget == m_pDirtyTarget; }
+	// Adds a rectangle of the current render target to its dirty rectangles, if they're being tracked
+	inline void MarkDirty( int left, int top, int right, int bottom ) { if( IsTrackingDirtyRects() ) m_pDirtyRects->Add( { left, top, right, bottom } ); }
+
+	// Render counter functions
+	//********************************************************************************************************************************
+
+	// Counts of what the drawing functions on a thread have done, to show where the renderer's time goes
+	struct RenderCounters
+	{
+		static constexpr int BLEND_POLICIES = 3; // Indexed by the blend policies' COUNTER_INDEX, which follows Graphics::BlendMode
+
+		int blits[BLEND_POLICIES]{}; // BlitPixels calls which weren't clipped away completely
+		int transforms[BLEND_POLICIES]{}; // TransformPixels calls
+		int pixelDraws[BLEND_POLICIES]{}; // DrawPixel and DrawPixelPreMult calls, which lines, rectangles, circles and debug text are made of
+		int lines{ 0 };
+		int clears{ 0 }; // Clears and backgrounds, including the parts restored for dirty rectangles
+		long long pixelsWritten{ 0 }; // Blended into the render target by everything apart from the clears
+		long long pixelsSkipped{ 0 }; // Transparent source pixels which weren't blended, which blits skip in runs
+		long long pixelsCleared{ 0 };
+	};
+
+	extern thread_local RenderCounters m_renderCounters;
+
+	// Gets the counts for the drawing done on the calling thread since they were last reset
+	inline const RenderCounters& GetRenderCounters() { return m_renderCounters; }
+	// Resets the calling thread's counts
+	inline void ResetRenderCounters() { m_renderCounters = RenderCounters{}; }
+
+	// Overdraw map functions
+	//********************************************************************************************************************************
+
+	// How many times each pixel of a buffer has been cleared or drawn over, to show which parts of a frame use up the fill rate
+	// > Counts the same pixels as the render counters' pixelsWritten and pixelsCleared, so its average is the overdraw
+	class OverdrawMap
+	{
+	public:
+		// Sets the size of the buffer being counted, and all the counts to 0
+		void Reset( int width, int height );
+		// Sets all the counts to 0
+		void Clear() { std::fill( m_vCounts.begin(), m_vCounts.end(), static_cast<uint16_t>( 0 ) ); }
+		int GetWidth() const { return m_width; }
+		int GetHeight() const { return m_height; }
+		// Gets the counts, in rows from the top of the buffer like its pixels
+		uint16_t* GetCounts() { return m_vCounts.data(); }
+		const uint16_t* GetCounts() const { return m_vCounts.data(); }
+		// Adds one to the counts in a rectangle (which should already be clipped to the buffer)
+		void Add( const PixelRect& rect );
+		// Draws the counts into a buffer of the same size as a heat map: black for 0, then blue, cyan, green, yellow,
+		// orange and red, up to white for 7 or more
+		void DrawHeatMap( PixelData& dest ) const;
+
+	private:
+		std::vector<uint16_t> m_vCounts;
+		int m_width{ 0 };
+		int m_height{ 0 };
+	};
+
+	// Sets the overdraw map which drawing into the given render target on the calling thread adds to (nullptr to stop)
+	void SetOverdrawMap( const PixelData* pTarget, OverdrawMap* pOverdrawMap );
+
+	extern thread_local OverdrawMap* m_pOverdrawMap;
+	extern thread_local const PixelData* m_pOverdrawTarget;
+
+	// Whether drawing into the current render target is adding to its overdraw map
+#ifndef PLAY_DISABLE_RENDER_COUNTERS
+	inline bool IsCountingOverdraw() { return m_pOverdrawMap && m_pRenderTarget == m_pOverdrawTarget; }
+#else
+	constexpr bool IsCountingOverdraw() { return false; }
+#endif
+	// Adds one to the count of a pixel of the current render target, if it's being counted and the pixel was drawn
+	inline void AddOverdraw( int posX, int posY, bool drawn ) { if( IsCountingOverdraw() ) m_pOverdrawMap->GetCounts()[posY * m_pOverdrawMap->GetWidth() + posX] += drawn; }
+	// Adds one to the counts of a rectangle of the current render target, if it's being counted
+	inline void AddOverdraw( const PixelRect& rect ) { if( IsCountingOverdraw() ) m_pOverdrawMap->Add( rect ); }
+	// Adds one to the counts of the pixels a blit draws (the ones which aren't transparent), a row at a time like BlitPixels
+	template< typename TBlend > void AddBlitOverdraw( uint32_t* srcPixels, int srcWidth, int destOffset, int endRow, int rows );
 
 	// Primitive drawing functions
 	//********************************************************************************************************************************
@@ -1250,8 +1518,14 @@ namespace Play::Render
 	template< typename TBlend > void RotateScalePixels(const PixelData& srcPixelData, int srcFrameOffset, int srcWidth, int srcHeight, const Point2f& origin, const Matrix2D& m, BlendColour globalMultiply);
 	// Clears the render target using the given pixel colour
 	void ClearRenderTarget( Pixel colour );
+	// Clears part of the render target using the given pixel colour
+	// > Isn't added to the dirty rectangles, as it's used to restore parts of the buffer which have already been drawn over
+	void ClearRenderTarget( Pixel colour, const PixelRect& rect );
 	// Copies a background image of the correct size to the render target
 	void BlitBackground( PixelData& backgroundImage );
+	// Copies part of a background image of the correct size to the same part of the render target
+	// > Isn't added to the dirty rectangles, as it's used to restore parts of the buffer which have already been drawn over
+	void BlitBackground( PixelData& backgroundImage, const PixelRect& rect );
 
 	//********************************************************************************************************************************
 	// Function:	BlitPixels - draws image data with and without a global alpha multiply
@@ -1298,7 +1572,17 @@ namespace Play::Render
 
 		//How many pixels per row in sprite.
 		int endRow = blitWidth - xClipEnd - xClipStart;
+		int rows = blitHeight - yClipEnd - yClipStart;
+
+		if (endRow <= 0 || rows <= 0)
+			return;
+
+		MarkDirty( blitX + xClipStart, blitY + yClipStart, blitX + blitWidth - xClipEnd, blitY + blitHeight - yClipEnd );
 
+		if( IsCountingOverdraw() )
+			AddBlitOverdraw<TBlend>( srcPixels, srcPixelData.width, destOffset, endRow, rows );
+
+		int drawn = 0;
 		if (globalMultiply.alpha < 1.0f || globalMultiply.red < 1.0f || globalMultiply.green < 1.0f || globalMultiply.blue < 1.0f )
 		{
 			// It is slightly faster to loop through without the additions 
@@ -1308,7 +1592,7 @@ namespace Play::Render
 
 				// Call the more versatile global multiply blend function
 				while (destPixels < destRowEnd)
-					TBlend::BlendSkip(srcPixels, destPixels, globalMultiply, destRowEnd);
+					drawn += TBlend::BlendSkip(srcPixels, destPixels, globalMultiply, destRowEnd);
 
 				// Increase buffers by pre-calculated amounts
 				destPixels += destInc;
@@ -1324,7 +1608,7 @@ namespace Play::Render
 
 				// Call the fastest available blend function
 				while (destPixels < destRowEnd)
-					TBlend::BlendFastSkip(srcPixels, destPixels, destRowEnd);
+					drawn += TBlend::BlendFastSkip(srcPixels, destPixels, destRowEnd);
 
 				// Increase buffers by pre-calculated amounts
 				destPixels += destInc;
@@ -1332,6 +1616,9 @@ namespace Play::Render
 			}
 		}
 
+		PLAY_RENDER_COUNT( blits[TBlend::COUNTER_INDEX], 1 );
+		PLAY_RENDER_COUNT( pixelsWritten, drawn );
+		PLAY_RENDER_COUNT( pixelsSkipped, endRow * rows - drawn );
 		return;
 	}
 
@@ -1386,6 +1673,8 @@ namespace Play::Render
 		if (dst_minx < 0) { dst_draw_width += (int)dst_minx; dst_minx = 0; }
 		if (dst_maxx > (float)dst_buffer_width) { dst_draw_width -= (int)dst_maxx - dst_buffer_width;  dst_maxx = (float)dst_buffer_width; }
 
+		MarkDirty( static_cast<int>( dst_minx ), static_cast<int>( dst_miny ), static_cast<int>( dst_minx ) + dst_draw_width, static_cast<int>( dst_miny ) + dst_draw_height );
+
 		// Transform the starting position within the render target into the sprite's space 
 		Point2f dst_pixel_start{ dst_minx, dst_miny };
 		Point2f src_pixel_start = invTransform.Transform(dst_pixel_start) + srcOrigin;
@@ -1410,6 +1699,12 @@ namespace Play::Render
 		int dst_start_pixel_index = dst_posx + (dst_posy * dst_buffer_width);
 		uint32_t* dst_pixel = (uint32_t*)m_pRenderTarget->pPixels + dst_start_pixel_index;
 		uint32_t* dst_pixel_end = dst_pixel + (dst_draw_height * dst_buffer_width);
+		int sampled = 0;
+		int drawn = 0;
+
+		// The overdraw counts are at the same offsets from the start of the map as the pixels are from the start of the buffer
+		uint32_t* dst_buffer = (uint32_t*)m_pRenderTarget->pPixels;
+		uint16_t* overdraw = IsCountingOverdraw() ? m_pOverdrawMap->GetCounts() : nullptr;
 
 		// Iterate sequentially through pixels within the render target buffer
 		while (dst_pixel < dst_pixel_end)
@@ -1427,7 +1722,10 @@ namespace Play::Render
 				{
 					int src_pixel_index = roundX + (roundY * srcPixelData.width);
 					uint32_t* src = ((uint32_t*)srcPixelData.pPixels + src_pixel_index + srcFrameOffset);
-					TBlend::Blend(src, dst_pixel, globalMultiply); // Perform the appropriate blend using a template
+					bool blended = TBlend::Blend(src, dst_pixel, globalMultiply); // Perform the appropriate blend using a template
+					drawn += blended;
+					sampled++;
+					if (overdraw) overdraw[dst_pixel - dst_buffer] += blended;
 				}
 
 				// Move one horizontal pixel in render target, which corresponds to the x axis of the inverse matrix in sprite space
@@ -1447,6 +1745,10 @@ namespace Play::Render
 			src_posx += src_yincx;
 			src_posy += src_yincy;
 		}
+
+		PLAY_RENDER_COUNT( transforms[TBlend::COUNTER_INDEX], 1 );
+		PLAY_RENDER_COUNT( pixelsWritten, drawn );
+		PLAY_RENDER_COUNT( pixelsSkipped, sampled - drawn );
 	}
 
 	template< typename TBlend > void DrawPixelPreMult(int posX, int posY, Pixel srcPixel)
@@ -1460,11 +1762,17 @@ namespace Play::Render
 		srcPixel.b = (srcPixel.b * srcPixel.a) >> 8;
 		srcPixel.a = 0xFF - srcPixel.a;
 
+		MarkDirty( posX, posY, posX + 1, posY + 1 );
+
 		uint32_t* pDest = &m_pRenderTarget->pPixels[(posY * m_pRenderTarget->width) + posX].bits;
 		uint32_t* pSrc = &srcPixel.bits;
 
-		TBlend::Blend(pSrc, pDest, { 1.0f, 1.0f, 1.0f, 1.0f });
+		bool drawn = TBlend::Blend(pSrc, pDest, { 1.0f, 1.0f, 1.0f, 1.0f });
 
+		PLAY_RENDER_COUNT( pixelDraws[TBlend::COUNTER_INDEX], 1 );
+		PLAY_RENDER_COUNT( pixelsWritten, drawn );
+		PLAY_RENDER_COUNT( pixelsSkipped, !drawn );
+		AddOverdraw( posX, posY, drawn );
 		return;
 	}
 
@@ -1473,13 +1781,43 @@ namespace Play::Render
 		if (srcPixel.a == 0x00 || posX < 0 || posX >= m_pRenderTarget->width || posY < 0 || posY >= m_pRenderTarget->height)
 			return;
 
+		MarkDirty( posX, posY, posX + 1, posY + 1 );
+
 		uint32_t* pDest = &m_pRenderTarget->pPixels[(posY * m_pRenderTarget->width) + posX].bits;
 		uint32_t* pSrc = &srcPixel.bits;
 
-		TBlend::Blend(pSrc, pDest, { 1.0f, 1.0f, 1.0f, 1.0f });
+		bool drawn = TBlend::Blend(pSrc, pDest, { 1.0f, 1.0f, 1.0f, 1.0f });
 
+		PLAY_RENDER_COUNT( pixelDraws[TBlend::COUNTER_INDEX], 1 );
+		PLAY_RENDER_COUNT( pixelsWritten, drawn );
+		PLAY_RENDER_COUNT( pixelsSkipped, !drawn );
+		AddOverdraw( posX, posY, drawn );
 		return;
 	}
+
+	template< typename TBlend > void AddBlitOverdraw( uint32_t* srcPixels, int srcWidth, int destOffset, int endRow, int rows )
+	{
+		uint16_t* pCountsRow = m_pOverdrawMap->GetCounts() + destOffset;
+		int countsWidth = m_pOverdrawMap->GetWidth();
+
+		// Skips runs of transparent pixels like the blends do, as the last pixel of a run is stored as 0xFF000000 which IsTransparent misses
+		for( int y = 0; y < rows; y++, srcPixels += srcWidth, pCountsRow += countsWidth )
+		{
+			uint32_t* src = srcPixels;
+			uint16_t* pCounts = pCountsRow;
+			const uint16_t* pCountsRowEnd = pCountsRow + endRow;
+
+			while( pCounts < pCountsRowEnd )
+			{
+				if( !TBlend::IsTransparent( *src ) )
+					( *pCounts++ )++, src++;
+				else if( TBlend::SKIPS_TRANSPARENT_RUNS )
+					Skip( src, pCounts, pCountsRowEnd );
+				else
+					pCounts++, src++;
+			}
+		}
+	}
 };
 #endif // PLAY_PLAYRENDER_H
 #ifndef PLAY_PLAYGRAPHICS_H
@@ -1500,7 +1838,8 @@ namespace Play::Graphics
 		BLEND_SUBTRACT
 	};
 
-	extern BlendMode blendMode;
+	// Each thread has its own blend mode, so the render thread can use the one each recorded draw was made with
+	extern thread_local BlendMode blendMode;
 
 	// Create/Destroy manager functions
 	//********************************************************************************************************************************
@@ -1641,15 +1980,69 @@ namespace Play::Graphics
 	// > Returns the number of timing segments
 	int SetTimingBarColour( Pixel pix );
 	// Draws the timing bar for the previous frame at the given position and size
+	// > The segments are drawn along the top, with the calling thread's profile scopes below them (see PlayProfile.h).
+	//   The bar is one frame wide at the paced frame rate, or as wide as the whole frame if the frame rate is 0.
 	void DrawTimingBar( Point2f pos, Point2f size );
 	// Gets the duration (in milliseconds) of a specific timing segment
 	float GetTimingSegmentDuration( int id );
 	// Clears the display buffer using the given pixel colour
-	inline void ClearBuffer( Pixel colour ) { Render::ClearRenderTarget( colour ); }
+	void ClearBuffer( Pixel colour );
 	// Sets the render target for drawing operations
 	inline PixelData* SetRenderTarget(PixelData* renderTarget) { return Render::SetRenderTarget(renderTarget); }
 	// Set the blend mode for all subsequent drawing operations that support different blend modes
 	inline void SetBlendMode(BlendMode bMode) { blendMode = bMode; }
+
+	// Pipelined rendering functions
+	//********************************************************************************************************************************
+
+	// Sets how many frames drawing and presenting may run behind the game: 0 (the default) or 1
+	// > At 1 the drawing functions record a draw list instead of drawing, and at the end of the frame a render thread draws it
+	//   into a back buffer and presents it while the game runs the next frame. Each gets a whole frame, but frames reach the
+	//   screen one frame later. GetDrawingBuffer then holds the last frame the render thread finished, so code which writes
+	//   to it directly, or keeps PixelData passed to DrawPixelData changing during a frame, needs a latency of 0.
+	// > It only speeds frames up when there's a spare core for the render thread. With a single core the game and render thread
+	//   take turns, so frames take as long as at 0 (plus recording the draw list) and still reach the screen a frame later.
+	void SetRenderLatency( int frames );
+	// Gets the render latency in frames
+	int GetRenderLatency();
+	// Presents the frame drawn since the last call: straight away, or by handing its draw list to the render thread
+	// > Returns the time taken in milliseconds, which with a render thread is the time spent waiting for it to be free
+	double PresentFrame();
+	// Waits until the render thread has finished the frame it's working on, if there is one
+	// > Called automatically by the functions which change sprite or background pixel data
+	void WaitForRenderThread();
+
+	// Dirty rectangle functions
+	//********************************************************************************************************************************
+
+	// Sets whether to track which parts of the display buffer are drawn into each frame
+	// > Clearing to the same colour, or drawing the same background, as the frames before then only restores the parts which
+	//   they drew over, and presenting only copies the parts which have changed. Anything written straight into the pixels
+	//   of GetDrawingBuffer isn't tracked, so needs tracking to be off.
+	void SetDirtyRectTracking( bool enable );
+	// Gets whether dirty rectangles are being tracked
+	bool GetDirtyRectTracking();
+	// Gets the number of pixels the last frame restored, drew or presented: the area of its dirty rectangles
+	int GetDirtyPixelCount();
+
+	// Render counter functions
+	//********************************************************************************************************************************
+
+	// Gets the render counters for the drawing done by the last frame presented
+	// > The counts are indexed by BlendMode, and are all 0 if PLAY_DISABLE_RENDER_COUNTERS is defined
+	Render::RenderCounters GetRenderCounters();
+	// Gets how many times over the last frame presented cleared or drew on the whole of the display buffer
+	float GetOverdraw();
+
+	// Overdraw view functions
+	//********************************************************************************************************************************
+
+	// Sets whether frames are presented as a heat map of how many times each pixel was cleared or drawn over, instead of the image
+	// > The colours are listed with Render::OverdrawMap::DrawHeatMap. It counts with the render counters, so is all black if
+	//   PLAY_DISABLE_RENDER_COUNTERS is defined. Anything written straight into the pixels of GetDrawingBuffer isn't counted.
+	void SetOverdrawView( bool enable );
+	// Gets whether frames are being presented as an overdraw heat map
+	bool GetOverdrawView();
 };
 #endif // PLAY_PLAYGRAPHICS_H
 #ifndef PLAY_PLAYAUDIO_H
@@ -1659,26 +2052,203 @@ namespace Play::Graphics
 // Description:	Declarations for a simple audio manager 
 // Platform:	Independant
 //********************************************************************************************************************************
+// > These functions are for the game's main thread only: they pass commands to the mixer through a queue which never waits
 namespace Play::Audio
 {
+	// Sounds are named by part or all of their filename (case doesn't matter), which is hashed into a key
+	// > The key can be worked out at compile time, e.g. constexpr Play::Audio::SoundKey SND_SHOOT( "shoot" );
+	struct SoundKey
+	{
+		constexpr SoundKey( const char* name ) : name( name ), hash( Hash( name ) ) {}
+
+		const char* name;
+		uint64_t hash;
+
+		// FNV-1a of the upper case name
+		static constexpr uint64_t Hash( const char* name )
+		{
+			uint64_t hash = 14695981039346656037ull;
+			for( ; *name; name++ )
+			{
+				char c = ( *name >= 'a' && *name <= 'z' ) ? static_cast<char>( *name - 'a' + 'A' ) : *name;
+				hash = ( hash ^ static_cast<uint8_t>( c ) ) * 1099511628211ull;
+			}
+			return hash;
+		}
+	};
+
+	// How sounds are kept in memory once they've been loaded
+	enum class SoundStorage
+	{
+		PCM, // As they are in the WAV files
+		ADPCM, // Compressed to about a quarter of the size (IMA-ADPCM), and decoded as they play: a little noisier and slower to mix
+	};
+#ifdef PLAY_AUDIO_ADPCM
+	constexpr SoundStorage DEFAULT_SOUND_STORAGE = SoundStorage::ADPCM;
+#else
+	constexpr SoundStorage DEFAULT_SOUND_STORAGE = SoundStorage::PCM;
+#endif
+
 	// Initialises the audio manager, using the directory provided as its root for finding .WAV files
-	bool CreateManager( const char* path );
+	bool CreateManager( const char* path, SoundStorage storage = DEFAULT_SOUND_STORAGE );
 	// Destroys any memory associated with the audio manager
 	bool DestroyManager();
-	// Play a sound using part of all of its filename, returns the voice id
-	int StartSound( const char* name, bool bLoop = false, float volume = 1.0f, float freqMod = 1.0f);
+	// Play a sound using part of all of its filename, returns the voice id (or -1 if all the voices are in use)
+	int StartSound( SoundKey name, bool bLoop = false, float volume = 1.0f, float freqMod = 1.0f);
 	//  Stop a currently playing sound using its voice id
 	bool StopSound( int voiceId ); 
-	//  Stop all currently playing sounds with the same filename 
-	bool StopSound( const char* name );
+	//  Stop the oldest currently playing sound with the same filename 
+	bool StopSound( SoundKey name );
 	// Set the volume of a looping sound that's playing using name
-	void SetLoopingSoundVolume( const char* name, float volume = 1.0f);
+	void SetLoopingSoundVolume( SoundKey name, float volume = 1.0f);
 	// Set the volume of a looping sound that's playing using id
 	void SetLoopingSoundVolume( int voiceId, float volume = 1.0f);
 	// Set the pitch of a looping sound that's playing using name
-	void SetLoopingSoundPitch(const char* name, float freqMod = 1.0f);
+	void SetLoopingSoundPitch( SoundKey name, float freqMod = 1.0f);
 	// Set the pitch of a looping sound that's playing using id
 	void SetLoopingSoundPitch(int voiceId, float freqMod = 1.0f);
+
+	// What happens when a sound is started and there are already as many voices playing as allowed
+	enum class VoiceSteal
+	{
+		NONE, // The new sound doesn't play (the default)
+		OLDEST, // The voice which has been playing longest is stopped to make room
+		QUIETEST, // The voice with the lowest volume is stopped to make room (the oldest of those if several match)
+	};
+	// Limits how many voices can play a sound at once (0 for no limit) and sets how it competes for voices with other sounds
+	// > When all the voices are in use, a sound can only take a voice from a sound with the same or a lower priority
+	void SetSoundVoiceLimit( SoundKey name, int maxVoices, int priority = 0, VoiceSteal steal = VoiceSteal::NONE );
+	// Limits how many voices can play at once across all sounds (256 by default, which is also the most there can be)
+	void SetMaxVoices( int maxVoices );
+
+	// Counters for the voices (since the audio manager was created)
+	struct VoiceStats
+	{
+		int voicesPlaying{ 0 }; // The number playing now
+		int voicesRejected{ 0 }; // The number of sounds which didn't play because they were over a limit or the mixer had fallen behind
+		int voicesStolen{ 0 }; // The number of voices stopped to make room for another sound
+	};
+	// Gets the voice counters
+	VoiceStats GetVoiceStats();
+
+	// The mixer buses: each sound plays through the music, sfx or ui bus (sfx unless it's set), and they all feed the master bus
+	enum class AudioBus
+	{
+		MASTER,
+		MUSIC,
+		SFX,
+		UI,
+	};
+	constexpr int AUDIO_BUS_COUNT = 4;
+	// Sets which bus a sound plays through (voices which are already playing stay where they are)
+	void SetSoundBus( SoundKey name, AudioBus bus );
+	// Sets the volume of a bus, which ramps over a quantum like a voice's volume
+	void SetBusVolume( AudioBus bus, float volume );
+	// Turns a bus down to depth (0-1) while the peak level of the sidechain bus is over threshold (e.g. music under the ui)
+	// > The bus goes down over attackTime seconds and comes back up over releaseTime seconds, a depth of 1 turns ducking off
+	void SetBusDucking( AudioBus bus, AudioBus sidechain, float threshold = 0.05f, float depth = 0.3f, float attackTime = 0.05f, float releaseTime = 0.5f );
+	// The effects on each bus are run in the order below, and are all off until they are set
+	// Sets the cutoff frequency of a 12dB per octave low-pass filter on a bus (0 turns it off)
+	void SetBusLowPass( AudioBus bus, float cutoffHz );
+	// Sets how much reverb is added to a bus (0 turns it off) and how long it rings for (0-1)
+	void SetBusReverb( AudioBus bus, float wet, float roomSize = 0.5f );
+	// Sets the peak level a bus is held under (0 turns it off)
+	void SetBusLimiter( AudioBus bus, float ceiling );
+
+	// Timings of the buses' gain, ducking and effects (the voices are counted in the MixerStats)
+	struct BusStats
+	{
+		int quantaMixed{ 0 };
+		float microsecondsPerQuantum[AUDIO_BUS_COUNT]{}; // The average time each bus took over a 10ms quantum
+	};
+	// Gets the bus timings since the last call
+	BusStats GetBusStats();
+
+	// The format of the software mixer's output
+	constexpr int MIX_SAMPLE_RATE = 48000;
+	constexpr int MIX_CHANNELS = 2;
+
+	// Receives the mixed audio and plays, saves or discards it
+	// > A sink decides when it needs more audio and calls MixAudio from its own thread to get it
+	class AudioSink
+	{
+	public:
+		virtual ~AudioSink() {}
+		// Starts pulling audio from the mixer, returns false if the output isn't available
+		virtual bool Start() = 0;
+		// Stops pulling audio: MixAudio won't be called by this sink after it returns
+		virtual void Stop() = 0;
+	};
+
+	// Creates a sink which mixes in real time and throws the result away (for headless runs)
+	AudioSink* CreateNullSink();
+	// Creates a sink which mixes in real time and writes the result to a 16-bit stereo WAV file
+	AudioSink* CreateWavFileSink( const char* filename );
+	// Creates a sink which only mixes when RenderAudio is called, writing the result to a WAV file if a filename is given and
+	// keeping it in memory if not, so the audio follows the game's frames rather than a device clock
+	// > Streamed sounds are waited for instead of playing silence, so the output is the same however fast the disk is
+	AudioSink* CreateOfflineSink( const char* filename = nullptr );
+	// Replaces the output sink (XAudio2 by default), the audio manager takes ownership of the new one
+	// > Returns false if the new sink can't start, in which case it's deleted and a null sink is used instead
+	bool SetOutputSink( AudioSink* pSink );
+	// Mixes the next frameCount frames through the offline sink
+	void RenderAudio( int frameCount );
+	// Mixes the audio for a game frame which took elapsedTime seconds through the offline sink (fractions of a frame are
+	// carried over to the next call)
+	void RenderAudioFrame( float elapsedTime );
+	// Gets the audio the offline sink has kept in memory since it started or was last cleared, as interleaved 16-bit stereo samples
+	// > A sink writing to a WAV file doesn't keep any
+	const std::vector< int16_t >& GetRenderedAudio();
+	// Empties the offline sink's memory, so long renders can use each part of the audio and then let it go
+	void ClearRenderedAudio();
+	// Mixes the next frameCount frames of all the playing voices into interleaved 16-bit stereo samples
+	// > The mix only depends on which sounds are played and when, so the same calls always give exactly the same output
+	void MixAudio( int16_t* pOutput, int frameCount );
+
+	// How the mixer resamples sounds which don't match its sample rate (or which have their pitch changed)
+	enum class Resampler
+	{
+		LINEAR, // Cheapest
+		CUBIC, // Catmull-Rom: less muffled, especially when pitched down
+	};
+	// Sets the resampler used for all voices
+	void SetResampler( Resampler resampler );
+
+	// Timings from the mixer, for working out how many voices fit in the audio budget
+	struct MixerStats
+	{
+		int quantaMixed{ 0 }; // The mixer works in 10ms quanta
+		int voicesMixed{ 0 }; // The total of the number of voices mixed in each quantum
+		float mixMilliseconds{ 0.0f }; // The time spent mixing
+		float voicesPerMillisecond{ 0.0f }; // The number of voices mixed for one quantum in each millisecond of mixing time
+	};
+	// Gets the mixer timings since the last call
+	MixerStats GetMixerStats();
+
+	// PCM files larger than this are streamed from disk while they play, rather than being loaded up front
+	constexpr int STREAMING_THRESHOLD_BYTES = 1024 * 1024;
+
+	// Counters for the sounds which are streamed (since the audio manager was created)
+	struct StreamingStats
+	{
+		int underruns{ 0 }; // The number of times a streamed voice had to play silence because its data hadn't loaded yet
+		int framesMissed{ 0 }; // The number of frames of silence played because of underruns
+		int chunksRead{ 0 }; // The number of chunks read from disk
+		int streamsRejected{ 0 }; // The number of streamed sounds which didn't play because all the streams were in use
+		int readErrors{ 0 }; // The number of streamed sounds which were stopped because their file couldn't be opened or read
+	};
+	// Gets the streaming counters
+	StreamingStats GetStreamingStats();
+
+	// How much memory the loaded sounds are using
+	struct SoundMemoryStats
+	{
+		int soundCount{ 0 };
+		int dataBytes{ 0 }; // The size of the sample data in the WAV files
+		int memoryBytes{ 0 }; // The size of what's kept in memory (after compression and streaming)
+	};
+	// Gets the memory used by the loaded sounds
+	SoundMemoryStats GetSoundMemoryStats();
 };
 #endif // PLAY_PLAYAUDIO_H
 
@@ -1687,7 +2257,7 @@ namespace Play::Audio
 //********************************************************************************************************************************
 // File:		PlayInput.h
 // Description:	Manages keyboard and mouse input 
-// Platform:	Windows
+// Platform:	Windows (or scripted, with PLAY_HEADLESS)
 // Notes:		Obtains mouse data from PlayWindow via MouseData structure
 //********************************************************************************************************************************
 
@@ -1736,10 +2306,229 @@ namespace Play
 		bool KeyPress( Play::KeyboardButton key, int frame = -1 );
 		// Returns true if the key is currently being held down
 		bool KeyHeld( KeyboardButton key );
+#ifdef PLAY_HEADLESS
+		// Holds or releases a key in a headless build, which has no keyboard
+		void SetScriptedKey( KeyboardButton key, bool held );
+		// Sets the mouse position and buttons in a headless build, which has no mouse
+		void SetScriptedMouse( Point2f pos, bool left, bool right );
+#endif // PLAY_HEADLESS
 	};
 }
 #endif // PLAY_PLAYINPUT_H
 
+#ifndef PLAY_PLAYJOBS_H
+#define PLAY_PLAYJOBS_H
+//********************************************************************************************************************************
+// File:		PlayJobs.h
+// Description:	A small work-stealing job system for spreading work across worker threads
+// Platform:	Independent
+// Notes:		Work is always split into the same chunks for the same count and chunk size, regardless of the number of threads.
+//				Which thread runs each chunk (and in which order) is not fixed, so chunks must not depend on each other.
+//
+//				Thread safety rules for code running inside a job:
+//				> SAFE: reading and writing the data your chunk was given (e.g. the GameObject passed to you), maths functions,
+//				  UpdateGameObject/IsColliding/IsVisible on objects in your chunk, and the sprite getters (GetSpriteSize etc).
+//				> NOT SAFE: creating or destroying GameObjects, spatial hash queries (QueryCollisions etc), any drawing
+//				  function, audio functions, KeyPressed, and rand(). Do these on the main thread before or after the job.
+//********************************************************************************************************************************
+namespace Play::Jobs
+{
+	// Creates the job system with the given number of worker threads
+	// > The default (-1) creates one worker for each hardware thread apart from the calling thread
+	bool CreateManager( int workerCount = -1 );
+	// Stops and destroys all the worker threads
+	bool DestroyManager();
+	// Calls fn( begin, end ) for every chunk of chunkSize items in the range [0,count) and waits for them all to finish
+	// > The calling thread runs chunks too, and it is safe to call ParallelFor from inside a job
+	void ParallelFor( int count, int chunkSize, const std::function<void( int begin, int end )>& fn );
+	// Gets the number of worker threads (not including the calling thread)
+	int GetWorkerCount();
+	// Returns true if the job system has been created
+	bool IsCreated();
+	// Gives the calling thread the queue kept for the render thread, so the ParallelFor calls it makes don't share the main thread's
+	// > It can be called before the job system is created, and the queue is kept when it's created again
+	void UseRenderQueue();
+};
+#endif // PLAY_PLAYJOBS_H
+
+#ifndef PLAY_PLAYCAPTURE_H
+#define PLAY_PLAYCAPTURE_H
+//********************************************************************************************************************************
+// File:		PlayCapture.h
+// Description:	Records the presented frames to numbered image files, for bug reports, replays and comparing against known good frames
+// Platform:	Independent
+// Notes:		Frames are saved losslessly in the QOI image format (https://qoiformat.org), which ffmpeg and many image viewers
+//				can read. Presenting a frame only copies it into a ring of frames, which a pool of encoder threads encodes and
+//				writes, several frames at a time. Each file is named after its frame number, so the order the encoders finish
+//				in doesn't matter. If the encoders fall behind and the ring fills up, frames are dropped rather than making
+//				the game wait, and the first drop is reported in the debug output.
+//********************************************************************************************************************************
+namespace Play::Capture
+{
+	// Statistics on the frames presented since capturing started
+	struct CaptureStats
+	{
+		int framesCaptured{ 0 }; // Copied into the ring
+		int framesDropped{ 0 }; // Not copied because the ring was full
+		int framesWritten{ 0 };
+		int writeErrors{ 0 };
+		long long bytesWritten{ 0 };
+		float averageEncodeMs{ 0.0f }; // The time an encoder thread takes to encode and write each frame
+		int encoderThreads{ 0 };
+	};
+
+	// Starts saving each presented frame as frame_NNNNNN.qoi in the directory, which is created if it doesn't exist
+	// > The frames are numbered from 0 when capturing starts, so any gaps are frames which were dropped
+	// > ringFrames is how many frames can be waiting to be written before any more are dropped
+	// > encoderThreads is how many frames are encoded at once: 0 uses half the hardware threads
+	// > To keep up, encoderThreads must be at least the encode time divided by the frame time (see averageEncodeMs)
+	bool StartCapture( const char* directory, int ringFrames = 8, int encoderThreads = 0 );
+	// Stops capturing once the frames waiting in the ring have been written
+	void StopCapture();
+	// Returns true while frames are being captured
+	bool IsCapturing();
+	// Gets the statistics on the frames presented since capturing started
+	CaptureStats GetCaptureStats();
+	// Copies a frame into the ring if capturing: called by the graphics manager for each frame it presents
+	void CaptureFrame( const PixelData& frame );
+
+	// QOI functions
+	//********************************************************************************************************************************
+
+	// Encodes an image in the QOI format, adding it to the end of vOut
+	void EncodeQOI( const PixelData& image, std::vector<uint8_t>& vOut );
+	// Decodes a QOI image, allocating its pixels with new[]
+	// > Returns false if the data isn't a valid QOI image
+	bool DecodeQOI( const uint8_t* pData, size_t size, PixelData& image );
+	// Loads a QOI image file, such as a captured frame, allocating its pixels with new[]
+	bool LoadQOI( const std::string& filename, PixelData& image );
+};
+#endif // PLAY_PLAYCAPTURE_H
+
+#ifndef PLAY_PLAYPROFILE_H
+#define PLAY_PLAYPROFILE_H
+//********************************************************************************************************************************
+// File:		PlayProfile.h
+// Description:	A hierarchical CPU profiler which times named scopes on any thread, for the timing bar, per scope statistics
+//				and traces which can be viewed in chrome://tracing or https://ui.perfetto.dev
+// Platform:	Independent
+// Notes:		PLAY_PROFILE_SCOPE( "name" ) times the rest of the enclosing block. Each thread records the scopes it finishes
+//				in its own buffer without taking any locks, and once a frame the game loop calls NewFrame to collect them.
+//				The name must stay valid until then, so it should be a string literal. Scopes nest, but not across threads.
+//				#define PLAY_DISABLE_PROFILER before including Play.h to compile all the scopes out.
+//********************************************************************************************************************************
+#ifndef PLAY_DISABLE_PROFILER
+#define PLAY_PROFILE_CONCAT_INNER( a, b ) a##b
+#define PLAY_PROFILE_CONCAT( a, b ) PLAY_PROFILE_CONCAT_INNER( a, b )
+#define PLAY_PROFILE_SCOPE( name ) Play::Profile::Scope PLAY_PROFILE_CONCAT( playProfileScope, __LINE__ )( name )
+#else
+#define PLAY_PROFILE_SCOPE( name )
+#endif
+
+namespace Play::Profile
+{
+	// A scope or timing bar segment which has finished
+	struct ProfileEvent
+	{
+		const char* name{ nullptr };
+		long long begin{ 0 }; // Nanoseconds on the profiler's clock
+		long long end{ 0 };
+		int depth{ 0 }; // How many scopes it was nested inside, or -1 for a timing bar segment
+		uint32_t colour{ 0 }; // The pixel colour of a timing bar segment
+		int thread{ 0 }; // The index of the thread which recorded it (see GetThreadIndex)
+	};
+
+	// The events which finished during a frame, from every thread
+	struct FrameProfile
+	{
+		long long begin{ 0 };
+		long long end{ 0 };
+		std::vector<ProfileEvent> vEvents;
+	};
+
+	// Timing statistics for all the scopes with the same name
+	struct ScopeStats
+	{
+		const char* name{ nullptr };
+		int calls{ 0 }; // Since the statistics were last reset
+		float minMs{ 0.0f }; // The shortest, average and longest time for one call
+		float avgMs{ 0.0f };
+		float maxMs{ 0.0f };
+		int frameCalls{ 0 }; // In the last frame
+		float frameMs{ 0.0f }; // The total time in the last frame
+	};
+
+	// Gets the profiler's raw clock: the time stamp counter where there is one, or nanoseconds where there isn't
+	// > Scopes only read the raw clock, and their times are converted to nanoseconds when the events are collected
+	inline long long GetTicks()
+	{
+#ifdef PLAY_PROFILE_TSC
+		return static_cast<long long>( __rdtsc() );
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+#endif
+	}
+	// Converts a time from GetTicks to nanoseconds on the profiler's clock
+	long long TicksToTime( long long ticks );
+	// Gets the profiler's clock in nanoseconds
+	inline long long GetTime() { return TicksToTime( GetTicks() ); }
+	// Starts a scope on the calling thread and returns its start time: used by Scope
+	long long BeginScope();
+	// Ends the calling thread's innermost scope and records it: used by Scope
+	void EndScope( const char* name, long long begin );
+
+	// Times the block it's declared in: declared by PLAY_PROFILE_SCOPE
+	class Scope
+	{
+	public:
+		explicit Scope( const char* name ) : m_name( name ), m_begin( BeginScope() ) {}
+		~Scope() { EndScope( m_name, m_begin ); }
+		Scope( const Scope& ) = delete;
+		Scope& operator=( const Scope& ) = delete;
+
+	private:
+		const char* m_name;
+		long long m_begin;
+	};
+
+	// Ends the calling thread's timing bar segment, if it has one, and starts a new one in the given colour
+	void BeginSegment( Pixel colour );
+	// Ends the calling thread's timing bar segment
+	void EndSegment();
+	// Names the calling thread in traces
+	void SetThreadName( const std::string& name );
+	// Gets the index which identifies the calling thread in ProfileEvent
+	int GetThreadIndex();
+
+	// Ends the profiler's frame: collects the events every thread has recorded and updates the statistics
+	// > Called by the game loop just before MainGameUpdate, so games don't need to call it
+	void NewFrame();
+	// Gets the events which finished during the last frame
+	// > The reference stays valid until the next call to NewFrame, so use it on the same thread as the game loop
+	const FrameProfile& GetLastFrame();
+	// Gets the statistics for each scope name, sorted by name
+	std::vector<ScopeStats> GetScopeStats();
+	// Resets the statistics
+	void ResetScopeStats();
+	// Gets the number of events which were lost because a thread's buffer filled up before they could be collected
+	int GetDroppedEventCount();
+	// Frees the event buffers of the threads which have exited and of the calling thread: called by Play::DestroyManager
+	// > Any other threads still running free their own buffers when they exit
+	void FreeThreadBuffers();
+
+	// Trace functions
+	//********************************************************************************************************************************
+
+	// Starts keeping every event for a trace
+	void StartTrace();
+	// Saves the events kept since StartTrace as a Chrome trace JSON file, and stops keeping them
+	// > Returns false if the file couldn't be written
+	bool SaveTrace( const char* filename );
+	// Returns true while events are being kept for a trace
+	bool IsTracing();
+};
+#endif // PLAY_PLAYPROFILE_H
+
 
 #ifndef PLAY_PLAYMANAGER_H
 #define PLAY_PLAYMANAGER_H
@@ -1849,6 +2638,21 @@ namespace Play
 
 	//! @brief Copies the contents of the drawing buffer to the window
 	void PresentDrawingBuffer();
+	//! @brief Sets whether each frame is drawn and presented on a render thread while the game runs the next one.
+	//! @param frames 0 (the default) draws everything straight away. 1 records the drawing and hands it to a render thread when the frame is presented, so the game and the renderer each get a whole frame, but frames reach the screen one frame later. This only helps when there's a spare core for the render thread.
+	inline void SetRenderLatency( int frames ) { Play::Graphics::SetRenderLatency( frames ); }
+	//! @brief Sets whether only the parts of the drawing buffer which change are cleared and presented each frame.
+	//! @param enable When true, ClearDrawingBuffer and DrawBackground only restore what the frames before drew over, as long as they cleared it the same way, and only the parts which changed are copied to the window. The F1 debug info then shows how many pixels each frame changed.
+	inline void SetDirtyRectTracking( bool enable ) { Play::Graphics::SetDirtyRectTracking( enable ); }
+	//! @brief Sets whether frames are shown as a heat map of how many times each pixel was drawn over, to find out which layers use up the fill rate. F2 also switches it on and off.
+	//! @param enable When true, each pixel is coloured by how many times the frame cleared or drew over it: black for none, then blue, cyan, green, yellow, orange and red, up to white for 7 or more.
+	inline void SetOverdrawView( bool enable ) { Play::Graphics::SetOverdrawView( enable ); }
+	//! @brief Starts saving every frame as a numbered QOI image file, e.g. for bug reports or checking frames against known good ones.
+	//! @param directory The directory to save the frames in, which is created if it doesn't exist. The frames are written by a background thread, and if it falls behind frames are skipped rather than slowing the game down.
+	//! @return False if the directory couldn't be created.
+	inline bool StartFrameCapture( const char* directory ) { return Play::Capture::StartCapture( directory ); }
+	//! @brief Stops saving frames, once the ones already captured have been written.
+	inline void StopFrameCapture() { Play::Capture::StopCapture(); }
 	//! @brief Gets the co-ordinates of the mouse cursor within the display buffer
 	//! @return The x/y coordinates of the mouse cursor in pixels.
 	inline Point2D GetMousePos() { return Play::Input::GetMousePos(); }
@@ -1863,6 +2667,36 @@ namespace Play
 	//! @return Height of the display buffer in pixels.
 	int GetBufferHeight();
 
+	// Fixed timestep functions
+	//**************************************************************************************************
+
+	//! @brief Statistics for the fixed timestep simulation since SetFixedTimestep was last called.
+	struct TickStats
+	{
+		//! The number of ticks which have been run.
+		int ticks{ 0 };
+		//! The number of ticks which fell due but were dropped because more than the maximum were due in one frame.
+		int droppedTicks{ 0 };
+		//! The most ticks which have been run in a single frame.
+		int maxTicksInFrame{ 0 };
+	};
+	//! @brief Sets how often the simulation run by RunFixedTimestep ticks, whatever the frame rate.
+	//! @param ticksPerSecond The number of simulation ticks per second. 0 turns the fixed timestep off, which is the default.
+	//! @param maxTicksPerFrame The most ticks to run in one frame. If a slow frame leaves more ticks due than this then the rest are dropped, so the game slows down instead of falling further and further behind.
+	void SetFixedTimestep( int ticksPerSecond, int maxTicksPerFrame = 4 );
+	//! @brief Runs the simulation ticks which have fallen due since the last frame.
+	//! @details Call this once from MainGameUpdate, doing all of the simulation (such as UpdateGameObject) in the tick function and all of the drawing afterwards. While the fixed timestep is on, the GameObject drawing functions draw each object part of the way from its oldPos/oldRot to its pos/rotation, by how far the simulation is through the next tick, so movement stays smooth when the frame rate doesn't match the tick rate.
+	//! @param elapsedTime The time since the last frame in seconds, as passed to MainGameUpdate.
+	//! @param tick The function to run for each tick. It is passed the length of a tick in seconds.
+	//! @return The number of ticks which were run.
+	int RunFixedTimestep( float elapsedTime, std::function<void( float )> tick );
+	//! @brief Gets how far the simulation is through the next tick.
+	//! @return The fraction of a tick, from 0 to 1, which has passed since the last tick was run. This is always 1 if the fixed timestep is off.
+	float GetTickInterpolation();
+	//! @brief Gets the statistics for the fixed timestep simulation.
+	//! @return The number of ticks run and dropped since SetFixedTimestep was last called.
+	TickStats GetTickStats();
+
 	// PlayAudio functions
 	//**************************************************************************************************
 
@@ -2104,9 +2938,16 @@ namespace Play
 	//! @return The number of timing segments
 	int ColourTimingBar( Colour colour );
 	//! @brief Draws the timing bar for the previous frame at the given position and size
+	//! @details The timing bar segments are drawn along the top, with any PLAY_PROFILE_SCOPE scopes in rows below them.
 	//! @param pos The x/y coordinate you want to draw the timing bar at.
 	//! @param size The size of the timing bar in pixels.
 	inline void DrawTimingBar( Point2f pos, Point2f size ) { Play::Graphics::DrawTimingBar( pos, size ); }
+	//! @brief Starts recording every profile scope for a trace.
+	inline void StartProfileTrace() { Play::Profile::StartTrace(); }
+	//! @brief Saves the profile scopes recorded since StartProfileTrace as a trace, which chrome://tracing or ui.perfetto.dev can open.
+	//! @param filename The name of the JSON file to save.
+	//! @return True if the trace was saved.
+	inline bool SaveProfileTrace( const char* filename ) { return Play::Profile::SaveTrace( filename ); }
 
 	// Miscellaneous functions
 	//**************************************************************************************************
@@ -2144,16 +2985,9 @@ namespace Play
 //! \brief Main Namespace for PlayBuffer
 namespace Play
 {
-	//! @brief The Gameobject struct. Holds all the data that a GameObject requires, and can be extended by the user.
-	struct GameObject
+	//! @brief The member variables of a GameObject, kept apart from it so they can be copied as plain values into world snapshots.
+	struct GameObjectState
 	{
-		//! @brief GameObject constructor.
-		//! @param type The type of the GameObject.
-		//! @param pos The initial x/y coordinates of the GameObject.
-		//! @param collisionRadius The radius of the collision circle of this GameObject.
-		//! @param spriteId The sprite ID of the GameObject.
-		GameObject(int type, Point2D pos, int collisionRadius, int spriteId); 
-
 		// Default member variables: don't change these!
 		//! A number representing the type of the GameObject as an int or enum. So a type of 1 might correspond to a health pickup and a type of 2 might correspond to a missile, for example. The only type value defined by PlayManager is -1, which corresponds to "no type". It is up to the user to decide how to assign other GameObject types. PlayManager will simply treat each unique value as a distinct type.
 		int type{ -1 };
@@ -2185,12 +3019,29 @@ namespace Play
 		int radius{ 0 };
 		//! The size to draw the sprite associated with the GameObject. 1.0f is full size, 0.5f half size, 2.0f double size, and so on.
 		float scale{ 1 };
+		//! The drawing order used by DrawAllGameObjects. GameObjects with a lower order are drawn first, so appear behind those with a higher order.
 		int order{ 0 };
 		//! What frame did this GameObject last get updated on? This stops GameObjects being updated multiple times per frame.
 		int lastFrameUpdated{ -1 };
+		//! Which fixed timestep tick did this GameObject last get updated in? While the fixed timestep is on, GameObjects updated in the latest tick are drawn part of the way between oldPos and pos.
+		int lastTickUpdated{ -1 };
 
 		// Add your own member variables here and every GameObject will have them
+		// > Stick to plain values (no pointers, strings or containers) so they can be saved in world snapshots
 		// int something{ 0 };
+	};
+
+	static_assert(std::is_trivially_copyable_v<GameObjectState>, "GameObject member variables must be plain values so they can be saved in world snapshots");
+
+	//! @brief The Gameobject struct. Holds all the data that a GameObject requires, and can be extended by the user.
+	struct GameObject : GameObjectState
+	{
+		//! @brief GameObject constructor.
+		//! @param type The type of the GameObject.
+		//! @param pos The initial x/y coordinates of the GameObject.
+		//! @param collisionRadius The radius of the collision circle of this GameObject.
+		//! @param spriteId The sprite ID of the GameObject.
+		GameObject(int type, Point2D pos, int collisionRadius, int spriteId); 
 
 		//! @brief Allows you to get the unique ID of a GameObject if you only have a reference or a copy of it.
 		//! @return This GameObject's unique ID.
@@ -2200,6 +3051,9 @@ namespace Play
 		// The GameObject's id should never be changed manually so we make it private!
 		int m_id{ -1 };
 
+		// Restoring a world snapshot gives GameObjects back their saved ids
+		friend bool RestoreWorldSnapshot(const std::vector<uint8_t>& buffer, const std::vector<uint8_t>* pPrevious);
+
 		// Preventing assignment and copying reduces the potential for bugs
 		GameObject& operator=(const GameObject&) = delete;
 		GameObject(const GameObject&) = delete;
@@ -2237,20 +3091,59 @@ namespace Play
 	//! @param wrapBorderSize If the object is wrapping, then how far off the edge of the screen should the object get before it wraps? Defaults to 0 pixels.
 	//! @param allowMultipleUpdatesPerFrame If set to true, then this allows for the object to be updated again if it already has this frame.
 	void UpdateGameObject(GameObject& object, bool bWrap = false, int wrapBorderSize = 0, bool allowMultipleUpdatesPerFrame = false);
+	//! @brief Calls a function for every GameObject of the given type, spreading the work across the job system's threads.
+	//! @details The objects are split into chunks of neighbouring ids, and the chunks are always the same for the same set of objects. See PlayJobs.h for the rules on what is safe to do inside the function.
+	//! @param type The type of the GameObjects you wish to process.
+	//! @param fn The function to call for each GameObject. It may be called from several threads at once, but never for the same object.
+	void ParallelForEachGameObject(int type, std::function<void(GameObject&)> fn);
 	//! @brief Deletes the GameObject with the corresponding Id.
+	//! @details The GameObject's type is set to -1 straight away, so for the rest of the frame it behaves like the object returned when no GameObject can be found. It is actually deleted at the end of the frame in PresentDrawingBuffer, so it is safe to destroy GameObjects while looping over them.
 	//! @param id The unique id of the GameObject you wish to delete.
 	void DestroyGameObject(int id);
 	//! @brief Deletes all GameObjects with the corresponding type.
+	//! @details Like DestroyGameObject, the GameObjects are deleted at the end of the frame.
 	//! @param type The type of the GameObjects you wish to delete.
 	void DestroyGameObjectsByType(int type);
-	//! @brief Deletes all GameObjects.
+	//! @brief Deletes all GameObjects immediately.
 	void DestroyAllGameObjects();
+	//! @brief Saves every GameObject, and the next id to be given out, into a buffer which can be copied, stored or sent anywhere.
+	//! @details Each GameObject's member variables (its GameObjectState) are saved as a straight copy, so any you add must be plain values. Saving with a previous snapshot only stores the parts of each GameObject which have changed, which is usually much smaller.
+	//! @param buffer The buffer to save the snapshot into. It is resized to fit.
+	//! @param pPrevious An optional full (not delta) snapshot to save the differences from. The same snapshot must be passed to RestoreWorldSnapshot.
+	void SaveWorldSnapshot(std::vector<uint8_t>& buffer, const std::vector<uint8_t>* pPrevious = nullptr);
+	//! @brief Replaces every GameObject with the ones saved in a snapshot, keeping their ids.
+	//! @details GameObjects which weren't in the snapshot are deleted immediately, and any references to them become invalid.
+	//! @param buffer A snapshot made by SaveWorldSnapshot.
+	//! @param pPrevious If the snapshot was saved with a previous snapshot, the same previous snapshot.
+	//! @return False if the snapshot (or the previous one) is truncated or corrupt, or was saved with a different GameObjectState, in which case nothing is changed.
+	bool RestoreWorldSnapshot(const std::vector<uint8_t>& buffer, const std::vector<uint8_t>* pPrevious = nullptr);
 
 	//! @brief Checks whether the two GameObjects are within each other's collision radii.
 	//! @param obj1 The first GameObject we want to check has collided.
 	//! @param obj2 The second GameObject we want to check has collided.
 	//! @return Returns true if the GameObjects are overlapping, false otherwise.
 	bool IsColliding(GameObject& obj1, GameObject& obj2);
+	//! @brief Calls a function for every pair of GameObjects of the given types which are within each other's collision radii.
+	//! @details Uses a spatial hash (a uniform grid of cells) so only GameObjects sharing a cell are tested against each other. The grid is updated from each object's pos and radius when it is queried, so there's no need to tell it when things move.
+	//! @note It is safe to destroy GameObjects inside the callback, and destroyed objects won't be reported in any more pairs.
+	//! @param typeA The type of the first GameObject in each pair.
+	//! @param typeB The type of the second GameObject in each pair (can be the same as typeA).
+	//! @param callback The function to call with each colliding pair, with the typeA object first.
+	void QueryCollisions(int typeA, int typeB, std::function<void(GameObject&, GameObject&)> callback);
+	//! @brief Collects the IDs of all the GameObjects whose collision circles overlap the given circle.
+	//! @param pos The x/y coordinates of the centre of the circle.
+	//! @param radius The radius of the circle in pixels.
+	//! @return A vector containing the IDs of the overlapping GameObjects in id order. The vector will be empty if nothing overlaps.
+	std::vector<int> CollectGameObjectIDsInRadius(Point2D pos, int radius);
+	//! @brief Collects the IDs of all the GameObjects of the given type whose collision circles overlap the given circle.
+	//! @param type The type of the GameObjects you wish to retrieve.
+	//! @param pos The x/y coordinates of the centre of the circle.
+	//! @param radius The radius of the circle in pixels.
+	//! @return A vector containing the IDs of the overlapping GameObjects in id order. The vector will be empty if nothing overlaps.
+	std::vector<int> CollectGameObjectIDsInRadius(int type, Point2D pos, int radius);
+	//! @brief Sets the size of the cells used by the spatial hash for QueryCollisions and CollectGameObjectIDsInRadius.
+	//! @param cellSize The width and height of each cell in pixels. Roughly twice the typical collision radius works well. Defaults to 64.
+	void SetCollisionCellSize(int cellSize);
 	//! @brief Checks whether any part of the GameObject is visible within the DisplayBuffer
 	//! @param obj The GameObject that we want to check for visibility.
 	bool IsVisible(GameObject& obj);
@@ -2294,6 +3187,9 @@ namespace Play
 	//! @param obj The GameObject you wish to draw.
 	//! @param opacity How transparent the object should be. 0.0f is fully transparent and 1.0f is fully opaque.
 	void DrawObjectRotated(GameObject& obj, float opacity = 1.0f);
+	//! @brief Draws every GameObject which is within the display area, in order of each object's order value.
+	//! @details Objects with the same order are grouped by sprite. Objects with no rotation and a scale of 1 are drawn as if by DrawObject, and the rest as if by DrawObjectRotated. Objects outside the display area are skipped before any drawing is done.
+	void DrawAllGameObjects();
 	//! @brief Draws debug info for all of the GameObjects that exist.
 	//! @details This includes the object's ID, sprite name and current animation frame. It will also draw the sprite's boundaries and the collision radius of the object.
 	void DrawGameObjectsDebug();
@@ -2321,10 +3217,9 @@ namespace Play
 //********************************************************************************************************************************
 
 
+#ifdef PLAY_MEMORY_TRACKER
 #pragma comment(lib, "DbgHelp.lib")
 
-#ifdef _DEBUG
-
 namespace Play
 {
 	constexpr int MAX_ALLOCATIONS = 8192 * 4;
@@ -2527,25 +3422,28 @@ void operator delete[](void* ptr) noexcept
 //********************************************************************************************************************************
 // File:		PlayWindow.cpp
 // Description:	Platform specific code to provide a window to draw into
-// Platform:	Windows
+// Platform:	Windows (or headless on any platform, with PLAY_HEADLESS)
 // Notes:		Uses a 32-bit ARGB display buffer
 //********************************************************************************************************************************
 
 using namespace Play; 
 
+#ifndef PLAY_HEADLESS
 // Instruct Visual Studio to add these to the list of libraries to link
 #pragma comment(lib, "gdiplus.lib")
 #pragma comment(lib, "dwmapi.lib")
+#endif
 
 // External functions which must be implemented by the user 
 extern void MainGameEntry( int argc, char* argv[] ); 
 extern bool MainGameUpdate( float ); // Called every frame
 extern int MainGameExit( void ); // Called on quit
-	
-ULONG_PTR g_pGDIToken = 0;
 
 #define ASSERT_WINDOW PLAY_ASSERT_MSG( Play::Window::m_bCreated, "Window Manager not initialised. Call Window::CreateManager() before using the Play::Window library functions.")
 
+#ifndef PLAY_HEADLESS
+ULONG_PTR g_pGDIToken = 0;
+
 int WINAPI WinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPSTR lpCmdLine, _In_ int nShowCmd )
 {
 	// Initialize GDI+
@@ -2559,6 +3457,14 @@ int WINAPI WinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 
 	return Play::Window::HandleWindows( hInstance, hPrevInstance, lpCmdLine, nShowCmd, L"PlayBuffer" );
 }
+#else
+int main( int argc, char* argv[] )
+{
+	MainGameEntry( argc, argv );
+
+	return Play::Window::HandleHeadless( argc, argv );
+}
+#endif // PLAY_HEADLESS
 
 namespace Play::Window
 {
@@ -2566,8 +3472,51 @@ namespace Play::Window
 	int m_scale{ 0 };
 	PixelData* m_pPlayBuffer{ nullptr };
 	MouseData* m_pMouseData{ nullptr };
-	HWND m_hWindow{ nullptr };
 	bool m_bCreated = false;
+#ifndef PLAY_HEADLESS
+	HWND m_hWindow{ nullptr };
+#else
+	int m_frameLimit{ 0 };
+	std::atomic<int> m_frameCount{ 0 }; // Presents can come from the render thread
+	std::function<bool( int )> m_frameScript;
+	std::function<void( const PixelData&, int )> m_presentCallback;
+#endif
+
+	// Frame pacing
+#ifndef PLAY_HEADLESS
+	double m_framePeriod{ 1.0 / FRAMES_PER_SECOND }; // In seconds, or 0 when frames aren't paced
+	HANDLE m_hFrameTimer{ nullptr };
+	bool m_bFrameTimerCreated{ false };
+#else
+	double m_framePeriod{ 0.0 };
+#endif
+	bool m_bFramesStarted{ false };
+	std::chrono::steady_clock::time_point m_lastFrameStart;
+	std::chrono::steady_clock::time_point m_nextFrameDue;
+	// Running estimates of how much later than asked a sleep wakes up, for deciding when to stop sleeping and start spinning
+	double m_sleepOvershoot{ 0.001 };
+	double m_sleepOvershootVariance{ 0.0 };
+
+	struct FrameTiming
+	{
+		float intervalMs{ 0.0f };
+		float sleepMs{ 0.0f };
+		float spinMs{ 0.0f };
+		bool bLate{ false };
+	};
+	FrameTiming m_frameTimings[FRAME_STATS_HISTORY];
+	int m_frameTimingCount{ 0 };
+	int m_nextFrameTiming{ 0 };
+
+	// Upscaling
+	std::atomic<UpscaleFilter> m_upscaleFilter{ UpscaleFilter::NEAREST }; // Set by the game, and read by the render thread when there is one
+	PixelData m_presentBuffer; // The display buffer upscaled by m_scale, allocated by the first present which needs it
+	std::vector<PixelRect> m_vPresentRects; // The parts of the (upscaled) buffer being presented
+	std::atomic<bool> m_bPresentAll{ true }; // Set when the next present must copy everything, not just what has changed
+
+	// Internal (private) functions
+	// Upscales the parts of the display buffer which have changed, setting m_vPresentRects to the parts of the result to present
+	const PixelData& UpscaleForPresent( const PixelData& display, const std::vector<PixelRect>& vDirty );
 
 	//********************************************************************************************************************************
 	// Create / Destroy functions for the Window Manager
@@ -2586,10 +3535,19 @@ namespace Play::Window
 	bool DestroyManager( void )
 	{
 		ASSERT_WINDOW;
+#ifndef PLAY_HEADLESS
+		if( m_hFrameTimer )
+			CloseHandle( m_hFrameTimer );
+		m_hFrameTimer = nullptr;
+		m_bFrameTimerCreated = false;
+#endif
+		delete[] m_presentBuffer.pPixels;
+		m_presentBuffer = PixelData{};
 		m_bCreated = false;
 		return true;
 	}
 
+#ifndef PLAY_HEADLESS
 	//********************************************************************************************************************************
 	// Windows functions
 	//********************************************************************************************************************************
@@ -2637,17 +3595,9 @@ namespace Play::Window
 
 		HACCEL hAccelTable = LoadAccelerators(hInstance, windowName);
 
-		LARGE_INTEGER frequency;
-		double elapsedTime = 0.0;
-		static LARGE_INTEGER lastDrawTime;
-		LARGE_INTEGER now;
-
 		MSG msg{};
 		bool quit = false;
-
-		// Set up counters for timing the frame
-		QueryPerformanceCounter(&lastDrawTime);
-		QueryPerformanceFrequency(&frequency);
+		Profile::SetThreadName( "Game" );
 
 		// Standard windows message loop
 		while (!quit)
@@ -2665,20 +3615,17 @@ namespace Play::Window
 				}
 			}
 
-			do
-			{
-				QueryPerformanceCounter(&now);
-				elapsedTime = (now.QuadPart - lastDrawTime.QuadPart) * 1000.0 / frequency.QuadPart;
-
-			} while (elapsedTime < 1000.0f / FRAMES_PER_SECOND);
+			double elapsedTime = WaitForNextFrame();
+			Profile::NewFrame();
 
 			// Call the main game update function (only while we have the input focus in release mode)
+			{
+				PLAY_PROFILE_SCOPE( "MainGameUpdate" );
 #ifndef _DEBUG
-			if (GetFocus() == m_hWindow)
+				if (GetFocus() == m_hWindow)
 #endif
-				quit = MainGameUpdate(static_cast<float>(elapsedTime) / 1000.0f);
-
-			lastDrawTime = now;
+					quit = MainGameUpdate(static_cast<float>(elapsedTime));
+			}
 
 			DwmFlush(); // Waits for DWM compositor to finish
 		}
@@ -2702,6 +3649,7 @@ namespace Play::Window
 			PAINTSTRUCT ps;
 			BeginPaint(hWnd, &ps);
 			EndPaint(hWnd, &ps);
+			m_bPresentAll = true; // Part of the window was covered up, so it can't just be updated where the frame has changed
 			break;
 
 		case WM_DESTROY:
@@ -2741,6 +3689,18 @@ namespace Play::Window
 	}
 
 	double Present( void )
+	{
+		ASSERT_WINDOW;
+		return Present( *m_pPlayBuffer );
+	}
+
+	double Present( const PixelData& display )
+	{
+		ASSERT_WINDOW;
+		return Present( display, { PixelRect{ 0, 0, display.width, display.height } } );
+	}
+
+	double Present( const PixelData& display, const std::vector<PixelRect>& vDirty )
 	{
 		ASSERT_WINDOW;
 
@@ -2750,11 +3710,14 @@ namespace Play::Window
 		QueryPerformanceCounter(&before);
 		QueryPerformanceFrequency(&frequency);
 
+		// GDI's own scaling often drops off its fast path, so we upscale first and let it do a straight copy
+		const PixelData& present = UpscaleForPresent( display, vDirty );
+
 		// Set up a BitmapInfo structure to represent the pixel format of the display buffer
 		BITMAPINFOHEADER bitmap_info_header
 		{
 				sizeof(BITMAPINFOHEADER),								// size of its own data,
-				m_pPlayBuffer->width, m_pPlayBuffer->height,		// width and height
+				present.width, present.height,		// width and height
 				1, 32, BI_RGB,				// planes must always be set to 1 (docs), 32-bit pixel data, uncompressed 
 				0, 0, 0, 0, 0				// rest can be set to 0 as this is uncompressed and has no palette
 		};
@@ -2763,10 +3726,15 @@ namespace Play::Window
 
 		HDC hDC = GetDC(m_hWindow);
 
-		// Copy the display buffer to the window: GDI only implements up scaling using simple pixel duplication, but that's what we want
+		// Copy the changed parts of the upscaled display buffer to the window
 		// Note that GDI+ DrawImage would do the same thing, but it's much slower! 
-		StretchDIBits(hDC, 0, 0, m_pPlayBuffer->width * m_scale, m_pPlayBuffer->height * m_scale, 0, m_pPlayBuffer->height + 1, m_pPlayBuffer->width, -m_pPlayBuffer->height, m_pPlayBuffer->pPixels, &bitmap_info, DIB_RGB_COLORS, SRCCOPY); // We flip h because Bitmaps store pixel data upside down.
-
+		for( const PixelRect& r : m_vPresentRects )
+		{
+			int w = r.right - r.left;
+			int h = r.bottom - r.top;
+			StretchDIBits(hDC, r.left, r.top, w, h, r.left, r.bottom + 1, w, -h, present.pPixels, &bitmap_info, DIB_RGB_COLORS, SRCCOPY); // We flip h because Bitmaps store pixel data upside down.
+		}
+
 		ReleaseDC(m_hWindow, hDC);
 
 		QueryPerformanceCounter(&after);
@@ -2775,6 +3743,468 @@ namespace Play::Window
 
 		return elapsedTime;
 	}
+#else
+	//********************************************************************************************************************************
+	// Headless functions
+	//********************************************************************************************************************************
+
+	int HandleHeadless( int argc, char* argv[] )
+	{
+		ASSERT_WINDOW;
+
+		const char* traceFilename = nullptr;
+		for( int i = 1; i < argc; i++ )
+		{
+			if( strncmp( argv[i], "--frames=", 9 ) == 0 )
+				m_frameLimit = atoi( argv[i] + 9 );
+			if( strncmp( argv[i], "--capture=", 10 ) == 0 )
+				Capture::StartCapture( argv[i] + 10 );
+			if( strncmp( argv[i], "--trace=", 8 ) == 0 )
+				traceFilename = argv[i] + 8;
+		}
+
+		// There's no display to wait for, so every frame runs as soon as the last one finishes with the same fixed elapsed time
+		const float elapsedTime = 1.0f / FRAMES_PER_SECOND;
+		bool quit = false;
+		Profile::SetThreadName( "Game" );
+		if( traceFilename )
+			Profile::StartTrace();
+
+		for( int frame = 0; !quit && ( m_frameLimit <= 0 || frame < m_frameLimit ); frame++ )
+		{
+			if( m_frameScript && !m_frameScript( frame ) )
+				break;
+
+			WaitForNextFrame();
+			Profile::NewFrame();
+
+			PLAY_PROFILE_SCOPE( "MainGameUpdate" );
+			quit = MainGameUpdate( elapsedTime );
+		}
+
+		// Call the main game cleanup function
+		int result = MainGameExit();
+
+		if( traceFilename )
+			Profile::SaveTrace( traceFilename );
+		return result;
+	}
+
+	void SetFrameLimit( int frames )
+	{
+		m_frameLimit = frames;
+	}
+
+	void SetFrameScript( std::function<bool( int )> script )
+	{
+		m_frameScript = std::move( script );
+	}
+
+	void SetPresentCallback( std::function<void( const PixelData&, int )> callback )
+	{
+		m_presentCallback = std::move( callback );
+		m_bPresentAll = true; // Nothing was upscaled while there wasn't a callback
+	}
+
+	int GetFrameCount()
+	{
+		return m_frameCount;
+	}
+
+	double Present( void )
+	{
+		ASSERT_WINDOW;
+		return Present( *m_pPlayBuffer );
+	}
+
+	double Present( const PixelData& display )
+	{
+		ASSERT_WINDOW;
+		return Present( display, { PixelRect{ 0, 0, display.width, display.height } } );
+	}
+
+	double Present( const PixelData& display, const std::vector<PixelRect>& vDirty )
+	{
+		ASSERT_WINDOW;
+
+		std::chrono::steady_clock::time_point before = std::chrono::steady_clock::now();
+
+		if( m_presentCallback )
+			m_presentCallback( UpscaleForPresent( display, vDirty ), m_frameCount );
+
+		m_frameCount++;
+
+		return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - before ).count();
+	}
+#endif // PLAY_HEADLESS
+
+	//********************************************************************************************************************************
+	// Frame pacing functions
+	//********************************************************************************************************************************
+
+	// Sleeps for about the given time, which may run over by up to a millisecond or two
+	void SleepFor( double seconds )
+	{
+#ifndef PLAY_HEADLESS
+		// A high resolution waitable timer is far more accurate than Sleep, but older versions of Windows don't have one
+		if( !m_bFrameTimerCreated )
+		{
+			m_hFrameTimer = CreateWaitableTimerExW( nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS );
+			m_bFrameTimerCreated = true;
+		}
+
+		if( m_hFrameTimer )
+		{
+			LARGE_INTEGER dueTime;
+			dueTime.QuadPart = -static_cast<LONGLONG>( seconds * 10000000.0 ); // Negative for a relative time, in 100ns units
+			if( SetWaitableTimer( m_hFrameTimer, &dueTime, 0, nullptr, nullptr, FALSE ) )
+			{
+				WaitForSingleObject( m_hFrameTimer, INFINITE );
+				return;
+			}
+		}
+#endif
+		std::this_thread::sleep_for( std::chrono::duration<double>( seconds ) );
+	}
+
+	void SetFrameRate( int framesPerSecond )
+	{
+		PLAY_ASSERT_MSG( framesPerSecond >= 0, "Invalid frame rate." );
+		m_framePeriod = framesPerSecond > 0 ? 1.0 / framesPerSecond : 0.0;
+		m_bFramesStarted = false;
+	}
+
+	int GetFrameRate()
+	{
+		return m_framePeriod > 0.0 ? static_cast<int>( lround( 1.0 / m_framePeriod ) ) : 0;
+	}
+
+	double WaitForNextFrame()
+	{
+		PLAY_PROFILE_SCOPE( "WaitForNextFrame" );
+		using namespace std::chrono;
+
+		steady_clock::time_point waitStart = steady_clock::now();
+		if( !m_bFramesStarted )
+		{
+			m_bFramesStarted = true;
+			m_lastFrameStart = waitStart;
+			m_nextFrameDue = waitStart + duration_cast<steady_clock::duration>( duration<double>( m_framePeriod ) );
+		}
+
+		steady_clock::time_point spinStart = waitStart;
+		if( m_framePeriod > 0.0 )
+		{
+			// Sleep until the rest of the wait is about as long as a sleep might overrun by
+			double margin = std::clamp( m_sleepOvershoot + 2.0 * sqrt( m_sleepOvershootVariance ), 0.0001, 0.004 );
+			double remaining = duration<double>( m_nextFrameDue - waitStart ).count();
+			if( remaining > margin )
+			{
+				double requested = remaining - margin;
+				SleepFor( requested );
+				spinStart = steady_clock::now();
+
+				double delta = duration<double>( spinStart - waitStart ).count() - requested - m_sleepOvershoot;
+				m_sleepOvershoot += 0.1 * delta;
+				m_sleepOvershootVariance = 0.9 * ( m_sleepOvershootVariance + 0.1 * delta * delta );
+			}
+
+			// Then spin for the last part, which is usually well under a millisecond
+			while( steady_clock::now() < m_nextFrameDue )
+			{
+#ifdef PLAY_SSE2
+				_mm_pause();
+#else
+				std::this_thread::yield();
+#endif
+			}
+		}
+
+		steady_clock::time_point frameStart = steady_clock::now();
+		double elapsedTime = duration<double>( frameStart - m_lastFrameStart ).count();
+
+		FrameTiming& timing = m_frameTimings[m_nextFrameTiming];
+		timing.intervalMs = static_cast<float>( elapsedTime * 1000.0 );
+		timing.sleepMs = duration<float, std::milli>( spinStart - waitStart ).count();
+		timing.spinMs = duration<float, std::milli>( frameStart - spinStart ).count();
+		timing.bLate = m_framePeriod > 0.0 && frameStart - m_nextFrameDue > milliseconds( 1 );
+		m_nextFrameTiming = ( m_nextFrameTiming + 1 ) % FRAME_STATS_HISTORY;
+		m_frameTimingCount = std::min( m_frameTimingCount + 1, FRAME_STATS_HISTORY );
+
+		// Frames are due at regular times, so one late frame doesn't hold back the rest. If a frame is so late that the next one
+		// would already be due then the times start again from now, rather than rushing through frames to catch up.
+		steady_clock::duration period = duration_cast<steady_clock::duration>( duration<double>( m_framePeriod ) );
+		m_nextFrameDue += period;
+		if( m_nextFrameDue <= frameStart )
+			m_nextFrameDue = frameStart + period;
+		m_lastFrameStart = frameStart;
+
+		return elapsedTime;
+	}
+
+	FrameStats GetFrameStats()
+	{
+		FrameStats stats;
+		stats.frames = m_frameTimingCount;
+		if( m_frameTimingCount == 0 )
+			return stats;
+
+		double total = 0.0;
+		double totalSquared = 0.0;
+		stats.minMs = m_frameTimings[0].intervalMs;
+		for( int i = 0; i < m_frameTimingCount; i++ )
+		{
+			const FrameTiming& timing = m_frameTimings[i];
+			total += timing.intervalMs;
+			totalSquared += static_cast<double>( timing.intervalMs ) * timing.intervalMs;
+			stats.minMs = std::min( stats.minMs, timing.intervalMs );
+			stats.maxMs = std::max( stats.maxMs, timing.intervalMs );
+			stats.sleepMs += timing.sleepMs;
+			stats.spinMs += timing.spinMs;
+			stats.lateFrames += timing.bLate ? 1 : 0;
+		}
+
+		double average = total / m_frameTimingCount;
+		stats.averageMs = static_cast<float>( average );
+		stats.jitterMs = static_cast<float>( sqrt( std::max( 0.0, totalSquared / m_frameTimingCount - average * average ) ) );
+		stats.sleepMs /= m_frameTimingCount;
+		stats.spinMs /= m_frameTimingCount;
+		return stats;
+	}
+
+	//********************************************************************************************************************************
+	// Upscaling functions
+	//********************************************************************************************************************************
+
+	// Copies each pixel of a row scale times across, four pixels at a time for the common scales
+	static void ReplicateRow( const uint32_t* pSrc, uint32_t* pDest, int width, int scale )
+	{
+		int x = 0;
+
+#ifdef PLAY_SSE2
+		switch( scale )
+		{
+			case 2:
+				for( ; x + 4 <= width; x += 4 )
+				{
+					__m128i p = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pSrc + x ) );
+					_mm_storeu_si128( reinterpret_cast<__m128i*>( pDest + x * 2 ), _mm_unpacklo_epi32( p, p ) );
+					_mm_storeu_si128( reinterpret_cast<__m128i*>( pDest + x * 2 + 4 ), _mm_unpackhi_epi32( p, p ) );
+				}
+				break;
+			case 3:
+				for( ; x + 4 <= width; x += 4 )
+				{
+					__m128i p = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pSrc + x ) );
+					_mm_storeu_si128( reinterpret_cast<__m128i*>( pDest + x * 3 ), _mm_shuffle_epi32( p, _MM_SHUFFLE( 1, 0, 0, 0 ) ) );
+					_mm_storeu_si128( reinterpret_cast<__m128i*>( pDest + x * 3 + 4 ), _mm_shuffle_epi32( p, _MM_SHUFFLE( 2, 2, 1, 1 ) ) );
+					_mm_storeu_si128( reinterpret_cast<__m128i*>( pDest + x * 3 + 8 ), _mm_shuffle_epi32( p, _MM_SHUFFLE( 3, 3, 3, 2 ) ) );
+				}
+				break;
+			case 4:
+				for( ; x + 4 <= width; x += 4 )
+				{
+					__m128i p = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pSrc + x ) );
+					_mm_storeu_si128( reinterpret_cast<__m128i*>( pDest + x * 4 ), _mm_shuffle_epi32( p, _MM_SHUFFLE( 0, 0, 0, 0 ) ) );
+					_mm_storeu_si128( reinterpret_cast<__m128i*>( pDest + x * 4 + 4 ), _mm_shuffle_epi32( p, _MM_SHUFFLE( 1, 1, 1, 1 ) ) );
+					_mm_storeu_si128( reinterpret_cast<__m128i*>( pDest + x * 4 + 8 ), _mm_shuffle_epi32( p, _MM_SHUFFLE( 2, 2, 2, 2 ) ) );
+					_mm_storeu_si128( reinterpret_cast<__m128i*>( pDest + x * 4 + 12 ), _mm_shuffle_epi32( p, _MM_SHUFFLE( 3, 3, 3, 3 ) ) );
+				}
+				break;
+		}
+#endif // PLAY_SSE2
+
+		// The end of the row, and any other scale
+		for( ; x < width; x++ )
+		{
+			uint32_t colour = pSrc[x];
+			for( int i = 0; i < scale; i++ )
+				pDest[x * scale + i] = colour;
+		}
+	}
+
+	// Scale2x (also known as EPX) turns each pixel P into four, copying a neighbour into a corner where two neighbours match:
+	//   A        E0 E1      E0 = C==A && C!=D && A!=B ? A : P      E1 = A==B && A!=C && B!=D ? B : P
+	// C P B  ->  E2 E3      E2 = D==C && D!=B && C!=A ? C : P      E3 = B==D && B!=A && D!=C ? D : P
+	//   D
+	// > Only the pixels [begin,end) of the row are scaled, but their neighbours are read from the whole width
+	static void Scale2xRow( const uint32_t* pAbove, const uint32_t* pRow, const uint32_t* pBelow, uint32_t* pDest0, uint32_t* pDest1, int width, int begin, int end )
+	{
+		auto scalarPixel = [&]( int x )
+		{
+			uint32_t a = pAbove[x], d = pBelow[x], p = pRow[x];
+			uint32_t c = pRow[x > 0 ? x - 1 : x];
+			uint32_t b = pRow[x < width - 1 ? x + 1 : x];
+			pDest0[x * 2] = ( c == a && c != d && a != b ) ? a : p;
+			pDest0[x * 2 + 1] = ( a == b && a != c && b != d ) ? b : p;
+			pDest1[x * 2] = ( d == c && d != b && c != a ) ? c : p;
+			pDest1[x * 2 + 1] = ( b == d && b != a && d != c ) ? d : p;
+		};
+
+		int x = begin;
+
+#ifdef PLAY_SSE2
+		auto select = []( __m128i mask, __m128i ifSet, __m128i ifClear )
+		{
+			return _mm_or_si128( _mm_and_si128( mask, ifSet ), _mm_andnot_si128( mask, ifClear ) );
+		};
+
+		if( x == 0 && x < end )
+			scalarPixel( x++ );
+
+		// Four pixels at a time while both horizontal neighbours are inside the row
+		for( ; x + 4 <= end && x + 5 <= width; x += 4 )
+		{
+			__m128i p = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pRow + x ) );
+			__m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pAbove + x ) );
+			__m128i d = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pBelow + x ) );
+			__m128i c = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pRow + x - 1 ) );
+			__m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pRow + x + 1 ) );
+
+			__m128i ca = _mm_cmpeq_epi32( c, a );
+			__m128i cd = _mm_cmpeq_epi32( c, d );
+			__m128i ab = _mm_cmpeq_epi32( a, b );
+			__m128i bd = _mm_cmpeq_epi32( b, d );
+
+			__m128i e0 = select( _mm_andnot_si128( _mm_or_si128( cd, ab ), ca ), a, p );
+			__m128i e1 = select( _mm_andnot_si128( _mm_or_si128( ca, bd ), ab ), b, p );
+			__m128i e2 = select( _mm_andnot_si128( _mm_or_si128( bd, ca ), cd ), c, p );
+			__m128i e3 = select( _mm_andnot_si128( _mm_or_si128( ab, cd ), bd ), d, p );
+
+			_mm_storeu_si128( reinterpret_cast<__m128i*>( pDest0 + x * 2 ), _mm_unpacklo_epi32( e0, e1 ) );
+			_mm_storeu_si128( reinterpret_cast<__m128i*>( pDest0 + x * 2 + 4 ), _mm_unpackhi_epi32( e0, e1 ) );
+			_mm_storeu_si128( reinterpret_cast<__m128i*>( pDest1 + x * 2 ), _mm_unpacklo_epi32( e2, e3 ) );
+			_mm_storeu_si128( reinterpret_cast<__m128i*>( pDest1 + x * 2 + 4 ), _mm_unpackhi_epi32( e2, e3 ) );
+		}
+#endif // PLAY_SSE2
+
+		for( ; x < end; x++ )
+			scalarPixel( x );
+	}
+
+	// Upscales a rectangle of the source into the same part of the destination
+	static void UpscaleRows( const PixelData& source, PixelData& dest, int scale, UpscaleFilter filter, const PixelRect& rect )
+	{
+		const uint32_t* pSrc = &source.pPixels->bits;
+		uint32_t* pDest = &dest.pPixels->bits;
+		int srcWidth = source.width;
+		int destWidth = dest.width;
+		int rectWidth = rect.right - rect.left;
+		size_t destRowBytes = sizeof( uint32_t ) * rectWidth * scale;
+
+		if( filter == UpscaleFilter::SCALE2X && scale % 2 == 0 )
+		{
+			// Scale2x makes two rows twice the width, which are then replicated for the rest of the scale
+			int repeat = scale / 2;
+			thread_local std::vector<uint32_t> vRows;
+			vRows.resize( static_cast<size_t>( srcWidth ) * 4 );
+
+			for( int y = rect.top; y < rect.bottom; y++ )
+			{
+				const uint32_t* pRow = pSrc + static_cast<size_t>( y ) * srcWidth;
+				const uint32_t* pAbove = y > 0 ? pRow - srcWidth : pRow;
+				const uint32_t* pBelow = y < source.height - 1 ? pRow + srcWidth : pRow;
+
+				if( repeat == 1 )
+				{
+					uint32_t* pFirst = pDest + static_cast<size_t>( y ) * 2 * destWidth;
+					Scale2xRow( pAbove, pRow, pBelow, pFirst, pFirst + destWidth, srcWidth, rect.left, rect.right );
+					continue;
+				}
+
+				Scale2xRow( pAbove, pRow, pBelow, vRows.data(), vRows.data() + srcWidth * 2, srcWidth, rect.left, rect.right );
+
+				for( int half = 0; half < 2; half++ )
+				{
+					uint32_t* pFirst = pDest + static_cast<size_t>( y * scale + half * repeat ) * destWidth + rect.left * scale;
+					ReplicateRow( vRows.data() + half * srcWidth * 2 + rect.left * 2, pFirst, rectWidth * 2, repeat );
+					for( int i = 1; i < repeat; i++ )
+						memcpy( pFirst + static_cast<size_t>( i ) * destWidth, pFirst, destRowBytes );
+				}
+			}
+			return;
+		}
+
+		for( int y = rect.top; y < rect.bottom; y++ )
+		{
+			uint32_t* pFirst = pDest + static_cast<size_t>( y ) * scale * destWidth + rect.left * scale;
+			ReplicateRow( pSrc + static_cast<size_t>( y ) * srcWidth + rect.left, pFirst, rectWidth, scale );
+			for( int i = 1; i < scale; i++ )
+				memcpy( pFirst + static_cast<size_t>( i ) * destWidth, pFirst, destRowBytes );
+		}
+	}
+
+	// Images with fewer upscaled pixels than this aren't worth handing out to the job system
+	constexpr int UPSCALE_PARALLEL_PIXELS = 1920 * 1080;
+	constexpr int UPSCALE_JOB_ROWS = 32;
+
+	// Upscales a rectangle of the source, splitting large ones into bands of rows for the job system
+	static void UpscaleRect( const PixelData& source, PixelData& dest, int scale, UpscaleFilter filter, const PixelRect& rect )
+	{
+		int rectHeight = rect.bottom - rect.top;
+
+		if( ( rect.right - rect.left ) * rectHeight * scale * scale >= UPSCALE_PARALLEL_PIXELS && Jobs::IsCreated() && Jobs::GetWorkerCount() > 0 )
+		{
+			Jobs::ParallelFor( rectHeight, UPSCALE_JOB_ROWS, [&]( int begin, int end )
+			{
+				UpscaleRows( source, dest, scale, filter, { rect.left, rect.top + begin, rect.right, rect.top + end } );
+			} );
+		}
+		else
+		{
+			UpscaleRows( source, dest, scale, filter, rect );
+		}
+	}
+
+	void Upscale( const PixelData& source, PixelData& dest, int scale, UpscaleFilter filter )
+	{
+		PLAY_ASSERT_MSG( scale > 0, "The upscale must be at least 1" );
+		PLAY_ASSERT_MSG( dest.width == source.width * scale && dest.height == source.height * scale, "The upscale destination is the wrong size" );
+		UpscaleRect( source, dest, scale, filter, { 0, 0, source.width, source.height } );
+	}
+
+	void SetUpscaleFilter( UpscaleFilter filter )
+	{
+		// The filter is set before the flag, so a present which sees the flag always upscales everything with the new filter
+		m_upscaleFilter = filter;
+		m_bPresentAll = true;
+	}
+
+	const PixelData& UpscaleForPresent( const PixelData& display, const std::vector<PixelRect>& vDirty )
+	{
+		bool bAll = m_bPresentAll.exchange( false );
+		UpscaleFilter filter = m_upscaleFilter;
+
+		if( m_scale > 1 && ( m_presentBuffer.width != display.width * m_scale || m_presentBuffer.height != display.height * m_scale ) )
+		{
+			delete[] m_presentBuffer.pPixels;
+			m_presentBuffer.width = display.width * m_scale;
+			m_presentBuffer.height = display.height * m_scale;
+			m_presentBuffer.pPixels = new Pixel[static_cast<size_t>( m_presentBuffer.width ) * m_presentBuffer.height];
+			bAll = true;
+		}
+
+		if( bAll )
+			m_vPresentRects.assign( 1, { 0, 0, display.width, display.height } );
+		else
+			m_vPresentRects = vDirty;
+
+		// Scale2x looks at each pixel's neighbours, so a changed pixel changes the upscaled pixels either side of it too
+		int border = ( filter == UpscaleFilter::SCALE2X && m_scale % 2 == 0 ) ? 1 : 0;
+
+		for( PixelRect& r : m_vPresentRects )
+		{
+			r = { std::max( r.left - border, 0 ), std::max( r.top - border, 0 ), std::min( r.right + border, display.width ), std::min( r.bottom + border, display.height ) };
+
+			if( m_scale > 1 )
+			{
+				UpscaleRect( display, m_presentBuffer, m_scale, filter, r );
+				r = { r.left * m_scale, r.top * m_scale, r.right * m_scale, r.bottom * m_scale };
+			}
+		}
+
+		return m_scale > 1 ? m_presentBuffer : display;
+	}
 
 	void RegisterMouse( MouseData* pMouseData ) 
 	{ 
@@ -2806,6 +4236,7 @@ namespace Play::Window
 // Loading functions
 //********************************************************************************************************************************
 
+#ifndef PLAY_HEADLESS
 int ReadPNGImage(std::string& fileAndPath, int& width, int& height)
 {
 	// Convert filename from single to wide string for GDI+ compatibility
@@ -2952,2204 +4383,7653 @@ int SavePNGImage( std::string& fileAndPath, const PixelData& sourceImage )
 
 	return 1;
 }
-
+#else
 //********************************************************************************************************************************
-// Miscellaneous functions
+// Headless PNG functions: headless builds don't have GDI+, so use a small built-in decoder and encoder instead
+// > Decodes every PNG colour type and bit depth, including interlaced images
+// > Encodes 8-bit RGBA using uncompressed deflate blocks, so the files are larger than they would be from GDI+
 //********************************************************************************************************************************
-
-void AssertFailMessage( const char* message, const char* file, long line )
+namespace Play::Png
 {
-	// file - the file in which the assertion failed ( __FILE__ )
-	// line - the line of code where the assertion failed ( __LINE__ )
-	std::filesystem::path p = file;
-	std::string s = p.filename().string() + " : LINE " + std::to_string(line);
-	s += "\n" + std::string(message);
-	int wide_count = MultiByteToWideChar(CP_UTF8, 0, s.c_str(), -1, NULL, 0);
-	wchar_t* wide = new wchar_t[wide_count];
-	MultiByteToWideChar(CP_UTF8, 0, s.c_str(), -1, wide, wide_count);
-	MessageBox(NULL, wide, (LPCWSTR)L"Assertion Failure", MB_ICONWARNING);
-	delete[] wide;
-}
+	// Reads bits from a deflate stream, least significant bit first
+	struct BitReader
+	{
+		const uint8_t* pData{ nullptr };
+		size_t size{ 0 };
+		size_t pos{ 0 };
+		uint32_t bitBuffer{ 0 };
+		int bitCount{ 0 };
+		bool bOverrun{ false };
 
-void DebugOutput( const char* s )
-{
-	OutputDebugStringA(s);
-}
+		int Bits( int count )
+		{
+			uint32_t value = bitBuffer;
+			while( bitCount < count )
+			{
+				if( pos >= size )
+				{
+					bOverrun = true;
+					return 0;
+				}
+				value |= static_cast<uint32_t>( pData[pos++] ) << bitCount;
+				bitCount += 8;
+			}
+			bitBuffer = value >> count;
+			bitCount -= count;
+			return static_cast<int>( value & ( ( 1u << count ) - 1 ) );
+		}
+	};
 
-void DebugOutput( std::string s )
-{
-	OutputDebugStringA(s.c_str());
-}
+	// A canonical Huffman code: the number of codes of each length and the symbols in code order
+	struct Huffman
+	{
+		uint16_t counts[16]{};
+		uint16_t symbols[288]{};
+	};
 
-void TracePrintf( const char* file, int line, const char* fmt, ... )
-{
-	constexpr size_t kMaxBufferSize = 512u;
-	char buffer[kMaxBufferSize];
+	// Returns false if the code lengths describe more codes than can exist
+	bool BuildHuffman( Huffman& huffman, const uint8_t* pLengths, int count )
+	{
+		memset( huffman.counts, 0, sizeof( huffman.counts ) );
+		for( int i = 0; i < count; i++ )
+			huffman.counts[pLengths[i]]++;
 
-	va_list args;
-	va_start(args, fmt);
-	// format should be double click-able in VS 
-	int len = sprintf_s(buffer, kMaxBufferSize, "%s(%d): ", file, line);
-	vsprintf_s(buffer + len, kMaxBufferSize - len, fmt, args);
-	DebugOutput(buffer);
-	va_end(args);
-}
+		int left = 1;
+		for( int len = 1; len < 16; len++ )
+		{
+			left = ( left << 1 ) - huffman.counts[len];
+			if( left < 0 )
+				return false;
+		}
 
-//********************************************************************************************************************************
-// File:		PlayRender.cpp
-// Description:	A software pixel renderer for drawing 2D primitives into a PixelData buffer
-// Platform:	Independent
-//********************************************************************************************************************************
+		uint16_t offsets[16]{};
+		for( int len = 1; len < 15; len++ )
+			offsets[len + 1] = offsets[len] + huffman.counts[len];
 
+		for( int i = 0; i < count; i++ )
+		{
+			if( pLengths[i] != 0 )
+				huffman.symbols[offsets[pLengths[i]]++] = static_cast<uint16_t>( i );
+		}
+		return true;
+	}
 
-#define ASSERT_RENDERTARGET	PLAY_ASSERT_MSG( Play::Render::m_pRenderTarget, "Render Target not initialised. Call Render::SetRenderTarget() before using the Play::Render library functions.")
+	// Returns the next symbol, or -1 if the bits don't make a valid code
+	int DecodeSymbol( BitReader& reader, const Huffman& huffman )
+	{
+		int code = 0;
+		int first = 0;
+		int index = 0;
+		for( int len = 1; len < 16; len++ )
+		{
+			code |= reader.Bits( 1 );
+			int count = huffman.counts[len];
+			if( code - count < first )
+				return huffman.symbols[index + ( code - first )];
+			index += count;
+			first = ( first + count ) << 1;
+			code <<= 1;
+		}
+		return -1;
+	}
 
-namespace Play::Render
-{
-	// Internal (private) namespace variables
-	PixelData* m_pRenderTarget{ nullptr };
+	// Decompresses a zlib stream (the Adler-32 checksum isn't checked)
+	bool Inflate( const uint8_t* pData, size_t size, std::vector<uint8_t>& out )
+	{
+		static const uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		static const uint8_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		static const uint16_t distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		static const uint8_t distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+		static const uint8_t codeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
 
-	PixelData* SetRenderTarget( PixelData* pRenderTarget ) 
-	{ 
-		PixelData* old = m_pRenderTarget; 
-		m_pRenderTarget = pRenderTarget; 
-		return old; 
-	}
+		if( size < 2 || ( pData[0] & 0x0F ) != 8 || ( ( pData[0] << 8 ) | pData[1] ) % 31 != 0 )
+			return false;
 
-	void DrawLine( int startX, int startY, int endX, int endY, Pixel pix ) 
-	{
-		ASSERT_RENDERTARGET;
+		BitReader reader{ pData + 2, size - 2 };
+		bool bLast = false;
 
-		//Implementation of Bresenham's Line Drawing Algorithm
-		int dx = abs(endX - startX);
-		int sx = 1;
-		if (endX < startX) { sx = -1; }
+		while( !bLast )
+		{
+			bLast = reader.Bits( 1 ) != 0;
+			int type = reader.Bits( 2 );
 
-		int dy = -abs(endY - startY);
-		int sy = 1;
-		if (endY < startY) { sy = -1; }
+			if( type == 0 )
+			{
+				// A stored block starts at the next byte boundary
+				reader.bitBuffer = 0;
+				reader.bitCount = 0;
+				if( reader.pos + 4 > reader.size )
+					return false;
+				const uint8_t* p = reader.pData + reader.pos;
+				size_t length = p[0] | ( p[1] << 8 );
+				if( length != ( ~( p[2] | ( p[3] << 8 ) ) & 0xFFFFu ) || reader.pos + 4 + length > reader.size )
+					return false;
+				out.insert( out.end(), p + 4, p + 4 + length );
+				reader.pos += 4 + length;
+				continue;
+			}
 
-		int err = dx + dy;
+			if( type == 3 )
+				return false;
 
-		if (dx == 0 && dy == 0) return;
+			Huffman literals;
+			Huffman distances;
+			uint8_t lengths[286 + 30]{};
 
-		int x = startX;
-		int y = startY;
+			if( type == 1 )
+			{
+				// The fixed codes
+				for( int i = 0; i < 288; i++ )
+					lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+				BuildHuffman( literals, lengths, 288 );
+				memset( lengths, 5, 30 );
+				BuildHuffman( distances, lengths, 30 );
+			}
+			else
+			{
+				// The dynamic codes, whose lengths are themselves Huffman coded
+				int literalCount = reader.Bits( 5 ) + 257;
+				int distanceCount = reader.Bits( 5 ) + 1;
+				int codeLengthCount = reader.Bits( 4 ) + 4;
+				if( literalCount > 286 || distanceCount > 30 )
+					return false;
 
-		while (true)
-		{
-			Graphics::DrawPixel({ x, y }, pix); // Axis flipping is performed within
+				uint8_t codeLengths[19]{};
+				for( int i = 0; i < codeLengthCount; i++ )
+					codeLengths[codeLengthOrder[i]] = static_cast<uint8_t>( reader.Bits( 3 ) );
 
-			if (x == endX && y == endY)
-				break;
+				Huffman codeLengthCodes;
+				if( !BuildHuffman( codeLengthCodes, codeLengths, 19 ) )
+					return false;
 
-			int e2 = 2 * err;
-			if (e2 >= dy)
-			{
-				err += dy;
-				x += sx;
+				int index = 0;
+				while( index < literalCount + distanceCount )
+				{
+					int symbol = DecodeSymbol( reader, codeLengthCodes );
+					if( symbol < 0 || reader.bOverrun )
+						return false;
+
+					if( symbol < 16 )
+					{
+						lengths[index++] = static_cast<uint8_t>( symbol );
+						continue;
+					}
+
+					uint8_t value = 0;
+					int repeat = 0;
+					if( symbol == 16 )
+					{
+						if( index == 0 )
+							return false;
+						value = lengths[index - 1];
+						repeat = 3 + reader.Bits( 2 );
+					}
+					else if( symbol == 17 )
+						repeat = 3 + reader.Bits( 3 );
+					else
+						repeat = 11 + reader.Bits( 7 );
+
+					if( index + repeat > literalCount + distanceCount )
+						return false;
+					while( repeat-- )
+						lengths[index++] = value;
+				}
+
+				if( lengths[256] == 0 || !BuildHuffman( literals, lengths, literalCount ) || !BuildHuffman( distances, lengths + literalCount, distanceCount ) )
+					return false;
 			}
-			if (e2 <= dx)
+
+			for( ;; )
 			{
-				err += dx;
-				y += sy;
+				int symbol = DecodeSymbol( reader, literals );
+				if( symbol < 0 || reader.bOverrun )
+					return false;
+
+				if( symbol < 256 )
+				{
+					out.push_back( static_cast<uint8_t>( symbol ) );
+					continue;
+				}
+
+				if( symbol == 256 )
+					break;
+
+				symbol -= 257;
+				if( symbol >= 29 )
+					return false;
+				size_t length = lengthBase[symbol] + reader.Bits( lengthExtra[symbol] );
+
+				int distanceSymbol = DecodeSymbol( reader, distances );
+				if( distanceSymbol < 0 || distanceSymbol >= 30 )
+					return false;
+				size_t distance = distanceBase[distanceSymbol] + reader.Bits( distanceExtra[distanceSymbol] );
+				if( distance > out.size() || reader.bOverrun )
+					return false;
+
+				// The copy can overlap the bytes it's writing, so it has to go one byte at a time
+				size_t from = out.size() - distance;
+				out.resize( out.size() + length );
+				uint8_t* pOut = out.data();
+				for( size_t i = 0; i < length; i++ )
+					pOut[from + distance + i] = pOut[from + i];
 			}
 		}
+		return !reader.bOverrun;
 	}
 
-	void ClearRenderTarget( Pixel colour ) 
+	uint32_t ReadBigEndian( const uint8_t* p )
 	{
-		ASSERT_RENDERTARGET;
-		Pixel* pBuffEnd = m_pRenderTarget->pPixels + (m_pRenderTarget->width * m_pRenderTarget->height);
-		for (Pixel* pBuff = m_pRenderTarget->pPixels; pBuff < pBuffEnd; *pBuff++ = colour.bits);
-		m_pRenderTarget->preMultiplied = false;
+		return ( static_cast<uint32_t>( p[0] ) << 24 ) | ( p[1] << 16 ) | ( p[2] << 8 ) | p[3];
 	}
 
-	void BlitBackground( PixelData& backgroundImage ) 
+	int PaethPredictor( int a, int b, int c )
 	{
-		ASSERT_RENDERTARGET;
-		PLAY_ASSERT_MSG(backgroundImage.height == m_pRenderTarget->height && backgroundImage.width == m_pRenderTarget->width, "Background size doesn't match render target!");
-		// Takes about 1ms for 720p screen on i7-8550U
-		memcpy(m_pRenderTarget->pPixels, backgroundImage.pPixels, sizeof(Pixel) * m_pRenderTarget->width * m_pRenderTarget->height);
+		int p = a + b - c;
+		int pa = abs( p - a );
+		int pb = abs( p - b );
+		int pc = abs( p - c );
+		if( pa <= pb && pa <= pc )
+			return a;
+		return pb <= pc ? b : c;
 	}
-}
-//********************************************************************************************************************************
-// File:		PlayGraphics.cpp
-// Description:	Manages 2D graphics operations on a PixelData buffer 
-// Platform:	Independent
-// Notes:		Uses PNG format. The end of the filename indicates the number of frames e.g. "bat_4.png" or "tiles_10x10.png"
-//********************************************************************************************************************************
 
+	// Decodes a PNG file, only reading the size if pPixels is null
+	// > Returns false if the file isn't a valid PNG
+	bool Decode( const std::vector<uint8_t>& file, int& width, int& height, std::vector<Pixel>* pPixels )
+	{
+		static const uint8_t signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+		if( file.size() < 8 + 25 || memcmp( file.data(), signature, 8 ) != 0 || memcmp( file.data() + 12, "IHDR", 4 ) != 0 )
+			return false;
 
-#define ASSERT_GRAPHICS PLAY_ASSERT_MSG( Play::Graphics::m_bCreated, "Graphics Manager not initialised. Call Graphics::CreateManager() before using the Play::Graphics library functions.")
+		const uint8_t* pHeader = file.data() + 16;
+		width = static_cast<int>( ReadBigEndian( pHeader ) );
+		height = static_cast<int>( ReadBigEndian( pHeader + 4 ) );
+		int bitDepth = pHeader[8];
+		int colourType = pHeader[9];
+		bool bInterlaced = pHeader[12] != 0;
 
-namespace Play::Graphics
-{
-	// Internal (private) declarations
-	// 
-	// Flag to record whether the manager has been created
-	bool m_bCreated = false;
-	// Count of the total number of sprites loaded
-	int m_nTotalSprites{ 0 };
-	// Buffer pointers
-	PixelData m_playBuffer;
-	// A buffer for unpacking the debug font into 
-	uint8_t* m_pDebugFontBuffer{ nullptr };
+		int channels = 0;
+		switch( colourType )
+		{
+			case 0: channels = 1; break; // Grey
+			case 2: channels = 3; break; // RGB
+			case 3: channels = 1; break; // Palette
+			case 4: channels = 2; break; // Grey and alpha
+			case 6: channels = 4; break; // RGBA
+			default: return false;
+		}
+		bool bValidDepth = colourType == 0 ? ( bitDepth == 1 || bitDepth == 2 || bitDepth == 4 || bitDepth == 8 || bitDepth == 16 ) :
+			colourType == 3 ? ( bitDepth == 1 || bitDepth == 2 || bitDepth == 4 || bitDepth == 8 ) : ( bitDepth == 8 || bitDepth == 16 );
+		if( width <= 0 || height <= 0 || width > ( 1 << 14 ) || height > ( 1 << 14 ) || !bValidDepth )
+			return false;
 
-	// A vector of all the loaded sprites
-	std::vector< Sprite > m_vSpriteData;
-	// A vector of all the loaded backgrounds
-	std::vector< PixelData > m_vBackgroundData;
+		if( !pPixels )
+			return true;
 
-	// Multiplies the sprite image by its own alpha transparency values to save repeating this calculation on every draw
-	// > A colour multiplication can also be applied at this stage, which affects all subseqent drawing operations on the sprite
-	void PreMultiplyAlpha( Pixel* source, Pixel* dest, int width, int height, int maxSkipWidth, float alphaMultiply, Pixel colourMultiply );
-	// Allocates a buffer for the debug font and copies the font pixel data to it
-	void DecompressDubugFont( void );
-	// Returns the pixel width of a string using the debug font
-	int GetDebugStringWidth( const std::string& s );
-	// Draws the offset points from the origin in all octants
-	void DrawCircleOctants( int posX, int posY, int offX, int offY, Pixel pix );
-	// Ends the current timing segment and calculates the duration
-	LARGE_INTEGER EndTimingSegment();
+		// Gather the palette, transparency and compressed image data from the chunks
+		uint8_t palette[256][4]{};
+		int transparentKey[3] = { -1, -1, -1 };
+		std::vector<uint8_t> compressed;
 
-	struct TimingSegment
-	{
-		Pixel pix;
-		long long begin{ 0 };
-		long long end{ 0 };
-		float millisecs{ 0 };
-	};
+		for( size_t offset = 8; offset + 12 <= file.size(); )
+		{
+			size_t length = ReadBigEndian( &file[offset] );
+			const uint8_t* pType = &file[offset + 4];
+			const uint8_t* pData = &file[offset + 8];
+			if( length > file.size() - offset - 12 )
+				return false;
 
-	// Vectors of timing data segments
-	std::vector<TimingSegment> m_vTimings;
-	std::vector<TimingSegment> m_vPrevTimings;
+			if( memcmp( pType, "PLTE", 4 ) == 0 )
+			{
+				for( size_t i = 0; i < length / 3 && i < 256; i++ )
+					palette[i][0] = pData[i * 3], palette[i][1] = pData[i * 3 + 1], palette[i][2] = pData[i * 3 + 2], palette[i][3] = 0xFF;
+			}
+			else if( memcmp( pType, "tRNS", 4 ) == 0 )
+			{
+				if( colourType == 3 )
+				{
+					for( size_t i = 0; i < length && i < 256; i++ )
+						palette[i][3] = pData[i];
+				}
+				else if( colourType == 0 && length >= 2 )
+					transparentKey[0] = ( pData[0] << 8 ) | pData[1];
+				else if( colourType == 2 && length >= 6 )
+				{
+					for( int c = 0; c < 3; c++ )
+						transparentKey[c] = ( pData[c * 2] << 8 ) | pData[c * 2 + 1];
+				}
+			}
+			else if( memcmp( pType, "IDAT", 4 ) == 0 )
+				compressed.insert( compressed.end(), pData, pData + length );
+			else if( memcmp( pType, "IEND", 4 ) == 0 )
+				break;
 
-	// The blend mode state
-	BlendMode blendMode{ BLEND_NORMAL };
+			offset += length + 12;
+		}
 
-	bool CreateManager( int bufferWidth, int bufferHeight, const char* path )
-	{
-		PLAY_ASSERT_MSG( !m_bCreated, "Graphics Manager already initialised! Cannot call Graphics::CreateManager() more than once.");
+		std::vector<uint8_t> data;
+		data.reserve( static_cast<size_t>( width ) * height * channels * bitDepth / 8 + height );
+		if( !Inflate( compressed.data(), compressed.size(), data ) )
+			return false;
 
-		m_bCreated = true;
+		// Interlaced images are stored as 7 smaller passes, each covering a regular grid of the pixels
+		static const int passes[7][4] = { { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+		static const int notInterlaced[1][4] = { { 0, 0, 1, 1 } };
+		const int( *pPasses )[4] = bInterlaced ? passes : notInterlaced;
+		int passCount = bInterlaced ? 7 : 1;
 
-		// A working buffer for our display. Each pixel is stored as an unsigned 32-bit integer: alpha<<24 | red<<16 | green<<8 | blue
-		m_playBuffer.width = bufferWidth;
-		m_playBuffer.height = bufferHeight;
-		m_playBuffer.pPixels = new Pixel[static_cast<size_t>( bufferWidth ) * bufferHeight];
-		m_playBuffer.preMultiplied = false;
-		PLAY_ASSERT( m_playBuffer.pPixels );
+		int bitsPerPixel = channels * bitDepth;
+		int filterBytes = std::max( 1, bitsPerPixel / 8 );
+		int maxSample = ( 1 << bitDepth ) - 1;
 
-		memset( m_playBuffer.pPixels, 0, sizeof( uint32_t ) * bufferWidth * bufferHeight );
+		// Each row of each pass is a filter type byte followed by the packed samples
+		auto PassSize = [&]( int pass, int& passWidth, int& passHeight ) -> size_t
+		{
+			passWidth = ( width - pPasses[pass][0] + pPasses[pass][2] - 1 ) / pPasses[pass][2];
+			passHeight = ( height - pPasses[pass][1] + pPasses[pass][3] - 1 ) / pPasses[pass][3];
+			return ( passWidth > 0 && passHeight > 0 ) ? ( static_cast<size_t>( passWidth ) * bitsPerPixel + 7 ) / 8 : 0;
+		};
 
-		// Make the display buffer the render target for the blitter
-		Render::SetRenderTarget( &m_playBuffer );
+		// Check there's enough data before allocating the pixels, in case the header is corrupt
+		size_t dataBytes = 0;
+		for( int pass = 0; pass < passCount; pass++ )
+		{
+			int passWidth, passHeight;
+			size_t rowBytes = PassSize( pass, passWidth, passHeight );
+			if( rowBytes > 0 )
+				dataBytes += ( rowBytes + 1 ) * passHeight;
+		}
+		if( data.size() < dataBytes )
+			return false;
 
-		// Iterate through the directory
-		PLAY_ASSERT_MSG( std::filesystem::exists( path ), "PlayBuffer: Drectory provided does not exist." );
+		pPixels->assign( static_cast<size_t>( width ) * height, Pixel( 0u ) );
 
-		for( const auto& p : std::filesystem::directory_iterator( path ) )
+		size_t offset = 0;
+		std::vector<uint8_t> previousRow;
+		for( int pass = 0; pass < passCount; pass++ )
 		{
-			// Switch everything to uppercase to avoid need to check case each time
-			std::string filename = p.path().string();
-			for( char& c : filename ) c = static_cast<char>( toupper( c ) );
+			int passWidth, passHeight;
+			size_t rowBytes = PassSize( pass, passWidth, passHeight );
+			if( rowBytes == 0 )
+				continue;
 
-			// Only attempt to load PNG files
-			if( filename.find( ".PNG" ) != std::string::npos )
-			{
-				std::ifstream png_infile;
-				png_infile.open( filename, std::ios::binary ); // Don't do this as part of the constructor or we lose 16 bytes!
+			int startX = pPasses[pass][0], startY = pPasses[pass][1], stepX = pPasses[pass][2], stepY = pPasses[pass][3];
+			previousRow.assign( rowBytes, 0 );
 
-				// If the PNG was opened okay
-				if( png_infile )
+			for( int y = 0; y < passHeight; y++ )
+			{
+				// Undo the row's filter in place
+				int filter = data[offset];
+				uint8_t* pRow = &data[offset + 1];
+				for( size_t i = 0; i < rowBytes; i++ )
 				{
-					int spriteId = LoadSpriteSheet( p.path().parent_path().string() + "\\", p.path().stem().string() );
+					int left = i >= static_cast<size_t>( filterBytes ) ? pRow[i - filterBytes] : 0;
+					int up = previousRow[i];
+					int upLeft = i >= static_cast<size_t>( filterBytes ) ? previousRow[i - filterBytes] : 0;
+					switch( filter )
+					{
+						case 0: break;
+						case 1: pRow[i] = static_cast<uint8_t>( pRow[i] + left ); break;
+						case 2: pRow[i] = static_cast<uint8_t>( pRow[i] + up ); break;
+						case 3: pRow[i] = static_cast<uint8_t>( pRow[i] + ( ( left + up ) >> 1 ) ); break;
+						case 4: pRow[i] = static_cast<uint8_t>( pRow[i] + PaethPredictor( left, up, upLeft ) ); break;
+						default: return false;
+					}
+				}
+				previousRow.assign( pRow, pRow + rowBytes );
+				offset += 1 + rowBytes;
 
-					// Now we check for .inf file for each sprite and load origins
-					int originX = 0, originY = 0;
+				// Convert each pixel to 8-bit ARGB, keeping the full precision samples for the transparency key
+				Pixel* pDest = pPixels->data() + static_cast<size_t>( startY + y * stepY ) * width + startX;
+				for( int x = 0; x < passWidth; x++, pDest += stepX )
+				{
+					int samples[4]{};
+					for( int c = 0; c < channels; c++ )
+					{
+						int index = x * channels + c;
+						if( bitDepth == 8 )
+							samples[c] = pRow[index];
+						else if( bitDepth == 16 )
+							samples[c] = ( pRow[index * 2] << 8 ) | pRow[index * 2 + 1];
+						else
+						{
+							int bit = index * bitDepth;
+							samples[c] = ( pRow[bit >> 3] >> ( 8 - bitDepth - ( bit & 7 ) ) ) & maxSample;
+						}
+					}
 
-					std::string info_filename = filename.replace( filename.find( ".PNG" ), 4, ".INF" );
+					auto To8Bit = [&]( int sample ) { return bitDepth == 16 ? sample >> 8 : sample * 255 / maxSample; };
 
-					if( std::filesystem::exists( info_filename ) )
+					switch( colourType )
 					{
-						std::ifstream info_infile;
-						info_infile.open( info_filename, std::ios::in );
-
-						PLAY_ASSERT_MSG( info_infile.is_open(), std::string( "Unable to load existing .inf file: " + info_filename ).c_str() );
-						if( info_infile.is_open() )
+						case 0:
+							*pDest = Pixel( samples[0] == transparentKey[0] ? 0 : 0xFF, To8Bit( samples[0] ), To8Bit( samples[0] ), To8Bit( samples[0] ) );
+							break;
+						case 2:
 						{
-							std::string type;
-							info_infile >> type;
-							info_infile >> originX;
-							info_infile >> originY;
+							bool bTransparent = samples[0] == transparentKey[0] && samples[1] == transparentKey[1] && samples[2] == transparentKey[2];
+							*pDest = Pixel( bTransparent ? 0 : 0xFF, To8Bit( samples[0] ), To8Bit( samples[1] ), To8Bit( samples[2] ) );
+							break;
 						}
-						info_infile.close();
+						case 3:
+							*pDest = Pixel( palette[samples[0]][3], palette[samples[0]][0], palette[samples[0]][1], palette[samples[0]][2] );
+							break;
+						case 4:
+							*pDest = Pixel( To8Bit( samples[1] ), To8Bit( samples[0] ), To8Bit( samples[0] ), To8Bit( samples[0] ) );
+							break;
+						case 6:
+							*pDest = Pixel( To8Bit( samples[3] ), To8Bit( samples[0] ), To8Bit( samples[1] ), To8Bit( samples[2] ) );
+							break;
 					}
-					SetSpriteOrigin( spriteId, { originX, originY }, false );
 				}
-				png_infile.close();
 			}
 		}
 		return true;
 	}
 
-	bool DestroyManager()
+	bool ReadFile( const std::string& fileAndPath, std::vector<uint8_t>& file )
 	{
-		ASSERT_GRAPHICS;
+		std::ifstream stream( fileAndPath, std::ios::binary );
+		if( !stream )
+			return false;
+		file.assign( std::istreambuf_iterator<char>( stream ), std::istreambuf_iterator<char>() );
+		return true;
+	}
 
-		for( Sprite& s : m_vSpriteData )
+	uint32_t Crc32( const uint8_t* pData, size_t size, uint32_t crc = 0 )
+	{
+		static uint32_t table[256]{};
+		if( table[1] == 0 )
 		{
-			if( s.canvasBuffer.pPixels )
-				delete[] s.canvasBuffer.pPixels;
-
-			if( s.preMultAlpha.pPixels )
-				delete[] s.preMultAlpha.pPixels;
+			for( uint32_t n = 0; n < 256; n++ )
+			{
+				uint32_t c = n;
+				for( int k = 0; k < 8; k++ )
+					c = ( c & 1 ) ? 0xEDB88320u ^ ( c >> 1 ) : c >> 1;
+				table[n] = c;
+			}
 		}
 
-		for( PixelData& pBgBuffer : m_vBackgroundData )
-			delete[] pBgBuffer.pPixels;
-
-		if( m_pDebugFontBuffer )
-			delete[] m_pDebugFontBuffer;
+		crc = ~crc;
+		for( size_t i = 0; i < size; i++ )
+			crc = table[( crc ^ pData[i] ) & 0xFF] ^ ( crc >> 8 );
+		return ~crc;
+	}
 
-		delete[] m_playBuffer.pPixels;
+	void WriteBigEndian( std::vector<uint8_t>& out, uint32_t value )
+	{
+		uint8_t bytes[4] = { static_cast<uint8_t>( value >> 24 ), static_cast<uint8_t>( value >> 16 ), static_cast<uint8_t>( value >> 8 ), static_cast<uint8_t>( value ) };
+		out.insert( out.end(), bytes, bytes + 4 );
+	}
 
-		m_bCreated = false;
-		return true;
+	void WriteChunk( std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data )
+	{
+		WriteBigEndian( out, static_cast<uint32_t>( data.size() ) );
+		size_t start = out.size();
+		out.insert( out.end(), type, type + 4 );
+		out.insert( out.end(), data.begin(), data.end() );
+		WriteBigEndian( out, Crc32( &out[start], out.size() - start ) );
 	}
+}
 
-	//********************************************************************************************************************************
-	// Loading functions
-	//********************************************************************************************************************************
+int ReadPNGImage( std::string& fileAndPath, int& width, int& height )
+{
+	std::vector<uint8_t> file;
+	if( !Play::Png::ReadFile( fileAndPath, file ) || !Play::Png::Decode( file, width, height, nullptr ) )
+		return -1;
 
-	int LoadSpriteSheet( const std::string& path, const std::string& filename )
-	{
-		ASSERT_GRAPHICS;
+	return 1;
+}
 
-		PixelData canvasBuffer;
-		std::string spriteName = filename;
-		bool isSpriteSheet = false;
-		int hCount = 1;
-		int vCount = 1;
+int LoadPNGImage( std::string& fileAndPath, PixelData& destImage )
+{
+	std::vector<uint8_t> file;
+	std::vector<Pixel> pixels;
+	if( !Play::Png::ReadFile( fileAndPath, file ) || !Play::Png::Decode( file, destImage.width, destImage.height, &pixels ) )
+		return -1;
 
-		// Switch everything to uppercase to avoid need to check case each time
-		for( char& c : spriteName ) c = static_cast<char>( toupper( c ) );
+	destImage.pPixels = new Pixel[destImage.width * destImage.height];
+	memcpy( destImage.pPixels, pixels.data(), sizeof( Pixel ) * destImage.width * destImage.height );
 
-		// Look for the final number in the filename to pull out the number of frames across the width
-		size_t frameWidthEnd = spriteName.find_last_of( "0123456789" );
-		size_t frameWidthStart = spriteName.find_last_not_of( "0123456789" );
+	return 1;
+}
 
-		// Make sure we are a sprite sheet (valid forms are sprite_w and sprite_wXh)
-		if (spriteName[frameWidthStart] == 'X' && frameWidthStart != 0)
-		{
-			size_t frameWidthDelimPos = spriteName.find_last_not_of("0123456789", frameWidthStart - 1);
-			if (spriteName[frameWidthDelimPos] == '_')
-				isSpriteSheet = true;
-		}
-		else if (spriteName[frameWidthStart] == '_')
-		{
-			isSpriteSheet = true;
-		}
+int SavePNGImage( std::string& fileAndPath, const PixelData& sourceImage )
+{
+	using namespace Play::Png;
 
-		if( frameWidthEnd == spriteName.length() - 1 && isSpriteSheet)
+	// Each row is a filter type byte (none) followed by the RGBA bytes
+	std::vector<uint8_t> raw;
+	raw.reserve( ( static_cast<size_t>( sourceImage.width ) * 4 + 1 ) * sourceImage.height );
+	for( int y = 0; y < sourceImage.height; y++ )
+	{
+		raw.push_back( 0 );
+		const Pixel* pSource = sourceImage.pPixels + static_cast<size_t>( y ) * sourceImage.width;
+		for( int x = 0; x < sourceImage.width; x++, pSource++ )
 		{
-			// Grab the number of frames
-			std::string widthString = spriteName.substr( frameWidthStart + 1, frameWidthEnd - frameWidthStart );
-
-			// Make sure the number is valid 
-			size_t num = widthString.find_first_of( "0123456789" );
-			PLAY_ASSERT_MSG( num == 0, std::string( "Incorrectly named sprite: " + filename ).c_str() );
+			uint8_t rgba[4] = { pSource->r, pSource->g, pSource->b, pSource->a };
+			raw.insert( raw.end(), rgba, rgba + 4 );
+		}
+	}
 
-			hCount = stoi( widthString );
+	// Wrap the rows in a zlib stream made of stored deflate blocks
+	std::vector<uint8_t> zlib = { 0x78, 0x01 };
+	for( size_t offset = 0; offset < raw.size() || offset == 0; )
+	{
+		size_t length = std::min<size_t>( raw.size() - offset, 0xFFFF );
+		bool bLast = offset + length == raw.size();
+		uint8_t header[5] = { static_cast<uint8_t>( bLast ? 1 : 0 ), static_cast<uint8_t>( length ), static_cast<uint8_t>( length >> 8 ), static_cast<uint8_t>( ~length ), static_cast<uint8_t>( ~length >> 8 ) };
+		zlib.insert( zlib.end(), header, header + 5 );
+		zlib.insert( zlib.end(), raw.begin() + offset, raw.begin() + offset + length );
+		offset += length;
+		if( bLast )
+			break;
+	}
 
-			if( spriteName[frameWidthStart] == 'X' )
-			{
-				//Two dimensional sprite sheet so the width was actually the height: copy it over and work out the real width
-				vCount = hCount;
+	uint32_t a = 1, b = 0;
+	for( uint8_t byte : raw )
+	{
+		a = ( a + byte ) % 65521;
+		b = ( b + a ) % 65521;
+	}
+	WriteBigEndian( zlib, ( b << 16 ) | a );
 
-				// Cut off the last number we just found plus an "x", then check for another number indicating a frame height (optional)
-				std::string truncated = spriteName.substr( 0, frameWidthStart );
-				frameWidthEnd = truncated.find_last_of( "0123456789" );
-				frameWidthStart = truncated.find_last_not_of( "0123456789" );
+	std::vector<uint8_t> header;
+	WriteBigEndian( header, static_cast<uint32_t>( sourceImage.width ) );
+	WriteBigEndian( header, static_cast<uint32_t>( sourceImage.height ) );
+	uint8_t format[5] = { 8, 6, 0, 0, 0 }; // 8-bit RGBA, deflate, adaptive filtering, not interlaced
+	header.insert( header.end(), format, format + 5 );
 
-				if( frameWidthEnd == truncated.length() - 1 && frameWidthStart != std::string::npos )
-				{
-					// Grab the number of images in the height
-					widthString = truncated.substr( frameWidthStart + 1, frameWidthEnd - frameWidthStart );
+	std::vector<uint8_t> file = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	WriteChunk( file, "IHDR", header );
+	WriteChunk( file, "IDAT", zlib );
+	WriteChunk( file, "IEND", {} );
 
-					// Make sure the number is valid
-					num = widthString.find_first_of( "0123456789" );
-					PLAY_ASSERT_MSG( num == 0, std::string( "Incorrectly named sprite: " + filename ).c_str() );
+	std::ofstream stream( fileAndPath, std::ios::binary );
+	if( !stream.write( reinterpret_cast<const char*>( file.data() ), file.size() ) )
+		return -1;
 
-					hCount = stoi( widthString );
-				}
-				else
-				{
-					PLAY_ASSERT_MSG( false, std::string( "Incorrectly named sprite: " + filename ).c_str() );
-				}
-			}
-			else
-			{
-				vCount = 1;
-			}
-		}
-		std::string fileAndPath( path + spriteName + ".PNG" );
-		LoadPNGImage( fileAndPath, canvasBuffer ); // Allocates memory as we don't know the size
-	
-		return AddSprite( filename, canvasBuffer, hCount, vCount );
-	}
+	return 1;
+}
+#endif // PLAY_HEADLESS
 
-	int AddSprite( const std::string& name, PixelData& pixelData, int hCount, int vCount )
-	{
-		ASSERT_GRAPHICS;
+//********************************************************************************************************************************
+// Miscellaneous functions
+//********************************************************************************************************************************
 
-		// Switch everything to uppercase to avoid need to check case each time
-		std::string spriteName = name;
-		for( char& c : spriteName ) c = static_cast<char>( toupper( c ) );
+void AssertFailMessage( const char* message, const char* file, long line )
+{
+	// file - the file in which the assertion failed ( __FILE__ )
+	// line - the line of code where the assertion failed ( __LINE__ )
+	std::filesystem::path p = file;
+	std::string s = p.filename().string() + " : LINE " + std::to_string(line);
+	s += "\n" + std::string(message);
+#ifdef PLAY_HEADLESS
+	std::cerr << "Assertion Failure: " << s << std::endl;
+#else
+	int wide_count = MultiByteToWideChar(CP_UTF8, 0, s.c_str(), -1, NULL, 0);
+	wchar_t* wide = new wchar_t[wide_count];
+	MultiByteToWideChar(CP_UTF8, 0, s.c_str(), -1, wide, wide_count);
+	MessageBox(NULL, wide, (LPCWSTR)L"Assertion Failure", MB_ICONWARNING);
+	delete[] wide;
+#endif
+}
 
-		Sprite s;
-		s.id = m_nTotalSprites++;
-		s.name = spriteName;
-		s.originX = s.originY = 0;
-		s.hCount = hCount;
-		s.vCount = vCount;
-		s.canvasBuffer = pixelData; // copy including pointer to pixel data
+void DebugOutput( const char* s )
+{
+#ifdef PLAY_HEADLESS
+	std::cerr << s;
+#else
+	OutputDebugStringA(s);
+#endif
+}
 
-		s.totalCount = s.hCount * s.vCount;
-		s.width = s.canvasBuffer.width / s.hCount;
-		s.height = s.canvasBuffer.height / s.vCount;
+void DebugOutput( std::string s )
+{
+	DebugOutput(s.c_str());
+}
 
-		// Create a separate buffer with the pre-multiplyied alpha
-		s.preMultAlpha.pPixels = new Pixel[static_cast<size_t>( s.canvasBuffer.width ) * s.canvasBuffer.height];
-		s.preMultAlpha.width = s.canvasBuffer.width;
-		s.preMultAlpha.height = s.canvasBuffer.height;
-		memset( s.preMultAlpha.pPixels, 0, sizeof( uint32_t ) * s.canvasBuffer.width * s.canvasBuffer.height );
-		PreMultiplyAlpha( s.canvasBuffer.pPixels, s.preMultAlpha.pPixels, s.canvasBuffer.width, s.canvasBuffer.height, s.width, 1.0f, 0x00FFFFFF );
-		s.canvasBuffer.preMultiplied = true;
+void TracePrintf( const char* file, int line, const char* fmt, ... )
+{
+	constexpr size_t kMaxBufferSize = 512u;
+	char buffer[kMaxBufferSize];
 
-		// Add the sprite to our vector
-		m_vSpriteData.push_back( s );
-		return s.id;
-	}
+	va_list args;
+	va_start(args, fmt);
+	// format should be double click-able in VS 
+	int len = snprintf(buffer, kMaxBufferSize, "%s(%d): ", file, line);
+	vsnprintf(buffer + len, kMaxBufferSize - len, fmt, args);
+	DebugOutput(buffer);
+	va_end(args);
+}
 
-	int UpdateSprite( const std::string& name, PixelData& pixelData, int hCount, int vCount )
-	{
-		ASSERT_GRAPHICS; 
+//********************************************************************************************************************************
+// File:		PlayRender.cpp
+// Description:	A software pixel renderer for drawing 2D primitives into a PixelData buffer
+// Platform:	Independent
+//********************************************************************************************************************************
 
-		// Switch everything to uppercase to avoid need to check case each time
-		std::string spriteName = name;
-		for( char& c : spriteName ) c = static_cast<char>( toupper( c ) );
 
-		for( Sprite& s : m_vSpriteData )
-		{
-			if( s.name.find( spriteName ) != std::string::npos )
-			{
-				// delete the old premultiplied buffer
-				delete s.preMultAlpha.pPixels;
+#define ASSERT_RENDERTARGET	PLAY_ASSERT_MSG( Play::Render::m_pRenderTarget, "Render Target not initialised. Call Render::SetRenderTarget() before using the Play::Render library functions.")
 
-				s.hCount = hCount;
-				s.vCount = vCount;
-				s.canvasBuffer = pixelData; // copy including pointer to pixel data
+namespace Play::Render
+{
+	// Internal (private) namespace variables
+	thread_local PixelData* m_pRenderTarget{ nullptr };
+	thread_local DirtyRects* m_pDirtyRects{ nullptr };
+	thread_local const PixelData* m_pDirtyTarget{ nullptr };
+	thread_local RenderCounters m_renderCounters;
+	thread_local OverdrawMap* m_pOverdrawMap{ nullptr };
+	thread_local const PixelData* m_pOverdrawTarget{ nullptr };
 
-				s.totalCount = s.hCount * s.vCount;
-				s.width = s.canvasBuffer.width / s.hCount;
-				s.height = s.canvasBuffer.height / s.vCount;
+	PixelData* SetRenderTarget( PixelData* pRenderTarget ) 
+	{ 
+		PixelData* old = m_pRenderTarget; 
+		m_pRenderTarget = pRenderTarget; 
+		return old; 
+	}
 
-				// Create a new buffer with the pre-multiplyied alpha
-				s.preMultAlpha.pPixels = new Pixel[static_cast<size_t>( s.canvasBuffer.width ) * s.canvasBuffer.height];
-				s.preMultAlpha.width = s.canvasBuffer.width;
-				s.preMultAlpha.height = s.canvasBuffer.height;
-				memset( s.preMultAlpha.pPixels, 0, sizeof( uint32_t ) * s.canvasBuffer.width * s.canvasBuffer.height );
-				PreMultiplyAlpha( s.canvasBuffer.pPixels, s.preMultAlpha.pPixels, s.canvasBuffer.width, s.canvasBuffer.height, s.width, 1.0f, 0x00FFFFFF );
-				s.canvasBuffer.preMultiplied = true;
+	//********************************************************************************************************************************
+	// Dirty rectangle functions
+	//********************************************************************************************************************************
 
-				return s.id;
-			}
-		}
-		return -1;
+	void SetDirtyRects( const PixelData* pTarget, DirtyRects* pDirtyRects )
+	{
+		m_pDirtyTarget = pTarget;
+		m_pDirtyRects = pDirtyRects;
 	}
 
-	int UpdateSprite( const std::string& name )
+	void DirtyRects::Add( PixelRect rect )
 	{
-		ASSERT_GRAPHICS;
-
-		// Switch everything to uppercase to avoid need to check case each time
-		std::string spriteName = name;
-		for( char& c : spriteName ) c = static_cast<char>(toupper( c ));
+		if( rect.left >= rect.right || rect.top >= rect.bottom )
+			return;
 
-		for( Sprite& s : m_vSpriteData )
+		// Most drawing is inside something which has already been drawn, like the rest of a line or a full screen clear
+		for( const PixelRect& r : m_vRects )
 		{
-			if( s.name.find( spriteName ) != std::string::npos )
-			{
-				memset( s.preMultAlpha.pPixels, 0, sizeof( uint32_t ) * s.canvasBuffer.width * s.canvasBuffer.height );
-				PreMultiplyAlpha( s.canvasBuffer.pPixels, s.preMultAlpha.pPixels, s.canvasBuffer.width, s.canvasBuffer.height, s.width, 1.0f, 0x00FFFFFF );
-				s.canvasBuffer.preMultiplied = true;
-
-				return s.id;
-			}
+			if( rect.left >= r.left && rect.right <= r.right && rect.top >= r.top && rect.bottom <= r.bottom )
+				return;
 		}
-		return -1;
-	}
-
-
-	int LoadBackground( const char* fileAndPath )
-	{
-		ASSERT_GRAPHICS;
 
-		// The background image may not be the right size for the background so we make sure the buffer is 
-		PixelData backgroundImage;
-		Pixel* pSrc, * pDest;
+		// Keep merging with whichever rectangle is close by, as each merge grows the rectangle. When none are close and the
+		// list is full, merge with the rectangle which adds the fewest pixels.
+		while( true )
+		{
+			size_t merge = m_vRects.size();
+			long long fewestAdded = std::numeric_limits<long long>::max();
 
-		Pixel* correctSizeBuffer = new Pixel[static_cast<size_t>( m_playBuffer.width ) * m_playBuffer.height];
-		PLAY_ASSERT( correctSizeBuffer );
+			for( size_t i = 0; i < m_vRects.size(); i++ )
+			{
+				const PixelRect& r = m_vRects[i];
 
-		std::string pngFile( fileAndPath );
-		PLAY_ASSERT_MSG( std::filesystem::exists( fileAndPath ), "The background png does not exist at the given location." );
-		LoadPNGImage( pngFile, backgroundImage ); // Allocates memory in function as we don't know the size
+				if( rect.left <= r.right + MERGE_DISTANCE && r.left <= rect.right + MERGE_DISTANCE && rect.top <= r.bottom + MERGE_DISTANCE && r.top <= rect.bottom + MERGE_DISTANCE )
+				{
+					merge = i;
+					break;
+				}
 
-		pSrc = backgroundImage.pPixels;
-		pDest = correctSizeBuffer;
+				if( m_vRects.size() >= MAX_RECTS )
+				{
+					long long added = static_cast<long long>( std::max( rect.right, r.right ) - std::min( rect.left, r.left ) ) * ( std::max( rect.bottom, r.bottom ) - std::min( rect.top, r.top ) )
+						- static_cast<long long>( r.right - r.left ) * ( r.bottom - r.top );
+					if( added < fewestAdded )
+					{
+						fewestAdded = added;
+						merge = i;
+					}
+				}
+			}
 
-		//Copy the image to our background buffer clipping where necessary
-		for( int h = 0; h < std::min( backgroundImage.height, m_playBuffer.height ); h++ )
-		{
-			for( int w = 0; w < std::min( backgroundImage.width, m_playBuffer.width ); w++ )
-				*pDest++ = *pSrc++;
+			if( merge == m_vRects.size() )
+				break;
 
-			// Skip pixels if we're clipping
-			pDest += std::max( m_playBuffer.width - backgroundImage.width, 0 );
-			pSrc += std::max( backgroundImage.width - m_playBuffer.width, 0 );
+			const PixelRect& r = m_vRects[merge];
+			rect = { std::min( rect.left, r.left ), std::min( rect.top, r.top ), std::max( rect.right, r.right ), std::max( rect.bottom, r.bottom ) };
+			m_vRects[merge] = m_vRects.back();
+			m_vRects.pop_back();
 		}
 
-		// Free up the loading buffer
-		delete backgroundImage.pPixels;
-		backgroundImage.pPixels = correctSizeBuffer;
+		m_vRects.push_back( rect );
+	}
 
-		m_vBackgroundData.push_back( backgroundImage );
+	void DirtyRects::Add( const DirtyRects& other )
+	{
+		for( const PixelRect& r : other.m_vRects )
+			Add( r );
+	}
 
-		return static_cast<int>( m_vBackgroundData.size() ) - 1;
+	int DirtyRects::GetPixelCount() const
+	{
+		int count = 0;
+		for( const PixelRect& r : m_vRects )
+			count += ( r.right - r.left ) * ( r.bottom - r.top );
+		return count;
 	}
 
 	//********************************************************************************************************************************
-	// Sprite Getters and Setters
+	// Overdraw map functions
 	//********************************************************************************************************************************
-	int GetSpriteId( const char* name ) 
+
+	void SetOverdrawMap( const PixelData* pTarget, OverdrawMap* pOverdrawMap )
 	{
-		ASSERT_GRAPHICS;
+		PLAY_ASSERT_MSG( !pTarget || !pOverdrawMap || ( pOverdrawMap->GetWidth() == pTarget->width && pOverdrawMap->GetHeight() == pTarget->height ),
+			"Overdraw map size doesn't match render target!" );
+		m_pOverdrawTarget = pTarget;
+		m_pOverdrawMap = pOverdrawMap;
+	}
 
-		std::string tofind( name );
-		for( char& c : tofind ) c = static_cast<char>( toupper( c ) );
+	void OverdrawMap::Reset( int width, int height )
+	{
+		m_width = width;
+		m_height = height;
+		m_vCounts.assign( static_cast<size_t>( width ) * height, 0 );
+	}
 
-		for( const Sprite& s : m_vSpriteData )
+	void OverdrawMap::Add( const PixelRect& rect )
+	{
+		for( int y = rect.top; y < rect.bottom; y++ )
 		{
-			if( s.name.find( tofind ) != std::string::npos )
-				return s.id;
+			uint16_t* pCounts = m_vCounts.data() + ( y * m_width );
+			for( int x = rect.left; x < rect.right; x++ )
+				pCounts[x]++;
 		}
-		PLAY_ASSERT_MSG( false, "The sprite name is invalid!" );
-		return -1;
 	}
 
-	const std::string& GetSpriteName( int spriteId )
+	void OverdrawMap::DrawHeatMap( PixelData& dest ) const
 	{
-		ASSERT_GRAPHICS;
-		PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to get name of invalid sprite id" );
-		return m_vSpriteData[spriteId].name;
+		PLAY_ASSERT_MSG( dest.width == m_width && dest.height == m_height, "Heat map size doesn't match overdraw map!" );
+
+		static const uint32_t ramp[] = { 0xFF000000, 0xFF0000C0, 0xFF00C0C0, 0xFF00C000, 0xFFFFFF00, 0xFFFF8000, 0xFFFF0000, 0xFFFFFFFF };
+		constexpr uint16_t maxCount = static_cast<uint16_t>( sizeof( ramp ) / sizeof( ramp[0] ) - 1 );
+
+		for( size_t i = 0; i < m_vCounts.size(); i++ )
+			dest.pPixels[i].bits = ramp[std::min( m_vCounts[i], maxCount )];
+		dest.preMultiplied = false;
 	}
 
-	Vector2f GetSpriteSize( int spriteId )
+	void DrawLine( int startX, int startY, int endX, int endY, Pixel pix ) 
+	{
+		ASSERT_RENDERTARGET;
+
+		//Implementation of Bresenham's Line Drawing Algorithm
+		int dx = abs(endX - startX);
+		int sx = 1;
+		if (endX < startX) { sx = -1; }
+
+		int dy = -abs(endY - startY);
+		int sy = 1;
+		if (endY < startY) { sy = -1; }
+
+		int err = dx + dy;
+
+		if (dx == 0 && dy == 0) return;
+
+		PLAY_RENDER_COUNT( lines, 1 );
+
+		int x = startX;
+		int y = startY;
+
+		while (true)
+		{
+			Graphics::DrawPixel({ x, y }, pix); // Axis flipping is performed within
+
+			if (x == endX && y == endY)
+				break;
+
+			int e2 = 2 * err;
+			if (e2 >= dy)
+			{
+				err += dy;
+				x += sx;
+			}
+			if (e2 <= dx)
+			{
+				err += dx;
+				y += sy;
+			}
+		}
+	}
+
+	void ClearRenderTarget( Pixel colour ) 
+	{
+		ASSERT_RENDERTARGET;
+		Pixel* pBuffEnd = m_pRenderTarget->pPixels + (m_pRenderTarget->width * m_pRenderTarget->height);
+		for (Pixel* pBuff = m_pRenderTarget->pPixels; pBuff < pBuffEnd; *pBuff++ = colour.bits);
+		m_pRenderTarget->preMultiplied = false;
+		MarkDirty( 0, 0, m_pRenderTarget->width, m_pRenderTarget->height );
+		PLAY_RENDER_COUNT( clears, 1 );
+		PLAY_RENDER_COUNT( pixelsCleared, m_pRenderTarget->width * m_pRenderTarget->height );
+		AddOverdraw( { 0, 0, m_pRenderTarget->width, m_pRenderTarget->height } );
+	}
+
+	void ClearRenderTarget( Pixel colour, const PixelRect& rect )
+	{
+		ASSERT_RENDERTARGET;
+		for( int y = rect.top; y < rect.bottom; y++ )
+		{
+			Pixel* pBuff = m_pRenderTarget->pPixels + ( y * m_pRenderTarget->width ) + rect.left;
+			std::fill( pBuff, pBuff + ( rect.right - rect.left ), colour );
+		}
+		m_pRenderTarget->preMultiplied = false;
+		PLAY_RENDER_COUNT( clears, 1 );
+		PLAY_RENDER_COUNT( pixelsCleared, ( rect.right - rect.left ) * ( rect.bottom - rect.top ) );
+		AddOverdraw( rect );
+	}
+
+	void BlitBackground( PixelData& backgroundImage ) 
+	{
+		ASSERT_RENDERTARGET;
+		PLAY_ASSERT_MSG(backgroundImage.height == m_pRenderTarget->height && backgroundImage.width == m_pRenderTarget->width, "Background size doesn't match render target!");
+		// Takes about 1ms for 720p screen on i7-8550U
+		memcpy(m_pRenderTarget->pPixels, backgroundImage.pPixels, sizeof(Pixel) * m_pRenderTarget->width * m_pRenderTarget->height);
+		MarkDirty( 0, 0, m_pRenderTarget->width, m_pRenderTarget->height );
+		PLAY_RENDER_COUNT( clears, 1 );
+		PLAY_RENDER_COUNT( pixelsCleared, m_pRenderTarget->width * m_pRenderTarget->height );
+		AddOverdraw( { 0, 0, m_pRenderTarget->width, m_pRenderTarget->height } );
+	}
+
+	void BlitBackground( PixelData& backgroundImage, const PixelRect& rect )
+	{
+		ASSERT_RENDERTARGET;
+		PLAY_ASSERT_MSG(backgroundImage.height == m_pRenderTarget->height && backgroundImage.width == m_pRenderTarget->width, "Background size doesn't match render target!");
+		for( int y = rect.top; y < rect.bottom; y++ )
+		{
+			int offset = ( y * m_pRenderTarget->width ) + rect.left;
+			memcpy( m_pRenderTarget->pPixels + offset, backgroundImage.pPixels + offset, sizeof( Pixel ) * ( rect.right - rect.left ) );
+		}
+		PLAY_RENDER_COUNT( clears, 1 );
+		PLAY_RENDER_COUNT( pixelsCleared, ( rect.right - rect.left ) * ( rect.bottom - rect.top ) );
+		AddOverdraw( rect );
+	}
+}
+//********************************************************************************************************************************
+// File:		PlayGraphics.cpp
+// Description:	Manages 2D graphics operations on a PixelData buffer 
+// Platform:	Independent
+// Notes:		Uses PNG format. The end of the filename indicates the number of frames e.g. "bat_4.png" or "tiles_10x10.png"
+//********************************************************************************************************************************
+
+
+#define ASSERT_GRAPHICS PLAY_ASSERT_MSG( Play::Graphics::m_bCreated, "Graphics Manager not initialised. Call Graphics::CreateManager() before using the Play::Graphics library functions.")
+
+namespace Play::Graphics
+{
+	// Internal (private) declarations
+	// 
+	// Flag to record whether the manager has been created
+	bool m_bCreated = false;
+	// Count of the total number of sprites loaded
+	int m_nTotalSprites{ 0 };
+	// Buffer pointers
+	PixelData m_playBuffer;
+	// A buffer for unpacking the debug font into 
+	uint8_t* m_pDebugFontBuffer{ nullptr };
+
+	// A vector of all the loaded sprites
+	std::vector< Sprite > m_vSpriteData;
+	// A vector of all the loaded backgrounds
+	std::vector< PixelData > m_vBackgroundData;
+
+	// Multiplies the sprite image by its own alpha transparency values to save repeating this calculation on every draw
+	// > A colour multiplication can also be applied at this stage, which affects all subseqent drawing operations on the sprite
+	void PreMultiplyAlpha( Pixel* source, Pixel* dest, int width, int height, int maxSkipWidth, float alphaMultiply, Pixel colourMultiply );
+	// Allocates a buffer for the debug font and copies the font pixel data to it
+	void DecompressDubugFont( void );
+	// Returns the pixel width of a string using the debug font
+	int GetDebugStringWidth( const std::string& s );
+	// Draws the offset points from the origin in all octants
+	void DrawCircleOctants( int posX, int posY, int offX, int offY, Pixel pix );
+	// Ends the current timing segment and calculates the duration
+	// > Returns the current time in nanoseconds
+	long long EndTimingSegment();
+	// Picks the colour a profile scope is drawn in on the timing bar from its name
+	Pixel GetScopeColour( const char* name );
+
+	struct TimingSegment
+	{
+		Pixel pix;
+		long long begin{ 0 };
+		long long end{ 0 };
+		float millisecs{ 0 };
+	};
+
+	// The timing segments since TimingBarBegin, for GetTimingSegmentDuration: the bar itself is drawn from the profiler's events
+	std::vector<TimingSegment> m_vTimings;
+
+	// The blend mode state
+	thread_local BlendMode blendMode{ BLEND_NORMAL };
+
+	// Pipelined rendering: with a render latency of 1, the drawing functions called on the game thread record what they would
+	// have drawn in the draw list. PresentFrame hands it to the render thread, which draws it into the back buffer and presents it.
+	enum class DrawOp
+	{
+		CLEAR,
+		BACKGROUND,
+		SPRITE,
+		SPRITE_TRANSFORMED,
+		PIXEL,
+		LINE,
+		RECT,
+		CIRCLE,
+		DEBUG_CHARACTER,
+		PIXEL_DATA,
+		COLOUR_SPRITE
+	};
+
+	struct DrawCommand
+	{
+		DrawOp op{ DrawOp::CLEAR };
+		BlendMode blend{ BLEND_NORMAL };
+		int id{ 0 }; // The sprite or background id, circle radius or debug character
+		int frameOffset{ 0 };
+		int x{ 0 }, y{ 0 }; // Where a sprite or pixel data is blitted, once its origin has been taken off
+		Point2f pos{ 0.0f, 0.0f }; // The position, or the start of a line or rectangle
+		Point2f pos2{ 0.0f, 0.0f }; // The end of a line or rectangle, or the origin of a transformed sprite
+		Matrix2D transform;
+		BlendColour multiply;
+		Pixel pix;
+		bool fill{ false };
+		PixelData pixelData;
+	};
+
+	int m_renderLatency{ 0 };
+	PixelData m_renderBuffer; // The back buffer which the render thread draws into
+	std::vector<DrawCommand> m_vDrawList; // Recorded by the game thread
+	std::vector<DrawCommand> m_vRenderList; // Drawn by the render thread
+	std::thread m_renderThread;
+	std::mutex m_renderMutex;
+	std::condition_variable m_renderCondition;
+	bool m_bRenderPending{ false }; // Set while the render list is waiting to be drawn or being drawn
+	bool m_bRenderQuit{ false };
+
+	// Whether a drawing function should record itself in the draw list rather than draw
+	// > Only drawing into the display buffer is recorded, and the render thread's own render target is the back buffer
+	inline bool IsRecording() { return m_renderLatency > 0 && Render::m_pRenderTarget == &m_playBuffer; }
+	// Adds a command to the draw list, using the current blend mode
+	DrawCommand& RecordDraw( DrawOp op );
+	// Draws the commands in a draw list into the render target
+	void DrawCommandList( const std::vector<DrawCommand>& vList );
+	// Waits for frames to be handed over and draws and presents them
+	void RenderThread();
+	// Draws a frame of a sprite once its position has been worked out
+	void BlitSprite( const Sprite& spr, int frameOffset, int destx, int desty, BlendColour globalMultiply );
+	void TransformSprite( const Sprite& spr, int frameOffset, Vector2f origin, const Matrix2D& trans, BlendColour globalMultiply );
+	// Regenerates a sprite's premultiplied alpha data with a colour multiply
+	void RecolourSprite( Sprite& s, Pixel colour );
+
+	// Dirty rectangle tracking: the frame being drawn adds what it draws to m_dirtyDrawn, which is then all that has to be
+	// put back when the next frame is cleared to the same colour or background. The render thread alternates between two
+	// buffers, so with it the last two frames' drawing is put back.
+	struct ClearedTo
+	{
+		int backgroundId{ -1 }; // Or -1 when cleared to a colour
+		uint32_t colour{ 0 };
+	};
+
+	bool m_bTrackDirtyRects{ false };
+	Render::DirtyRects m_dirtyDrawn; // What the frame being drawn has drawn over since it was last cleared
+	Render::DirtyRects m_dirtyRestored; // What the frame being drawn has put back to the colour or background
+	Render::DirtyRects m_dirtyRestoring; // Working lists, kept so that their memory is reused
+	Render::DirtyRects m_dirtyPresent;
+	Render::DirtyRects m_dirtyHistory[2]; // What each of the last two frames had drawn over
+	bool m_bFrameCleared{ false };
+	ClearedTo m_frameClearedTo;
+	ClearedTo m_historyClearedTo;
+	int m_historyFrames{ 0 }; // How many frames in a row m_historyClearedTo was cleared to
+	std::atomic<int> m_dirtyPixelCount{ 0 };
+
+	// The render counters for the last frame presented, which the render thread sets
+	Render::RenderCounters m_frameCounters;
+	std::mutex m_countersMutex;
+
+	// The overdraw view: whichever thread draws the frame counts into m_overdrawMap, which is drawn into m_overdrawView to be presented
+	bool m_bShowOverdraw{ false };
+	Render::OverdrawMap m_overdrawMap;
+	PixelData m_overdrawView;
+
+	// Clears the render target to a colour or draws a background over it, but only where it needs to be when tracking dirty rectangles
+	void RestoreRenderTarget( const ClearedTo& clearTo );
+	// Presents a finished buffer, only copying the parts which have changed when tracking dirty rectangles
+	double PresentBuffer( const PixelData& buffer );
+	// Forgets what the last frames drew, so the next clear restores everything and the next present copies everything
+	void ResetDirtyRects();
+
+	bool CreateManager( int bufferWidth, int bufferHeight, const char* path )
+	{
+		PLAY_ASSERT_MSG( !m_bCreated, "Graphics Manager already initialised! Cannot call Graphics::CreateManager() more than once.");
+
+		m_bCreated = true;
+
+		// A working buffer for our display. Each pixel is stored as an unsigned 32-bit integer: alpha<<24 | red<<16 | green<<8 | blue
+		m_playBuffer.width = bufferWidth;
+		m_playBuffer.height = bufferHeight;
+		m_playBuffer.pPixels = new Pixel[static_cast<size_t>( bufferWidth ) * bufferHeight];
+		m_playBuffer.preMultiplied = false;
+		PLAY_ASSERT( m_playBuffer.pPixels );
+
+		memset( m_playBuffer.pPixels, 0, sizeof( uint32_t ) * bufferWidth * bufferHeight );
+
+		// Make the display buffer the render target for the blitter
+		Render::SetRenderTarget( &m_playBuffer );
+
+		// Iterate through the directory
+		PLAY_ASSERT_MSG( std::filesystem::exists( path ), "PlayBuffer: Drectory provided does not exist." );
+
+		for( const auto& p : std::filesystem::directory_iterator( path ) )
+		{
+			// Switch everything to uppercase to avoid need to check case each time
+			std::string filename = p.path().string();
+			for( char& c : filename ) c = static_cast<char>( toupper( c ) );
+
+			// Only attempt to load PNG files
+			if( filename.find( ".PNG" ) != std::string::npos )
+			{
+				std::ifstream png_infile;
+				png_infile.open( p.path().string(), std::ios::binary ); // Don't do this as part of the constructor or we lose 16 bytes!
+
+				// If the PNG was opened okay
+				if( png_infile )
+				{
+					int spriteId = LoadSpriteSheet( p.path().parent_path().string() + "/", p.path().stem().string() );
+
+					// Now we check for .inf file for each sprite and load origins
+					int originX = 0, originY = 0;
+
+					std::string info_filename = std::filesystem::path( p.path() ).replace_extension( ".inf" ).string();
+
+					if( std::filesystem::exists( info_filename ) )
+					{
+						std::ifstream info_infile;
+						info_infile.open( info_filename, std::ios::in );
+
+						PLAY_ASSERT_MSG( info_infile.is_open(), std::string( "Unable to load existing .inf file: " + info_filename ).c_str() );
+						if( info_infile.is_open() )
+						{
+							std::string type;
+							info_infile >> type;
+							info_infile >> originX;
+							info_infile >> originY;
+						}
+						info_infile.close();
+					}
+					SetSpriteOrigin( spriteId, { originX, originY }, false );
+				}
+				png_infile.close();
+			}
+		}
+		return true;
+	}
+
+	bool DestroyManager()
 	{
 		ASSERT_GRAPHICS;
-		PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to get width of invalid sprite id" );
-		return { m_vSpriteData[spriteId].width, m_vSpriteData[spriteId].height };
+
+		SetRenderLatency( 0 );
+		Capture::StopCapture();
+
+		for( Sprite& s : m_vSpriteData )
+		{
+			if( s.canvasBuffer.pPixels )
+				delete[] s.canvasBuffer.pPixels;
+
+			if( s.preMultAlpha.pPixels )
+				delete[] s.preMultAlpha.pPixels;
+		}
+
+		for( PixelData& pBgBuffer : m_vBackgroundData )
+			delete[] pBgBuffer.pPixels;
+
+		if( m_pDebugFontBuffer )
+			delete[] m_pDebugFontBuffer;
+
+		Render::SetOverdrawMap( nullptr, nullptr );
+		delete[] m_overdrawView.pPixels;
+		m_overdrawView = PixelData{};
+		m_bShowOverdraw = false;
+
+		delete[] m_playBuffer.pPixels;
+
+		m_bCreated = false;
+		return true;
 	}
 
-	int GetSpriteFrames( int spriteId )
+	//********************************************************************************************************************************
+	// Loading functions
+	//********************************************************************************************************************************
+
+	int LoadSpriteSheet( const std::string& path, const std::string& filename )
+	{
+		ASSERT_GRAPHICS;
+
+		PixelData canvasBuffer;
+		std::string spriteName = filename;
+		bool isSpriteSheet = false;
+		int hCount = 1;
+		int vCount = 1;
+
+		// Switch everything to uppercase to avoid need to check case each time
+		for( char& c : spriteName ) c = static_cast<char>( toupper( c ) );
+
+		// Look for the final number in the filename to pull out the number of frames across the width
+		size_t frameWidthEnd = spriteName.find_last_of( "0123456789" );
+		size_t frameWidthStart = spriteName.find_last_not_of( "0123456789" );
+
+		// Make sure we are a sprite sheet (valid forms are sprite_w and sprite_wXh)
+		if (spriteName[frameWidthStart] == 'X' && frameWidthStart != 0)
+		{
+			size_t frameWidthDelimPos = spriteName.find_last_not_of("0123456789", frameWidthStart - 1);
+			if (spriteName[frameWidthDelimPos] == '_')
+				isSpriteSheet = true;
+		}
+		else if (spriteName[frameWidthStart] == '_')
+		{
+			isSpriteSheet = true;
+		}
+
+		if( frameWidthEnd == spriteName.length() - 1 && isSpriteSheet)
+		{
+			// Grab the number of frames
+			std::string widthString = spriteName.substr( frameWidthStart + 1, frameWidthEnd - frameWidthStart );
+
+			// Make sure the number is valid 
+			size_t num = widthString.find_first_of( "0123456789" );
+			PLAY_ASSERT_MSG( num == 0, std::string( "Incorrectly named sprite: " + filename ).c_str() );
+
+			hCount = stoi( widthString );
+
+			if( spriteName[frameWidthStart] == 'X' )
+			{
+				//Two dimensional sprite sheet so the width was actually the height: copy it over and work out the real width
+				vCount = hCount;
+
+				// Cut off the last number we just found plus an "x", then check for another number indicating a frame height (optional)
+				std::string truncated = spriteName.substr( 0, frameWidthStart );
+				frameWidthEnd = truncated.find_last_of( "0123456789" );
+				frameWidthStart = truncated.find_last_not_of( "0123456789" );
+
+				if( frameWidthEnd == truncated.length() - 1 && frameWidthStart != std::string::npos )
+				{
+					// Grab the number of images in the height
+					widthString = truncated.substr( frameWidthStart + 1, frameWidthEnd - frameWidthStart );
+
+					// Make sure the number is valid
+					num = widthString.find_first_of( "0123456789" );
+					PLAY_ASSERT_MSG( num == 0, std::string( "Incorrectly named sprite: " + filename ).c_str() );
+
+					hCount = stoi( widthString );
+				}
+				else
+				{
+					PLAY_ASSERT_MSG( false, std::string( "Incorrectly named sprite: " + filename ).c_str() );
+				}
+			}
+			else
+			{
+				vCount = 1;
+			}
+		}
+		std::string fileAndPath( path + filename + ".png" );
+		LoadPNGImage( fileAndPath, canvasBuffer ); // Allocates memory as we don't know the size
+	
+		return AddSprite( filename, canvasBuffer, hCount, vCount );
+	}
+
+	int AddSprite( const std::string& name, PixelData& pixelData, int hCount, int vCount )
+	{
+		ASSERT_GRAPHICS;
+		WaitForRenderThread(); // The sprite vector may move
+
+		// Switch everything to uppercase to avoid need to check case each time
+		std::string spriteName = name;
+		for( char& c : spriteName ) c = static_cast<char>( toupper( c ) );
+
+		Sprite s;
+		s.id = m_nTotalSprites++;
+		s.name = spriteName;
+		s.originX = s.originY = 0;
+		s.hCount = hCount;
+		s.vCount = vCount;
+		s.canvasBuffer = pixelData; // copy including pointer to pixel data
+
+		s.totalCount = s.hCount * s.vCount;
+		s.width = s.canvasBuffer.width / s.hCount;
+		s.height = s.canvasBuffer.height / s.vCount;
+
+		// Create a separate buffer with the pre-multiplyied alpha
+		s.preMultAlpha.pPixels = new Pixel[static_cast<size_t>( s.canvasBuffer.width ) * s.canvasBuffer.height];
+		s.preMultAlpha.width = s.canvasBuffer.width;
+		s.preMultAlpha.height = s.canvasBuffer.height;
+		memset( s.preMultAlpha.pPixels, 0, sizeof( uint32_t ) * s.canvasBuffer.width * s.canvasBuffer.height );
+		PreMultiplyAlpha( s.canvasBuffer.pPixels, s.preMultAlpha.pPixels, s.canvasBuffer.width, s.canvasBuffer.height, s.width, 1.0f, 0x00FFFFFF );
+		s.canvasBuffer.preMultiplied = true;
+
+		// Add the sprite to our vector
+		m_vSpriteData.push_back( s );
+		return s.id;
+	}
+
+	int UpdateSprite( const std::string& name, PixelData& pixelData, int hCount, int vCount )
+	{
+		ASSERT_GRAPHICS; 
+		WaitForRenderThread();
+
+		// Switch everything to uppercase to avoid need to check case each time
+		std::string spriteName = name;
+		for( char& c : spriteName ) c = static_cast<char>( toupper( c ) );
+
+		for( Sprite& s : m_vSpriteData )
+		{
+			if( s.name.find( spriteName ) != std::string::npos )
+			{
+				// delete the old premultiplied buffer
+				delete s.preMultAlpha.pPixels;
+
+				s.hCount = hCount;
+				s.vCount = vCount;
+				s.canvasBuffer = pixelData; // copy including pointer to pixel data
+
+				s.totalCount = s.hCount * s.vCount;
+				s.width = s.canvasBuffer.width / s.hCount;
+				s.height = s.canvasBuffer.height / s.vCount;
+
+				// Create a new buffer with the pre-multiplyied alpha
+				s.preMultAlpha.pPixels = new Pixel[static_cast<size_t>( s.canvasBuffer.width ) * s.canvasBuffer.height];
+				s.preMultAlpha.width = s.canvasBuffer.width;
+				s.preMultAlpha.height = s.canvasBuffer.height;
+				memset( s.preMultAlpha.pPixels, 0, sizeof( uint32_t ) * s.canvasBuffer.width * s.canvasBuffer.height );
+				PreMultiplyAlpha( s.canvasBuffer.pPixels, s.preMultAlpha.pPixels, s.canvasBuffer.width, s.canvasBuffer.height, s.width, 1.0f, 0x00FFFFFF );
+				s.canvasBuffer.preMultiplied = true;
+
+				return s.id;
+			}
+		}
+		return -1;
+	}
+
+	int UpdateSprite( const std::string& name )
+	{
+		ASSERT_GRAPHICS;
+		WaitForRenderThread();
+
+		// Switch everything to uppercase to avoid need to check case each time
+		std::string spriteName = name;
+		for( char& c : spriteName ) c = static_cast<char>(toupper( c ));
+
+		for( Sprite& s : m_vSpriteData )
+		{
+			if( s.name.find( spriteName ) != std::string::npos )
+			{
+				memset( s.preMultAlpha.pPixels, 0, sizeof( uint32_t ) * s.canvasBuffer.width * s.canvasBuffer.height );
+				PreMultiplyAlpha( s.canvasBuffer.pPixels, s.preMultAlpha.pPixels, s.canvasBuffer.width, s.canvasBuffer.height, s.width, 1.0f, 0x00FFFFFF );
+				s.canvasBuffer.preMultiplied = true;
+
+				return s.id;
+			}
+		}
+		return -1;
+	}
+
+
+	int LoadBackground( const char* fileAndPath )
+	{
+		ASSERT_GRAPHICS;
+		WaitForRenderThread(); // The background vector may move
+
+		// The background image may not be the right size for the background so we make sure the buffer is 
+		PixelData backgroundImage;
+		Pixel* pSrc, * pDest;
+
+		Pixel* correctSizeBuffer = new Pixel[static_cast<size_t>( m_playBuffer.width ) * m_playBuffer.height];
+		PLAY_ASSERT( correctSizeBuffer );
+
+		std::string pngFile( fileAndPath );
+		PLAY_ASSERT_MSG( std::filesystem::exists( fileAndPath ), "The background png does not exist at the given location." );
+		LoadPNGImage( pngFile, backgroundImage ); // Allocates memory in function as we don't know the size
+
+		pSrc = backgroundImage.pPixels;
+		pDest = correctSizeBuffer;
+
+		//Copy the image to our background buffer clipping where necessary
+		for( int h = 0; h < std::min( backgroundImage.height, m_playBuffer.height ); h++ )
+		{
+			for( int w = 0; w < std::min( backgroundImage.width, m_playBuffer.width ); w++ )
+				*pDest++ = *pSrc++;
+
+			// Skip pixels if we're clipping
+			pDest += std::max( m_playBuffer.width - backgroundImage.width, 0 );
+			pSrc += std::max( backgroundImage.width - m_playBuffer.width, 0 );
+		}
+
+		// Free up the loading buffer
+		delete backgroundImage.pPixels;
+		backgroundImage.pPixels = correctSizeBuffer;
+
+		m_vBackgroundData.push_back( backgroundImage );
+
+		return static_cast<int>( m_vBackgroundData.size() ) - 1;
+	}
+
+	//********************************************************************************************************************************
+	// Sprite Getters and Setters
+	//********************************************************************************************************************************
+	int GetSpriteId( const char* name ) 
+	{
+		ASSERT_GRAPHICS;
+
+		std::string tofind( name );
+		for( char& c : tofind ) c = static_cast<char>( toupper( c ) );
+
+		for( const Sprite& s : m_vSpriteData )
+		{
+			if( s.name.find( tofind ) != std::string::npos )
+				return s.id;
+		}
+		PLAY_ASSERT_MSG( false, "The sprite name is invalid!" );
+		return -1;
+	}
+
+	const std::string& GetSpriteName( int spriteId )
+	{
+		ASSERT_GRAPHICS;
+		PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to get name of invalid sprite id" );
+		return m_vSpriteData[spriteId].name;
+	}
+
+	Vector2f GetSpriteSize( int spriteId )
+	{
+		ASSERT_GRAPHICS;
+		PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to get width of invalid sprite id" );
+		return { m_vSpriteData[spriteId].width, m_vSpriteData[spriteId].height };
+	}
+
+	int GetSpriteFrames( int spriteId )
+	{
+		ASSERT_GRAPHICS;
+		PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to get frames of invalid sprite id" );
+		return m_vSpriteData[spriteId].totalCount;
+	}
+
+	Vector2f GetSpriteOrigin( int spriteId ) 
+	{
+		ASSERT_GRAPHICS;
+		PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to get origin with invalid sprite id" );
+		return { m_vSpriteData[spriteId].originX, m_vSpriteData[spriteId].originY };
+	}
+
+	void SetSpriteOrigin( int spriteId, Vector2f newOrigin, bool relative )
+	{
+		ASSERT_GRAPHICS;
+		PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to set origin with invalid sprite id" );
+		if( relative )
+		{
+			m_vSpriteData[spriteId].originX += static_cast<int>( newOrigin.x );
+			m_vSpriteData[spriteId].originY += static_cast<int>( newOrigin.y );
+		}
+		else
+		{
+			m_vSpriteData[spriteId].originX = static_cast<int>( newOrigin.x );
+			m_vSpriteData[spriteId].originY = static_cast<int>( newOrigin.y );
+		}
+	}
+
+	void CentreSpriteOrigin( int spriteId )
+	{
+		ASSERT_GRAPHICS;
+		SetSpriteOrigin( spriteId, GetSpriteSize( spriteId ) / 2, false );
+	}
+
+	void CentreAllSpriteOrigins( void )
+	{
+		ASSERT_GRAPHICS;
+		for( Sprite& s : m_vSpriteData )
+			CentreSpriteOrigin( s.id );
+	}
+
+	void FlipSpriteOriginVertically( int spriteId )
+	{
+		ASSERT_GRAPHICS;
+		Vector2f origin = GetSpriteOrigin( spriteId );
+		origin.y = GetSpriteSize( spriteId ).y - origin.y;
+		SetSpriteOrigin( spriteId, origin, false );
+	}
+
+	void FlipAllSpriteOriginsVertically( void )
+	{
+		ASSERT_GRAPHICS;
+		for( Sprite& s : m_vSpriteData )
+			FlipSpriteOriginVertically( s.id );
+	}
+
+	void SetSpriteOrigins( const char* rootName, Vector2f newOrigin, bool relative )
+	{
+		ASSERT_GRAPHICS;
+		std::string tofind( rootName );
+		for( char& c : tofind ) c = static_cast<char>( toupper( c ) );
+
+		for( Sprite& s : m_vSpriteData )
+		{
+			if( s.name.find( tofind ) != std::string::npos )
+			{
+				if( relative )
+				{
+					s.originX += static_cast<int>( newOrigin.x );
+					s.originY += static_cast<int>( newOrigin.y );
+				}
+				else
+				{
+					s.originX = static_cast<int>( newOrigin.x );
+					s.originY = static_cast<int>( newOrigin.y );
+				}
+			}
+		}
+	}
+
+	int GetTotalLoadedSprites() 
+	{ 
+		ASSERT_GRAPHICS;
+		return m_nTotalSprites; 
+	}
+	
+	const PixelData* GetSpritePixelData(int spriteId) 
+	{ 
+		ASSERT_GRAPHICS;
+		return &m_vSpriteData[spriteId].canvasBuffer; 
+	}
+
+	//********************************************************************************************************************************
+	// Drawing functions
+	//********************************************************************************************************************************
+
+	void DrawTransparent( int spriteId, Point2f pos, int frameIndex, BlendColour globalMultiply)
+	{
+		ASSERT_GRAPHICS;
+		const Sprite& spr = m_vSpriteData[spriteId];
+		int destx = static_cast<int>( pos.x + 0.5f ) - spr.originX;
+		int desty = static_cast<int>( pos.y + 0.5f ) + (spr.height - spr.originY);
+		frameIndex = frameIndex % spr.totalCount;
+		int frameX = frameIndex % spr.hCount;
+		int frameY = frameIndex / spr.hCount;
+		int pixelX = frameX * spr.width;
+		int pixelY = frameY * spr.height;
+		int frameOffset = pixelX + ( spr.canvasBuffer.width * pixelY );
+
+		if( IsRecording() )
+		{
+			DrawCommand& cmd = RecordDraw( DrawOp::SPRITE );
+			cmd.id = spriteId;
+			cmd.frameOffset = frameOffset;
+			cmd.x = destx;
+			cmd.y = desty;
+			cmd.multiply = globalMultiply;
+			return;
+		}
+
+		BlitSprite( spr, frameOffset, destx, desty, globalMultiply );
+	};
+
+	void BlitSprite( const Sprite& spr, int frameOffset, int destx, int desty, BlendColour globalMultiply )
+	{
+		switch (blendMode)
+		{
+			case BLEND_NORMAL:
+				Render::BlitPixels<Render::AlphaBlendPolicy>(spr.preMultAlpha, frameOffset, destx, desty, spr.width, spr.height, globalMultiply);
+				break;
+			case BLEND_ADD:
+				Render::BlitPixels<Render::AdditiveBlendPolicy>(spr.preMultAlpha, frameOffset, destx, desty, spr.width, spr.height, globalMultiply);
+				break;
+			case BLEND_MULTIPLY:
+				Render::BlitPixels<Render::MultiplyBlendPolicy>(spr.canvasBuffer, frameOffset, destx, desty, spr.width, spr.height, globalMultiply);
+				break;
+			default:
+				PLAY_ASSERT_MSG(false, "Unsupported blend mode in DrawTransparent")
+					break;
+		}
+	}
+
+	void DrawRotated( int spriteId, Point2f pos, int frameIndex, float angle, float scale, BlendColour globalMultiply )
+	{
+		ASSERT_GRAPHICS;
+		Matrix2D trans = MatrixScale( scale, scale ) * MatrixRotation( angle )  * MatrixTranslation( pos.x, pos.y );
+		DrawTransformed( spriteId, trans, frameIndex, globalMultiply);
+	}
+
+	void DrawTransformed( int spriteId, const Matrix2D& trans, int frameIndex, BlendColour globalMultiply)
+	{
+		ASSERT_GRAPHICS;
+		const Sprite& spr = m_vSpriteData[spriteId];
+		frameIndex = frameIndex % spr.totalCount;
+		int frameX = frameIndex % spr.hCount;
+		int frameY = frameIndex / spr.hCount;
+		int pixelX = frameX * spr.width;
+		int pixelY = frameY * spr.height;
+		int frameOffset = pixelX + ( spr.canvasBuffer.width * pixelY );
+
+		Vector2f origin = { spr.originX, spr.height - spr.originY };
+
+		if( IsRecording() )
+		{
+			DrawCommand& cmd = RecordDraw( DrawOp::SPRITE_TRANSFORMED );
+			cmd.id = spriteId;
+			cmd.frameOffset = frameOffset;
+			cmd.pos2 = origin;
+			cmd.transform = trans;
+			cmd.multiply = globalMultiply;
+			return;
+		}
+
+		TransformSprite( spr, frameOffset, origin, trans, globalMultiply );
+	}
+
+	void TransformSprite( const Sprite& spr, int frameOffset, Vector2f origin, const Matrix2D& trans, BlendColour globalMultiply )
+	{
+		switch (blendMode)
+		{
+		case BLEND_NORMAL:
+			Render::TransformPixels<Render::AlphaBlendPolicy>(spr.preMultAlpha, frameOffset, spr.width, spr.height, origin, trans, globalMultiply);
+			break;
+		case BLEND_ADD:
+			Render::TransformPixels<Render::AdditiveBlendPolicy>(spr.preMultAlpha, frameOffset, spr.width, spr.height, origin, trans, globalMultiply);
+			break;
+		case BLEND_MULTIPLY:
+			Render::TransformPixels<Render::MultiplyBlendPolicy>(spr.preMultAlpha, frameOffset, spr.width, spr.height, origin, trans, globalMultiply);
+			break;
+		default:
+			PLAY_ASSERT_MSG(false, "Unsupported blend mode in DrawTransparent")
+				break;
+		}
+	}
+
+	void DrawBackground( int backgroundId )
+	{
+		ASSERT_GRAPHICS;
+		PLAY_ASSERT_MSG( m_playBuffer.pPixels, "Trying to draw background without initialising display!" );
+		PLAY_ASSERT_MSG( m_vBackgroundData.size() > static_cast<size_t>(backgroundId), "Background image out of range!" );
+
+		if( IsRecording() )
+		{
+			RecordDraw( DrawOp::BACKGROUND ).id = backgroundId;
+			return;
+		}
+
+		RestoreRenderTarget( { backgroundId, 0 } );
+	}
+
+	void ColourSprite( int spriteId, int r, int g, int b )
+	{
+		ASSERT_GRAPHICS;
+		PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to colour invalid sprite id" );
+
+		uint32_t col = ( ( r & 0xFF ) << 16 ) | ( ( g & 0xFF ) << 8 ) | ( b & 0xFF );
+
+		// Recorded like a drawing function, so the colour only applies to the sprites drawn after it
+		if( m_renderLatency > 0 )
+		{
+			DrawCommand& cmd = RecordDraw( DrawOp::COLOUR_SPRITE );
+			cmd.id = spriteId;
+			cmd.pix = col;
+			return;
+		}
+
+		RecolourSprite( m_vSpriteData[spriteId], col );
+	}
+
+	void RecolourSprite( Sprite& s, Pixel colour )
+	{
+		PreMultiplyAlpha( s.canvasBuffer.pPixels, s.preMultAlpha.pPixels, s.canvasBuffer.width, s.canvasBuffer.height, s.width, 1.0f, colour );
+		s.canvasBuffer.preMultiplied = true;
+	}
+
+	int DrawString( int fontId, Point2f pos, std::string text )
+	{
+		ASSERT_GRAPHICS;
+		PLAY_ASSERT_MSG( fontId >= 0 && fontId < m_nTotalSprites, "Trying to use invalid sprite id for font" );
+
+		int width = 0;
+
+		for( char c : text )
+		{
+			Draw( fontId, { pos.x + width, pos.y }, c - 32 );
+			width += GetFontCharWidth( fontId, c );
+		}
+		return width;
+	}
+
+	int DrawStringCentred( int fontId, Point2f pos, std::string text )
+	{
+		ASSERT_GRAPHICS;
+		int totalWidth = 0;
+
+		for( char c : text )
+			totalWidth += GetFontCharWidth( fontId, c );
+
+		pos.x -= totalWidth / 2;
+
+		DrawString( fontId, pos, text );
+		return totalWidth;
+	}
+
+	int DrawChar( int fontId, Point2f pos, char c )
+	{
+		ASSERT_GRAPHICS;
+		PLAY_ASSERT_MSG( fontId >= 0 && fontId < m_nTotalSprites, "Trying to use invalid sprite id for font" );
+		Draw( fontId, { pos.x, pos.y }, c - 32 );
+		return GetFontCharWidth( fontId, c );
+	}
+
+	int DrawCharRotated( int fontId, Point2f pos, float angle, float scale, char c )
+	{
+		ASSERT_GRAPHICS;
+		PLAY_ASSERT_MSG( fontId >= 0 && fontId < m_nTotalSprites, "Trying to use invalid sprite id for font" );
+		DrawRotated( fontId, { pos.x, pos.y }, c - 32, angle, scale );
+		return GetFontCharWidth( fontId, c );
+	}
+
+	int GetFontCharWidth( int fontId, char c )
+	{
+		ASSERT_GRAPHICS;
+		PLAY_ASSERT_MSG( fontId >= 0 && fontId < m_nTotalSprites, "Trying to use invalid sprite id for font" );
+		int glyphWidthDataOffset = m_vSpriteData[ fontId ].canvasBuffer.width * (m_vSpriteData[ fontId ].canvasBuffer.height - 1);
+		return (m_vSpriteData[fontId].canvasBuffer.pPixels + glyphWidthDataOffset + ( c - 32 ))->b; // character width hidden in pixel data
+	}
+
+	//********************************************************************************************************************************
+	// Function:	SpriteCollide: function that checks by pixel if two sprites collide
+	// Parameters:	s1Xpos, s1Ypos, s2Xpos, s2Ypos = the origin of rotation for both sprites.
+	//				s1Id, s2Id = the ids of both sprites
+	//				s1angle, s2angle = the angle of rotation for both sprites, clockwise. 0 = unrotated.
+	//				s1Pixelcoll, s2Pixelcoll = the top left and bottom right co-ordinates defining the collision rectangle of both sprites
+	//				
+	// Returns: true if a single pixel or more overlap between the two sprites and false if not.
+	// Notes:	rounding errors may cause it not to be pixel perfect.	
+	//********************************************************************************************************************************
+	int SpriteCollide( int spriteIdA, int frameIndexA, Matrix2D& transA, int spriteIdB, int frameIndexB, Matrix2D& transB )
+	{
+		ASSERT_GRAPHICS;
+		int overlapping_pixels = 0;
+
+		// This algorithm transforms Sprite A's pixels into the co-ordinate space of Sprite B and iterates through all Sprite A's pixels checking for collisions
+		// This only works reliably if the pixels of Sprite A are smaller or the same size as those of Sprite B
+		
+		// If Matrix A's pixels are larger than Matrix A's in both dimensions then swap the sprites around
+		if( transA.row[0].Length() > transB.row[ 0 ].Length() && transA.row[ 1 ].Length() > transB.row[ 1 ].Length() )
+			return SpriteCollide( spriteIdB, frameIndexB, transB, spriteIdA, frameIndexA, transA );
+
+		PLAY_ASSERT_MSG( transA.row[ 0 ].Length() <= transB.row[ 0 ].Length() && transA.row[ 1 ].Length() <= transB.row[ 1 ].Length(), "Sprite Collide algorithm only works with uniform scaling" );
+
+		const Sprite& spr_a = m_vSpriteData[ spriteIdA ];
+		const Sprite& spr_b = m_vSpriteData[ spriteIdB ];
+
+		Matrix2D a_trans_right{ transA };
+		a_trans_right.row[ 0 ] = { transA.row[ 0 ].x, transA.row[ 1 ].x, 0.0f };
+		a_trans_right.row[ 1 ] = { transA.row[ 0 ].y, transA.row[ 1 ].y, 0.0f };
+		a_trans_right.row[ 2 ] = { transA.row[ 2 ].x, -transA.row[ 2 ].y, 1.0f };
+		
+		Matrix2D b_trans_right{ transB };
+		b_trans_right.row[ 0 ] = { transB.row[ 0 ].x, transB.row[ 1 ].x, 0.0f };
+		b_trans_right.row[ 1 ] = { transB.row[ 0 ].y, transB.row[ 1 ].y, 0.0f };
+		b_trans_right.row[ 2 ] = { transB.row[ 2 ].x, -transB.row[ 2 ].y, 1.0f };
+
+		frameIndexA = frameIndexA % spr_a.totalCount;
+		int a_frame_x = frameIndexA % spr_a.hCount;
+		int a_frame_y = frameIndexA / spr_a.hCount;
+		int a_pixel_x = a_frame_x * spr_a.width;
+		int a_pixel_y = a_frame_y * spr_a.height;
+		int a_frame_offset = a_pixel_x + (spr_a.canvasBuffer.width * a_pixel_y);
+
+		frameIndexB = frameIndexB % spr_b.totalCount;
+		int b_frame_x = frameIndexB % spr_b.hCount;
+		int b_frame_y = frameIndexB / spr_b.hCount;
+		int b_pixel_x = b_frame_x * spr_b.width;
+		int b_pixel_y = b_frame_y * spr_b.height;
+		int b_frame_offset = b_pixel_x + (spr_b.canvasBuffer.width * b_pixel_y);
+
+		Vector2f a_origin = { spr_a.originX, spr_a.height - spr_a.originY };
+		Vector2f b_origin = { spr_b.originX, spr_b.height - spr_b.originY };
+
+		Matrix2D b_inv_trans = Play::MatrixTranslation( -b_origin.x, -b_origin.y ) * b_trans_right;
+		b_inv_trans.Inverse();
+		Matrix2D a2b_trans = Play::MatrixTranslation( -a_origin.x, -a_origin.y ) * a_trans_right * b_inv_trans;
+
+		float b_posx = a2b_trans.row[2].x;
+		float b_posy = a2b_trans.row[2].y;
+
+		float b_xincx = a2b_trans.row[ 0 ].x;
+		float b_xincy = a2b_trans.row[ 0 ].y;
+		float b_yincx = a2b_trans.row[ 1 ].x;
+		float b_yincy = a2b_trans.row[ 1 ].y;
+		float b_xresetx = b_xincx * spr_a.width; // This needs to be sprite a's width as that's the space we are iterating through
+		float b_xresety = b_xincy * spr_a.width; // This needs to be sprite a's width as that's the space we are iterating through
+
+		uint32_t* a_pixel = (uint32_t*)spr_a.preMultAlpha.pPixels + a_frame_offset;
+		uint32_t* a_pixel_end = a_pixel + (spr_a.height * spr_a.canvasBuffer.width);
+
+		// Iterate sequentially through pixels within the render target buffer
+		while( a_pixel < a_pixel_end )
+		{
+			// For each row of pixels in turn
+			uint32_t* dst_row_end = a_pixel + spr_a.width;
+			while( a_pixel < dst_row_end )
+			{
+				if( *a_pixel < 0xFF000000 )
+				{
+					// The origin of a pixel is in its centre
+					int roundX = static_cast<int>(b_posx + 0.5f);
+					int roundY = static_cast<int>(b_posy + 0.5f);
+
+					// Clip within the sprite boundaries
+					if( roundX >= 0 && roundY >= 0 && roundX < spr_b.width && roundY < spr_b.height )
+					{
+						int b_pixel_index = roundX + (roundY * spr_b.canvasBuffer.width);
+						uint32_t* b_pixel = ((uint32_t*)spr_b.canvasBuffer.pPixels + b_pixel_index + b_frame_offset);
+						if( *b_pixel & 0xFF000000 )
+							overlapping_pixels++; // Could also overwite to visualise: *b_pixel = 0xFFFFFFFF, but need to call UpdateSprite afterwards.	
+					}
+				}
+
+				// Move one horizontal pixel in render target, which corresponds to the x axis of the inverse matrix in sprite space
+				a_pixel++;
+				b_posx += b_xincx;
+				b_posy += b_xincy;
+			}
+
+			// Move render target pointer to the start of the next row
+			a_pixel += spr_a.canvasBuffer.width - spr_a.width;
+
+			// Move sprite buffer pointer back to the start of the current row
+			b_posx -= b_xresetx;
+			b_posy -= b_xresety;
+
+			// One vertical pixel in the render target corresponds to the y axis of the inverse matrix in sprite space
+			b_posx += b_yincx;
+			b_posy += b_yincy;
+		}
+		return overlapping_pixels;
+	}
+
+	//********************************************************************************************************************************
+	// Function:	PreMultiplyAlpha - calculates the (src*srcAlpha) alpha blending calculation in advance as it doesn't change
+	// Parameters:	s = the sprite to pre-calculate data for
+	// Notes:		Also inverts the alpha ready for the (dest*(1-srcAlpha)) calculation and stores information in the new
+	//				buffer which provides the number of fully-transparent pixels in a row (so they can be skipped)
+	//********************************************************************************************************************************
+	void PreMultiplyAlpha( Pixel* source, Pixel* dest, int width, int height, int maxSkipWidth, float alphaMultiply = 1.0f, Pixel colourMultiply = 0x00FFFFFF )
+	{
+		ASSERT_GRAPHICS;
+
+		Pixel* pSourcePixels = source;
+		Pixel* pDestPixels = dest;
+
+		// Iterate through all the pixels in the entire canvas
+		for( int bh = 0; bh < height; bh++ )
+		{
+			for( int bw = 0; bw < width; bw++ )
+			{
+				Pixel src = *pSourcePixels;
+
+				// Separate the channels and calculate src*srcAlpha
+				int srcAlpha = static_cast<int>( ( src.bits >> 24 ) * alphaMultiply );
+
+				int destRed = ( srcAlpha * ( ( src.bits >> 16 ) & 0xFF ) ) >> 8;
+				int destGreen = ( srcAlpha * ( ( src.bits >> 8 ) & 0xFF ) ) >> 8;
+				int destBlue = ( srcAlpha * ( src.bits & 0xFF ) ) >> 8;
+
+				destRed = ( destRed * ( ( colourMultiply.bits >> 16 ) & 0xFF ) ) >> 8;
+				destGreen = ( destGreen * ( ( colourMultiply.bits >> 8 ) & 0xFF ) ) >> 8;
+				destBlue = ( destBlue * ( colourMultiply.bits & 0xFF ) ) >> 8;
+
+				srcAlpha = 0xFF - srcAlpha; // invert the alpha ready to multiply with the destination pixels
+				*pDestPixels = ( srcAlpha << 24 ) | ( destRed << 16 ) | ( destGreen << 8 ) | destBlue;
+
+				if( srcAlpha == 0xFF ) // Completely transparent pixel
+				{
+					int repeats = 0;
+					// We can only skip to the end of the row because the sprite frames are arranged on a continuous canvas
+					int maxSkip = maxSkipWidth - ( bw % maxSkipWidth );
+
+					for( int zw = 1; zw < maxSkip; zw++ )
+					{
+						if( ( pSourcePixels + zw )->bits >> 24 == 0x00 ) // Another transparent pixel
+							repeats++;
+						else
+							break;
+					}
+					*pDestPixels = 0xFF000000 | repeats; // Doesn't matter what the colour was so we use it to store the skip value
+				}
+				pDestPixels++;
+				pSourcePixels++;
+			}
+		}
+	}
+
+	//********************************************************************************************************************************
+	// Basic drawing functions
+	//********************************************************************************************************************************
+	void DrawPixel( Point2f pos, Pixel srcPix )
+	{
+		ASSERT_GRAPHICS;
+
+		if( IsRecording() )
+		{
+			DrawCommand& cmd = RecordDraw( DrawOp::PIXEL );
+			cmd.pos = pos;
+			cmd.pix = srcPix;
+			return;
+		}
+
+		pos.y = Window::GetHeight() - pos.y; //// Flip the y-coordinate to be consistant with a Cartesian co-ordinate system
+
+		// Convert floating point co-ordinates to pixels
+		switch (blendMode)
+		{
+		case BLEND_NORMAL:
+			// Convert floating point co-ordinates to pixels
+			Render::DrawPixelPreMult<Render::AlphaBlendPolicy>(static_cast<int>(pos.x + 0.5f), static_cast<int>(pos.y + 0.5f), srcPix);
+			break;
+		case BLEND_ADD:
+			// Convert floating point co-ordinates to pixels
+			Render::DrawPixelPreMult<Render::AdditiveBlendPolicy>(static_cast<int>(pos.x + 0.5f), static_cast<int>(pos.y + 0.5f), srcPix);
+			break;
+		case BLEND_MULTIPLY:
+			// Convert floating point co-ordinates to pixels
+			Render::DrawPixel<Render::MultiplyBlendPolicy>(static_cast<int>(pos.x + 0.5f), static_cast<int>(pos.y + 0.5f), srcPix);
+			break;
+		default:
+			PLAY_ASSERT_MSG(false, "Unsupported blend mode in PlayGraphics::DrawPixel")
+				break;
+		}
+	}
+
+	void DrawLine( Point2f startPos, Point2f endPos, Pixel pix )
+	{
+		ASSERT_GRAPHICS;
+
+		if( IsRecording() )
+		{
+			DrawCommand& cmd = RecordDraw( DrawOp::LINE );
+			cmd.pos = startPos;
+			cmd.pos2 = endPos;
+			cmd.pix = pix;
+			return;
+		}
+
+		// Convert floating point co-ordinates to pixels
+		int x1 = static_cast<int>( startPos.x + 0.5f );
+		int y1 = static_cast<int>( startPos.y + 0.5f );
+		int x2 = static_cast<int>( endPos.x + 0.5f );
+		int y2 = static_cast<int>( endPos.y + 0.5f );
+
+		Render::DrawLine( x1, y1, x2, y2, pix );
+	}
+
+	void DrawRect( Point2f bottomLeft, Point2f topRight, Pixel pix, bool fill /*= false */ )
+	{
+		ASSERT_GRAPHICS;
+
+		if( IsRecording() )
+		{
+			DrawCommand& cmd = RecordDraw( DrawOp::RECT );
+			cmd.pos = bottomLeft;
+			cmd.pos2 = topRight;
+			cmd.pix = pix;
+			cmd.fill = fill;
+			return;
+		}
+
+		// Convert floating point co-ordinates to pixels
+		int x1 = static_cast<int>( bottomLeft.x + 0.5f );
+		int x2 = static_cast<int>( topRight.x + 0.5f );
+		int y1 = static_cast<int>( bottomLeft.y + 0.5f );
+		int y2 = static_cast<int>( topRight.y + 0.5f );
+
+		if( fill )
+		{
+			for( int x = x1; x < x2; x++ )
+			{
+				for( int y = y1; y < y2; y++ )
+					DrawPixel({ x, y }, pix);
+			}
+		}
+		else
+		{
+			Render::DrawLine( x1, y1, x2, y1, pix );
+			Render::DrawLine( x2, y1, x2, y2, pix );
+			Render::DrawLine( x2, y2, x1, y2, pix );
+			Render::DrawLine( x1, y2, x1, y1, pix );
+		}
+	}
+
+	// Private function called by DrawCircle
+	void DrawCircleOctants( int posX, int posY, int offX, int offY, Pixel pix )
+	{
+		ASSERT_GRAPHICS;
+		DrawPixel( { posX + offX , posY + offY }, pix );
+		DrawPixel( { posX - offX , posY + offY }, pix );
+		DrawPixel( { posX + offX , posY - offY }, pix );
+		DrawPixel( { posX - offX , posY - offY }, pix );
+		DrawPixel( { posX - offY , posY + offX }, pix );
+		DrawPixel( { posX + offY , posY - offX }, pix );
+		DrawPixel( { posX - offY , posY - offX }, pix );
+		DrawPixel( { posX + offY , posY + offX }, pix );
+	}
+
+	void DrawCircle( Point2f pos, int radius, Pixel pix )
+	{
+		ASSERT_GRAPHICS;
+
+		if( IsRecording() )
+		{
+			DrawCommand& cmd = RecordDraw( DrawOp::CIRCLE );
+			cmd.pos = pos;
+			cmd.id = radius;
+			cmd.pix = pix;
+			return;
+		}
+
+		// Convert floating point co-ordinates to pixels
+		int x = static_cast<int>( pos.x + 0.5f );
+		int y = static_cast<int>( pos.y + 0.5f );
+
+		int dx = 0;
+		int dy = radius;
+
+		int d = 3 - 2 * radius;
+		DrawCircleOctants( x, y, dx, dy, pix );
+
+		while( dy >= dx )
+		{
+			dx++;
+			if( d > 0 )
+			{
+				dy--;
+				d = static_cast<int>( d + 4 * ( dx - dy ) + 10 );
+			}
+			else
+			{
+				d = static_cast<int>( d + 4 * dx + 6 );
+			}
+			DrawCircleOctants( x, y, dx, dy, pix );
+		}
+	};
+
+	void DrawPixelData( PixelData* pixelData, Point2f pos, float alpha )
+	{
+		ASSERT_GRAPHICS;
+		if( !pixelData->preMultiplied )
+		{
+			PreMultiplyAlpha( pixelData->pPixels, pixelData->pPixels, pixelData->width, pixelData->height, pixelData->width );
+			pixelData->preMultiplied = true;
+		}
+
+		if( IsRecording() )
+		{
+			DrawCommand& cmd = RecordDraw( DrawOp::PIXEL_DATA );
+			cmd.pixelData = *pixelData;
+			cmd.x = static_cast<int>( pos.x );
+			cmd.y = static_cast<int>( pos.y );
+			cmd.multiply = { alpha, 1.0f, 1.0f, 1.0f };
+			return;
+		}
+
+		Render::BlitPixels<Render::AlphaBlendPolicy>(*pixelData, 0, static_cast<int>(pos.x), static_cast<int>(pos.y), pixelData->width, pixelData->height, { alpha, 1.0f, 1.0f, 1.0f });
+	}
+
+	//********************************************************************************************************************************
+	// Debug font functions
+	//********************************************************************************************************************************
+
+	// Settings for the embedded debug font
+	#define FONT_IMAGE_WIDTH	96
+	#define FONT_IMAGE_HEIGHT	36
+	#define FONT_CHAR_WIDTH		6
+	#define FONT_CHAR_HEIGHT	12
+
+	// A 96x36 font image @ 1bpp containing basic ASCII characters from 0x30 (0) to 0x5F (underscore) at 6x12 pixels each
+	uint32_t debugFontData[] =
+	{
+		0x87304178, 0x0800861F, 0xFFFFFFE1, 0x7BBFBE79, 0xF7FE79EF, 0xFFFFFFFE, 0x7BBFBE79, 0xF7FE79EC, 0xFFFFFFFE, 0x7BBFBE79, 0xF7FE79EC, 0xFFFFFFFE, 0x7BBFBE79, 0xF7FE79EF, 0xFFEE3DFE, 0x6BB86080,	0x1078860F, 0xE3DFFEFE, 
+		0x5BB7FEFB, 0xE7BE7BEF, 0xFFBFFF41, 0x7BB7FEFB, 0xE7BE7BEC, 0xFFDFFEDF, 0x7BB7FEFB, 0xE7BE7BEC, 0xFFEE3DDF, 0x7BB7FEFB, 0xE7BE7BEF, 0xFFFFFFFF, 0x7BB7BEF9, 0xE7BE7BEF,	0xFFFFFFDF, 0x87B001F8, 0x187E87EF, 0xFFFFFFDF, 
+		0x86106104, 0x00007A30, 0x1E7C5061, 0x79E79E79, 0xF7DF7B7F, 0x5E7DA79E, 0x79E79F79, 0xF7DF7B7F, 0x5E7DA79E, 0x79E79F79, 0xF7DF7B7F, 0x5E7DA79E,	0x59E79F79, 0xF7DF7B7F, 0x597DA79E, 0x58005F78, 0x30D0037F, 0x477DA79E, 
+		0x59E79F79, 0xF7DE7B7F, 0x597DA79E, 0x59E79F79, 0xF7DE7B7F, 0x5E7DA79E, 0x41E79F79, 0xF7DE7B7F, 0x5E7DA79E, 0x7DE79F79,	0xF7DE7B7F, 0x5E7DA79E, 0x7DE79E79, 0xF7DE7B7F, 0x5E7DA79E, 0x81E06104, 0x07C17A38, 0xDE01A7A1, 
+		0x06106101, 0xE79E79E0, 0x337F3FFF, 0x79E79EED, 0xE79E79EF, 0xB77FBFFF, 0x79E79FED, 0xE79E79EF,	0xB7BFBFFF, 0x79E79FED, 0xE79A79EF, 0xB7BFBFFF, 0x79E75FED, 0xE79AB5EF, 0x77DFBFFF, 0x05E0E1ED, 0xE79ACC0E, 0xF7DFBFFF, 
+		0x7DE77EED, 0xE79AB7ED, 0xF7EFBFFF, 0x7DE7BEED, 0xE79A7BEB, 0xF7EFBFFF,	0x7DE7BEED, 0xE79A7BE7, 0xF7F7BFFF, 0x7DA7BEED, 0xE79A7BE7, 0xF7F7BCFF, 0x7DD79EED, 0xEB5A7BE7, 0xF7FBBCFF, 0x7C27A1EE, 0x1CE57810, 0x33FB3EC0
+	};
+
+	void DecompressDubugFont( void )
+	{
+		ASSERT_GRAPHICS;
+
+		m_pDebugFontBuffer = new uint8_t[FONT_IMAGE_WIDTH * FONT_IMAGE_HEIGHT];
+
+		for( int y = 0; y < FONT_IMAGE_HEIGHT; y++ )
+		{
+			for( int x = 0; x < FONT_IMAGE_WIDTH; x++ )
+			{
+				int bufferIndex = ( y * FONT_IMAGE_WIDTH ) + x;
+				int dataIndex = bufferIndex / 32;
+				int dataShift = 31 - ( bufferIndex % 32 );
+
+				// Convert 1bpp to an 8-bit array for easy data access
+				if( ( debugFontData[dataIndex] >> dataShift ) & 0x01 )
+					m_pDebugFontBuffer[( y * FONT_IMAGE_WIDTH ) + x] = 0; // not ARGB just 0 (no pixel)
+				else
+					m_pDebugFontBuffer[( y * FONT_IMAGE_WIDTH ) + x] = 1; // not ARGB just 1 (a pixel)
+			}
+		}
+	}
+
+	int DrawDebugCharacter( Point2f pos, char c, Pixel pix )
+	{
+		ASSERT_GRAPHICS;
+
+		if( IsRecording() )
+		{
+			DrawCommand& cmd = RecordDraw( DrawOp::DEBUG_CHARACTER );
+			cmd.pos = pos;
+			cmd.id = c;
+			cmd.pix = pix;
+			return FONT_CHAR_WIDTH;
+		}
+
+		// Limited character set in the font (0x30-0x5F) so includes translation of useful chars outside that range
+		switch( c )
+		{
+			case 0x2C: c = 0x5E; break; // Map full stop to comma (nearly the same!)
+			case 0x2D: c = 0x3B; break; // Map minus to semi-colon (rarely used)
+			case 0x28: c = 0x5B; break; // Map brackets to square brackets
+			case 0x29: c = 0x5D; break; // Map brackets to square brackets
+			case 0x2E: c = 0x5E; break; // Map full stop to carot (never used)
+		}
+
+		if( c < 0x30 || c > 0x5F )
+			return FONT_CHAR_WIDTH;
+
+		int sourceX = ( ( c - 0x30 ) % 16 ) * FONT_CHAR_WIDTH;
+		int sourceY = ( ( c - 0x30 ) / 16 ) * FONT_CHAR_HEIGHT;
+
+		// Loop over the bounding box of the glyph
+		for( int x = 0; x < FONT_CHAR_WIDTH; x++ )
+		{
+			for( int y = 0; y < FONT_CHAR_HEIGHT; y++ )
+			{
+				if( m_pDebugFontBuffer[( ( sourceY + y ) * FONT_IMAGE_WIDTH ) + ( sourceX + x )] > 0 )
+					DrawPixel( { pos.x + x, pos.y + (FONT_CHAR_HEIGHT - y - 1) }, pix ); 
+			}
+		}
+		return FONT_CHAR_WIDTH;
+	}
+
+	int DrawDebugString( Point2f pos, const std::string& s, Pixel pix, bool centred )
+	{
+		ASSERT_GRAPHICS;
+
+		if( m_pDebugFontBuffer == nullptr )
+			DecompressDubugFont();
+
+		if( centred )
+			pos.x -= GetDebugStringWidth( s ) / 2;
+
+		pos.y -= 6; // half the height of the debug font
+
+		for( char c : s )
+			pos.x += DrawDebugCharacter( pos, static_cast<char>( toupper( c ) ), pix ) + 1;
+
+		// Return horizontal position at the end of the string so strings can be concatenated easily
+		return static_cast<int>( pos.x );
+	}
+
+	int GetDebugStringWidth( const std::string& s )
+	{
+		ASSERT_GRAPHICS;
+		return static_cast<int>( s.length() ) * ( FONT_CHAR_WIDTH + 1 );
+	}
+
+	//********************************************************************************************************************************
+	// Miscellaneous functions
+	//********************************************************************************************************************************
+	PixelData* GetDrawingBuffer(void) 
+	{ 
+		ASSERT_GRAPHICS;
+		return &m_playBuffer; 
+	}
+
+	long long EndTimingSegment()
+	{
+		ASSERT_GRAPHICS;
+
+		int size = static_cast<int>( m_vTimings.size() );
+
+		long long now = Profile::GetTime();
+
+		if( size > 0 )
+		{
+			m_vTimings[size - 1].end = now;
+			m_vTimings[size - 1].millisecs = static_cast<float>( m_vTimings[size - 1].end - m_vTimings[size - 1].begin ) / 1000000.0f;
+		}
+		return now;
+	}
+
+	int SetTimingBarColour( Pixel pix )
+	{
+		ASSERT_GRAPHICS;
+
+		TimingSegment newData;
+		newData.pix = pix;
+		newData.begin = EndTimingSegment();
+
+		m_vTimings.push_back( newData );
+		Profile::BeginSegment( pix );
+
+		return static_cast<int>( m_vTimings.size() );
+	};
+
+	void DrawTimingBar( Point2f pos, Point2f size )
+	{
+		ASSERT_GRAPHICS;
+
+		// The segments go along the top row and the scopes below them, one row for each level of nesting
+		const Profile::FrameProfile& frame = Profile::GetLastFrame();
+		int thread = Profile::GetThreadIndex();
+		int segmentRows = 0;
+		int rows = 0;
+		for( const Profile::ProfileEvent& event : frame.vEvents )
+		{
+			if( event.thread != thread )
+				continue;
+			segmentRows = event.depth < 0 ? 1 : segmentRows;
+			rows = std::max( rows, event.depth + 1 );
+		}
+		rows += segmentRows;
+
+		// The bar's width is a frame at the rate the game is paced to, or the whole of the last frame if it isn't paced
+		int frameRate = Window::GetFrameRate();
+		double frameNs = frameRate > 0 ? 1000000000.0 / frameRate : static_cast<double>( frame.end - frame.begin );
+
+		for( const Profile::ProfileEvent& event : frame.vEvents )
+		{
+			if( event.thread != thread || frameNs <= 0.0 )
+				continue;
+
+			float left = static_cast<float>( std::clamp( ( event.begin - frame.begin ) / frameNs, 0.0, 1.0 ) ) * size.width;
+			float right = static_cast<float>( std::clamp( ( event.end - frame.begin ) / frameNs, 0.0, 1.0 ) ) * size.width;
+			int row = event.depth < 0 ? 0 : event.depth + segmentRows;
+			Pixel colour = event.depth < 0 ? Pixel( event.colour ) : GetScopeColour( event.name );
+			DrawRect( { pos.x + left, pos.y + ( size.height * row ) / rows }, { pos.x + right, pos.y + ( size.height * ( row + 1 ) ) / rows }, colour, true );
+		}
+
+		DrawRect( { pos.x, pos.y }, { pos.x + size.width, pos.y + size.height }, PIX_BLACK, false );
+		DrawRect( { pos.x - 1, pos.y - 1 }, { pos.x + size.width + 1 , pos.y + size.height + 1 }, PIX_WHITE, false );
+	}
+
+	float GetTimingSegmentDuration( int id )
+	{
+		ASSERT_GRAPHICS;
+		PLAY_ASSERT_MSG( static_cast<size_t>(id) < m_vTimings.size(), "Invalid id for timing data." );
+
+		// The current segment hasn't ended yet, so it's the time it's been going for
+		if( static_cast<size_t>( id ) == m_vTimings.size() - 1 )
+			EndTimingSegment();
+		return m_vTimings[id].millisecs;
+	}
+
+	void TimingBarBegin( Pixel pix )
+	{
+		ASSERT_GRAPHICS;
+		EndTimingSegment();
+		m_vTimings.clear();
+		SetTimingBarColour( pix );
+	}
+
+	Pixel GetScopeColour( const char* name )
+	{
+		static const Pixel palette[] = { PIX_RED, PIX_GREEN, PIX_BLUE, PIX_YELLOW, PIX_MAGENTA, PIX_CYAN, PIX_ORANGE, PIX_GREY };
+
+		uint32_t hash = 2166136261u;
+		for( const char* c = name; *c; c++ )
+			hash = ( hash ^ static_cast<uint8_t>( *c ) ) * 16777619u;
+		return palette[hash % ( sizeof( palette ) / sizeof( palette[0] ) )];
+	}
+
+	void ClearBuffer( Pixel colour )
+	{
+		ASSERT_GRAPHICS;
+
+		if( IsRecording() )
+		{
+			RecordDraw( DrawOp::CLEAR ).pix = colour;
+			return;
+		}
+
+		RestoreRenderTarget( { -1, colour.bits } );
+	}
+
+	//********************************************************************************************************************************
+	// Pipelined rendering functions
+	//********************************************************************************************************************************
+	void SetRenderLatency( int frames )
+	{
+		ASSERT_GRAPHICS;
+		PLAY_ASSERT_MSG( frames == 0 || frames == 1, "The render latency can only be 0 or 1 frames" );
+
+		if( frames == m_renderLatency )
+			return;
+
+		if( frames > 0 )
+		{
+			m_renderBuffer.width = m_playBuffer.width;
+			m_renderBuffer.height = m_playBuffer.height;
+			m_renderBuffer.pPixels = new Pixel[static_cast<size_t>( m_playBuffer.width ) * m_playBuffer.height];
+			// Anything already drawn this frame is in the display buffer, which is swapped with this one when the frame is presented
+			memcpy( m_renderBuffer.pPixels, m_playBuffer.pPixels, sizeof( Pixel ) * m_playBuffer.width * m_playBuffer.height );
+			m_bRenderPending = false;
+			m_bRenderQuit = false;
+			m_renderLatency = frames;
+			ResetDirtyRects();
+			m_renderThread = std::thread( RenderThread );
+			return;
+		}
+
+		// Finish the frame being rendered, then draw whatever has been recorded since straight into its pixels
+		{
+			std::unique_lock<std::mutex> lock( m_renderMutex );
+			m_bRenderQuit = true;
+		}
+		m_renderCondition.notify_all();
+		m_renderThread.join();
+		m_renderLatency = 0;
+
+		std::swap( m_playBuffer.pPixels, m_renderBuffer.pPixels );
+		ResetDirtyRects();
+		DrawCommandList( m_vDrawList );
+		m_vDrawList.clear();
+		m_vRenderList.clear();
+
+		delete[] m_renderBuffer.pPixels;
+		m_renderBuffer = PixelData{};
+	}
+
+	int GetRenderLatency()
+	{
+		return m_renderLatency;
+	}
+
+	double PresentFrame()
+	{
+		ASSERT_GRAPHICS;
+		PLAY_PROFILE_SCOPE( "PresentFrame" );
+
+		if( m_renderLatency == 0 )
+			return PresentBuffer( m_playBuffer );
+
+		std::chrono::steady_clock::time_point before = std::chrono::steady_clock::now();
+
+		WaitForRenderThread();
+
+		// The frame the render thread just finished becomes the drawing buffer, and its old pixels become the next back buffer
+		std::swap( m_playBuffer.pPixels, m_renderBuffer.pPixels );
+		m_vRenderList.swap( m_vDrawList );
+		m_vDrawList.clear();
+
+		{
+			std::unique_lock<std::mutex> lock( m_renderMutex );
+			m_bRenderPending = true;
+		}
+		m_renderCondition.notify_all();
+
+		return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - before ).count();
+	}
+
+	void WaitForRenderThread()
+	{
+		if( m_renderLatency == 0 )
+			return;
+
+		std::unique_lock<std::mutex> lock( m_renderMutex );
+		m_renderCondition.wait( lock, [] { return !m_bRenderPending; } );
+	}
+
+	DrawCommand& RecordDraw( DrawOp op )
+	{
+		DrawCommand& cmd = m_vDrawList.emplace_back();
+		cmd.op = op;
+		cmd.blend = blendMode;
+		return cmd;
+	}
+
+	void DrawCommandList( const std::vector<DrawCommand>& vList )
+	{
+		PLAY_PROFILE_SCOPE( "DrawCommandList" );
+		BlendMode oldBlendMode = blendMode;
+
+		for( const DrawCommand& cmd : vList )
+		{
+			blendMode = cmd.blend;
+
+			switch( cmd.op )
+			{
+				case DrawOp::CLEAR: RestoreRenderTarget( { -1, cmd.pix.bits } ); break;
+				case DrawOp::BACKGROUND: RestoreRenderTarget( { cmd.id, 0 } ); break;
+				case DrawOp::SPRITE: BlitSprite( m_vSpriteData[cmd.id], cmd.frameOffset, cmd.x, cmd.y, cmd.multiply ); break;
+				case DrawOp::SPRITE_TRANSFORMED: TransformSprite( m_vSpriteData[cmd.id], cmd.frameOffset, cmd.pos2, cmd.transform, cmd.multiply ); break;
+				case DrawOp::PIXEL: DrawPixel( cmd.pos, cmd.pix ); break;
+				case DrawOp::LINE: DrawLine( cmd.pos, cmd.pos2, cmd.pix ); break;
+				case DrawOp::RECT: DrawRect( cmd.pos, cmd.pos2, cmd.pix, cmd.fill ); break;
+				case DrawOp::CIRCLE: DrawCircle( cmd.pos, cmd.id, cmd.pix ); break;
+				case DrawOp::DEBUG_CHARACTER: DrawDebugCharacter( cmd.pos, static_cast<char>( cmd.id ), cmd.pix ); break;
+				case DrawOp::PIXEL_DATA:
+					Render::BlitPixels<Render::AlphaBlendPolicy>( cmd.pixelData, 0, cmd.x, cmd.y, cmd.pixelData.width, cmd.pixelData.height, cmd.multiply );
+					break;
+				case DrawOp::COLOUR_SPRITE: RecolourSprite( m_vSpriteData[cmd.id], cmd.pix ); break;
+			}
+		}
+
+		blendMode = oldBlendMode;
+	}
+
+	void RenderThread()
+	{
+		Profile::SetThreadName( "Render" );
+		Jobs::UseRenderQueue(); // Upscaling a present can use the job system
+		Render::SetRenderTarget( &m_renderBuffer );
+
+		std::unique_lock<std::mutex> lock( m_renderMutex );
+
+		while( true )
+		{
+			m_renderCondition.wait( lock, [] { return m_bRenderPending || m_bRenderQuit; } );
+
+			if( !m_bRenderPending )
+				break;
+
+			lock.unlock();
+
+			// Tracking can only be switched on or off between frames
+			Render::SetDirtyRects( &m_renderBuffer, m_bTrackDirtyRects ? &m_dirtyDrawn : nullptr );
+			Render::SetOverdrawMap( &m_renderBuffer, m_bShowOverdraw ? &m_overdrawMap : nullptr );
+
+			// Frames which don't start by covering the whole buffer carry on drawing over the last one, like they would without the render thread
+			bool bCovered = !m_vRenderList.empty() && ( m_vRenderList[0].op == DrawOp::CLEAR || m_vRenderList[0].op == DrawOp::BACKGROUND );
+			if( !bCovered )
+				memcpy( m_renderBuffer.pPixels, m_playBuffer.pPixels, sizeof( Pixel ) * m_renderBuffer.width * m_renderBuffer.height );
+
+			DrawCommandList( m_vRenderList );
+			PresentBuffer( m_renderBuffer );
+
+			lock.lock();
+			m_bRenderPending = false;
+			m_renderCondition.notify_all();
+		}
+	}
+
+	//********************************************************************************************************************************
+	// Dirty rectangle functions
+	//********************************************************************************************************************************
+	void SetDirtyRectTracking( bool enable )
+	{
+		ASSERT_GRAPHICS;
+		WaitForRenderThread();
+		m_bTrackDirtyRects = enable;
+		Render::SetDirtyRects( &m_playBuffer, enable ? &m_dirtyDrawn : nullptr );
+		ResetDirtyRects();
+	}
+
+	bool GetDirtyRectTracking()
+	{
+		return m_bTrackDirtyRects;
+	}
+
+	int GetDirtyPixelCount()
+	{
+		return m_dirtyPixelCount;
+	}
+
+	void ResetDirtyRects()
+	{
+		m_dirtyDrawn.Clear();
+		m_dirtyRestored.Clear();
+		m_dirtyRestored.Add( { 0, 0, m_playBuffer.width, m_playBuffer.height } );
+		m_bFrameCleared = false;
+		m_historyFrames = 0;
+	}
+
+	void RestoreRenderTarget( const ClearedTo& clearTo )
+	{
+		PixelData* pBackground = clearTo.backgroundId >= 0 ? &m_vBackgroundData[clearTo.backgroundId] : nullptr;
+		Pixel colour = clearTo.colour;
+
+		auto isSame = [&clearTo]( const ClearedTo& other ) { return other.backgroundId == clearTo.backgroundId && other.colour == clearTo.colour; };
+
+		if( !Render::IsTrackingDirtyRects() )
+		{
+			if( pBackground )
+				Render::BlitBackground( *pBackground );
+			else
+				Render::ClearRenderTarget( colour );
+			return;
+		}
+
+		// Everything which isn't dirty is already the right colour or background as long as the buffer was last cleared the same way,
+		// by this frame or the ones before (all of them before with the render thread, as it has a second buffer they drew into)
+		m_dirtyRestoring.Clear();
+		bool bPartial = false;
+
+		if( m_bFrameCleared )
+		{
+			bPartial = isSame( m_frameClearedTo );
+		}
+		else if( m_historyFrames > m_renderLatency && isSame( m_historyClearedTo ) )
+		{
+			bPartial = true;
+			for( int i = 0; i <= m_renderLatency; i++ )
+				m_dirtyRestoring.Add( m_dirtyHistory[i] );
+		}
+
+		if( bPartial )
+		{
+			m_dirtyRestoring.Add( m_dirtyDrawn );
+
+			for( const PixelRect& r : m_dirtyRestoring.GetRects() )
+			{
+				if( pBackground )
+					Render::BlitBackground( *pBackground, r );
+				else
+					Render::ClearRenderTarget( colour, r );
+			}
+
+			m_dirtyRestored.Add( m_dirtyRestoring );
+		}
+		else
+		{
+			if( pBackground )
+				Render::BlitBackground( *pBackground );
+			else
+				Render::ClearRenderTarget( colour );
+
+			m_dirtyRestored.Add( { 0, 0, Render::m_pRenderTarget->width, Render::m_pRenderTarget->height } );
+		}
+
+		m_dirtyDrawn.Clear();
+		m_bFrameCleared = true;
+		m_frameClearedTo = clearTo;
+	}
+
+	double PresentBuffer( const PixelData& buffer )
+	{
+		PLAY_PROFILE_SCOPE( "PresentBuffer" );
+
+		// The overdraw view is presented (and captured) instead of the frame, and its counts start again for the next one
+		const PixelData* pPresent = &buffer;
+		if( m_bShowOverdraw )
+		{
+			m_overdrawMap.DrawHeatMap( m_overdrawView );
+			m_overdrawMap.Clear();
+			pPresent = &m_overdrawView;
+		}
+
+		Capture::CaptureFrame( *pPresent );
+
+		// The frame was drawn on this thread, so its counters hold everything drawn since the last frame
+		{
+			std::lock_guard<std::mutex> lock( m_countersMutex );
+			m_frameCounters = Render::GetRenderCounters();
+		}
+		Render::ResetRenderCounters();
+
+		if( !m_bTrackDirtyRects )
+			return Window::Present( *pPresent );
+
+		// The window already shows the last frame, so only what this frame has put back or drawn over needs to be copied
+		m_dirtyPresent = m_dirtyRestored;
+		m_dirtyPresent.Add( m_dirtyDrawn );
+		m_dirtyPixelCount = m_dirtyPresent.GetPixelCount();
+
+		bool bSameAsHistory = m_historyClearedTo.backgroundId == m_frameClearedTo.backgroundId && m_historyClearedTo.colour == m_frameClearedTo.colour;
+		m_historyFrames = !m_bFrameCleared ? 0 : ( m_historyFrames > 0 && bSameAsHistory ) ? m_historyFrames + 1 : 1;
+		m_historyClearedTo = m_frameClearedTo;
+		m_dirtyHistory[1] = m_dirtyHistory[0];
+		m_dirtyHistory[0] = m_dirtyDrawn;
+
+		m_dirtyDrawn.Clear();
+		m_dirtyRestored.Clear();
+		m_bFrameCleared = false;
+
+		// Every pixel of the heat map can change, even where the frame didn't
+		if( m_bShowOverdraw )
+			return Window::Present( m_overdrawView );
+
+		return Window::Present( buffer, m_dirtyPresent.GetRects() );
+	}
+
+	//********************************************************************************************************************************
+	// Render counter functions
+	//********************************************************************************************************************************
+	Render::RenderCounters GetRenderCounters()
+	{
+		std::lock_guard<std::mutex> lock( m_countersMutex );
+		return m_frameCounters;
+	}
+
+	float GetOverdraw()
+	{
+		std::lock_guard<std::mutex> lock( m_countersMutex );
+		long long bufferPixels = static_cast<long long>( m_playBuffer.width ) * m_playBuffer.height;
+		return bufferPixels > 0 ? static_cast<float>( m_frameCounters.pixelsWritten + m_frameCounters.pixelsCleared ) / bufferPixels : 0.0f;
+	}
+
+	//********************************************************************************************************************************
+	// Overdraw view functions
+	//********************************************************************************************************************************
+	void SetOverdrawView( bool enable )
+	{
+		ASSERT_GRAPHICS;
+		WaitForRenderThread();
+
+		if( enable && !m_overdrawView.pPixels )
+		{
+			m_overdrawView.width = m_playBuffer.width;
+			m_overdrawView.height = m_playBuffer.height;
+			m_overdrawView.pPixels = new Pixel[static_cast<size_t>( m_playBuffer.width ) * m_playBuffer.height];
+			m_overdrawMap.Reset( m_playBuffer.width, m_playBuffer.height );
+		}
+
+		m_bShowOverdraw = enable;
+		m_overdrawMap.Clear();
+		Render::SetOverdrawMap( &m_playBuffer, enable ? &m_overdrawMap : nullptr );
+
+		// The window has to be presented in full to switch between the frames and the heat map
+		ResetDirtyRects();
+	}
+
+	bool GetOverdrawView()
+	{
+		return m_bShowOverdraw;
+	}
+}
+//********************************************************************************************************************************
+// File:		PlayAudio.cpp
+// Description:	Implementation of a very simple audio manager with a software mixer
+// Platform:	Independent (the XAudio2 sink and XWMA playback are Windows only)
+// Notes:		Uses WAV format (uncompressed, so audio file sizes can be large)
+//				All the PCM voices are mixed in software into stereo buses (music, sfx and ui, which feed the master bus), and
+//				the master bus is passed to an output sink. The sink decides when it needs more audio and calls MixAudio from
+//				its own thread to get it.
+//				The game thread never shares the voices with the mixer: it sends commands through a lock-free queue instead.
+//				PCM files over STREAMING_THRESHOLD_BYTES are read from disk a chunk at a time by a streaming thread.
+//				An offline sink lets the game drive the mix itself (RenderAudio), for tests and benchmarks without a device.
+//				Voice limits are checked by StartSound, which stops (steals) an existing voice when a sound is allowed to.
+//********************************************************************************************************************************
+
+
+using namespace std;
+
+#define ASSERT_AUDIO PLAY_ASSERT_MSG( Play::Audio::m_bCreated, "Audio Manager not initialised. Call Audio::CreateManager() before using the Play::Audio library functions.")
+
+namespace Play::Audio
+{
+	// Flag to record whether the manager has been created
+	bool m_bCreated = false;
+
+#ifndef PLAY_HEADLESS
+	// XAudio2 objects (created by the XAudio2 sink)
+	IXAudio2* m_pXAudio2 = nullptr;
+	IXAudio2MasteringVoice* m_pMasterVoice = nullptr;
+#else
+	// Headless builds don't have XAudio2, which works the same as XAudio2 failing to start: everything is mixed without being
+	// heard, and XWMA sounds (which only XAudio2 can decode) are silent. The WAV data is still described with XAudio2's types.
+	struct WAVEFORMATEX
+	{
+		uint16_t wFormatTag;
+		uint16_t nChannels;
+		uint32_t nSamplesPerSec;
+		uint32_t nAvgBytesPerSec;
+		uint16_t nBlockAlign;
+		uint16_t wBitsPerSample;
+		uint16_t cbSize;
+	};
+	struct WAVEFORMATEXTENSIBLE
+	{
+		WAVEFORMATEX Format;
+		uint16_t wValidBitsPerSample;
+		uint32_t dwChannelMask;
+		uint8_t SubFormat[16];
+	};
+	struct PCMWAVEFORMAT // The fields of WAVEFORMATEX up to wBitsPerSample
+	{
+		uint16_t wFormatTag;
+		uint16_t nChannels;
+		uint32_t nSamplesPerSec;
+		uint32_t nAvgBytesPerSec;
+		uint16_t nBlockAlign;
+		uint16_t wBitsPerSample;
+	};
+	constexpr uint16_t WAVE_FORMAT_WMAUDIO2 = 0x0161;
+	constexpr uint16_t WAVE_FORMAT_WMAUDIO3 = 0x0162;
+
+	struct XAUDIO2_BUFFER
+	{
+		uint32_t Flags;
+		uint32_t AudioBytes;
+		const uint8_t* pAudioData;
+		uint32_t PlayBegin;
+		uint32_t PlayLength;
+		uint32_t LoopBegin;
+		uint32_t LoopLength;
+		uint32_t LoopCount;
+		void* pContext;
+	};
+	struct XAUDIO2_BUFFER_WMA
+	{
+		const uint32_t* pDecodedPacketCumulativeBytes;
+		uint32_t PacketCount;
+	};
+	constexpr uint32_t XAUDIO2_END_OF_STREAM = 0x0040;
+#endif // PLAY_HEADLESS
+
+	// Each WAV file in the audio directory is loaded into a SoundEffect structure
+	struct SoundEffect
+	{
+		std::string fileAndPath;
+		const uint8_t* pMappedFile{ nullptr }; // The whole file, mapped into memory
+		size_t mappedBytes{ 0 }; // The size of the mapped file
+		uint8_t* pFileBuffer{ nullptr }; // Data which can't be played straight from the mapped file is kept in here instead
+		bool isXWMA = false;
+		XAUDIO2_BUFFER xAudio2Buffer{ 0 }; // Pointer to the WAV data within the mapped file
+		XAUDIO2_BUFFER_WMA xAudio2BufferWMA{ 0 }; // Pointer to XWMA data.
+		WAVEFORMATEXTENSIBLE format{ 0 }; 
+		// The 16-bit PCM samples used by the mixer (also within the mapped file, unless they've been copied)
+		const int16_t* pSamples{ nullptr };
+		int frameCount{ 0 };
+		int channels{ 0 };
+		int sampleRate{ 0 };
+		// Large sounds are streamed: only the first chunk is kept in memory (at pSamples) and the rest is read when needed
+		bool bStreamed{ false };
+		int64_t streamDataOffset{ 0 }; // Where the samples start in the file
+		// Compressed sounds are kept as ADPCM blocks (in the file buffer) instead of PCM samples
+		const uint8_t* pAdpcm{ nullptr };
+		int dataBytes{ 0 };
+		int memoryBytes{ 0 };
+		// The pool slots of the voices playing this sound, oldest first (linked through the VoiceSlots)
+		int firstVoiceSlot{ -1 };
+		int lastVoiceSlot{ -1 };
+		// How many voices the sound can have and how it competes with other sounds for them
+		int maxVoices{ 0 }; // 0 when there's no limit
+		int priority{ 0 };
+		VoiceSteal steal{ VoiceSteal::NONE };
+		AudioBus bus{ AudioBus::SFX };
+	};
+	std::vector< SoundEffect > m_vSoundEffects; // Vector of all the loaded sound effects
+
+	// Each name a sound has been asked for by is looked up once, then found again from its hash
+	struct SoundIndexEntry
+	{
+		std::string name; // Upper case, to check for two names with the same hash
+		int soundIndex{ -1 };
+	};
+	std::unordered_map< uint64_t, SoundIndexEntry > m_soundIndex;
+
+	// Voices come from a fixed size pool, so playing a sound never allocates
+	// > A voice id is its slot in the pool plus a generation count, so an old id never matches a newer sound in the same slot
+	constexpr int MAX_VOICES = 256;
+
+	// The mixer's state for a playing sound (only touched by the thread which calls MixAudio)
+	struct AudioVoice
+	{
+		int id{ -1 }; // -1 when the voice isn't playing
+		SoundEffect* pSoundEffect{ nullptr };
+		uint64_t position{ 0 }; // The position in the sound in frames, as 32.32 fixed point so the mix is exactly repeatable
+		float volume{ 1.0f };
+		float gain{ 1.0f }; // The volume at the end of the last quantum, which ramps towards the new volume
+		float freqMod{ 1.0f };
+		bool bLoop{ false };
+		int stream{ -1 }; // The stream which a streamed sound is read through
+		int64_t loopCount{ 0 }; // How many times a looping sound has been round (for finding the right streamed chunks)
+		AudioBus bus{ AudioBus::SFX };
+	};
+	AudioVoice m_voicePool[MAX_VOICES];
+	// The pool slots of the voices being mixed, in the order they were started (which is the order they are mixed in)
+	int m_activeVoices[MAX_VOICES];
+	int m_activeVoiceCount = 0;
+
+	// The game thread's view of each slot in the pool
+	struct VoiceSlot
+	{
+		int voiceId{ -1 }; // -1 when the slot is free
+		int generation{ 0 };
+		SoundEffect* pSoundEffect{ nullptr };
+		int prevSlot{ -1 }; // Neighbours in the sound effect's list of voices
+		int nextSlot{ -1 };
+#ifndef PLAY_HEADLESS
+		IXAudio2SourceVoice* pSourceVoice{ nullptr }; // Only used for XWMA sounds, which XAudio2 decodes and plays itself
+#endif
+		std::atomic<int> finishedVoiceId{ -1 }; // Set by the mixer (or XAudio2) when a sound plays to the end
+		uint64_t startOrder{ 0 }; // When the voice was started (counted in voices), for finding the oldest
+		float volume{ 1.0f }; // The volume last asked for, for finding the quietest
+	};
+	VoiceSlot m_voiceSlots[MAX_VOICES];
+	int m_nextVoiceSlot = 0; // Slots are reused in turn, so a finished one is left alone for as long as possible
+
+	// Voice limits and counters (only used by the game thread)
+	int m_maxVoices = MAX_VOICES;
+	int m_usedVoiceSlots = 0; // Includes voices which have finished but whose slots haven't been freed yet
+	uint64_t m_voicesStarted = 0;
+	int m_voicesRejected = 0;
+	int m_voicesStolen = 0;
+
+	// A fixed size queue between one producer thread and one consumer thread, which never blocks or allocates
+	template< typename T, int CAPACITY >
+	class SpscQueue
+	{
+	public:
+		static_assert( ( CAPACITY & ( CAPACITY - 1 ) ) == 0, "The queue capacity must be a power of two" );
+
+		// Adds an item from the producer thread, returns false if the queue is full
+		bool Push( const T& item )
+		{
+			uint32_t tail = m_tail.load( std::memory_order_relaxed );
+			if( tail - m_head.load( std::memory_order_acquire ) == CAPACITY )
+				return false;
+
+			m_items[tail & ( CAPACITY - 1 )] = item;
+			m_tail.store( tail + 1, std::memory_order_release );
+			return true;
+		}
+
+		// Removes an item from the consumer thread, returns false if the queue is empty
+		bool Pop( T& item )
+		{
+			uint32_t head = m_head.load( std::memory_order_relaxed );
+			if( head == m_tail.load( std::memory_order_acquire ) )
+				return false;
+
+			item = m_items[head & ( CAPACITY - 1 )];
+			m_head.store( head + 1, std::memory_order_release );
+			return true;
+		}
+
+		// Gets how many items can be pushed from the producer thread (the consumer can only add to this until the next Push)
+		int GetFreeSpace() const
+		{
+			return static_cast<int>( CAPACITY - ( m_tail.load( std::memory_order_relaxed ) - m_head.load( std::memory_order_acquire ) ) );
+		}
+
+		// Empties the queue (only while neither thread is using it)
+		void Clear()
+		{
+			m_head = 0;
+			m_tail = 0;
+		}
+
+	private:
+		alignas( 64 ) std::atomic<uint32_t> m_head{ 0 }; // The producer and consumer each write to their own cache line
+		alignas( 64 ) std::atomic<uint32_t> m_tail{ 0 };
+		T m_items[CAPACITY];
+	};
+
+	// Changes to the voices are passed from the game thread to the mixer as commands, so neither ever waits for the other
+	struct VoiceCommand
+	{
+		enum class Type
+		{
+			START,
+			STOP,
+			SET_VOLUME,
+			SET_PITCH,
+		};
+
+		Type type{ Type::START };
+		int voiceId{ -1 };
+		SoundEffect* pSoundEffect{ nullptr }; // START only
+		float volume{ 1.0f };
+		float freqMod{ 1.0f };
+		bool bLoop{ false };
+		AudioBus bus{ AudioBus::SFX }; // START only
+	};
+	SpscQueue< VoiceCommand, 1024 > m_voiceCommands;
+	constexpr int START_SOUND_COMMANDS = 3; // Starting a sound can stop two voices (its own limit and the global one) as well
+
+	// Streamed sounds are read a chunk at a time on the streaming thread, into a few buffers which each stream cycles through
+	// > The first chunk of each sound is always in memory, so a sound can start (and loop back round) without waiting
+	constexpr int MAX_STREAMS = 4;
+	constexpr int STREAM_CHUNK_FRAMES = 16384; // About a third of a second
+	constexpr int STREAM_CHUNKS = 3; // The mixer reads from up to two while the next one loads
+	constexpr int STREAM_MAX_CHANNELS = 2;
+
+	struct StreamChunk
+	{
+		std::atomic<bool> bReady{ false }; // Set by the streaming thread once loaded, cleared by the mixer when it's finished with it
+		int64_t sequence{ -1 }; // Which chunk it holds, counting through every loop of the sound
+		int16_t samples[STREAM_CHUNK_FRAMES * STREAM_MAX_CHANNELS];
+	};
+
+	struct AudioStream
+	{
+		enum State
+		{
+			IDLE, // Free for the mixer to use
+			PLAYING, // Being filled by the streaming thread
+			FAILED, // The file couldn't be read, so the mixer stops the voice
+			STOPPING, // Finished with by the mixer, waiting for the streaming thread to let go of it
+		};
+
+		std::atomic<int> state{ IDLE };
+		SoundEffect* pSoundEffect{ nullptr };
+		bool bLoop{ false };
+		int64_t nextSequence{ 0 }; // The next chunk to load (only used by the streaming thread)
+		std::ifstream file; // Only used by the streaming thread
+		StreamChunk chunks[STREAM_CHUNKS];
+	};
+	AudioStream m_streams[MAX_STREAMS];
+
+	std::thread m_streamingThread;
+	std::atomic<bool> m_bStreaming{ false };
+
+	std::atomic<int> m_statsStreamUnderruns{ 0 };
+	std::atomic<int> m_statsStreamFramesMissed{ 0 };
+	std::atomic<int> m_statsStreamChunksRead{ 0 };
+	std::atomic<int> m_statsStreamsRejected{ 0 };
+	std::atomic<int> m_statsStreamReadErrors{ 0 };
+
+	// Compressed sounds are split into blocks which can each be decoded on their own, the first sample of each is stored as is
+	// > Each block holds the header (first sample and step index) of each channel, then each channel's 4-bit codes in turn
+	constexpr int ADPCM_BLOCK_FRAMES = 256;
+	constexpr int ADPCM_MAX_CHANNELS = 2;
+	constexpr int ADPCM_CHANNEL_BYTES = 4 + ADPCM_BLOCK_FRAMES / 2; // The header, then a code for every sample after the first
+
+	// Each voice decodes the block it's playing into a cache, so a block is only decoded once however many quanta read it
+	struct AdpcmCache
+	{
+		int block{ -1 };
+		int16_t samples[ADPCM_BLOCK_FRAMES * ADPCM_MAX_CHANNELS];
+	};
+	AdpcmCache m_adpcmCaches[MAX_VOICES];
+
+	SoundStorage m_soundStorage = SoundStorage::PCM;
+
+	// The mixer works through the output a quantum at a time
+	constexpr int MIX_QUANTUM_FRAMES = 480; // 10ms
+	// Fractional bits of resampling positions within a quantum (leaves room for 192kHz sounds at double speed)
+	constexpr int MIX_FRACTION_BITS = 20;
+	// The fastest a sound can be played: the highest sample rate a WAV file can have, at the highest frequency ratio
+	constexpr int MAX_SOUND_SAMPLE_RATE = 192000;
+	constexpr float MAX_FREQ_MOD = 2.0f;
+	// The most source frames one voice can need for a quantum, including the taps either side for cubic resampling
+	constexpr int MIX_RESAMPLE_FRAMES = MIX_QUANTUM_FRAMES * ( MAX_SOUND_SAMPLE_RATE / MIX_SAMPLE_RATE ) * static_cast<int>( MAX_FREQ_MOD ) + 8;
+
+	// A bus's settings, which the game thread can change at any time and the mixer picks up at the start of each quantum
+	struct BusSettings
+	{
+		std::atomic<float> volume{ 1.0f };
+		std::atomic<int> duckSidechain{ -1 }; // The bus which ducks this one, -1 if it isn't ducked
+		std::atomic<float> duckThreshold{ 0.0f };
+		std::atomic<float> duckDepth{ 1.0f };
+		std::atomic<float> duckAttack{ 0.0f };
+		std::atomic<float> duckRelease{ 0.0f };
+		std::atomic<float> lowPassCutoff{ 0.0f };
+		std::atomic<float> reverbWet{ 0.0f };
+		std::atomic<float> reverbRoomSize{ 0.5f };
+		std::atomic<float> limiterCeiling{ 0.0f };
+	};
+	BusSettings m_busSettings[AUDIO_BUS_COUNT];
+
+	// The reverb is a small Freeverb: parallel damped comb filters into allpass filters, for each channel
+	// > The delays are in frames at 48kHz, and the right channel's are slightly longer to spread it across the stereo field
+	constexpr int REVERB_COMBS = 4; // The reverb's inner loop is written out for four combs
+	constexpr int REVERB_ALLPASSES = 2;
+	constexpr int REVERB_COMB_FRAMES[REVERB_COMBS] = { 1215, 1293, 1390, 1476 };
+	constexpr int REVERB_ALLPASS_FRAMES[REVERB_ALLPASSES] = { 605, 480 };
+	constexpr int REVERB_STEREO_SPREAD = 25;
+	constexpr int REVERB_CHANNEL_FRAMES = 1215 + 1293 + 1390 + 1476 + 605 + 480 + ( REVERB_COMBS + REVERB_ALLPASSES ) * REVERB_STEREO_SPREAD;
+
+	struct DelayLine
+	{
+		float* pBuffer{ nullptr };
+		int length{ 0 };
+		int position{ 0 };
+		float store{ 0.0f }; // The comb filters' damping filter
+	};
+
+	// The mixer's state for each bus (only touched by the thread which calls MixAudio)
+	struct MixBus
+	{
+		float samples[MIX_QUANTUM_FRAMES * MIX_CHANNELS];
+		bool bMixed{ false }; // Whether anything has been mixed into the samples this quantum
+		float gain{ 1.0f }; // The volume (with ducking) at the end of the last quantum
+		float duck{ 1.0f };
+		float level{ 0.0f }; // The peak level this quantum, for ducking other buses
+		// Low-pass biquad
+		float lowPassCutoff{ 0.0f };
+		float b0{ 1.0f }, b1{ 0.0f }, b2{ 0.0f }, a1{ 0.0f }, a2{ 0.0f };
+		float x1[MIX_CHANNELS]{}, x2[MIX_CHANNELS]{}, y1[MIX_CHANNELS]{}, y2[MIX_CHANNELS]{};
+		// Reverb
+		float reverbMemory[REVERB_CHANNEL_FRAMES * MIX_CHANNELS];
+		DelayLine combs[MIX_CHANNELS][REVERB_COMBS];
+		DelayLine allpasses[MIX_CHANNELS][REVERB_ALLPASSES];
+		bool bReverbRinging{ false };
+		// Limiter
+		float limiterGain{ 1.0f };
+	};
+	MixBus m_mixBuses[AUDIO_BUS_COUNT];
+
+	// Bus timings, collected until they are read by GetBusStats
+	std::atomic<int> m_statsBusQuanta{ 0 };
+	std::atomic<int64_t> m_statsBusNanoseconds[AUDIO_BUS_COUNT]{};
+
+	// Where the mixed audio goes
+	AudioSink* m_pSink = nullptr;
+	class OfflineSink* m_pOfflineSink = nullptr; // Set while the output is an offline sink
+	std::atomic<bool> m_bWaitForStreams{ false }; // Offline rendering waits for streamed chunks rather than playing silence
+
+	std::atomic<Resampler> m_resampler{ Resampler::LINEAR };
+
+	// Mixer timings, collected until they are read by GetMixerStats
+	std::atomic<int> m_statsVoiceQuanta{ 0 };
+	std::atomic<int> m_statsQuanta{ 0 };
+	std::atomic<int64_t> m_statsMixNanoseconds{ 0 };
+
+	// Internal (private) functions
+	bool LoadSoundEffect( std::string& filename, SoundEffect& sf );
+	const uint8_t* MapSoundFile( const std::string& filename, size_t& fileSize );
+	void UnmapSoundFile( const uint8_t* pFile, size_t fileSize );
+	int FindSoundEffect( const SoundKey& key );
+	int FindFreeVoiceSlot();
+	int FirstPlayingVoiceSlot( int slotIndex );
+	bool MakeRoomForVoice( SoundEffect& soundEffect );
+	bool IsBetterToSteal( const VoiceSlot& slot, const VoiceSlot& than, VoiceSteal steal );
+	void FreeFinishedVoiceSlots();
+	bool IsVoiceSlotPlaying( const VoiceSlot& slot );
+	void FreeVoiceSlot( VoiceSlot& slot );
+	bool SendVoiceCommand( VoiceCommand::Type type, int voiceId, float value );
+	void ApplyVoiceCommands();
+	void DestroyXAudio2Voices();
+	void ResetVoices();
+	void EndVoice( AudioVoice& voice );
+	void StreamingThread();
+	void FailStream( AudioStream& stream );
+	bool ParseWavFile( const uint8_t* pFile, size_t fileSize, SoundEffect& soundEffect );
+	const int16_t* GetStreamedFrames( const AudioVoice& voice, int64_t loop, int64_t frame );
+	void ReleaseStreamChunks( const AudioVoice& voice );
+	void CompressSoundEffect( SoundEffect& soundEffect );
+	const int16_t* GetDecodedFrames( const AudioVoice& voice, int64_t frame );
+	void WriteWavHeader( std::ostream& out, uint32_t frameCount );
+	void ResetBuses();
+	float GetBusGain( AudioBus bus );
+	void UpdateXWMAVolumes();
+	void ProcessBus( AudioBus bus, int frameCount );
+	void ApplyLowPass( MixBus& mixBus, float cutoffHz, int frameCount );
+	void ApplyReverb( MixBus& mixBus, float wet, float roomSize, int frameCount );
+	void ApplyLimiter( MixBus& mixBus, float ceiling, int frameCount );
+	
+#ifndef PLAY_HEADLESS
+	// An XAudio2 callback is required to find out when XWMA voices have finished playing
+	// > The buffer's context is the voice id, and the voice is destroyed later on by the game thread
+	class VoiceCallback : public IXAudio2VoiceCallback
+	{
+	public:
+		void STDMETHODCALLTYPE OnStreamEnd() override {}
+		void STDMETHODCALLTYPE OnVoiceProcessingPassEnd() override {}
+		void STDMETHODCALLTYPE OnVoiceProcessingPassStart( UINT32 ) override {}
+		void STDMETHODCALLTYPE OnBufferStart( void* ) override {}
+		void STDMETHODCALLTYPE OnLoopEnd( void* ) override {}
+		void STDMETHODCALLTYPE OnVoiceError( void*, HRESULT ) override {}
+		void STDMETHODCALLTYPE OnBufferEnd( void* pBufferContext ) override
+		{
+			int voiceId = static_cast<int>( reinterpret_cast<intptr_t>( pBufferContext ) );
+			m_voiceSlots[voiceId % MAX_VOICES].finishedVoiceId.store( voiceId, std::memory_order_release );
+		}
+	};
+
+	//********************************************************************************************************************************
+	// Output sinks
+	//********************************************************************************************************************************
+
+	// Plays the mix through XAudio2 using a single source voice, refilling each buffer as XAudio2 finishes with it
+	class XAudio2Sink : public AudioSink, public IXAudio2VoiceCallback
+	{
+	public:
+		bool Start() override
+		{
+			HRESULT hr = CoInitializeEx( nullptr, COINIT_MULTITHREADED );
+			if( FAILED( hr ) )
+				return false;
+
+			if( FAILED( XAudio2Create( &m_pXAudio2, 0, XAUDIO2_DEFAULT_PROCESSOR ) ) || FAILED( m_pXAudio2->CreateMasteringVoice( &m_pMasterVoice ) ) )
+			{
+				Release();
+				return false;
+			}
+
+			WAVEFORMATEX format{ 0 };
+			format.wFormatTag = WAVE_FORMAT_PCM;
+			format.nChannels = MIX_CHANNELS;
+			format.nSamplesPerSec = MIX_SAMPLE_RATE;
+			format.wBitsPerSample = 16;
+			format.nBlockAlign = MIX_CHANNELS * sizeof( int16_t );
+			format.nAvgBytesPerSec = MIX_SAMPLE_RATE * format.nBlockAlign;
+
+			if( FAILED( m_pXAudio2->CreateSourceVoice( &m_pOutputVoice, &format, 0u, 2.0f, this ) ) )
+			{
+				Release();
+				return false;
+			}
+
+			m_bStopping = false;
+			for( int i = 0; i < NUM_BUFFERS; i++ )
+				SubmitNextBuffer();
+
+			m_pOutputVoice->Start( 0 );
+			return true;
+		}
+
+		void Stop() override
+		{
+			m_bStopping = true;
+			Release();
+		}
+
+		void STDMETHODCALLTYPE OnStreamEnd() override {}
+		void STDMETHODCALLTYPE OnVoiceProcessingPassEnd() override {}
+		void STDMETHODCALLTYPE OnVoiceProcessingPassStart( UINT32 ) override {}
+		void STDMETHODCALLTYPE OnBufferStart( void* ) override {}
+		void STDMETHODCALLTYPE OnLoopEnd( void* ) override {}
+		void STDMETHODCALLTYPE OnVoiceError( void*, HRESULT ) override {}
+		void STDMETHODCALLTYPE OnBufferEnd( void* ) override { if( !m_bStopping ) SubmitNextBuffer(); }
+
+	private:
+		static constexpr int NUM_BUFFERS = 3; // Enough to cover the time it takes to mix the next one
+		int16_t m_buffers[NUM_BUFFERS][MIX_QUANTUM_FRAMES * MIX_CHANNELS];
+		int m_nextBuffer{ 0 };
+		IXAudio2SourceVoice* m_pOutputVoice{ nullptr };
+		std::atomic<bool> m_bStopping{ false };
+
+		void SubmitNextBuffer()
+		{
+			int16_t* pBuffer = m_buffers[m_nextBuffer];
+			m_nextBuffer = ( m_nextBuffer + 1 ) % NUM_BUFFERS;
+
+			MixAudio( pBuffer, MIX_QUANTUM_FRAMES );
+
+			XAUDIO2_BUFFER buffer{ 0 };
+			buffer.AudioBytes = sizeof( m_buffers[0] );
+			buffer.pAudioData = reinterpret_cast<const BYTE*>( pBuffer );
+			m_pOutputVoice->SubmitSourceBuffer( &buffer );
+		}
+
+		void Release()
+		{
+			// Destroying a voice waits for any callback which is running, so this mustn't be called with the voice mutex held
+			if( m_pOutputVoice )
+				m_pOutputVoice->DestroyVoice();
+			if( m_pMasterVoice )
+				m_pMasterVoice->DestroyVoice();
+			if( m_pXAudio2 )
+				m_pXAudio2->Release();
+
+			m_pOutputVoice = nullptr;
+			m_pMasterVoice = nullptr;
+			m_pXAudio2 = nullptr;
+		}
+	};
+#endif // PLAY_HEADLESS
+
+	// Mixes a quantum at a time on its own thread, paced by the clock to run at the same rate as a real device would
+	class TimedSink : public AudioSink
+	{
+	public:
+		bool Start() override
+		{
+			m_bRunning = true;
+			m_thread = std::thread( &TimedSink::Run, this );
+			return true;
+		}
+
+		void Stop() override
+		{
+			m_bRunning = false;
+			if( m_thread.joinable() )
+				m_thread.join();
+		}
+
+	protected:
+		// Called from the sink's thread with each quantum of mixed audio
+		virtual void Write( const int16_t*, int ) {}
+
+	private:
+		std::thread m_thread;
+		std::atomic<bool> m_bRunning{ false };
+
+		void Run()
+		{
+			int16_t buffer[MIX_QUANTUM_FRAMES * MIX_CHANNELS];
+			std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+
+			while( m_bRunning )
+			{
+				MixAudio( buffer, MIX_QUANTUM_FRAMES );
+				Write( buffer, MIX_QUANTUM_FRAMES );
+				next += std::chrono::microseconds( 1000000LL * MIX_QUANTUM_FRAMES / MIX_SAMPLE_RATE );
+				std::this_thread::sleep_until( next );
+			}
+		}
+	};
+
+	class NullSink : public TimedSink
+	{
+	};
+
+	class WavFileSink : public TimedSink
+	{
+	public:
+		WavFileSink( const char* filename ) : m_filename( filename ) {}
+
+		bool Start() override
+		{
+			m_file.open( m_filename, std::ios::binary );
+			if( !m_file.is_open() )
+				return false;
+
+			m_frameCount = 0;
+			WriteWavHeader( m_file, 0 ); // Filled in properly when the sink is stopped
+			return TimedSink::Start();
+		}
+
+		void Stop() override
+		{
+			TimedSink::Stop();
+			if( !m_file.is_open() )
+				return;
+
+			m_file.seekp( 0 );
+			WriteWavHeader( m_file, m_frameCount );
+			m_file.close();
+		}
+
+	protected:
+		void Write( const int16_t* pSamples, int frameCount ) override
+		{
+			m_file.write( reinterpret_cast<const char*>( pSamples ), frameCount * MIX_CHANNELS * sizeof( int16_t ) );
+			m_frameCount += frameCount;
+		}
+
+	private:
+		std::string m_filename;
+		std::ofstream m_file;
+		uint32_t m_frameCount{ 0 };
+	};
+
+	// Mixes only when asked to by RenderAudio, on the game thread
+	class OfflineSink : public AudioSink
+	{
+	public:
+		OfflineSink( const char* filename ) : m_filename( filename ? filename : "" ) {}
+
+		bool Start() override
+		{
+			if( !m_filename.empty() )
+			{
+				m_file.open( m_filename, std::ios::binary );
+				if( !m_file.is_open() )
+					return false;
+				WriteWavHeader( m_file, 0 ); // Filled in properly when the sink is stopped
+			}
+
+			m_pOfflineSink = this;
+			m_bWaitForStreams = true;
+			return true;
+		}
+
+		void Stop() override
+		{
+			m_pOfflineSink = nullptr;
+			m_bWaitForStreams = false;
+			if( !m_file.is_open() )
+				return;
+
+			m_file.seekp( 0 );
+			WriteWavHeader( m_file, m_fileFrameCount );
+			m_file.close();
+		}
+
+		void Render( int frameCount )
+		{
+			if( !m_file.is_open() )
+			{
+				size_t start = m_samples.size();
+				m_samples.resize( start + static_cast<size_t>( frameCount ) * MIX_CHANNELS );
+				MixAudio( m_samples.data() + start, frameCount );
+				return;
+			}
+
+			// Audio going to a file is mixed a quantum at a time, so a long render doesn't use any more memory
+			while( frameCount > 0 )
+			{
+				int frames = std::min( frameCount, MIX_QUANTUM_FRAMES );
+				MixAudio( m_buffer, frames );
+				m_file.write( reinterpret_cast<const char*>( m_buffer ), frames * MIX_CHANNELS * sizeof( int16_t ) );
+				m_fileFrameCount += frames;
+				frameCount -= frames;
+			}
+		}
+
+		std::vector< int16_t > m_samples;
+		double m_frameRemainder{ 0.0 }; // The part of a frame left over from the last RenderAudioFrame
+
+	private:
+		std::string m_filename;
+		std::ofstream m_file;
+		uint32_t m_fileFrameCount{ 0 };
+		int16_t m_buffer[MIX_QUANTUM_FRAMES * MIX_CHANNELS];
+	};
+
+	AudioSink* CreateNullSink()
+	{
+		return new NullSink;
+	}
+
+	AudioSink* CreateOfflineSink( const char* filename )
+	{
+		return new OfflineSink( filename );
+	}
+
+	AudioSink* CreateWavFileSink( const char* filename )
+	{
+		return new WavFileSink( filename );
+	}
+
+	bool SetOutputSink( AudioSink* pSink )
+	{
+		ASSERT_AUDIO;
+		PLAY_ASSERT_MSG( pSink, "Output sink can't be null: use CreateNullSink() for no output" );
+
+		// The old sink is stopped before the new one starts, as only one sink can be calling MixAudio (and XAudio2 sinks
+		// share the XAudio2 objects)
+		if( m_pSink )
+		{
+			// XWMA voices belong to XAudio2, which may be about to go
+			DestroyXAudio2Voices();
+			m_pSink->Stop();
+			delete m_pSink;
+		}
+
+		m_pSink = pSink;
+		if( m_pSink->Start() )
+			return true;
+
+		// Keep mixing without any output, so the game behaves the same
+		DebugOutput( "Unable to start the audio output sink: audio will be mixed but not heard\n" );
+		delete m_pSink;
+		m_pSink = CreateNullSink();
+		m_pSink->Start();
+		return false;
+	}
+
+	void RenderAudio( int frameCount )
+	{
+		ASSERT_AUDIO;
+		PLAY_ASSERT_MSG( m_pOfflineSink, "Audio can only be rendered through an offline sink: use SetOutputSink( CreateOfflineSink() )" );
+		PLAY_ASSERT_MSG( frameCount >= 0, "Can't render a negative number of frames" );
+		if( m_pOfflineSink && frameCount > 0 )
+			m_pOfflineSink->Render( frameCount );
+	}
+
+	void RenderAudioFrame( float elapsedTime )
+	{
+		ASSERT_AUDIO;
+		PLAY_ASSERT_MSG( m_pOfflineSink, "Audio can only be rendered through an offline sink: use SetOutputSink( CreateOfflineSink() )" );
+		if( !m_pOfflineSink )
+			return;
+
+		double frames = m_pOfflineSink->m_frameRemainder + static_cast<double>( elapsedTime ) * MIX_SAMPLE_RATE;
+		int frameCount = static_cast<int>( frames );
+		m_pOfflineSink->m_frameRemainder = frames - frameCount;
+		RenderAudio( frameCount );
+	}
+
+	const std::vector< int16_t >& GetRenderedAudio()
+	{
+		ASSERT_AUDIO;
+		PLAY_ASSERT_MSG( m_pOfflineSink, "Only an offline sink keeps the audio it renders" );
+		static const std::vector< int16_t > noAudio;
+		return m_pOfflineSink ? m_pOfflineSink->m_samples : noAudio;
+	}
+
+	void ClearRenderedAudio()
+	{
+		ASSERT_AUDIO;
+		PLAY_ASSERT_MSG( m_pOfflineSink, "Only an offline sink keeps the audio it renders" );
+		if( m_pOfflineSink )
+			m_pOfflineSink->m_samples.clear();
+	}
+
+	//********************************************************************************************************************************
+	// Create and Destroy functions
+	//********************************************************************************************************************************
+	bool CreateManager( const char* path, SoundStorage storage )
+	{
+		PLAY_ASSERT_MSG( !m_bCreated, "Audio manager has already been created!" );
+		m_soundStorage = storage;
+		m_maxVoices = MAX_VOICES;
+		m_voicesRejected = 0;
+		m_voicesStolen = 0;
+		ResetBuses();
+
+		// Does the Audio folder exist?
+		if (std::filesystem::is_directory(path)) {
+
+			// Iterate through the directory loading all the sound effects
+			for( auto& p : std::filesystem::directory_iterator( path ) )
+			{
+				// Switch everything to uppercase to avoid need to check case each time
+				std::string filename = p.path().string();
+				for( char& c : filename ) c = static_cast<char>(toupper( c ));
+
+				// Only load .wav files
+				if( filename.find( ".WAV" ) != std::string::npos )
+				{
+					SoundEffect soundEffect;
+					std::string fileAndPath = p.path().string();
+					if( LoadSoundEffect( fileAndPath, soundEffect ) )
+						m_vSoundEffects.push_back( soundEffect );
+				}
+			}
+		}
+
+		// Streamed sounds are read in on their own thread, so the mixer never waits for the disk
+		if( std::any_of( m_vSoundEffects.begin(), m_vSoundEffects.end(), []( const SoundEffect& sfx ) { return sfx.bStreamed; } ) )
+		{
+			m_bStreaming = true;
+			m_streamingThread = std::thread( StreamingThread );
+		}
+
+		// Play through XAudio2 if possible, otherwise keep mixing without any output so the game behaves the same
+#ifndef PLAY_HEADLESS
+		m_pSink = new XAudio2Sink;
+		if( !m_pSink->Start() )
+		{
+			DebugOutput( "Unable to start XAudio2: audio will be mixed but not heard\n" );
+			delete m_pSink;
+			m_pSink = CreateNullSink();
+			m_pSink->Start();
+		}
+#else
+		m_pSink = CreateNullSink();
+		m_pSink->Start();
+#endif
+
+		m_bCreated = true;
+		return true;
+	}
+
+	bool DestroyManager( void )
+	{
+		ASSERT_AUDIO;
+
+		// XWMA voices belong to XAudio2, which the sink is about to close down
+		DestroyXAudio2Voices();
+
+		// Stop the output (this also closes down XAudio2)
+		m_pSink->Stop();
+		delete m_pSink;
+		m_pSink = nullptr;
+
+		m_bStreaming = false;
+		if( m_streamingThread.joinable() )
+			m_streamingThread.join();
+
+		// Nothing is mixing or streaming any more, so the voices can be cleared directly
+		ResetVoices();
+
+		// Delete all the sound effects
+		for( SoundEffect& soundEffect : m_vSoundEffects )
+		{
+			delete[] soundEffect.pFileBuffer;
+			if( soundEffect.pMappedFile )
+				UnmapSoundFile( soundEffect.pMappedFile, soundEffect.mappedBytes ); // The XAudio2Buffer is within the mapped file
+		}
+		m_vSoundEffects.clear();
+		m_soundIndex.clear();
+
+		m_bCreated = false;
+		return true;
+	}
+
+	//********************************************************************************************************************************
+	// Sound playing functions
+	//********************************************************************************************************************************
+	int StartSound( SoundKey name, bool bLoop, float volume ,float freqMod )
+	{
+		ASSERT_AUDIO;
+
+		int soundIndex = FindSoundEffect( name );
+		PLAY_ASSERT_MSG( soundIndex != -1, std::string( "Trying to play unknown sound effect: " + std::string( name.name ) + "\nTry checking the 'Audio' folder").c_str());
+		if( soundIndex == -1 )
+			return -1;
+
+		// Every command the sound could need must fit before a voice is stolen for it, or the stolen voice would be lost for nothing
+		if( m_voiceCommands.GetFreeSpace() < START_SOUND_COMMANDS )
+		{
+			m_voicesRejected++;
+			return -1; // The mixer has fallen behind
+		}
+
+		SoundEffect& soundEffect = m_vSoundEffects[soundIndex];
+		int slotIndex = MakeRoomForVoice( soundEffect ) ? FindFreeVoiceSlot() : -1;
+		if( slotIndex == -1 )
+		{
+			m_voicesRejected++;
+			return -1; // Over the sound's limit, or all the voices are in use
+		}
+
+		// Generations start from 1 so that voice ids are never negative
+		VoiceSlot& slot = m_voiceSlots[slotIndex];
+		int generation = slot.generation % ( INT_MAX / MAX_VOICES - 1 ) + 1;
+		int voiceId = generation * MAX_VOICES + slotIndex;
+
+		// The mixer only handles PCM, so XWMA sounds are given their own XAudio2 voice (and are silent without one)
+#ifndef PLAY_HEADLESS
+		if( soundEffect.isXWMA && m_pXAudio2 )
+		{
+			static VoiceCallback voiceCallback;
+			m_pXAudio2->CreateSourceVoice( &slot.pSourceVoice, (WAVEFORMATEX*)&soundEffect.format, 0u, 2.0f, &voiceCallback );
+			soundEffect.xAudio2Buffer.pContext = reinterpret_cast<void*>( static_cast<intptr_t>( voiceId ) );
+			soundEffect.xAudio2Buffer.LoopCount = bLoop ? XAUDIO2_LOOP_INFINITE : 0;
+			slot.pSourceVoice->SubmitSourceBuffer( &soundEffect.xAudio2Buffer, &soundEffect.xAudio2BufferWMA );
+			slot.pSourceVoice->SetVolume( volume * GetBusGain( soundEffect.bus ) );
+			slot.pSourceVoice->SetFrequencyRatio( freqMod );
+			slot.pSourceVoice->Start( 0 );
+		}
+		else
+#endif // PLAY_HEADLESS
+		{
+			VoiceCommand command;
+			command.type = VoiceCommand::Type::START;
+			command.voiceId = voiceId;
+			command.pSoundEffect = &soundEffect;
+			command.volume = volume;
+			command.freqMod = freqMod;
+			command.bLoop = bLoop;
+			command.bus = soundEffect.bus;
+
+			// There was room for this before any voices were stolen
+			bool bPushed = m_voiceCommands.Push( command );
+			PLAY_ASSERT_MSG( bPushed, "The voice command queue filled up while starting a sound" );
+		}
+
+		slot.voiceId = voiceId;
+		slot.generation = generation;
+		slot.pSoundEffect = &soundEffect;
+		slot.startOrder = m_voicesStarted++;
+		slot.volume = volume;
+		m_usedVoiceSlots++;
+
+		// Add the voice to the end of the sound effect's list
+		slot.prevSlot = soundEffect.lastVoiceSlot;
+		slot.nextSlot = -1;
+		if( soundEffect.lastVoiceSlot != -1 )
+			m_voiceSlots[soundEffect.lastVoiceSlot].nextSlot = slotIndex;
+		else
+			soundEffect.firstVoiceSlot = slotIndex;
+		soundEffect.lastVoiceSlot = slotIndex;
+
+		return voiceId;
+	}
+
+	bool StopSound( int voiceId )
+	{
+		ASSERT_AUDIO;
+
+		// Only stop audio voices that exist!
+		if( voiceId < 0 )
+			return false;
+		VoiceSlot& slot = m_voiceSlots[voiceId % MAX_VOICES];
+		if( slot.voiceId != voiceId || !IsVoiceSlotPlaying( slot ) )
+			return false;
+
+#ifndef PLAY_HEADLESS
+		if( !slot.pSourceVoice && !SendVoiceCommand( VoiceCommand::Type::STOP, voiceId, 0.0f ) )
+#else
+		if( !SendVoiceCommand( VoiceCommand::Type::STOP, voiceId, 0.0f ) )
+#endif
+			return false;
+
+		FreeVoiceSlot( slot );
+		return true;
+	}
+
+	bool StopSound( SoundKey name )
+	{
+		ASSERT_AUDIO;
+
+		int soundIndex = FindSoundEffect( name );
+		if( soundIndex == -1 )
+			return false;
+
+		int slotIndex = FirstPlayingVoiceSlot( m_vSoundEffects[soundIndex].firstVoiceSlot );
+		return slotIndex != -1 && StopSound( m_voiceSlots[slotIndex].voiceId );
+	}
+
+	void SetLoopingSoundVolume( SoundKey name, float volume )
+	{
+		ASSERT_AUDIO;
+
+		int soundIndex = FindSoundEffect( name );
+		if( soundIndex == -1 )
+			return;
+
+		// Only the voices playing this sound are visited
+		for( int slotIndex = FirstPlayingVoiceSlot( m_vSoundEffects[soundIndex].firstVoiceSlot ); slotIndex != -1; slotIndex = FirstPlayingVoiceSlot( m_voiceSlots[slotIndex].nextSlot ) )
+			SetLoopingSoundVolume( m_voiceSlots[slotIndex].voiceId, volume );
+	}
+
+	void SetLoopingSoundVolume(int voiceId, float volume)
+	{
+		ASSERT_AUDIO;
+
+		// Try and find the voice to see if it exists
+		if( voiceId < 0 )
+			return;
+		VoiceSlot& slot = m_voiceSlots[voiceId % MAX_VOICES];
+		if( slot.voiceId != voiceId || !IsVoiceSlotPlaying( slot ) )
+			return;
+
+#ifndef PLAY_HEADLESS
+		if( slot.pSourceVoice )
+			slot.pSourceVoice->SetVolume( volume * GetBusGain( slot.pSoundEffect->bus ) );
+		else
+#endif
+		if( !SendVoiceCommand( VoiceCommand::Type::SET_VOLUME, voiceId, volume ) )
+			return;
+		slot.volume = volume;
+	}
+
+	void SetLoopingSoundPitch( SoundKey name, float freqMod )
+	{
+		ASSERT_AUDIO;
+
+		int soundIndex = FindSoundEffect( name );
+		if( soundIndex == -1 )
+			return;
+
+		// Only the voices playing this sound are visited
+		for( int slotIndex = FirstPlayingVoiceSlot( m_vSoundEffects[soundIndex].firstVoiceSlot ); slotIndex != -1; slotIndex = FirstPlayingVoiceSlot( m_voiceSlots[slotIndex].nextSlot ) )
+			SetLoopingSoundPitch( m_voiceSlots[slotIndex].voiceId, freqMod );
+	}
+
+	void SetLoopingSoundPitch(int voiceId, float freqMod)
+	{
+		ASSERT_AUDIO;
+
+		// Try and find the voice to see if it exists
+		if( voiceId < 0 )
+			return;
+		VoiceSlot& slot = m_voiceSlots[voiceId % MAX_VOICES];
+		if( slot.voiceId != voiceId || !IsVoiceSlotPlaying( slot ) )
+			return;
+
+#ifndef PLAY_HEADLESS
+		if( slot.pSourceVoice )
+			slot.pSourceVoice->SetFrequencyRatio( freqMod );
+		else
+#endif
+			SendVoiceCommand( VoiceCommand::Type::SET_PITCH, voiceId, freqMod );
+	}
+
+	void SetSoundVoiceLimit( SoundKey name, int maxVoices, int priority, VoiceSteal steal )
+	{
+		ASSERT_AUDIO;
+		PLAY_ASSERT_MSG( maxVoices >= 0, "A sound's voice limit can't be negative" );
+
+		int soundIndex = FindSoundEffect( name );
+		PLAY_ASSERT_MSG( soundIndex != -1, std::string( "Trying to limit unknown sound effect: " + std::string( name.name ) ).c_str() );
+		if( soundIndex == -1 )
+			return;
+
+		SoundEffect& soundEffect = m_vSoundEffects[soundIndex];
+		soundEffect.maxVoices = maxVoices;
+		soundEffect.priority = priority;
+		soundEffect.steal = steal;
+	}
+
+	void SetMaxVoices( int maxVoices )
+	{
+		ASSERT_AUDIO;
+		PLAY_ASSERT_MSG( maxVoices > 0 && maxVoices <= MAX_VOICES, "The voice limit must be between 1 and MAX_VOICES" );
+		m_maxVoices = std::clamp( maxVoices, 1, MAX_VOICES );
+	}
+
+	VoiceStats GetVoiceStats()
+	{
+		ASSERT_AUDIO;
+		FreeFinishedVoiceSlots();
+
+		VoiceStats stats;
+		stats.voicesPlaying = m_usedVoiceSlots;
+		stats.voicesRejected = m_voicesRejected;
+		stats.voicesStolen = m_voicesStolen;
+		return stats;
+	}
+
+	//********************************************************************************************************************************
+	// Voice functions
+	//********************************************************************************************************************************
+
+	int FindSoundEffect( const SoundKey& key )
+	{
+		// Compares two names ignoring case, without making upper case copies
+		auto SameLetter = []( char a, char b ) { return toupper( a ) == toupper( b ); };
+
+		std::unordered_map< uint64_t, SoundIndexEntry >::iterator i = m_soundIndex.find( key.hash );
+		if( i != m_soundIndex.end() && std::equal( i->second.name.begin(), i->second.name.end(), key.name, key.name + strlen( key.name ), SameLetter ) )
+			return i->second.soundIndex;
+
+		// The first sound with the name anywhere in its path, as it has always been
+		int soundIndex = -1;
+		for( int s = 0; s < static_cast<int>( m_vSoundEffects.size() ); s++ )
+		{
+			const std::string& path = m_vSoundEffects[s].fileAndPath;
+			if( std::search( path.begin(), path.end(), key.name, key.name + strlen( key.name ), SameLetter ) != path.end() )
+			{
+				soundIndex = s;
+				break;
+			}
+		}
+
+		// Remember the answer, unless another name already has the same hash (which is too unlikely to be worth handling)
+		if( soundIndex != -1 && i == m_soundIndex.end() )
+		{
+			SoundIndexEntry entry;
+			entry.name = key.name;
+			for( char& c : entry.name ) c = static_cast<char>( toupper( c ) );
+			entry.soundIndex = soundIndex;
+			m_soundIndex.emplace( key.hash, entry );
+		}
+
+		return soundIndex;
+	}
+
+	int FindFreeVoiceSlot()
+	{
+		for( int n = 0; n < MAX_VOICES; n++ )
+		{
+			int slotIndex = ( m_nextVoiceSlot + n ) % MAX_VOICES;
+			VoiceSlot& slot = m_voiceSlots[slotIndex];
+			if( IsVoiceSlotPlaying( slot ) )
+				continue;
+
+			FreeVoiceSlot( slot ); // Tidies up after a sound which has played to the end
+			m_nextVoiceSlot = ( slotIndex + 1 ) % MAX_VOICES;
+			return slotIndex;
+		}
+		return -1;
+	}
+
+	int FirstPlayingVoiceSlot( int slotIndex )
+	{
+		// Voices which have played to the end are taken off the list on the way past
+		while( slotIndex != -1 && !IsVoiceSlotPlaying( m_voiceSlots[slotIndex] ) )
+		{
+			int nextSlot = m_voiceSlots[slotIndex].nextSlot;
+			FreeVoiceSlot( m_voiceSlots[slotIndex] );
+			slotIndex = nextSlot;
+		}
+		return slotIndex;
+	}
+
+	bool MakeRoomForVoice( SoundEffect& soundEffect )
+	{
+		// Keep within the sound's own limit by stealing one of its voices (its list only holds playing voices once it's been walked)
+		if( soundEffect.maxVoices > 0 )
+		{
+			int voiceCount = 0;
+			int stealSlot = -1;
+			for( int slotIndex = FirstPlayingVoiceSlot( soundEffect.firstVoiceSlot ); slotIndex != -1; slotIndex = FirstPlayingVoiceSlot( m_voiceSlots[slotIndex].nextSlot ) )
+			{
+				voiceCount++;
+				if( stealSlot == -1 || IsBetterToSteal( m_voiceSlots[slotIndex], m_voiceSlots[stealSlot], soundEffect.steal ) )
+					stealSlot = slotIndex;
+			}
+
+			if( voiceCount >= soundEffect.maxVoices )
+			{
+				if( soundEffect.steal == VoiceSteal::NONE || voiceCount > soundEffect.maxVoices || !StopSound( m_voiceSlots[stealSlot].voiceId ) )
+					return false;
+				m_voicesStolen++;
+			}
+		}
+
+		// Keep within the global limit by stealing a voice from a sound with the same or a lower priority
+		if( m_usedVoiceSlots >= m_maxVoices )
+			FreeFinishedVoiceSlots();
+		if( m_usedVoiceSlots >= m_maxVoices )
+		{
+			if( soundEffect.steal == VoiceSteal::NONE || m_usedVoiceSlots > m_maxVoices )
+				return false;
+
+			int stealSlot = -1;
+			for( int slotIndex = 0; slotIndex < MAX_VOICES; slotIndex++ )
+			{
+				const VoiceSlot& slot = m_voiceSlots[slotIndex];
+				if( slot.voiceId == -1 || slot.pSoundEffect->priority > soundEffect.priority )
+					continue;
+				if( stealSlot == -1 || IsBetterToSteal( slot, m_voiceSlots[stealSlot], soundEffect.steal ) )
+					stealSlot = slotIndex;
+			}
+
+			if( stealSlot == -1 || !StopSound( m_voiceSlots[stealSlot].voiceId ) )
+				return false;
+			m_voicesStolen++;
+		}
+
+		return true;
+	}
+
+	bool IsBetterToSteal( const VoiceSlot& slot, const VoiceSlot& than, VoiceSteal steal )
+	{
+		// Lower priority sounds go first, then the quietest (if that's the policy), then the oldest
+		if( slot.pSoundEffect->priority != than.pSoundEffect->priority )
+			return slot.pSoundEffect->priority < than.pSoundEffect->priority;
+		if( steal == VoiceSteal::QUIETEST && slot.volume != than.volume )
+			return slot.volume < than.volume;
+		return slot.startOrder < than.startOrder;
+	}
+
+	void FreeFinishedVoiceSlots()
+	{
+		for( VoiceSlot& slot : m_voiceSlots )
+		{
+			if( slot.voiceId != -1 && !IsVoiceSlotPlaying( slot ) )
+				FreeVoiceSlot( slot );
+		}
+	}
+
+	bool IsVoiceSlotPlaying( const VoiceSlot& slot )
+	{
+		return slot.voiceId != -1 && slot.finishedVoiceId.load( std::memory_order_acquire ) != slot.voiceId;
+	}
+
+	void FreeVoiceSlot( VoiceSlot& slot )
+	{
+#ifndef PLAY_HEADLESS
+		if( slot.pSourceVoice )
+		{
+			slot.pSourceVoice->Stop();
+			slot.pSourceVoice->FlushSourceBuffers();
+			slot.pSourceVoice->DestroyVoice();
+			slot.pSourceVoice = nullptr;
+		}
+#endif
+
+		// Take it out of the sound effect's list of voices
+		if( slot.pSoundEffect )
+		{
+			if( slot.prevSlot != -1 )
+				m_voiceSlots[slot.prevSlot].nextSlot = slot.nextSlot;
+			else
+				slot.pSoundEffect->firstVoiceSlot = slot.nextSlot;
+			if( slot.nextSlot != -1 )
+				m_voiceSlots[slot.nextSlot].prevSlot = slot.prevSlot;
+			else
+				slot.pSoundEffect->lastVoiceSlot = slot.prevSlot;
+		}
+
+		if( slot.voiceId != -1 )
+			m_usedVoiceSlots--;
+
+		slot.voiceId = -1;
+		slot.pSoundEffect = nullptr;
+		slot.prevSlot = -1;
+		slot.nextSlot = -1;
+	}
+
+	bool SendVoiceCommand( VoiceCommand::Type type, int voiceId, float value )
+	{
+		VoiceCommand command;
+		command.type = type;
+		command.voiceId = voiceId;
+		command.volume = value;
+		command.freqMod = value;
+		return m_voiceCommands.Push( command );
+	}
+
+	void ApplyVoiceCommands()
+	{
+		VoiceCommand command;
+		while( m_voiceCommands.Pop( command ) )
+		{
+			int slotIndex = command.voiceId % MAX_VOICES;
+			AudioVoice& voice = m_voicePool[slotIndex];
+
+			if( command.type == VoiceCommand::Type::START )
+			{
+				if( voice.id == -1 )
+					m_activeVoices[m_activeVoiceCount++] = slotIndex;
+				else
+					EndVoice( voice );
+
+				voice.id = command.voiceId;
+				voice.pSoundEffect = command.pSoundEffect;
+				voice.position = 0;
+				voice.volume = command.volume;
+				voice.gain = command.volume;
+				voice.freqMod = command.freqMod;
+				voice.bLoop = command.bLoop;
+				voice.loopCount = 0;
+				voice.bus = command.bus;
+				m_adpcmCaches[slotIndex].block = -1;
+
+				// A streamed sound needs a stream to read through (without one it finishes straight away)
+				if( voice.pSoundEffect->bStreamed )
+				{
+					for( int s = 0; s < MAX_STREAMS && voice.stream == -1; s++ )
+					{
+						AudioStream& stream = m_streams[s];
+						if( stream.state.load( std::memory_order_acquire ) != AudioStream::IDLE )
+							continue;
+
+						stream.pSoundEffect = voice.pSoundEffect;
+						stream.bLoop = voice.bLoop;
+						stream.nextSequence = 1; // The first chunk is already in memory
+						for( StreamChunk& chunk : stream.chunks )
+							chunk.bReady.store( false, std::memory_order_relaxed );
+						stream.state.store( AudioStream::PLAYING, std::memory_order_release );
+						voice.stream = s;
+					}
+
+					if( voice.stream == -1 )
+						m_statsStreamsRejected.fetch_add( 1, std::memory_order_relaxed );
+				}
+				continue;
+			}
+
+			// The voice may have finished playing since the command was sent
+			if( voice.id != command.voiceId )
+				continue;
+
+			switch( command.type )
+			{
+				case VoiceCommand::Type::STOP:
+					EndVoice( voice );
+					m_activeVoiceCount = static_cast<int>( std::remove( m_activeVoices, m_activeVoices + m_activeVoiceCount, slotIndex ) - m_activeVoices );
+					break;
+				case VoiceCommand::Type::SET_VOLUME:
+					voice.volume = command.volume;
+					break;
+				case VoiceCommand::Type::SET_PITCH:
+					voice.freqMod = command.freqMod;
+					break;
+				default:
+					break;
+			}
+		}
+	}
+
+	void DestroyXAudio2Voices()
+	{
+#ifndef PLAY_HEADLESS
+		for( VoiceSlot& slot : m_voiceSlots )
+		{
+			if( slot.pSourceVoice )
+				FreeVoiceSlot( slot );
+		}
+#endif
+	}
+
+	void ResetVoices()
+	{
+		m_voiceCommands.Clear();
+		for( AudioVoice& voice : m_voicePool )
+		{
+			voice.id = -1;
+			voice.stream = -1;
+		}
+		m_activeVoiceCount = 0;
+
+		for( AudioStream& stream : m_streams )
+		{
+			stream.file.close();
+			stream.state = AudioStream::IDLE;
+		}
+
+		for( VoiceSlot& slot : m_voiceSlots )
+			FreeVoiceSlot( slot );
+	}
+
+	void EndVoice( AudioVoice& voice )
+	{
+		// Hand the stream back to the streaming thread, which frees it once it's stopped reading
+		if( voice.stream != -1 )
+			m_streams[voice.stream].state.store( AudioStream::STOPPING, std::memory_order_release );
+
+		voice.stream = -1;
+		voice.id = -1;
+	}
+
+	//********************************************************************************************************************************
+	// Streaming functions
+	//********************************************************************************************************************************
+
+	void StreamingThread()
+	{
+		while( m_bStreaming )
+		{
+			for( AudioStream& stream : m_streams )
+			{
+				int state = stream.state.load( std::memory_order_acquire );
+				if( state == AudioStream::STOPPING )
+				{
+					stream.file.close();
+					stream.state.store( AudioStream::IDLE, std::memory_order_release );
+					continue;
+				}
+				if( state != AudioStream::PLAYING )
+					continue;
+
+				const SoundEffect& sfx = *stream.pSoundEffect;
+				if( !stream.file.is_open() )
+				{
+					stream.file.open( sfx.fileAndPath, std::ios::binary );
+					if( !stream.file.is_open() )
+					{
+						FailStream( stream );
+						continue;
+					}
+				}
+
+				int chunksPerLoop = ( sfx.frameCount + STREAM_CHUNK_FRAMES - 1 ) / STREAM_CHUNK_FRAMES;
+				int frameBytes = sfx.channels * sizeof( int16_t );
+
+				// Fill any buffers the mixer has finished with, in the order the chunks will be played
+				for( StreamChunk& chunk : stream.chunks )
+				{
+					if( chunk.bReady.load( std::memory_order_acquire ) )
+						continue;
+
+					// Looping sounds go back round to the second chunk, as the first one is always in memory
+					if( stream.nextSequence % chunksPerLoop == 0 )
+						stream.nextSequence++;
+					if( !stream.bLoop && stream.nextSequence >= chunksPerLoop )
+						break;
+
+					int chunkIndex = static_cast<int>( stream.nextSequence % chunksPerLoop );
+					int frames = std::min( STREAM_CHUNK_FRAMES, sfx.frameCount - chunkIndex * STREAM_CHUNK_FRAMES );
+					stream.file.seekg( sfx.streamDataOffset + static_cast<int64_t>( chunkIndex ) * STREAM_CHUNK_FRAMES * frameBytes );
+					stream.file.read( reinterpret_cast<char*>( chunk.samples ), frames * frameBytes );
+
+					// A file which has been changed or cut short since it was loaded stops the voice, rather than playing a partly
+					// filled chunk (which is cleared so nothing stale is left in it)
+					std::streamsize bytesRead = std::max<std::streamsize>( stream.file.gcount(), 0 );
+					if( bytesRead < frames * frameBytes )
+					{
+						memset( reinterpret_cast<char*>( chunk.samples ) + bytesRead, 0, static_cast<size_t>( frames * frameBytes - bytesRead ) );
+						FailStream( stream );
+						break;
+					}
+
+					chunk.sequence = stream.nextSequence++;
+					chunk.bReady.store( true, std::memory_order_release );
+					m_statsStreamChunksRead.fetch_add( 1, std::memory_order_relaxed );
+				}
+			}
+
+			// A chunk lasts about a third of a second, so there's no need to check back very often
+			std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+		}
+	}
+
+	void FailStream( AudioStream& stream )
+	{
+		stream.file.close();
+		m_statsStreamReadErrors.fetch_add( 1, std::memory_order_relaxed );
+
+		// The mixer may have stopped the voice already, in which case the stream is just freed as usual
+		int playing = AudioStream::PLAYING;
+		stream.state.compare_exchange_strong( playing, AudioStream::FAILED, std::memory_order_acq_rel );
+	}
+
+	const int16_t* GetStreamedFrames( const AudioVoice& voice, int64_t loop, int64_t frame )
+	{
+		const SoundEffect& sfx = *voice.pSoundEffect;
+		int chunkIndex = static_cast<int>( frame / STREAM_CHUNK_FRAMES );
+		int64_t chunkOffset = ( frame - static_cast<int64_t>( chunkIndex ) * STREAM_CHUNK_FRAMES ) * sfx.channels;
+
+		if( chunkIndex == 0 )
+			return sfx.pSamples + chunkOffset;
+
+		int chunksPerLoop = ( sfx.frameCount + STREAM_CHUNK_FRAMES - 1 ) / STREAM_CHUNK_FRAMES;
+		int64_t sequence = loop * chunksPerLoop + chunkIndex;
+		do
+		{
+			for( StreamChunk& chunk : m_streams[voice.stream].chunks )
+			{
+				if( chunk.bReady.load( std::memory_order_acquire ) && chunk.sequence == sequence )
+					return chunk.samples + chunkOffset;
+			}
+
+			// Offline rendering isn't in a hurry, so it waits for the streaming thread to read the chunk in
+			if( m_bWaitForStreams.load( std::memory_order_relaxed ) )
+				std::this_thread::yield();
+		}
+		while( m_bWaitForStreams.load( std::memory_order_relaxed ) && m_bStreaming && m_streams[voice.stream].state.load( std::memory_order_acquire ) != AudioStream::FAILED );
+		return nullptr;
+	}
+
+	void ReleaseStreamChunks( const AudioVoice& voice )
+	{
+		// Everything before the frame preceding the voice's position has been played
+		const SoundEffect& sfx = *voice.pSoundEffect;
+		int chunksPerLoop = ( sfx.frameCount + STREAM_CHUNK_FRAMES - 1 ) / STREAM_CHUNK_FRAMES;
+		int64_t frame = static_cast<int64_t>( voice.position >> 32 ) - 1;
+		int64_t loop = voice.loopCount;
+		if( frame < 0 )
+		{
+			frame += sfx.frameCount;
+			loop--;
+		}
+		int64_t firstNeeded = loop * chunksPerLoop + frame / STREAM_CHUNK_FRAMES;
+
+		for( StreamChunk& chunk : m_streams[voice.stream].chunks )
+		{
+			if( chunk.bReady.load( std::memory_order_acquire ) && chunk.sequence < firstNeeded )
+				chunk.bReady.store( false, std::memory_order_release );
+		}
+	}
+
+	StreamingStats GetStreamingStats()
+	{
+		ASSERT_AUDIO;
+
+		StreamingStats stats;
+		stats.underruns = m_statsStreamUnderruns;
+		stats.framesMissed = m_statsStreamFramesMissed;
+		stats.chunksRead = m_statsStreamChunksRead;
+		stats.streamsRejected = m_statsStreamsRejected;
+		stats.readErrors = m_statsStreamReadErrors;
+		return stats;
+	}
+
+	//********************************************************************************************************************************
+	// Mixer functions
+	//********************************************************************************************************************************
+
+	// The source frames needed for a quantum are converted to float here first, so the kernels never have to check for
+	// the end of the sound or loop back to the start
+	// > They're big enough for the fastest sound, so the mixer thread never has to allocate them
+	float m_resampleLeft[MIX_RESAMPLE_FRAMES];
+	float m_resampleRight[MIX_RESAMPLE_FRAMES];
+
+	// Interpolates between source frames x1 and x2 (x0 and x3 are the frames either side, used by cubic)
+	static inline float Interpolate( Resampler resampler, float x0, float x1, float x2, float x3, float frac )
+	{
+		if( resampler == Resampler::LINEAR )
+			return x1 + ( x2 - x1 ) * frac;
+
+		// Catmull-Rom spline
+		float c1 = 0.5f * ( x2 - x0 );
+		float c2 = x0 - 2.5f * x1 + 2.0f * x2 - 0.5f * x3;
+		float c3 = 0.5f * ( x3 - x0 ) + 1.5f * ( x1 - x2 );
+		return ( ( c3 * frac + c2 ) * frac + c1 ) * frac + x1;
+	}
+
+#ifdef PLAY_SSE2
+	// The same sums as Interpolate, four frames at a time (so the results are identical)
+	static inline __m128 Interpolate4( Resampler resampler, __m128 x0, __m128 x1, __m128 x2, __m128 x3, __m128 frac )
+	{
+		if( resampler == Resampler::LINEAR )
+			return _mm_add_ps( x1, _mm_mul_ps( _mm_sub_ps( x2, x1 ), frac ) );
+
+		__m128 c1 = _mm_mul_ps( _mm_set1_ps( 0.5f ), _mm_sub_ps( x2, x0 ) );
+		__m128 c2 = _mm_sub_ps( _mm_add_ps( _mm_sub_ps( x0, _mm_mul_ps( _mm_set1_ps( 2.5f ), x1 ) ), _mm_mul_ps( _mm_set1_ps( 2.0f ), x2 ) ), _mm_mul_ps( _mm_set1_ps( 0.5f ), x3 ) );
+		__m128 c3 = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( 0.5f ), _mm_sub_ps( x3, x0 ) ), _mm_mul_ps( _mm_set1_ps( 1.5f ), _mm_sub_ps( x1, x2 ) ) );
+		return _mm_add_ps( _mm_mul_ps( _mm_add_ps( _mm_mul_ps( _mm_add_ps( _mm_mul_ps( c3, frac ), c2 ), frac ), c1 ), frac ), x1 );
+	}
+
+	// Resamples four frames from their taps in pSamples, starting at each index
+	static inline __m128 Resample4( Resampler resampler, const float* pSamples, const int* index, __m128 frac )
+	{
+		if( resampler == Resampler::LINEAR )
+		{
+			// Each pair of neighbouring taps is a single 64-bit load, then shuffled apart
+			// > _mm_loadl_epi64 doesn't need any alignment, as the taps are only 4-byte aligned
+			__m128 p01 = _mm_castsi128_ps( _mm_unpacklo_epi64( _mm_loadl_epi64( reinterpret_cast<const __m128i*>( pSamples + index[0] + 1 ) ), _mm_loadl_epi64( reinterpret_cast<const __m128i*>( pSamples + index[1] + 1 ) ) ) );
+			__m128 p23 = _mm_castsi128_ps( _mm_unpacklo_epi64( _mm_loadl_epi64( reinterpret_cast<const __m128i*>( pSamples + index[2] + 1 ) ), _mm_loadl_epi64( reinterpret_cast<const __m128i*>( pSamples + index[3] + 1 ) ) ) );
+			__m128 x1 = _mm_shuffle_ps( p01, p23, _MM_SHUFFLE( 2, 0, 2, 0 ) );
+			__m128 x2 = _mm_shuffle_ps( p01, p23, _MM_SHUFFLE( 3, 1, 3, 1 ) );
+			return Interpolate4( resampler, x1, x1, x2, x2, frac );
+		}
+
+		// All four taps of a frame are one load, transposed so each register holds the same tap for every frame
+		__m128 x0 = _mm_loadu_ps( pSamples + index[0] );
+		__m128 x1 = _mm_loadu_ps( pSamples + index[1] );
+		__m128 x2 = _mm_loadu_ps( pSamples + index[2] );
+		__m128 x3 = _mm_loadu_ps( pSamples + index[3] );
+		_MM_TRANSPOSE4_PS( x0, x1, x2, x3 );
+		return Interpolate4( resampler, x0, x1, x2, x3, frac );
+	}
+#endif
+
+	// Adds frameCount frames of a voice into the bus, returns false when the voice has finished
+	bool MixVoice( AudioVoice& voice, float* pBus, int frameCount )
+	{
+		const SoundEffect& sfx = *voice.pSoundEffect;
+		if( ( !sfx.pSamples && !sfx.pAdpcm ) || sfx.frameCount == 0 || ( sfx.bStreamed && voice.stream == -1 ) )
+			return false;
+
+		// How far to step through the sound for each output frame, in 32.32 fixed point
+		// > The frequency ratio is limited to the same range as XAudio2 was given
+		float freqMod = std::clamp( voice.freqMod, 1.0f / 1024.0f, MAX_FREQ_MOD );
+		uint64_t step = static_cast<uint64_t>( ( static_cast<double>( sfx.sampleRate ) / MIX_SAMPLE_RATE ) * freqMod * 4294967296.0 );
+		uint64_t length = static_cast<uint64_t>( sfx.frameCount ) << 32;
+
+		// A sound which doesn't loop is only mixed up to its end
+		bool bFinished = false;
+		if( !voice.bLoop && voice.position + step * frameCount >= length )
+		{
+			frameCount = static_cast<int>( ( length - voice.position + step - 1 ) / step );
+			bFinished = true;
+		}
+
+		// Convert the source frames needed into float, starting one before the first (for cubic)
+		int64_t firstFrame = static_cast<int64_t>( voice.position >> 32 ) - 1;
+		int spanFrames = static_cast<int>( ( ( voice.position + step * frameCount ) >> 32 ) - firstFrame ) + 3;
+
+		PLAY_ASSERT_MSG( spanFrames <= MIX_RESAMPLE_FRAMES, "A voice needs more source frames than the mixer has room for" );
+
+		// Mono sounds are played equally in both speakers, so they only need resampling once
+		float* pLeft = m_resampleLeft;
+		float* pRight = sfx.channels > 1 ? m_resampleRight : pLeft;
+		int channels = sfx.channels;
+
+		// Copy across in runs of consecutive frames, which stop at the end of the sound (or of a streamed chunk)
+		int64_t src = firstFrame;
+		int64_t loop = voice.loopCount;
+		if( src < 0 && voice.bLoop )
+		{
+			src += sfx.frameCount;
+			loop--;
+		}
+
+		bool bUnderrun = false;
+		for( int k = 0; k < spanFrames; )
+		{
+			if( voice.bLoop && src >= sfx.frameCount )
+			{
+				src = 0;
+				loop++;
+			}
+
+			// Silence before the start and after the end of sounds which don't loop (and before a streamed sound starts)
+			if( src < 0 || src >= sfx.frameCount || ( sfx.bStreamed && loop < 0 ) )
+			{
+				pLeft[k] = 0.0f;
+				pRight[k] = 0.0f;
+				k++;
+				src++;
+				continue;
+			}
+
+			int run = static_cast<int>( std::min<int64_t>( spanFrames - k, sfx.frameCount - src ) );
+			const int16_t* p = nullptr;
+
+			if( sfx.pAdpcm )
+			{
+				run = static_cast<int>( std::min<int64_t>( run, ADPCM_BLOCK_FRAMES - src % ADPCM_BLOCK_FRAMES ) );
+				p = GetDecodedFrames( voice, src );
+			}
+			else if( sfx.bStreamed )
+			{
+				run = static_cast<int>( std::min<int64_t>( run, STREAM_CHUNK_FRAMES - src % STREAM_CHUNK_FRAMES ) );
+				p = GetStreamedFrames( voice, loop, src );
+
+				// A sound whose file can't be read any more stops once it has played the chunks which were read
+				if( !p && m_streams[voice.stream].state.load( std::memory_order_acquire ) == AudioStream::FAILED )
+					return false;
+
+				// Play silence rather than wait for a chunk which hasn't loaded in time
+				if( !p )
+				{
+					std::fill( pLeft + k, pLeft + k + run, 0.0f );
+					std::fill( pRight + k, pRight + k + run, 0.0f );
+					m_statsStreamFramesMissed.fetch_add( run, std::memory_order_relaxed );
+					bUnderrun = true;
+					k += run;
+					src += run;
+					continue;
+				}
+			}
+			else
+			{
+				// Only plain PCM sounds have all their samples at pSamples
+				p = sfx.pSamples + src * channels;
+			}
+
+			if( channels == 1 )
+			{
+				for( int i = 0; i < run; i++ )
+					pLeft[k + i] = p[i];
+			}
+			else
+			{
+				for( int i = 0; i < run; i++ )
+				{
+					pLeft[k + i] = p[i * channels];
+					pRight[k + i] = p[i * channels + 1];
+				}
+			}
+
+			k += run;
+			src += run;
+		}
+
+		if( bUnderrun )
+			m_statsStreamUnderruns.fetch_add( 1, std::memory_order_relaxed );
+
+		// The volume ramps across the quantum to avoid clicks when it changes
+		float gainStart = voice.gain / 32768.0f;
+		float gainStep = ( voice.volume - voice.gain ) / ( 32768.0f * frameCount );
+		Resampler resampler = m_resampler;
+
+		// Positions within the quantum are relative to pLeft[0], in 12.20 fixed point so four fit in an SSE register
+		// > The scalar frames use the same numbers, so both give identical results
+		uint32_t position = static_cast<uint32_t>( ( voice.position & 0xFFFFFFFF ) >> ( 32 - MIX_FRACTION_BITS ) );
+		uint32_t positionStep = static_cast<uint32_t>( step >> ( 32 - MIX_FRACTION_BITS ) );
+		const uint32_t fractionMask = ( 1u << MIX_FRACTION_BITS ) - 1;
+		const float fractionScale = 1.0f / ( 1 << MIX_FRACTION_BITS );
+		int n = 0;
+
+#ifdef PLAY_SSE2
+		__m128i positions = _mm_add_epi32( _mm_set1_epi32( static_cast<int>( position ) ),
+			_mm_setr_epi32( 0, static_cast<int>( positionStep ), static_cast<int>( positionStep * 2 ), static_cast<int>( positionStep * 3 ) ) );
+		__m128 frames = _mm_setr_ps( 0.0f, 1.0f, 2.0f, 3.0f );
+
+		for( ; n + 4 <= frameCount; n += 4 )
+		{
+			alignas( 16 ) int index[4];
+			_mm_store_si128( reinterpret_cast<__m128i*>( index ), _mm_srli_epi32( positions, MIX_FRACTION_BITS ) );
+			__m128 frac = _mm_mul_ps( _mm_cvtepi32_ps( _mm_and_si128( positions, _mm_set1_epi32( fractionMask ) ) ), _mm_set1_ps( fractionScale ) );
+
+			__m128 gain = _mm_add_ps( _mm_set1_ps( gainStart ), _mm_mul_ps( _mm_set1_ps( gainStep ), frames ) );
+			__m128 left = Resample4( resampler, pLeft, index, frac );
+			__m128 right = pRight != pLeft ? Resample4( resampler, pRight, index, frac ) : left;
+			left = _mm_mul_ps( left, gain );
+			right = _mm_mul_ps( right, gain );
+
+			// Interleave back into left/right pairs and add to the bus
+			float* pOut = pBus + n * 2;
+			_mm_storeu_ps( pOut, _mm_add_ps( _mm_loadu_ps( pOut ), _mm_unpacklo_ps( left, right ) ) );
+			_mm_storeu_ps( pOut + 4, _mm_add_ps( _mm_loadu_ps( pOut + 4 ), _mm_unpackhi_ps( left, right ) ) );
+
+			positions = _mm_add_epi32( positions, _mm_set1_epi32( static_cast<int>( positionStep * 4 ) ) );
+			frames = _mm_add_ps( frames, _mm_set1_ps( 4.0f ) );
+		}
+		position += positionStep * n;
+#endif
+		for( ; n < frameCount; n++, position += positionStep )
+		{
+			int i = static_cast<int>( position >> MIX_FRACTION_BITS );
+			float frac = static_cast<float>( static_cast<int>( position & fractionMask ) ) * fractionScale;
+			float gain = gainStart + gainStep * float( n );
+			float left = Interpolate( resampler, pLeft[i], pLeft[i + 1], pLeft[i + 2], pLeft[i + 3], frac );
+			float right = pRight != pLeft ? Interpolate( resampler, pRight[i], pRight[i + 1], pRight[i + 2], pRight[i + 3], frac ) : left;
+			pBus[n * 2] += left * gain;
+			pBus[n * 2 + 1] += right * gain;
+		}
+
+		voice.gain = voice.volume;
+		voice.position += step * frameCount;
+		if( voice.bLoop )
+		{
+			voice.loopCount += voice.position / length;
+			voice.position %= length;
+		}
+
+		// Let the streaming thread reuse the chunks which have been played
+		if( voice.stream != -1 && !bFinished )
+			ReleaseStreamChunks( voice );
+
+		return !bFinished;
+	}
+
+	void MixAudio( int16_t* pOutput, int frameCount )
+	{
+		while( frameCount > 0 )
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			int frames = std::min( frameCount, MIX_QUANTUM_FRAMES );
+			for( MixBus& mixBus : m_mixBuses )
+			{
+				std::fill( mixBus.samples, mixBus.samples + frames * MIX_CHANNELS, 0.0f );
+				mixBus.bMixed = false;
+			}
+
+			// Pick up any changes the game has made since the last quantum
+			ApplyVoiceCommands();
+			m_statsVoiceQuanta.fetch_add( m_activeVoiceCount, std::memory_order_relaxed );
+
+			// Voices are always mixed in the order they were started, so the floating point sums are the same every time
+			int activeCount = 0;
+			for( int i = 0; i < m_activeVoiceCount; i++ )
+			{
+				int slotIndex = m_activeVoices[i];
+				AudioVoice& voice = m_voicePool[slotIndex];
+				MixBus& mixBus = m_mixBuses[static_cast<int>( voice.bus )];
+				mixBus.bMixed = true;
+
+				if( MixVoice( voice, mixBus.samples, frames ) )
+				{
+					m_activeVoices[activeCount++] = slotIndex;
+					continue;
+				}
+
+				// The voice has finished playing, so the game thread can reuse its slot
+				m_voiceSlots[slotIndex].finishedVoiceId.store( voice.id, std::memory_order_release );
+				EndVoice( voice );
+			}
+			m_activeVoiceCount = activeCount;
+
+			// The sidechain levels are measured before any bus is ducked, then each bus is added into the master bus
+			for( int b = 0; b < AUDIO_BUS_COUNT; b++ )
+			{
+				MixBus& mixBus = m_mixBuses[b];
+				float peak = 0.0f;
+				if( mixBus.bMixed )
+				{
+					for( int s = 0; s < frames * MIX_CHANNELS; s++ )
+						peak = std::max( peak, std::abs( mixBus.samples[s] ) );
+				}
+				mixBus.level = peak * m_busSettings[b].volume.load( std::memory_order_relaxed );
+			}
+			for( AudioBus bus : { AudioBus::MUSIC, AudioBus::SFX, AudioBus::UI, AudioBus::MASTER } )
+				ProcessBus( bus, frames );
+			m_statsBusQuanta.fetch_add( 1, std::memory_order_relaxed );
+
+			const float* pMix = m_mixBuses[static_cast<int>( AudioBus::MASTER )].samples;
+			for( int s = 0; s < frames * MIX_CHANNELS; s++ )
+			{
+				float sample = std::clamp( pMix[s], -1.0f, 1.0f ) * 32767.0f;
+				*pOutput++ = static_cast<int16_t>( sample < 0.0f ? sample - 0.5f : sample + 0.5f );
+			}
+
+			frameCount -= frames;
+			m_statsQuanta.fetch_add( 1, std::memory_order_relaxed );
+			m_statsMixNanoseconds.fetch_add( std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count(), std::memory_order_relaxed );
+		}
+	}
+
+	void SetResampler( Resampler resampler )
+	{
+		ASSERT_AUDIO;
+		m_resampler = resampler;
+	}
+
+	MixerStats GetMixerStats()
+	{
+		ASSERT_AUDIO;
+
+		MixerStats stats;
+		stats.quantaMixed = m_statsQuanta.exchange( 0 );
+		stats.voicesMixed = m_statsVoiceQuanta.exchange( 0 );
+		stats.mixMilliseconds = m_statsMixNanoseconds.exchange( 0 ) / 1000000.0f;
+		stats.voicesPerMillisecond = stats.mixMilliseconds > 0.0f ? stats.voicesMixed / stats.mixMilliseconds : 0.0f;
+		return stats;
+	}
+
+	//********************************************************************************************************************************
+	// Bus functions
+	//********************************************************************************************************************************
+	void SetSoundBus( SoundKey name, AudioBus bus )
+	{
+		ASSERT_AUDIO;
+
+		int soundIndex = FindSoundEffect( name );
+		PLAY_ASSERT_MSG( soundIndex != -1, std::string( "Trying to set the bus of unknown sound effect: " + std::string( name.name ) ).c_str() );
+		if( soundIndex != -1 )
+			m_vSoundEffects[soundIndex].bus = bus;
+	}
+
+	void SetBusVolume( AudioBus bus, float volume )
+	{
+		ASSERT_AUDIO;
+		m_busSettings[static_cast<int>( bus )].volume.store( volume, std::memory_order_relaxed );
+		UpdateXWMAVolumes();
+	}
+
+	void SetBusDucking( AudioBus bus, AudioBus sidechain, float threshold, float depth, float attackTime, float releaseTime )
+	{
+		ASSERT_AUDIO;
+		PLAY_ASSERT_MSG( bus != AudioBus::MASTER && sidechain != AudioBus::MASTER && bus != sidechain, "Only the music, sfx and ui buses can duck each other" );
+		PLAY_ASSERT_MSG( depth >= 0.0f && depth <= 1.0f, "The ducking depth must be between 0 and 1" );
+
+		BusSettings& settings = m_busSettings[static_cast<int>( bus )];
+		settings.duckThreshold.store( threshold, std::memory_order_relaxed );
+		settings.duckDepth.store( depth, std::memory_order_relaxed );
+		settings.duckAttack.store( attackTime, std::memory_order_relaxed );
+		settings.duckRelease.store( releaseTime, std::memory_order_relaxed );
+		settings.duckSidechain.store( depth < 1.0f ? static_cast<int>( sidechain ) : -1, std::memory_order_relaxed );
+	}
+
+	void SetBusLowPass( AudioBus bus, float cutoffHz )
+	{
+		ASSERT_AUDIO;
+		PLAY_ASSERT_MSG( cutoffHz >= 0.0f, "The low-pass cutoff can't be negative" );
+		m_busSettings[static_cast<int>( bus )].lowPassCutoff.store( cutoffHz, std::memory_order_relaxed );
+	}
+
+	void SetBusReverb( AudioBus bus, float wet, float roomSize )
+	{
+		ASSERT_AUDIO;
+		BusSettings& settings = m_busSettings[static_cast<int>( bus )];
+		settings.reverbRoomSize.store( std::clamp( roomSize, 0.0f, 1.0f ), std::memory_order_relaxed );
+		settings.reverbWet.store( std::max( wet, 0.0f ), std::memory_order_relaxed );
+	}
+
+	void SetBusLimiter( AudioBus bus, float ceiling )
+	{
+		ASSERT_AUDIO;
+		m_busSettings[static_cast<int>( bus )].limiterCeiling.store( std::max( ceiling, 0.0f ), std::memory_order_relaxed );
+	}
+
+	BusStats GetBusStats()
+	{
+		ASSERT_AUDIO;
+
+		BusStats stats;
+		stats.quantaMixed = m_statsBusQuanta.exchange( 0 );
+		for( int b = 0; b < AUDIO_BUS_COUNT; b++ )
+		{
+			int64_t nanoseconds = m_statsBusNanoseconds[b].exchange( 0 );
+			stats.microsecondsPerQuantum[b] = stats.quantaMixed > 0 ? nanoseconds / ( 1000.0f * stats.quantaMixed ) : 0.0f;
+		}
+		return stats;
+	}
+
+	void ResetBuses()
+	{
+		for( int b = 0; b < AUDIO_BUS_COUNT; b++ )
+		{
+			BusSettings& settings = m_busSettings[b];
+			settings.volume = 1.0f;
+			settings.duckSidechain = -1;
+			settings.duckDepth = 1.0f;
+			settings.lowPassCutoff = 0.0f;
+			settings.reverbWet = 0.0f;
+			settings.reverbRoomSize = 0.5f;
+			settings.limiterCeiling = 0.0f;
+
+			MixBus& mixBus = m_mixBuses[b];
+			mixBus.gain = 1.0f;
+			mixBus.duck = 1.0f;
+			mixBus.lowPassCutoff = 0.0f;
+			mixBus.bReverbRinging = false;
+			mixBus.limiterGain = 1.0f;
+
+			// The reverb's delay lines share one block of memory
+			std::fill( std::begin( mixBus.reverbMemory ), std::end( mixBus.reverbMemory ), 0.0f );
+			float* pMemory = mixBus.reverbMemory;
+			for( int c = 0; c < MIX_CHANNELS; c++ )
+			{
+				for( int d = 0; d < REVERB_COMBS + REVERB_ALLPASSES; d++ )
+				{
+					DelayLine& line = d < REVERB_COMBS ? mixBus.combs[c][d] : mixBus.allpasses[c][d - REVERB_COMBS];
+					line.length = ( d < REVERB_COMBS ? REVERB_COMB_FRAMES[d] : REVERB_ALLPASS_FRAMES[d - REVERB_COMBS] ) + c * REVERB_STEREO_SPREAD;
+					line.pBuffer = pMemory;
+					line.position = 0;
+					line.store = 0.0f;
+					pMemory += line.length;
+				}
+			}
+		}
+	}
+
+	float GetBusGain( AudioBus bus )
+	{
+		float gain = m_busSettings[static_cast<int>( AudioBus::MASTER )].volume.load( std::memory_order_relaxed );
+		if( bus != AudioBus::MASTER )
+			gain *= m_busSettings[static_cast<int>( bus )].volume.load( std::memory_order_relaxed );
+		return gain;
+	}
+
+	void UpdateXWMAVolumes()
+	{
+		// XAudio2 plays XWMA sounds itself, so they only get the bus volumes (not the ducking or effects)
+#ifndef PLAY_HEADLESS
+		for( VoiceSlot& slot : m_voiceSlots )
+		{
+			if( slot.pSourceVoice && IsVoiceSlotPlaying( slot ) )
+				slot.pSourceVoice->SetVolume( slot.volume * GetBusGain( slot.pSoundEffect->bus ) );
+		}
+#endif
+	}
+
+	void ProcessBus( AudioBus bus, int frameCount )
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		int b = static_cast<int>( bus );
+		MixBus& mixBus = m_mixBuses[b];
+		BusSettings& settings = m_busSettings[b];
+
+		// Ducking follows the sidechain's level a quantum at a time
+		float duckTarget = 1.0f;
+		int sidechain = settings.duckSidechain.load( std::memory_order_relaxed );
+		if( sidechain != -1 && m_mixBuses[sidechain].level > settings.duckThreshold.load( std::memory_order_relaxed ) )
+			duckTarget = settings.duckDepth.load( std::memory_order_relaxed );
+		float duckTime = ( duckTarget < mixBus.duck ? settings.duckAttack : settings.duckRelease ).load( std::memory_order_relaxed );
+		float quantumTime = frameCount / static_cast<float>( MIX_SAMPLE_RATE );
+		mixBus.duck += ( duckTarget - mixBus.duck ) * ( duckTime > 0.0f ? 1.0f - expf( -quantumTime / duckTime ) : 1.0f );
+
+		float gain = settings.volume.load( std::memory_order_relaxed ) * mixBus.duck;
+		float cutoff = settings.lowPassCutoff.load( std::memory_order_relaxed );
+		float wet = settings.reverbWet.load( std::memory_order_relaxed );
+		float ceiling = settings.limiterCeiling.load( std::memory_order_relaxed );
+		bool bReverb = wet > 0.0f && ( mixBus.bMixed || mixBus.bReverbRinging );
+
+		// A silent bus has nothing to add (unless its reverb is still ringing)
+		if( !mixBus.bMixed && !bReverb )
+		{
+			mixBus.gain = gain;
+			mixBus.lowPassCutoff = 0.0f;
+			mixBus.limiterGain = 1.0f;
+			m_statsBusNanoseconds[b].fetch_add( std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count(), std::memory_order_relaxed );
+			return;
+		}
+
+		// The gain ramps from its old value over the quantum, like a voice's volume
+		float* pSamples = mixBus.samples;
+		if( gain != 1.0f || mixBus.gain != 1.0f )
+		{
+			float step = ( gain - mixBus.gain ) / frameCount;
+			float g = mixBus.gain;
+			for( int f = 0; f < frameCount; f++ )
+			{
+				g += step;
+				pSamples[f * MIX_CHANNELS] *= g;
+				pSamples[f * MIX_CHANNELS + 1] *= g;
+			}
+		}
+		mixBus.gain = gain;
+
+		if( cutoff > 0.0f )
+			ApplyLowPass( mixBus, cutoff, frameCount );
+		else
+			mixBus.lowPassCutoff = 0.0f;
+
+		if( bReverb )
+			ApplyReverb( mixBus, wet, settings.reverbRoomSize.load( std::memory_order_relaxed ), frameCount );
+
+		if( ceiling > 0.0f )
+			ApplyLimiter( mixBus, ceiling, frameCount );
+		else
+			mixBus.limiterGain = 1.0f;
+
+		if( bus != AudioBus::MASTER )
+		{
+			MixBus& master = m_mixBuses[static_cast<int>( AudioBus::MASTER )];
+			for( int s = 0; s < frameCount * MIX_CHANNELS; s++ )
+				master.samples[s] += pSamples[s];
+			master.bMixed = true;
+		}
+
+		m_statsBusNanoseconds[b].fetch_add( std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count(), std::memory_order_relaxed );
+	}
+
+	void ApplyLowPass( MixBus& mixBus, float cutoffHz, int frameCount )
+	{
+		// The coefficients are only worked out when the cutoff changes (a Butterworth biquad from the RBJ cookbook)
+		if( cutoffHz != mixBus.lowPassCutoff )
+		{
+			if( mixBus.lowPassCutoff == 0.0f )
+			{
+				std::fill( std::begin( mixBus.x1 ), std::end( mixBus.x1 ), 0.0f );
+				std::fill( std::begin( mixBus.x2 ), std::end( mixBus.x2 ), 0.0f );
+				std::fill( std::begin( mixBus.y1 ), std::end( mixBus.y1 ), 0.0f );
+				std::fill( std::begin( mixBus.y2 ), std::end( mixBus.y2 ), 0.0f );
+			}
+
+			float w0 = 2.0f * PLAY_PI * std::min( cutoffHz, MIX_SAMPLE_RATE * 0.45f ) / MIX_SAMPLE_RATE;
+			float alpha = sinf( w0 ) * 0.70710678f; // sin( w0 ) / ( 2 * Q ) with Q = 1 / sqrt( 2 )
+			float a0 = 1.0f + alpha;
+			mixBus.b1 = ( 1.0f - cosf( w0 ) ) / a0;
+			mixBus.b0 = mixBus.b1 * 0.5f;
+			mixBus.b2 = mixBus.b0;
+			mixBus.a1 = -2.0f * cosf( w0 ) / a0;
+			mixBus.a2 = ( 1.0f - alpha ) / a0;
+			mixBus.lowPassCutoff = cutoffHz;
+		}
+
+		for( int c = 0; c < MIX_CHANNELS; c++ )
+		{
+			float x1 = mixBus.x1[c], x2 = mixBus.x2[c], y1 = mixBus.y1[c], y2 = mixBus.y2[c];
+			float* p = mixBus.samples + c;
+			for( int f = 0; f < frameCount; f++, p += MIX_CHANNELS )
+			{
+				float y = mixBus.b0 * *p + mixBus.b1 * x1 + mixBus.b2 * x2 - mixBus.a1 * y1 - mixBus.a2 * y2;
+				x2 = x1;
+				x1 = *p;
+				y2 = y1;
+				y1 = y;
+				*p = y;
+			}
+			mixBus.x1[c] = x1;
+			mixBus.x2[c] = x2;
+			mixBus.y1[c] = y1;
+			mixBus.y2[c] = y2;
+		}
+	}
+
+	void ApplyReverb( MixBus& mixBus, float wet, float roomSize, int frameCount )
+	{
+		// Freeverb's tuning, with the room size setting how much the comb filters feed back
+		constexpr float INPUT_GAIN = 0.015f;
+		constexpr float WET_SCALE = 3.0f;
+		constexpr float DAMPING = 0.2f;
+		float feedback = 0.7f + 0.28f * roomSize;
+
+		// The filters run over the whole quantum at a time, which keeps the inner loops short and simple
+		float input[MIX_QUANTUM_FRAMES];
+		float output[MIX_QUANTUM_FRAMES];
+		for( int f = 0; f < frameCount; f++ )
+			input[f] = ( mixBus.samples[f * MIX_CHANNELS] + mixBus.samples[f * MIX_CHANNELS + 1] ) * INPUT_GAIN;
+
+		float peak = 0.0f;
+		for( int c = 0; c < MIX_CHANNELS; c++ )
+		{
+			// The combs run side by side (their damping filters don't depend on each other), in runs where none of them wrap
+			DelayLine* combs = mixBus.combs[c];
+			for( int f = 0; f < frameCount; )
+			{
+				int run = frameCount - f;
+				for( int d = 0; d < REVERB_COMBS; d++ )
+					run = std::min( run, combs[d].length - combs[d].position );
+
+				float* p0 = combs[0].pBuffer + combs[0].position;
+				float* p1 = combs[1].pBuffer + combs[1].position;
+				float* p2 = combs[2].pBuffer + combs[2].position;
+				float* p3 = combs[3].pBuffer + combs[3].position;
+				float s0 = combs[0].store, s1 = combs[1].store, s2 = combs[2].store, s3 = combs[3].store;
+				for( int i = 0; i < run; i++ )
+				{
+					float in = input[f + i];
+					float d0 = p0[i], d1 = p1[i], d2 = p2[i], d3 = p3[i];
+					s0 = d0 * ( 1.0f - DAMPING ) + s0 * DAMPING;
+					s1 = d1 * ( 1.0f - DAMPING ) + s1 * DAMPING;
+					s2 = d2 * ( 1.0f - DAMPING ) + s2 * DAMPING;
+					s3 = d3 * ( 1.0f - DAMPING ) + s3 * DAMPING;
+					p0[i] = in + s0 * feedback;
+					p1[i] = in + s1 * feedback;
+					p2[i] = in + s2 * feedback;
+					p3[i] = in + s3 * feedback;
+					output[f + i] = ( d0 + d1 ) + ( d2 + d3 );
+				}
+				combs[0].store = s0;
+				combs[1].store = s1;
+				combs[2].store = s2;
+				combs[3].store = s3;
+
+				for( int d = 0; d < REVERB_COMBS; d++ )
+				{
+					combs[d].position += run;
+					if( combs[d].position == combs[d].length )
+						combs[d].position = 0;
+				}
+				f += run;
+			}
+
+			for( DelayLine& allpass : mixBus.allpasses[c] )
+			{
+				for( int f = 0; f < frameCount; f++ )
+				{
+					float delayed = allpass.pBuffer[allpass.position];
+					allpass.pBuffer[allpass.position] = output[f] + delayed * 0.5f;
+					allpass.position = allpass.position + 1 == allpass.length ? 0 : allpass.position + 1;
+					output[f] = delayed - output[f];
+				}
+			}
+
+			float* p = mixBus.samples + c;
+			for( int f = 0; f < frameCount; f++, p += MIX_CHANNELS )
+			{
+				peak = std::max( peak, std::abs( output[f] ) );
+				*p += output[f] * wet * WET_SCALE;
+			}
+		}
+
+		// Once the tail has died away the reverb can be skipped until something plays through the bus again
+		mixBus.bReverbRinging = mixBus.bMixed || peak > 1e-5f;
+	}
+
+	void ApplyLimiter( MixBus& mixBus, float ceiling, int frameCount )
+	{
+		// The gain drops straight away to keep peaks under the ceiling, then recovers over about 100ms
+		const float release = 1.0f - expf( -1.0f / ( 0.1f * MIX_SAMPLE_RATE ) );
+		float gain = mixBus.limiterGain;
+		float* p = mixBus.samples;
+		for( int f = 0; f < frameCount; f++, p += MIX_CHANNELS )
+		{
+			float peak = std::max( std::abs( p[0] ), std::abs( p[1] ) );
+			gain += ( 1.0f - gain ) * release;
+			if( peak * gain > ceiling )
+				gain = ceiling / peak;
+			p[0] *= gain;
+			p[1] *= gain;
+		}
+		mixBus.limiterGain = gain;
+	}
+
+	//********************************************************************************************************************************
+	// ADPCM functions
+	//********************************************************************************************************************************
+
+	// The IMA-ADPCM step sizes, and how the step moves for each 4-bit code
+	constexpr int16_t ADPCM_STEPS[89] = 
+	{
+		7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 
+		130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 
+		1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 
+		7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+	};
+	constexpr int ADPCM_INDEX_CHANGES[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+	// The change to the sample and the next step index for every step index and code, so decoding is just two lookups
+	struct AdpcmTables
+	{
+		int diffs[89 * 16];
+		uint8_t nextIndex[89 * 16];
+	};
+	constexpr AdpcmTables MakeAdpcmTables()
+	{
+		AdpcmTables tables{};
+		for( int stepIndex = 0; stepIndex < 89; stepIndex++ )
+		{
+			for( int code = 0; code < 16; code++ )
+			{
+				int step = ADPCM_STEPS[stepIndex];
+				int diff = step >> 3;
+				if( code & 4 ) diff += step;
+				if( code & 2 ) diff += step >> 1;
+				if( code & 1 ) diff += step >> 2;
+
+				tables.diffs[stepIndex * 16 + code] = ( code & 8 ) ? -diff : diff;
+				tables.nextIndex[stepIndex * 16 + code] = static_cast<uint8_t>( std::clamp( stepIndex + ADPCM_INDEX_CHANGES[code], 0, 88 ) );
+			}
+		}
+		return tables;
+	}
+	constexpr AdpcmTables ADPCM_TABLES = MakeAdpcmTables();
+
+	// Works out the next sample from its 4-bit code (the encoder uses this too, so it always agrees with the decoder)
+	static inline int DecodeAdpcm( int code, int& predictor, int& stepIndex )
+	{
+		predictor = std::clamp( predictor + ADPCM_TABLES.diffs[stepIndex * 16 + code], -32768, 32767 );
+		stepIndex = ADPCM_TABLES.nextIndex[stepIndex * 16 + code];
+		return predictor;
+	}
+
+	static inline int EncodeAdpcm( int sample, int& predictor, int& stepIndex )
+	{
+		int step = ADPCM_STEPS[stepIndex];
+		int diff = sample - predictor;
+		int code = 0;
+		if( diff < 0 )
+		{
+			code = 8;
+			diff = -diff;
+		}
+		if( diff >= step )
+		{
+			code |= 4;
+			diff -= step;
+		}
+		if( diff >= step >> 1 )
+		{
+			code |= 2;
+			diff -= step >> 1;
+		}
+		if( diff >= step >> 2 )
+			code |= 1;
+
+		DecodeAdpcm( code, predictor, stepIndex );
+		return code;
+	}
+
+	void CompressSoundEffect( SoundEffect& soundEffect )
+	{
+		int channels = soundEffect.channels;
+		int blockCount = ( soundEffect.frameCount + ADPCM_BLOCK_FRAMES - 1 ) / ADPCM_BLOCK_FRAMES;
+		int blockBytes = ADPCM_CHANNEL_BYTES * channels;
+		uint8_t* pAdpcm = new uint8_t[blockCount * blockBytes];
+		std::fill( pAdpcm, pAdpcm + blockCount * blockBytes, uint8_t( 0 ) );
+
+		for( int c = 0; c < channels; c++ )
+		{
+			// The step size carries on from one block to the next, so each block starts off well adapted
+			int stepIndex = 0;
+			for( int b = 0; b < blockCount; b++ )
+			{
+				int firstFrame = b * ADPCM_BLOCK_FRAMES;
+				int frames = std::min( ADPCM_BLOCK_FRAMES, soundEffect.frameCount - firstFrame );
+				const int16_t* pSamples = soundEffect.pSamples + firstFrame * channels + c;
+
+				uint8_t* pHeader = pAdpcm + b * blockBytes + c * 4;
+				uint8_t* pCodes = pAdpcm + b * blockBytes + channels * 4 + c * ( ADPCM_CHANNEL_BYTES - 4 );
+				int predictor = pSamples[0];
+				memcpy( pHeader, &pSamples[0], sizeof( int16_t ) );
+				pHeader[2] = static_cast<uint8_t>( stepIndex );
+
+				for( int i = 1; i < frames; i++ )
+				{
+					int code = EncodeAdpcm( pSamples[i * channels], predictor, stepIndex );
+					pCodes[( i - 1 ) >> 1] |= static_cast<uint8_t>( ( i - 1 ) & 1 ? code << 4 : code );
+				}
+			}
+		}
+
+		// The compressed blocks replace the file data
+		delete[] soundEffect.pFileBuffer;
+		if( soundEffect.pMappedFile )
+			UnmapSoundFile( soundEffect.pMappedFile, soundEffect.mappedBytes );
+		soundEffect.pMappedFile = nullptr;
+		soundEffect.mappedBytes = 0;
+		soundEffect.pFileBuffer = pAdpcm;
+		soundEffect.pAdpcm = pAdpcm;
+		soundEffect.pSamples = nullptr;
+		soundEffect.xAudio2Buffer.pAudioData = nullptr;
+		soundEffect.memoryBytes = blockCount * blockBytes;
+	}
+
+	const int16_t* GetDecodedFrames( const AudioVoice& voice, int64_t frame )
+	{
+		const SoundEffect& sfx = *voice.pSoundEffect;
+		AdpcmCache& cache = m_adpcmCaches[&voice - m_voicePool];
+		int block = static_cast<int>( frame / ADPCM_BLOCK_FRAMES );
+
+		if( cache.block != block )
+		{
+			int channels = sfx.channels;
+			int blockBytes = ADPCM_CHANNEL_BYTES * channels;
+			int frames = std::min( ADPCM_BLOCK_FRAMES, sfx.frameCount - block * ADPCM_BLOCK_FRAMES );
+
+			for( int c = 0; c < channels; c++ )
+			{
+				const uint8_t* pHeader = sfx.pAdpcm + block * blockBytes + c * 4;
+				const uint8_t* pCodes = sfx.pAdpcm + block * blockBytes + channels * 4 + c * ( ADPCM_CHANNEL_BYTES - 4 );
+				int16_t first;
+				memcpy( &first, pHeader, sizeof( int16_t ) );
+				int predictor = first;
+				int stepIndex = pHeader[2];
+
+				int16_t* pOut = cache.samples + c;
+				pOut[0] = first;
+				for( int i = 1; i < frames; i += 2 )
+				{
+					int codes = *pCodes++;
+					pOut[i * channels] = static_cast<int16_t>( DecodeAdpcm( codes & 0xF, predictor, stepIndex ) );
+					if( i + 1 < frames )
+						pOut[( i + 1 ) * channels] = static_cast<int16_t>( DecodeAdpcm( codes >> 4, predictor, stepIndex ) );
+				}
+			}
+			cache.block = block;
+		}
+
+		return cache.samples + ( frame - static_cast<int64_t>( block ) * ADPCM_BLOCK_FRAMES ) * sfx.channels;
+	}
+
+	SoundMemoryStats GetSoundMemoryStats()
+	{
+		ASSERT_AUDIO;
+
+		SoundMemoryStats stats;
+		for( const SoundEffect& sfx : m_vSoundEffects )
+		{
+			stats.soundCount++;
+			stats.dataBytes += sfx.dataBytes;
+			stats.memoryBytes += sfx.memoryBytes;
+		}
+		return stats;
+	}
+
+	//********************************************************************************************************************************
+	// Loading functions
+	//********************************************************************************************************************************
+
+	// RIFF (Resource Interchange File Format) is a tagged file structure for multimedia resource files. 
+	// The RIFF structure identifies supported file formats using four-character codes, and groups their data into chunks. 
+	struct RiffChunk
+	{
+		uint32_t m_id; // The type of data (4x char)
+		uint32_t m_size; // The size of the chunk
+	};
+
+	// The format tags of the sounds the mixer plays (not the Windows macros, which headless builds don't have)
+	constexpr uint16_t WAV_FORMAT_PCM = 0x0001;
+	constexpr uint16_t WAV_FORMAT_EXTENSIBLE = 0xFFFE;
+	// Extensible formats give the actual format as a GUID at this offset in the format chunk
+	constexpr size_t WAV_SUBFORMAT_OFFSET = 24;
+	// KSDATAFORMAT_SUBTYPE_PCM, as it's stored in the file
+	constexpr uint8_t WAV_SUBFORMAT_PCM[16] = { 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 };
+
+	// A chunk which has been checked to lie within the file
+	struct RiffChunkData
+	{
+		uint32_t id{ 0 };
+		const uint8_t* pData{ nullptr };
+		uint32_t size{ 0 };
+	};
+
+	bool NextRiffChunk( const uint8_t* pFile, size_t endOffset, size_t& offset, RiffChunkData& chunk )
+	{
+		// Nothing is read unless it lies before endOffset, however the chunk sizes in the file have been mangled
+		if( offset > endOffset || endOffset - offset < sizeof( RiffChunk ) )
+			return false;
+
+		RiffChunk header;
+		memcpy( &header, pFile + offset, sizeof( RiffChunk ) ); // The file may not keep it aligned
+		offset += sizeof( RiffChunk );
+
+		// A chunk which claims to run past the end is cut short (files which weren't finished being written are like this)
+		chunk.id = header.m_id;
+		chunk.pData = pFile + offset;
+		chunk.size = static_cast<uint32_t>( std::min<size_t>( header.m_size, endOffset - offset ) );
+
+		// Chunks are padded to an even size
+		offset += static_cast<size_t>( chunk.size ) + ( chunk.size & 1 );
+		return true;
+	}
+
+	bool ParseWavFile( const uint8_t* pFile, size_t fileSize, SoundEffect& soundEffect )
+	{
+		// The first chunk is the root entry and must have a ID of 'RIFF' 
+		size_t offset = 0;
+		RiffChunkData riffChunk;
+		if( !NextRiffChunk( pFile, fileSize, offset, riffChunk ) || riffChunk.id != 'FFIR' || riffChunk.size < sizeof( uint32_t ) ) // Reverse byte order = 'FFIR'
+			return false;
+
+		// Next we're looking for a WAVE chunk (.WAV file) or a XWMA chunk (xWMA compressed audio).
+		uint32_t waveId;
+		memcpy( &waveId, riffChunk.pData, sizeof( uint32_t ) );
+		if( waveId != 'EVAW' && waveId != 'AMWX' )
+			return false;
+
+		// Subsequent chunks should be the sound data, within the RIFF chunk (unknown ones are skipped)
+		size_t endOffset = static_cast<size_t>( riffChunk.pData - pFile ) + riffChunk.size;
+		offset = static_cast<size_t>( riffChunk.pData - pFile ) + sizeof( uint32_t );
+
+		bool bFoundFormat = false;
+		bool bFoundData = false;
+		bool bPCM = false;
+		RiffChunkData dpdsChunk;
+
+		RiffChunkData chunk;
+		while( NextRiffChunk( pFile, endOffset, offset, chunk ) )
+		{
+			switch( chunk.id )
+			{
+			case ' tmf': // format chunk (fmt backwards)
+				if( chunk.size < sizeof( PCMWAVEFORMAT ) )
+					return false;
+				memcpy( &soundEffect.format, chunk.pData, sizeof( PCMWAVEFORMAT ) );
+				bFoundFormat = true;
+
+				// Anything else (such as ADPCM or float samples) would be played as noise
+				bPCM = soundEffect.format.Format.wFormatTag == WAV_FORMAT_PCM;
+				if( soundEffect.format.Format.wFormatTag == WAV_FORMAT_EXTENSIBLE )
+					bPCM = chunk.size >= WAV_SUBFORMAT_OFFSET + sizeof( WAV_SUBFORMAT_PCM ) && memcmp( chunk.pData + WAV_SUBFORMAT_OFFSET, WAV_SUBFORMAT_PCM, sizeof( WAV_SUBFORMAT_PCM ) ) == 0;
+				break;
+
+			case 'atad': // Data chunk (data backwards)
+				soundEffect.xAudio2Buffer.pAudioData = chunk.pData;
+				soundEffect.xAudio2Buffer.AudioBytes = chunk.size;
+				bFoundData = true;
+				break;
+
+			case 'sdpd': // DPDS XWMA chunk (which may come before the format)
+				dpdsChunk = chunk;
+				break;
+			}
+		}
+
+		if( !bFoundFormat || !bFoundData )
+			return false;
+
+		const WAVEFORMATEX& format = soundEffect.format.Format;
+		if( format.wFormatTag == WAVE_FORMAT_WMAUDIO2 || format.wFormatTag == WAVE_FORMAT_WMAUDIO3 )
+		{
+			if( !dpdsChunk.pData )
+				return false;
+			soundEffect.isXWMA = true;
+			soundEffect.xAudio2BufferWMA.pDecodedPacketCumulativeBytes = reinterpret_cast<const uint32_t*>( dpdsChunk.pData );
+			soundEffect.xAudio2BufferWMA.PacketCount = dpdsChunk.size / 4;
+			return true;
+		}
+
+		// The mixer only plays 16-bit PCM
+		if( !bPCM || format.wBitsPerSample != 16 || format.nChannels == 0 || format.nSamplesPerSec == 0 || format.nSamplesPerSec > MAX_SOUND_SAMPLE_RATE )
+			return false;
+
+		soundEffect.channels = format.nChannels;
+		soundEffect.sampleRate = format.nSamplesPerSec;
+		soundEffect.frameCount = static_cast<int>( soundEffect.xAudio2Buffer.AudioBytes / ( format.nChannels * sizeof( int16_t ) ) );
+		return true;
+	}
+
+#ifndef PLAY_HEADLESS
+	const uint8_t* MapSoundFile( const std::string& filename, size_t& fileSize )
+	{
+		HANDLE hFile = CreateFileA( filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+		PLAY_ASSERT_MSG( hFile != INVALID_HANDLE_VALUE, std::string( "Unable to open sound file: " + filename ).c_str() );
+		if( hFile == INVALID_HANDLE_VALUE )
+			return nullptr;
+
+		LARGE_INTEGER size{};
+		GetFileSizeEx( hFile, &size );
+		HANDLE hMapping = size.QuadPart > 0 ? CreateFileMappingA( hFile, nullptr, PAGE_READONLY, 0, 0, nullptr ) : nullptr;
+		const uint8_t* pFile = hMapping ? static_cast<const uint8_t*>( MapViewOfFile( hMapping, FILE_MAP_READ, 0, 0, 0 ) ) : nullptr;
+
+		// The view keeps the file open by itself
+		if( hMapping )
+			CloseHandle( hMapping );
+		CloseHandle( hFile );
+
+		fileSize = static_cast<size_t>( size.QuadPart );
+		return pFile;
+	}
+
+	void UnmapSoundFile( const uint8_t* pFile, size_t )
+	{
+		UnmapViewOfFile( pFile );
+	}
+#elif !defined(_WIN32)
+	const uint8_t* MapSoundFile( const std::string& filename, size_t& fileSize )
+	{
+		int fd = open( filename.c_str(), O_RDONLY );
+		PLAY_ASSERT_MSG( fd != -1, std::string( "Unable to open sound file: " + filename ).c_str() );
+		if( fd == -1 )
+			return nullptr;
+
+		struct stat status{};
+		fileSize = fstat( fd, &status ) == 0 ? static_cast<size_t>( status.st_size ) : 0;
+		void* pMapping = fileSize > 0 ? mmap( nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0 ) : MAP_FAILED;
+
+		// The mapping keeps the file open by itself
+		close( fd );
+
+		return pMapping != MAP_FAILED ? static_cast<const uint8_t*>( pMapping ) : nullptr;
+	}
+
+	void UnmapSoundFile( const uint8_t* pFile, size_t fileSize )
+	{
+		munmap( const_cast<uint8_t*>( pFile ), fileSize );
+	}
+#else
+	// Headless Windows builds don't include the Windows headers, so they read the whole file in instead of mapping it
+	const uint8_t* MapSoundFile( const std::string& filename, size_t& fileSize )
+	{
+		std::ifstream file( filename, std::ios::binary | std::ios::ate );
+		PLAY_ASSERT_MSG( file, std::string( "Unable to open sound file: " + filename ).c_str() );
+		if( !file )
+			return nullptr;
+
+		fileSize = static_cast<size_t>( file.tellg() );
+		if( fileSize == 0 )
+			return nullptr;
+
+		uint8_t* pFile = new uint8_t[fileSize];
+		file.seekg( 0 );
+		file.read( reinterpret_cast<char*>( pFile ), fileSize );
+		return pFile;
+	}
+
+	void UnmapSoundFile( const uint8_t* pFile, size_t )
+	{
+		delete[] pFile;
+	}
+#endif // PLAY_HEADLESS
+
+	bool LoadSoundEffect( std::string& filename, SoundEffect& soundEffect )
+	{
+		// Map the file into memory rather than reading it in, so the samples can be played from where they are
+		size_t fileSize = 0;
+		const uint8_t* pFile = MapSoundFile( filename, fileSize );
+
+		bool bValid = pFile && ParseWavFile( pFile, fileSize, soundEffect );
+		PLAY_ASSERT_MSG( bValid, std::string( "Invalid sound data in: " + filename ).c_str() );
+		if( !bValid )
+		{
+			if( pFile )
+				UnmapSoundFile( pFile, fileSize );
+			return false;
+		}
+
+		soundEffect.pMappedFile = pFile;
+		soundEffect.mappedBytes = fileSize;
+		soundEffect.fileAndPath = filename;
+		soundEffect.dataBytes = soundEffect.xAudio2Buffer.AudioBytes;
+		soundEffect.memoryBytes = static_cast<int>( fileSize );
+
+		// Initialise typical flags (some overwritten on play)
+		soundEffect.xAudio2Buffer.Flags = XAUDIO2_END_OF_STREAM;
+		soundEffect.xAudio2Buffer.LoopBegin = 0u;
+		soundEffect.xAudio2Buffer.LoopLength = 0u;
+		soundEffect.xAudio2Buffer.LoopCount = 0;
+
+		if( soundEffect.isXWMA )
+			return true;
+
+		const uint8_t* pData = soundEffect.xAudio2Buffer.pAudioData;
+		int frameBytes = soundEffect.channels * sizeof( int16_t );
+
+		// Large PCM files are streamed, so only their first chunk is kept in memory (and the file isn't left mapped)
+		if( fileSize > static_cast<size_t>( STREAMING_THRESHOLD_BYTES ) && soundEffect.channels <= STREAM_MAX_CHANNELS && soundEffect.frameCount > STREAM_CHUNK_FRAMES * 2 )
+		{
+			soundEffect.pFileBuffer = new uint8_t[STREAM_CHUNK_FRAMES * frameBytes];
+			memcpy( soundEffect.pFileBuffer, pData, STREAM_CHUNK_FRAMES * frameBytes );
+			soundEffect.streamDataOffset = pData - pFile; // Worked out while pData still points into the mapping
+			UnmapSoundFile( pFile, fileSize );
+
+			soundEffect.pMappedFile = nullptr;
+			soundEffect.mappedBytes = 0;
+			soundEffect.xAudio2Buffer.pAudioData = nullptr;
+			soundEffect.pSamples = reinterpret_cast<const int16_t*>( soundEffect.pFileBuffer );
+			soundEffect.bStreamed = true;
+			soundEffect.dataBytes = soundEffect.frameCount * frameBytes;
+			soundEffect.memoryBytes = STREAM_CHUNK_FRAMES * frameBytes;
+			return true;
+		}
+
+		// The mixer plays the samples straight from the mapped file, unless a badly padded file has left them unaligned
+		if( reinterpret_cast<uintptr_t>( pData ) % alignof( int16_t ) != 0 )
+		{
+			soundEffect.pFileBuffer = new uint8_t[soundEffect.xAudio2Buffer.AudioBytes];
+			memcpy( soundEffect.pFileBuffer, pData, soundEffect.xAudio2Buffer.AudioBytes );
+			soundEffect.xAudio2Buffer.pAudioData = soundEffect.pFileBuffer;
+			pData = soundEffect.pFileBuffer;
+		}
+		soundEffect.pSamples = reinterpret_cast<const int16_t*>( pData );
+
+		if( m_soundStorage == SoundStorage::ADPCM && soundEffect.channels <= ADPCM_MAX_CHANNELS )
+			CompressSoundEffect( soundEffect );
+
+		return true;
+	}
+
+	void WriteWavHeader( std::ostream& out, uint32_t frameCount )
+	{
+		// A canonical 44 byte header for 16-bit stereo PCM at the mixer's sample rate
+		struct WavHeader
+		{
+			uint32_t riffId{ 'FFIR' };
+			uint32_t riffSize{ 0 };
+			uint32_t waveId{ 'EVAW' };
+			uint32_t fmtId{ ' tmf' };
+			uint32_t fmtSize{ 16 };
+			uint16_t formatTag{ 1 }; // PCM
+			uint16_t channels{ MIX_CHANNELS };
+			uint32_t sampleRate{ MIX_SAMPLE_RATE };
+			uint32_t bytesPerSecond{ MIX_SAMPLE_RATE * MIX_CHANNELS * sizeof( int16_t ) };
+			uint16_t blockAlign{ MIX_CHANNELS * sizeof( int16_t ) };
+			uint16_t bitsPerSample{ 16 };
+			uint32_t dataId{ 'atad' };
+			uint32_t dataSize{ 0 };
+		};
+
+		WavHeader header;
+		header.dataSize = frameCount * header.blockAlign;
+		header.riffSize = header.dataSize + sizeof( WavHeader ) - 8;
+		out.write( reinterpret_cast<const char*>( &header ), sizeof( WavHeader ) );
+	}
+}
+//********************************************************************************************************************************
+// File:		PlayInput.cpp
+// Description:	Manages keyboard and mouse input 
+// Platform:	Windows (or scripted, with PLAY_HEADLESS)
+// Notes:		Obtains mouse data from PlayWindow via MouseData structure
+//********************************************************************************************************************************
+
+
+#define ASSERT_INPUT PLAY_ASSERT_MSG( Play::Input::m_bCreated, "Input Manager not initialised. Call Input::CreateManager() before using the Play::Input library functions.")
+
+namespace Play::Input
+{
+	// Flag to record whether the manager has been created
+	bool m_bCreated = false;
+	// The state of the mouse
+	MouseData m_mouseData;
+#ifdef PLAY_HEADLESS
+	// The scripted state of each key, indexed by KeyboardButton
+	bool m_scriptedKeys[256]{};
+#endif
+
+	//********************************************************************************************************************************
+	// Create and Destroy functions
+	//********************************************************************************************************************************
+	MouseData* CreateManager(void)
+	{
+		PLAY_ASSERT_MSG(!m_bCreated, "Input manager has already been created!");
+		m_bCreated = true;
+		return &m_mouseData;
+	}
+
+	bool DestroyManager(void) 
+	{
+		ASSERT_INPUT;
+		m_bCreated = false;
+		return true;
+	}
+
+	//********************************************************************************************************************************
+	// Mouse functions
+	//********************************************************************************************************************************
+	bool GetMouseDown(MouseButton button)
+	{
+		ASSERT_INPUT;
+		PLAY_ASSERT_MSG(button == MouseButton::BUTTON_LEFT || button == MouseButton::BUTTON_RIGHT, "Invalid mouse button selected.");
+
+		if (button == MouseButton::BUTTON_LEFT)
+			return m_mouseData.left;
+		else
+			return m_mouseData.right;
+	};
+
+	bool KeyPress( KeyboardButton key, int frame)
+	{
+		ASSERT_INPUT;
+		static std::map< int, int > keyMap;
+
+		int& previous_frame = keyMap[key];
+
+		// Returns true if key wasn't pressed the last time we checked or if this is the same frame as the last check
+		if (KeyHeld(key) && (previous_frame == 0 || (previous_frame == frame && frame != -1)))
+		{
+			previous_frame = frame;
+			return true;
+		}
+
+		if (!KeyHeld(key))
+			previous_frame = 0;
+
+		return false;
+	}
+
+	bool KeyHeld( KeyboardButton key)
+	{
+		ASSERT_INPUT;
+#ifndef PLAY_HEADLESS
+		return GetAsyncKeyState(key) & 0x8000; // Don't want multiple calls to KeyState
+#else
+		return key >= 0 && key < 256 && m_scriptedKeys[key];
+#endif
+	}
+
+#ifdef PLAY_HEADLESS
+	void SetScriptedKey( KeyboardButton key, bool held )
+	{
+		ASSERT_INPUT;
+		PLAY_ASSERT_MSG( key >= 0 && key < 256, "Invalid key." );
+		m_scriptedKeys[key] = held;
+	}
+
+	void SetScriptedMouse( Point2f pos, bool left, bool right )
+	{
+		ASSERT_INPUT;
+		m_mouseData.pos = pos;
+		m_mouseData.left = left;
+		m_mouseData.right = right;
+	}
+#endif // PLAY_HEADLESS
+
+	Point2f GetMousePos() 
+	{ 
+		ASSERT_INPUT;
+		return m_mouseData.pos; 
+	}
+}
+//********************************************************************************************************************************
+// File:		PlayJobs.cpp
+// Description:	A small work-stealing job system for spreading work across worker threads
+// Platform:	Independent
+//********************************************************************************************************************************
+
+#define ASSERT_JOBS PLAY_ASSERT_MSG( Play::Jobs::m_bCreated, "Job Manager not initialised. Call Jobs::CreateManager() before using the Play::Jobs library functions.")
+
+namespace Play::Jobs
+{
+	// Flag to record whether the manager has been created
+	bool m_bCreated = false;
+
+	// A single chunk of work from a call to ParallelFor
+	struct Job
+	{
+		const std::function<void( int, int )>* pFunction{ nullptr };
+		int begin{ 0 };
+		int end{ 0 };
+		std::atomic<int>* pRemaining{ nullptr }; // Counts down the unfinished chunks of the ParallelFor call
+	};
+
+	// Every thread has its own queue: it takes jobs from the back of its own queue and steals from the front of the others
+	struct JobQueue
+	{
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	std::vector<std::thread> m_vWorkers;
+	std::vector<JobQueue*> m_vQueues; // Queue 0 belongs to the thread which created the manager, and queue 1 to the render thread
+	thread_local int t_queueIndex = 0;
+	constexpr int RENDER_QUEUE = 1;
+	constexpr int FIRST_WORKER_QUEUE = 2;
+
+	// Sleeping workers are woken when there are jobs waiting to be taken, and threads in ParallelFor when their chunks have finished
+	std::atomic<int> m_waitingJobs{ 0 };
+	std::atomic<bool> m_bQuit{ false };
+	std::mutex m_wakeMutex;
+	std::condition_variable m_wakeCondition;
+
+	// Internal (private) functions
+	bool RunOneJob( int queueIndex );
+	void WorkerThread( int queueIndex );
+
+	//********************************************************************************************************************************
+	// Create and Destroy functions
+	//********************************************************************************************************************************
+	bool CreateManager( int workerCount )
 	{
-		ASSERT_GRAPHICS;
-		PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to get frames of invalid sprite id" );
-		return m_vSpriteData[spriteId].totalCount;
+		PLAY_ASSERT_MSG( !m_bCreated, "Job manager has already been created!" );
+
+		if( workerCount < 0 )
+			workerCount = std::max( static_cast<int>( std::thread::hardware_concurrency() ) - 1, 0 );
+
+		m_bQuit = false;
+		m_waitingJobs = 0;
+
+		for( int i = 0; i < FIRST_WORKER_QUEUE + workerCount; i++ )
+			m_vQueues.push_back( new JobQueue );
+
+		for( int i = FIRST_WORKER_QUEUE; i < FIRST_WORKER_QUEUE + workerCount; i++ )
+			m_vWorkers.push_back( std::thread( WorkerThread, i ) );
+
+		m_bCreated = true;
+		return true;
 	}
 
-	Vector2f GetSpriteOrigin( int spriteId ) 
+	bool DestroyManager()
 	{
-		ASSERT_GRAPHICS;
-		PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to get origin with invalid sprite id" );
-		return { m_vSpriteData[spriteId].originX, m_vSpriteData[spriteId].originY };
+		ASSERT_JOBS;
+
+		{
+			std::lock_guard<std::mutex> lock( m_wakeMutex );
+			m_bQuit = true;
+		}
+		m_wakeCondition.notify_all();
+
+		for( std::thread& worker : m_vWorkers )
+			worker.join();
+
+		for( JobQueue* pQueue : m_vQueues )
+			delete pQueue;
+
+		m_vWorkers.clear();
+		m_vQueues.clear();
+
+		m_bCreated = false;
+		return true;
 	}
 
-	void SetSpriteOrigin( int spriteId, Vector2f newOrigin, bool relative )
+	//********************************************************************************************************************************
+	// Job functions
+	//********************************************************************************************************************************
+	void ParallelFor( int count, int chunkSize, const std::function<void( int, int )>& fn )
 	{
-		ASSERT_GRAPHICS;
-		PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to set origin with invalid sprite id" );
-		if( relative )
+		ASSERT_JOBS;
+
+		if( count <= 0 )
+			return;
+
+		if( chunkSize < 1 )
+			chunkSize = 1;
+
+		int numChunks = ( count + chunkSize - 1 ) / chunkSize;
+
+		// Without any workers (or with only one chunk) there's nothing to be gained from scheduling
+		if( m_vWorkers.empty() || numChunks == 1 )
 		{
-			m_vSpriteData[spriteId].originX += static_cast<int>( newOrigin.x );
-			m_vSpriteData[spriteId].originY += static_cast<int>( newOrigin.y );
+			for( int begin = 0; begin < count; begin += chunkSize )
+				fn( begin, std::min( begin + chunkSize, count ) );
+			return;
 		}
-		else
+
+		std::atomic<int> remaining{ numChunks };
+		m_waitingJobs += numChunks;
+
+		// Deal the chunks out across the calling thread's queue and the workers' so every thread has work before any stealing is needed
+		// > The other thread which isn't a worker (main or render) may not be there to help, so it isn't dealt any
+		int numQueues = static_cast<int>( m_vQueues.size() );
+		int queueIndex = t_queueIndex;
+		for( int c = 0; c < numChunks; c++ )
 		{
-			m_vSpriteData[spriteId].originX = static_cast<int>( newOrigin.x );
-			m_vSpriteData[spriteId].originY = static_cast<int>( newOrigin.y );
+			int begin = c * chunkSize;
+			JobQueue& queue = *m_vQueues[queueIndex];
+			{
+				std::lock_guard<std::mutex> lock( queue.mutex );
+				queue.jobs.push_back( { &fn, begin, std::min( begin + chunkSize, count ), &remaining } );
+			}
+
+			do
+				queueIndex = ( queueIndex + 1 ) % numQueues;
+			while( queueIndex < FIRST_WORKER_QUEUE && queueIndex != t_queueIndex );
 		}
-	}
 
-	void CentreSpriteOrigin( int spriteId )
-	{
-		ASSERT_GRAPHICS;
-		SetSpriteOrigin( spriteId, GetSpriteSize( spriteId ) / 2, false );
+		// Taking the lock before notifying makes sure a worker can't miss the wake-up between checking and sleeping
+		{
+			std::lock_guard<std::mutex> lock( m_wakeMutex );
+		}
+		m_wakeCondition.notify_all();
+
+		// The calling thread helps out rather than waiting idle, then sleeps until the chunks other threads took have finished
+		// > It also wakes for new jobs, such as those from a ParallelFor inside one of the chunks
+		while( remaining > 0 )
+		{
+			if( RunOneJob( t_queueIndex ) )
+				continue;
+
+			std::unique_lock<std::mutex> lock( m_wakeMutex );
+			m_wakeCondition.wait( lock, [&remaining] { return remaining == 0 || m_waitingJobs > 0; } );
+		}
 	}
 
-	void CentreAllSpriteOrigins( void )
+	int GetWorkerCount()
 	{
-		ASSERT_GRAPHICS;
-		for( Sprite& s : m_vSpriteData )
-			CentreSpriteOrigin( s.id );
+		ASSERT_JOBS;
+		return static_cast<int>( m_vWorkers.size() );
 	}
 
-	void FlipSpriteOriginVertically( int spriteId )
+	bool IsCreated()
 	{
-		ASSERT_GRAPHICS;
-		Vector2f origin = GetSpriteOrigin( spriteId );
-		origin.y = GetSpriteSize( spriteId ).y - origin.y;
-		SetSpriteOrigin( spriteId, origin, false );
+		return m_bCreated;
 	}
 
-	void FlipAllSpriteOriginsVertically( void )
+	void UseRenderQueue()
 	{
-		ASSERT_GRAPHICS;
-		for( Sprite& s : m_vSpriteData )
-			FlipSpriteOriginVertically( s.id );
+		t_queueIndex = RENDER_QUEUE;
 	}
 
-	void SetSpriteOrigins( const char* rootName, Vector2f newOrigin, bool relative )
+	bool RunOneJob( int queueIndex )
 	{
-		ASSERT_GRAPHICS;
-		std::string tofind( rootName );
-		for( char& c : tofind ) c = static_cast<char>( toupper( c ) );
+		Job job;
+		bool bFound = false;
+		int numQueues = static_cast<int>( m_vQueues.size() );
 
-		for( Sprite& s : m_vSpriteData )
+		// Try our own queue first (newest job first), then try stealing the oldest job from each of the others in turn
+		for( int n = 0; n < numQueues && !bFound; n++ )
 		{
-			if( s.name.find( tofind ) != std::string::npos )
+			JobQueue& queue = *m_vQueues[( queueIndex + n ) % numQueues];
+			std::lock_guard<std::mutex> lock( queue.mutex );
+
+			if( queue.jobs.empty() )
+				continue;
+
+			if( n == 0 )
 			{
-				if( relative )
-				{
-					s.originX += static_cast<int>( newOrigin.x );
-					s.originY += static_cast<int>( newOrigin.y );
-				}
-				else
-				{
-					s.originX = static_cast<int>( newOrigin.x );
-					s.originY = static_cast<int>( newOrigin.y );
-				}
+				job = queue.jobs.back();
+				queue.jobs.pop_back();
+			}
+			else
+			{
+				job = queue.jobs.front();
+				queue.jobs.pop_front();
 			}
+			bFound = true;
 		}
-	}
 
-	int GetTotalLoadedSprites() 
-	{ 
-		ASSERT_GRAPHICS;
-		return m_nTotalSprites; 
-	}
-	
-	const PixelData* GetSpritePixelData(int spriteId) 
-	{ 
-		ASSERT_GRAPHICS;
-		return &m_vSpriteData[spriteId].canvasBuffer; 
-	}
+		if( !bFound )
+			return false;
 
-	//********************************************************************************************************************************
-	// Drawing functions
-	//********************************************************************************************************************************
+		m_waitingJobs--;
+		{
+			PLAY_PROFILE_SCOPE( "Job" );
+			( *job.pFunction )( job.begin, job.end );
+		}
 
-	void DrawTransparent( int spriteId, Point2f pos, int frameIndex, BlendColour globalMultiply)
+		// The last chunk wakes the thread waiting in ParallelFor (the counter can't be used after this, as it may have returned)
+		if( --( *job.pRemaining ) == 0 )
+		{
+			{
+				std::lock_guard<std::mutex> lock( m_wakeMutex );
+			}
+			m_wakeCondition.notify_all();
+		}
+		return true;
+	}
+
+	void WorkerThread( int queueIndex )
 	{
-		ASSERT_GRAPHICS;
-		const Sprite& spr = m_vSpriteData[spriteId];
-		int destx = static_cast<int>( pos.x + 0.5f ) - spr.originX;
-		int desty = static_cast<int>( pos.y + 0.5f ) + (spr.height - spr.originY);
-		frameIndex = frameIndex % spr.totalCount;
-		int frameX = frameIndex % spr.hCount;
-		int frameY = frameIndex / spr.hCount;
-		int pixelX = frameX * spr.width;
-		int pixelY = frameY * spr.height;
-		int frameOffset = pixelX + ( spr.canvasBuffer.width * pixelY );
+		t_queueIndex = queueIndex;
+		Profile::SetThreadName( "Worker " + std::to_string( queueIndex - FIRST_WORKER_QUEUE + 1 ) );
 
-		switch (blendMode)
+		while( !m_bQuit )
 		{
-			case BLEND_NORMAL:
-				Render::BlitPixels<Render::AlphaBlendPolicy>(spr.preMultAlpha, frameOffset, destx, desty, spr.width, spr.height, globalMultiply);
-				break;
-			case BLEND_ADD:
-				Render::BlitPixels<Render::AdditiveBlendPolicy>(spr.preMultAlpha, frameOffset, destx, desty, spr.width, spr.height, globalMultiply);
-				break;
-			case BLEND_MULTIPLY:
-				Render::BlitPixels<Render::MultiplyBlendPolicy>(spr.canvasBuffer, frameOffset, destx, desty, spr.width, spr.height, globalMultiply);
-				break;
-			default:
-				PLAY_ASSERT_MSG(false, "Unsupported blend mode in DrawTransparent")
-					break;
+			if( RunOneJob( queueIndex ) )
+				continue;
+
+			std::unique_lock<std::mutex> lock( m_wakeMutex );
+			m_wakeCondition.wait( lock, [] { return m_bQuit || m_waitingJobs > 0; } );
 		}
+	}
+}
+//********************************************************************************************************************************
+// File:		PlayCapture.cpp
+// Description:	Records the presented frames to numbered image files, for bug reports, replays and comparing against known good frames
+// Platform:	Independent
+//********************************************************************************************************************************
 
+namespace Play::Capture
+{
+	// A frame in the ring: slots are filled and handed to the encoders in ring order, but can finish in any order
+	enum class SlotState
+	{
+		FREE,
+		WAITING, // Copied, but not yet taken by an encoder
+		ENCODING,
 	};
 
-	void DrawRotated( int spriteId, Point2f pos, int frameIndex, float angle, float scale, BlendColour globalMultiply )
+	struct CaptureSlot
 	{
-		ASSERT_GRAPHICS;
-		Matrix2D trans = MatrixScale( scale, scale ) * MatrixRotation( angle )  * MatrixTranslation( pos.x, pos.y );
-		DrawTransformed( spriteId, trans, frameIndex, globalMultiply);
-	}
+		PixelData image;
+		int frame{ 0 };
+		SlotState state{ SlotState::FREE };
+	};
 
-	void DrawTransformed( int spriteId, const Matrix2D& trans, int frameIndex, BlendColour globalMultiply)
+	std::vector<CaptureSlot> m_vRing;
+	std::string m_directory;
+	std::vector<std::thread> m_vEncoderThreads;
+	std::mutex m_captureMutex; // Guards everything apart from the pixels of the slots being encoded
+	std::condition_variable m_captureCondition;
+	std::atomic<bool> m_bCapturing{ false };
+	bool m_bStopping{ false };
+	int m_nextCapture{ 0 }; // The slot the next frame is copied into
+	int m_nextEncode{ 0 }; // The slot the next free encoder takes
+	int m_frameNumber{ 0 };
+	CaptureStats m_stats;
+	double m_totalEncodeMs{ 0.0 };
+
+	// Internal (private) functions
+	// Encodes and writes the frames in the ring until capturing stops
+	void EncoderThread( int index );
+
+	bool StartCapture( const char* directory, int ringFrames, int encoderThreads )
 	{
-		ASSERT_GRAPHICS;
-		const Sprite& spr = m_vSpriteData[spriteId];
-		frameIndex = frameIndex % spr.totalCount;
-		int frameX = frameIndex % spr.hCount;
-		int frameY = frameIndex / spr.hCount;
-		int pixelX = frameX * spr.width;
-		int pixelY = frameY * spr.height;
-		int frameOffset = pixelX + ( spr.canvasBuffer.width * pixelY );
+		PLAY_ASSERT_MSG( ringFrames > 0, "The capture ring needs at least one frame" );
+		PLAY_ASSERT_MSG( encoderThreads >= 0, "The number of capture encoder threads can't be negative" );
 
-		Vector2f origin = { spr.originX, spr.height - spr.originY };
+		if( m_bCapturing )
+			StopCapture();
+
+		std::error_code error;
+		std::filesystem::create_directories( directory, error );
+		if( !std::filesystem::is_directory( directory ) )
+			return false;
+
+		if( encoderThreads == 0 )
+			encoderThreads = std::max( static_cast<int>( std::thread::hardware_concurrency() ) / 2, 1 );
+
+		// The slots' pixels are allocated by the first frame, when the size is known
+		m_vRing.assign( ringFrames, CaptureSlot{} );
+		m_directory = directory;
+		m_bStopping = false;
+		m_nextCapture = 0;
+		m_nextEncode = 0;
+		m_frameNumber = 0;
+		m_stats = CaptureStats{};
+		m_stats.encoderThreads = encoderThreads;
+		m_totalEncodeMs = 0.0;
+		m_bCapturing = true;
+		for( int i = 0; i < encoderThreads; i++ )
+			m_vEncoderThreads.emplace_back( EncoderThread, i );
+		return true;
+	}
+
+	void StopCapture()
+	{
+		if( !m_bCapturing )
+			return;
 
-		switch (blendMode)
 		{
-		case BLEND_NORMAL:
-			Render::TransformPixels<Render::AlphaBlendPolicy>(spr.preMultAlpha, frameOffset, spr.width, spr.height, origin, trans, globalMultiply);
-			break;
-		case BLEND_ADD:
-			Render::TransformPixels<Render::AdditiveBlendPolicy>(spr.preMultAlpha, frameOffset, spr.width, spr.height, origin, trans, globalMultiply);
-			break;
-		case BLEND_MULTIPLY:
-			Render::TransformPixels<Render::MultiplyBlendPolicy>(spr.preMultAlpha, frameOffset, spr.width, spr.height, origin, trans, globalMultiply);
-			break;
-		default:
-			PLAY_ASSERT_MSG(false, "Unsupported blend mode in DrawTransparent")
-				break;
+			std::unique_lock<std::mutex> lock( m_captureMutex );
+			m_bCapturing = false;
+			m_bStopping = true;
 		}
+		m_captureCondition.notify_all();
+		for( std::thread& thread : m_vEncoderThreads )
+			thread.join();
+		m_vEncoderThreads.clear();
+
+		for( CaptureSlot& slot : m_vRing )
+			delete[] slot.image.pPixels;
+		m_vRing.clear();
 	}
 
-	void DrawBackground( int backgroundId )
+	bool IsCapturing()
 	{
-		ASSERT_GRAPHICS;
-		PLAY_ASSERT_MSG( m_playBuffer.pPixels, "Trying to draw background without initialising display!" );
-		PLAY_ASSERT_MSG( m_vBackgroundData.size() > static_cast<size_t>(backgroundId), "Background image out of range!" );
-		Render::BlitBackground( m_vBackgroundData[backgroundId] );
+		return m_bCapturing;
 	}
 
-	void ColourSprite( int spriteId, int r, int g, int b )
+	CaptureStats GetCaptureStats()
 	{
-		ASSERT_GRAPHICS;
-		PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to colour invalid sprite id" );
-
-		Sprite& s = m_vSpriteData[spriteId];
-		uint32_t col = ( ( r & 0xFF ) << 16 ) | ( ( g & 0xFF ) << 8 ) | ( b & 0xFF );
-
-		PreMultiplyAlpha( s.canvasBuffer.pPixels, s.preMultAlpha.pPixels, s.canvasBuffer.width, s.canvasBuffer.height, s.width, 1.0f, col );
-		s.canvasBuffer.preMultiplied = true;
+		std::unique_lock<std::mutex> lock( m_captureMutex );
+		CaptureStats stats = m_stats;
+		stats.averageEncodeMs = m_stats.framesWritten > 0 ? static_cast<float>( m_totalEncodeMs / m_stats.framesWritten ) : 0.0f;
+		return stats;
 	}
 
-	int DrawString( int fontId, Point2f pos, std::string text )
+	void CaptureFrame( const PixelData& frame )
 	{
-		ASSERT_GRAPHICS;
-		PLAY_ASSERT_MSG( fontId >= 0 && fontId < m_nTotalSprites, "Trying to use invalid sprite id for font" );
+		if( !m_bCapturing )
+			return;
 
-		int width = 0;
+		// The encoders only take the lock to take or free a slot, so this never waits for a frame to be encoded
+		std::unique_lock<std::mutex> lock( m_captureMutex );
 
-		for( char c : text )
+		if( !m_bCapturing )
+			return;
+
+		int frameNumber = m_frameNumber++;
+
+		CaptureSlot& slot = m_vRing[m_nextCapture];
+		if( slot.state != SlotState::FREE )
 		{
-			Draw( fontId, { pos.x + width, pos.y }, c - 32 );
-			width += GetFontCharWidth( fontId, c );
+			if( m_stats.framesDropped++ == 0 )
+			{
+				char message[160];
+				snprintf( message, sizeof( message ), "Capture is dropping frames, starting with frame %d: the encoder threads (%d) can't keep up\n", frameNumber, m_stats.encoderThreads );
+				DebugOutput( message );
+			}
+			return;
 		}
-		return width;
+
+		if( slot.image.width != frame.width || slot.image.height != frame.height )
+		{
+			delete[] slot.image.pPixels;
+			slot.image.width = frame.width;
+			slot.image.height = frame.height;
+			slot.image.pPixels = new Pixel[static_cast<size_t>( frame.width ) * frame.height];
+		}
+
+		memcpy( slot.image.pPixels, frame.pPixels, sizeof( Pixel ) * frame.width * frame.height );
+		slot.frame = frameNumber;
+		slot.state = SlotState::WAITING;
+
+		m_nextCapture = ( m_nextCapture + 1 ) % static_cast<int>( m_vRing.size() );
+		m_stats.framesCaptured++;
+		lock.unlock();
+		m_captureCondition.notify_one();
 	}
 
-	int DrawStringCentred( int fontId, Point2f pos, std::string text )
+	void EncoderThread( int index )
 	{
-		ASSERT_GRAPHICS;
-		int totalWidth = 0;
+		Profile::SetThreadName( "Capture " + std::to_string( index + 1 ) );
+		std::vector<uint8_t> vEncoded;
+		std::unique_lock<std::mutex> lock( m_captureMutex );
 
-		for( char c : text )
-			totalWidth += GetFontCharWidth( fontId, c );
+		while( true )
+		{
+			m_captureCondition.wait( lock, [] { return m_vRing[m_nextEncode].state == SlotState::WAITING || m_bStopping; } );
 
-		pos.x -= totalWidth / 2;
+			// Everything captured is written before stopping
+			if( m_vRing[m_nextEncode].state != SlotState::WAITING )
+				break;
 
-		DrawString( fontId, pos, text );
-		return totalWidth;
-	}
+			CaptureSlot& slot = m_vRing[m_nextEncode];
+			slot.state = SlotState::ENCODING;
+			m_nextEncode = ( m_nextEncode + 1 ) % static_cast<int>( m_vRing.size() );
+			lock.unlock();
 
-	int DrawChar( int fontId, Point2f pos, char c )
-	{
-		ASSERT_GRAPHICS;
-		PLAY_ASSERT_MSG( fontId >= 0 && fontId < m_nTotalSprites, "Trying to use invalid sprite id for font" );
-		Draw( fontId, { pos.x, pos.y }, c - 32 );
-		return GetFontCharWidth( fontId, c );
-	}
+			std::chrono::steady_clock::time_point before = std::chrono::steady_clock::now();
 
-	int DrawCharRotated( int fontId, Point2f pos, float angle, float scale, char c )
-	{
-		ASSERT_GRAPHICS;
-		PLAY_ASSERT_MSG( fontId >= 0 && fontId < m_nTotalSprites, "Trying to use invalid sprite id for font" );
-		DrawRotated( fontId, { pos.x, pos.y }, c - 32, angle, scale );
-		return GetFontCharWidth( fontId, c );
-	}
+			vEncoded.clear();
+			EncodeQOI( slot.image, vEncoded );
 
-	int GetFontCharWidth( int fontId, char c )
-	{
-		ASSERT_GRAPHICS;
-		PLAY_ASSERT_MSG( fontId >= 0 && fontId < m_nTotalSprites, "Trying to use invalid sprite id for font" );
-		int glyphWidthDataOffset = m_vSpriteData[ fontId ].canvasBuffer.width * (m_vSpriteData[ fontId ].canvasBuffer.height - 1);
-		return (m_vSpriteData[fontId].canvasBuffer.pPixels + glyphWidthDataOffset + ( c - 32 ))->b; // character width hidden in pixel data
+			char filename[32];
+			snprintf( filename, sizeof( filename ), "/frame_%06d.qoi", slot.frame );
+			std::ofstream file( m_directory + filename, std::ios::binary );
+			file.write( reinterpret_cast<const char*>( vEncoded.data() ), vEncoded.size() );
+			bool bWritten = file.good();
+			file.close();
+
+			double encodeMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - before ).count();
+
+			lock.lock();
+			slot.state = SlotState::FREE;
+			m_totalEncodeMs += encodeMs;
+			if( bWritten )
+			{
+				m_stats.framesWritten++;
+				m_stats.bytesWritten += static_cast<long long>( vEncoded.size() );
+			}
+			else
+			{
+				m_stats.writeErrors++;
+			}
+		}
 	}
 
 	//********************************************************************************************************************************
-	// Function:	SpriteCollide: function that checks by pixel if two sprites collide
-	// Parameters:	s1Xpos, s1Ypos, s2Xpos, s2Ypos = the origin of rotation for both sprites.
-	//				s1Id, s2Id = the ids of both sprites
-	//				s1angle, s2angle = the angle of rotation for both sprites, clockwise. 0 = unrotated.
-	//				s1Pixelcoll, s2Pixelcoll = the top left and bottom right co-ordinates defining the collision rectangle of both sprites
-	//				
-	// Returns: true if a single pixel or more overlap between the two sprites and false if not.
-	// Notes:	rounding errors may cause it not to be pixel perfect.	
+	// QOI functions
 	//********************************************************************************************************************************
-	int SpriteCollide( int spriteIdA, int frameIndexA, Matrix2D& transA, int spriteIdB, int frameIndexB, Matrix2D& transB )
-	{
-		ASSERT_GRAPHICS;
-		int overlapping_pixels = 0;
-
-		// This algorithm transforms Sprite A's pixels into the co-ordinate space of Sprite B and iterates through all Sprite A's pixels checking for collisions
-		// This only works reliably if the pixels of Sprite A are smaller or the same size as those of Sprite B
-		
-		// If Matrix A's pixels are larger than Matrix A's in both dimensions then swap the sprites around
-		if( transA.row[0].Length() > transB.row[ 0 ].Length() && transA.row[ 1 ].Length() > transB.row[ 1 ].Length() )
-			return SpriteCollide( spriteIdB, frameIndexB, transB, spriteIdA, frameIndexA, transA );
 
-		PLAY_ASSERT_MSG( transA.row[ 0 ].Length() <= transB.row[ 0 ].Length() && transA.row[ 1 ].Length() <= transB.row[ 1 ].Length(), "Sprite Collide algorithm only works with uniform scaling" );
+	// The QOI chunk tags: the 2-bit tags are in the top two bits of the first byte, and the 8-bit ones are the whole byte
+	constexpr uint8_t QOI_OP_INDEX = 0x00;
+	constexpr uint8_t QOI_OP_DIFF = 0x40;
+	constexpr uint8_t QOI_OP_LUMA = 0x80;
+	constexpr uint8_t QOI_OP_RUN = 0xC0;
+	constexpr uint8_t QOI_OP_RGB = 0xFE;
+	constexpr uint8_t QOI_OP_RGBA = 0xFF;
+	constexpr uint8_t QOI_MASK_2 = 0xC0;
+	constexpr int QOI_HEADER_SIZE = 14;
+	constexpr uint8_t QOI_END_MARKER[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
 
-		const Sprite& spr_a = m_vSpriteData[ spriteIdA ];
-		const Sprite& spr_b = m_vSpriteData[ spriteIdB ];
+	// Where a pixel goes in the array of recently seen pixels
+	static inline int QoiHash( Pixel p )
+	{
+		return ( p.r * 3 + p.g * 5 + p.b * 7 + p.a * 11 ) % 64;
+	}
 
-		Matrix2D a_trans_right{ transA };
-		a_trans_right.row[ 0 ] = { transA.row[ 0 ].x, transA.row[ 1 ].x, 0.0f };
-		a_trans_right.row[ 1 ] = { transA.row[ 0 ].y, transA.row[ 1 ].y, 0.0f };
-		a_trans_right.row[ 2 ] = { transA.row[ 2 ].x, -transA.row[ 2 ].y, 1.0f };
-		
-		Matrix2D b_trans_right{ transB };
-		b_trans_right.row[ 0 ] = { transB.row[ 0 ].x, transB.row[ 1 ].x, 0.0f };
-		b_trans_right.row[ 1 ] = { transB.row[ 0 ].y, transB.row[ 1 ].y, 0.0f };
-		b_trans_right.row[ 2 ] = { transB.row[ 2 ].x, -transB.row[ 2 ].y, 1.0f };
+	void EncodeQOI( const PixelData& image, std::vector<uint8_t>& vOut )
+	{
+		PLAY_PROFILE_SCOPE( "EncodeQOI" );
+		size_t pixelCount = static_cast<size_t>( image.width ) * image.height;
 
-		frameIndexA = frameIndexA % spr_a.totalCount;
-		int a_frame_x = frameIndexA % spr_a.hCount;
-		int a_frame_y = frameIndexA / spr_a.hCount;
-		int a_pixel_x = a_frame_x * spr_a.width;
-		int a_pixel_y = a_frame_y * spr_a.height;
-		int a_frame_offset = a_pixel_x + (spr_a.canvasBuffer.width * a_pixel_y);
+		// The worst case is every pixel needing a QOI_OP_RGBA chunk
+		size_t start = vOut.size();
+		vOut.resize( start + QOI_HEADER_SIZE + pixelCount * 5 + sizeof( QOI_END_MARKER ) );
+		uint8_t* pOut = vOut.data() + start;
 
-		frameIndexB = frameIndexB % spr_b.totalCount;
-		int b_frame_x = frameIndexB % spr_b.hCount;
-		int b_frame_y = frameIndexB / spr_b.hCount;
-		int b_pixel_x = b_frame_x * spr_b.width;
-		int b_pixel_y = b_frame_y * spr_b.height;
-		int b_frame_offset = b_pixel_x + (spr_b.canvasBuffer.width * b_pixel_y);
+		auto write32 = [&pOut]( uint32_t value )
+		{
+			*pOut++ = static_cast<uint8_t>( value >> 24 );
+			*pOut++ = static_cast<uint8_t>( value >> 16 );
+			*pOut++ = static_cast<uint8_t>( value >> 8 );
+			*pOut++ = static_cast<uint8_t>( value );
+		};
 
-		Vector2f a_origin = { spr_a.originX, spr_a.height - spr_a.originY };
-		Vector2f b_origin = { spr_b.originX, spr_b.height - spr_b.originY };
+		memcpy( pOut, "qoif", 4 );
+		pOut += 4;
+		write32( image.width );
+		write32( image.height );
+		*pOut++ = 4; // RGBA
+		*pOut++ = 0; // sRGB with linear alpha
 
-		Matrix2D b_inv_trans = Play::MatrixTranslation( -b_origin.x, -b_origin.y ) * b_trans_right;
-		b_inv_trans.Inverse();
-		Matrix2D a2b_trans = Play::MatrixTranslation( -a_origin.x, -a_origin.y ) * a_trans_right * b_inv_trans;
+		Pixel index[64];
+		std::fill( index, index + 64, Pixel( 0u ) );
+		Pixel prev( 0xFF000000 );
 
-		float b_posx = a2b_trans.row[2].x;
-		float b_posy = a2b_trans.row[2].y;
+		const Pixel* pPixels = image.pPixels;
+		for( size_t i = 0; i < pixelCount; i++ )
+		{
+			Pixel p = pPixels[i];
 
-		float b_xincx = a2b_trans.row[ 0 ].x;
-		float b_xincy = a2b_trans.row[ 0 ].y;
-		float b_yincx = a2b_trans.row[ 1 ].x;
-		float b_yincy = a2b_trans.row[ 1 ].y;
-		float b_xresetx = b_xincx * spr_a.width; // This needs to be sprite a's width as that's the space we are iterating through
-		float b_xresety = b_xincy * spr_a.width; // This needs to be sprite a's width as that's the space we are iterating through
+			if( p.bits == prev.bits )
+			{
+				// Find the whole run in one go, as frames often have large areas of one colour
+				size_t end = i + 1;
+				while( end < pixelCount && pPixels[end].bits == p.bits )
+					end++;
+
+				size_t run = end - i;
+				for( ; run >= 62; run -= 62 )
+					*pOut++ = QOI_OP_RUN | 61;
+				if( run > 0 )
+					*pOut++ = static_cast<uint8_t>( QOI_OP_RUN | ( run - 1 ) );
+
+				i = end - 1;
+				continue;
+			}
 
-		uint32_t* a_pixel = (uint32_t*)spr_a.preMultAlpha.pPixels + a_frame_offset;
-		uint32_t* a_pixel_end = a_pixel + (spr_a.height * spr_a.canvasBuffer.width);
+			int hash = QoiHash( p );
 
-		// Iterate sequentially through pixels within the render target buffer
-		while( a_pixel < a_pixel_end )
-		{
-			// For each row of pixels in turn
-			uint32_t* dst_row_end = a_pixel + spr_a.width;
-			while( a_pixel < dst_row_end )
+			if( index[hash].bits == p.bits )
 			{
-				if( *a_pixel < 0xFF000000 )
+				*pOut++ = static_cast<uint8_t>( QOI_OP_INDEX | hash );
+			}
+			else
+			{
+				index[hash] = p;
+
+				if( p.a == prev.a )
 				{
-					// The origin of a pixel is in its centre
-					int roundX = static_cast<int>(b_posx + 0.5f);
-					int roundY = static_cast<int>(b_posy + 0.5f);
+					int8_t dr = static_cast<int8_t>( p.r - prev.r );
+					int8_t dg = static_cast<int8_t>( p.g - prev.g );
+					int8_t db = static_cast<int8_t>( p.b - prev.b );
+					int8_t drg = static_cast<int8_t>( dr - dg );
+					int8_t dbg = static_cast<int8_t>( db - dg );
 
-					// Clip within the sprite boundaries
-					if( roundX >= 0 && roundY >= 0 && roundX < spr_b.width && roundY < spr_b.height )
+					if( dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1 )
 					{
-						int b_pixel_index = roundX + (roundY * spr_b.canvasBuffer.width);
-						uint32_t* b_pixel = ((uint32_t*)spr_b.canvasBuffer.pPixels + b_pixel_index + b_frame_offset);
-						if( *b_pixel & 0xFF000000 )
-							overlapping_pixels++; // Could also overwite to visualise: *b_pixel = 0xFFFFFFFF, but need to call UpdateSprite afterwards.	
+						*pOut++ = static_cast<uint8_t>( QOI_OP_DIFF | ( dr + 2 ) << 4 | ( dg + 2 ) << 2 | ( db + 2 ) );
+					}
+					else if( dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7 )
+					{
+						*pOut++ = static_cast<uint8_t>( QOI_OP_LUMA | ( dg + 32 ) );
+						*pOut++ = static_cast<uint8_t>( ( drg + 8 ) << 4 | ( dbg + 8 ) );
+					}
+					else
+					{
+						*pOut++ = QOI_OP_RGB;
+						*pOut++ = p.r;
+						*pOut++ = p.g;
+						*pOut++ = p.b;
 					}
 				}
-
-				// Move one horizontal pixel in render target, which corresponds to the x axis of the inverse matrix in sprite space
-				a_pixel++;
-				b_posx += b_xincx;
-				b_posy += b_xincy;
+				else
+				{
+					*pOut++ = QOI_OP_RGBA;
+					*pOut++ = p.r;
+					*pOut++ = p.g;
+					*pOut++ = p.b;
+					*pOut++ = p.a;
+				}
 			}
 
-			// Move render target pointer to the start of the next row
-			a_pixel += spr_a.canvasBuffer.width - spr_a.width;
+			prev = p;
+		}
 
-			// Move sprite buffer pointer back to the start of the current row
-			b_posx -= b_xresetx;
-			b_posy -= b_xresety;
+		memcpy( pOut, QOI_END_MARKER, sizeof( QOI_END_MARKER ) );
+		pOut += sizeof( QOI_END_MARKER );
 
-			// One vertical pixel in the render target corresponds to the y axis of the inverse matrix in sprite space
-			b_posx += b_yincx;
-			b_posy += b_yincy;
-		}
-		return overlapping_pixels;
+		vOut.resize( pOut - vOut.data() );
 	}
 
-	//********************************************************************************************************************************
-	// Function:	PreMultiplyAlpha - calculates the (src*srcAlpha) alpha blending calculation in advance as it doesn't change
-	// Parameters:	s = the sprite to pre-calculate data for
-	// Notes:		Also inverts the alpha ready for the (dest*(1-srcAlpha)) calculation and stores information in the new
-	//				buffer which provides the number of fully-transparent pixels in a row (so they can be skipped)
-	//********************************************************************************************************************************
-	void PreMultiplyAlpha( Pixel* source, Pixel* dest, int width, int height, int maxSkipWidth, float alphaMultiply = 1.0f, Pixel colourMultiply = 0x00FFFFFF )
+	bool DecodeQOI( const uint8_t* pData, size_t size, PixelData& image )
 	{
-		ASSERT_GRAPHICS;
-
-		Pixel* pSourcePixels = source;
-		Pixel* pDestPixels = dest;
+		if( size < QOI_HEADER_SIZE + sizeof( QOI_END_MARKER ) || memcmp( pData, "qoif", 4 ) != 0 )
+			return false;
 
-		// Iterate through all the pixels in the entire canvas
-		for( int bh = 0; bh < height; bh++ )
+		auto read32 = [pData]( int offset )
 		{
-			for( int bw = 0; bw < width; bw++ )
-			{
-				Pixel src = *pSourcePixels;
+			return static_cast<uint32_t>( pData[offset] ) << 24 | static_cast<uint32_t>( pData[offset + 1] ) << 16 | static_cast<uint32_t>( pData[offset + 2] ) << 8 | pData[offset + 3];
+		};
 
-				// Separate the channels and calculate src*srcAlpha
-				int srcAlpha = static_cast<int>( ( src.bits >> 24 ) * alphaMultiply );
+		uint32_t width = read32( 4 );
+		uint32_t height = read32( 8 );
+		uint8_t channels = pData[12];
 
-				int destRed = ( srcAlpha * ( ( src.bits >> 16 ) & 0xFF ) ) >> 8;
-				int destGreen = ( srcAlpha * ( ( src.bits >> 8 ) & 0xFF ) ) >> 8;
-				int destBlue = ( srcAlpha * ( src.bits & 0xFF ) ) >> 8;
+		// Stop a corrupt header asking for an enormous image
+		if( width == 0 || height == 0 || width > 16384 || height > 16384 || ( channels != 3 && channels != 4 ) )
+			return false;
 
-				destRed = ( destRed * ( ( colourMultiply.bits >> 16 ) & 0xFF ) ) >> 8;
-				destGreen = ( destGreen * ( ( colourMultiply.bits >> 8 ) & 0xFF ) ) >> 8;
-				destBlue = ( destBlue * ( colourMultiply.bits & 0xFF ) ) >> 8;
+		size_t pixelCount = static_cast<size_t>( width ) * height;
+		Pixel* pPixels = new Pixel[pixelCount];
 
-				srcAlpha = 0xFF - srcAlpha; // invert the alpha ready to multiply with the destination pixels
-				*pDestPixels = ( srcAlpha << 24 ) | ( destRed << 16 ) | ( destGreen << 8 ) | destBlue;
+		Pixel index[64];
+		std::fill( index, index + 64, Pixel( 0u ) );
+		Pixel p( 0xFF000000 );
 
-				if( srcAlpha == 0xFF ) // Completely transparent pixel
-				{
-					int repeats = 0;
-					// We can only skip to the end of the row because the sprite frames are arranged on a continuous canvas
-					int maxSkip = maxSkipWidth - ( bw % maxSkipWidth );
+		const uint8_t* pIn = pData + QOI_HEADER_SIZE;
+		const uint8_t* pEnd = pData + size - sizeof( QOI_END_MARKER );
+		size_t i = 0;
 
-					for( int zw = 1; zw < maxSkip; zw++ )
+		while( i < pixelCount && pIn < pEnd )
+		{
+			uint8_t b1 = *pIn++;
+
+			if( b1 == QOI_OP_RGB || b1 == QOI_OP_RGBA )
+			{
+				int bytes = b1 == QOI_OP_RGB ? 3 : 4;
+				if( pEnd - pIn < bytes )
+					break;
+				p.r = *pIn++;
+				p.g = *pIn++;
+				p.b = *pIn++;
+				if( bytes == 4 )
+					p.a = *pIn++;
+			}
+			else
+			{
+				switch( b1 & QOI_MASK_2 )
+				{
+					case QOI_OP_INDEX:
+						p = index[b1];
+						break;
+					case QOI_OP_DIFF:
+						p.r = static_cast<uint8_t>( p.r + ( ( b1 >> 4 ) & 0x03 ) - 2 );
+						p.g = static_cast<uint8_t>( p.g + ( ( b1 >> 2 ) & 0x03 ) - 2 );
+						p.b = static_cast<uint8_t>( p.b + ( b1 & 0x03 ) - 2 );
+						break;
+					case QOI_OP_LUMA:
 					{
-						if( ( pSourcePixels + zw )->bits >> 24 == 0x00 ) // Another transparent pixel
-							repeats++;
-						else
+						if( pIn == pEnd )
 							break;
+						uint8_t b2 = *pIn++;
+						int dg = ( b1 & 0x3F ) - 32;
+						p.r = static_cast<uint8_t>( p.r + dg - 8 + ( ( b2 >> 4 ) & 0x0F ) );
+						p.g = static_cast<uint8_t>( p.g + dg );
+						p.b = static_cast<uint8_t>( p.b + dg - 8 + ( b2 & 0x0F ) );
+						break;
+					}
+					case QOI_OP_RUN:
+					{
+						// The run includes this pixel, which is written below
+						size_t run = std::min<size_t>( b1 & 0x3F, pixelCount - i - 1 );
+						for( size_t r = 0; r < run; r++ )
+							pPixels[i++] = p;
+						break;
 					}
-					*pDestPixels = 0xFF000000 | repeats; // Doesn't matter what the colour was so we use it to store the skip value
 				}
-				pDestPixels++;
-				pSourcePixels++;
 			}
+
+			index[QoiHash( p )] = p;
+			pPixels[i++] = p;
 		}
+
+		if( i < pixelCount )
+		{
+			delete[] pPixels;
+			return false;
+		}
+
+		image.width = static_cast<int>( width );
+		image.height = static_cast<int>( height );
+		image.pPixels = pPixels;
+		image.preMultiplied = false;
+		return true;
 	}
 
-	//********************************************************************************************************************************
-	// Basic drawing functions
-	//********************************************************************************************************************************
-	void DrawPixel( Point2f pos, Pixel srcPix )
+	bool LoadQOI( const std::string& filename, PixelData& image )
 	{
-		ASSERT_GRAPHICS;
+		std::ifstream file( filename, std::ios::binary );
+		if( !file )
+			return false;
 
-		pos.y = Window::GetHeight() - pos.y; //// Flip the y-coordinate to be consistant with a Cartesian co-ordinate system
+		std::vector<uint8_t> vData( ( std::istreambuf_iterator<char>( file ) ), std::istreambuf_iterator<char>() );
+		return DecodeQOI( vData.data(), vData.size(), image );
+	}
+}
+//********************************************************************************************************************************
+// File:		PlayProfile.cpp
+// Description:	A hierarchical CPU profiler which times named scopes on any thread, for the timing bar, per scope statistics
+//				and traces which can be viewed in chrome://tracing or https://ui.perfetto.dev
+// Platform:	Independent
+//********************************************************************************************************************************
 
-		// Convert floating point co-ordinates to pixels
-		switch (blendMode)
+namespace Play::Profile
+{
+	constexpr uint32_t EVENT_BUFFER_SIZE = 8192; // The number of events a thread can record between calls to NewFrame
+	constexpr size_t MAX_TRACE_EVENTS = 1 << 21;
+	const char* TIMING_SEGMENT_NAME = "Timing Bar";
+
+	// A ring of events which only its own thread writes, and only NewFrame reads
+	// > The events' times are in ticks until they're collected
+	struct ThreadBuffer
+	{
+		ProfileEvent events[EVENT_BUFFER_SIZE];
+		std::atomic<uint32_t> written{ 0 }; // Counts up forever, so the difference from read is the number waiting
+		std::atomic<uint32_t> read{ 0 };
+		std::atomic<int> dropped{ 0 };
+		int index{ 0 };
+		bool bExited{ false }; // Its thread has gone, so NewFrame frees it once the events are collected
+	};
+
+	// Hands the thread's buffer back when the thread exits, so the threads which come and go don't keep theirs
+	struct ThreadRegistration
+	{
+		ThreadBuffer* pBuffer{ nullptr };
+		~ThreadRegistration();
+	};
+
+	// Statistics while they're being added up
+	struct ScopeTotals
+	{
+		const char* name{ nullptr };
+		int calls{ 0 };
+		double totalMs{ 0.0 };
+		double minMs{ 0.0 };
+		double maxMs{ 0.0 };
+		int frameCalls{ 0 };
+		double frameMs{ 0.0 };
+	};
+
+	std::mutex m_profileMutex; // Guards everything apart from the events in the thread buffers
+	std::vector<ThreadBuffer*> m_vThreadBuffers; // By thread index, with nullptr where a buffer has been freed (and the index can be used again)
+	std::vector<std::string> m_vThreadNames; // By thread index, kept after the buffer is freed so traces still have the name
+	int m_freedDroppedEvents{ 0 }; // Dropped by the threads whose buffers have been freed
+	bool m_bFreeOnExit{ false }; // Set by FreeThreadBuffers, when there won't be another NewFrame to free the buffers of the threads still running
+	std::unordered_map<const char*, ScopeTotals> m_scopeTotals; // By address, so names which are the same string but not the same literal are added together later
+	FrameProfile m_currentFrame;
+	FrameProfile m_lastFrame;
+	bool m_bTracing{ false };
+	long long m_traceBegin{ 0 };
+	std::vector<ProfileEvent> m_vTrace;
+
+	// The calling thread's buffer and scopes
+	thread_local ThreadBuffer* t_pBuffer{ nullptr };
+	thread_local ThreadRegistration t_registration;
+	thread_local int t_depth{ 0 };
+	thread_local uint32_t t_segmentColour{ 0 };
+	thread_local long long t_segmentBegin{ -1 }; // In ticks, or -1 when there isn't a timing bar segment
+
+	// Internal (private) functions
+	// Gives the calling thread a buffer
+	ThreadBuffer* RegisterThread();
+	// Frees a thread's buffer, once its events have been collected
+	void FreeThreadBuffer( ThreadBuffer* pBuffer );
+	// Adds an event to the calling thread's buffer
+	void RecordEvent( const char* name, long long begin, long long end, int depth, uint32_t colour );
+	// Moves the events waiting in every thread buffer into the current frame
+	void CollectEvents();
+	// Writes a string to a JSON file, with quotes and escapes
+	void WriteJsonString( std::ofstream& file, const char* s );
+
+	long long TicksToTime( long long ticks )
+	{
+#ifdef PLAY_PROFILE_TSC
+		// The counter's rate is measured against the system clock the first time it's needed, by spinning for a few milliseconds
+		struct TickClock
 		{
-		case BLEND_NORMAL:
-			// Convert floating point co-ordinates to pixels
-			Render::DrawPixelPreMult<Render::AlphaBlendPolicy>(static_cast<int>(pos.x + 0.5f), static_cast<int>(pos.y + 0.5f), srcPix);
-			break;
-		case BLEND_ADD:
-			// Convert floating point co-ordinates to pixels
-			Render::DrawPixelPreMult<Render::AdditiveBlendPolicy>(static_cast<int>(pos.x + 0.5f), static_cast<int>(pos.y + 0.5f), srcPix);
-			break;
-		case BLEND_MULTIPLY:
-			// Convert floating point co-ordinates to pixels
-			Render::DrawPixel<Render::MultiplyBlendPolicy>(static_cast<int>(pos.x + 0.5f), static_cast<int>(pos.y + 0.5f), srcPix);
-			break;
-		default:
-			PLAY_ASSERT_MSG(false, "Unsupported blend mode in PlayGraphics::DrawPixel")
-				break;
+			long long baseTicks{ 0 };
+			long long baseTime{ 0 };
+			double nsPerTick{ 1.0 };
+		};
+		static const TickClock clock = []
+		{
+			auto steadyTime = [] { return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count(); };
+			TickClock c;
+			c.baseTime = steadyTime();
+			c.baseTicks = GetTicks();
+
+			long long time;
+			do
+				time = steadyTime();
+			while( time - c.baseTime < 5000000 );
+
+			c.nsPerTick = static_cast<double>( time - c.baseTime ) / static_cast<double>( GetTicks() - c.baseTicks );
+			return c;
+		}();
+		return clock.baseTime + static_cast<long long>( static_cast<double>( ticks - clock.baseTicks ) * clock.nsPerTick );
+#else
+		return ticks;
+#endif
+	}
+
+	ThreadRegistration::~ThreadRegistration()
+	{
+		if( !pBuffer )
+			return;
+
+		std::lock_guard<std::mutex> lock( m_profileMutex );
+
+		// Its events may not have been collected yet, so it's normally left for NewFrame to free
+		if( m_bFreeOnExit )
+			FreeThreadBuffer( pBuffer );
+		else
+			pBuffer->bExited = true;
+
+		pBuffer = nullptr;
+		t_pBuffer = nullptr;
+	}
+
+	ThreadBuffer* RegisterThread()
+	{
+		std::lock_guard<std::mutex> lock( m_profileMutex );
+
+		ThreadBuffer* pBuffer = new ThreadBuffer;
+		pBuffer->index = static_cast<int>( std::find( m_vThreadBuffers.begin(), m_vThreadBuffers.end(), nullptr ) - m_vThreadBuffers.begin() );
+		if( pBuffer->index == static_cast<int>( m_vThreadBuffers.size() ) )
+		{
+			m_vThreadBuffers.push_back( nullptr );
+			m_vThreadNames.emplace_back();
+		}
+		m_vThreadBuffers[pBuffer->index] = pBuffer;
+		m_vThreadNames[pBuffer->index].clear();
+
+		t_registration.pBuffer = pBuffer;
+		t_pBuffer = pBuffer;
+		return pBuffer;
+	}
+
+	void FreeThreadBuffer( ThreadBuffer* pBuffer )
+	{
+		m_freedDroppedEvents += pBuffer->dropped.load( std::memory_order_relaxed );
+		m_vThreadBuffers[pBuffer->index] = nullptr;
+		delete pBuffer;
+	}
+
+	void RecordEvent( const char* name, long long begin, long long end, int depth, uint32_t colour )
+	{
+		ThreadBuffer* pBuffer = t_pBuffer ? t_pBuffer : RegisterThread();
+
+		uint32_t written = pBuffer->written.load( std::memory_order_relaxed );
+		if( written - pBuffer->read.load( std::memory_order_acquire ) >= EVENT_BUFFER_SIZE )
+		{
+			pBuffer->dropped.store( pBuffer->dropped.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+			return;
 		}
+
+		ProfileEvent& event = pBuffer->events[written % EVENT_BUFFER_SIZE];
+		event.name = name;
+		event.begin = begin;
+		event.end = end;
+		event.depth = depth;
+		event.colour = colour;
+		event.thread = pBuffer->index;
+		pBuffer->written.store( written + 1, std::memory_order_release );
+	}
+
+	long long BeginScope()
+	{
+		t_depth++;
+		return GetTicks();
+	}
+
+	void EndScope( const char* name, long long begin )
+	{
+		long long end = GetTicks();
+		RecordEvent( name, begin, end, --t_depth, 0 );
+	}
+
+	void BeginSegment( Pixel colour )
+	{
+		long long now = GetTicks();
+		if( t_segmentBegin >= 0 )
+			RecordEvent( TIMING_SEGMENT_NAME, t_segmentBegin, now, -1, t_segmentColour );
+
+		t_segmentColour = colour.bits;
+		t_segmentBegin = now;
 	}
 
-	void DrawLine( Point2f startPos, Point2f endPos, Pixel pix )
+	void EndSegment()
 	{
-		ASSERT_GRAPHICS;
-		// Convert floating point co-ordinates to pixels
-		int x1 = static_cast<int>( startPos.x + 0.5f );
-		int y1 = static_cast<int>( startPos.y + 0.5f );
-		int x2 = static_cast<int>( endPos.x + 0.5f );
-		int y2 = static_cast<int>( endPos.y + 0.5f );
+		if( t_segmentBegin < 0 )
+			return;
 
-		Render::DrawLine( x1, y1, x2, y2, pix );
+		RecordEvent( TIMING_SEGMENT_NAME, t_segmentBegin, GetTicks(), -1, t_segmentColour );
+		t_segmentBegin = -1;
 	}
 
-	void DrawRect( Point2f bottomLeft, Point2f topRight, Pixel pix, bool fill /*= false */ )
+	void SetThreadName( const std::string& name )
 	{
-		ASSERT_GRAPHICS;
-		// Convert floating point co-ordinates to pixels
-		int x1 = static_cast<int>( bottomLeft.x + 0.5f );
-		int x2 = static_cast<int>( topRight.x + 0.5f );
-		int y1 = static_cast<int>( bottomLeft.y + 0.5f );
-		int y2 = static_cast<int>( topRight.y + 0.5f );
+		ThreadBuffer* pBuffer = t_pBuffer ? t_pBuffer : RegisterThread();
+		std::lock_guard<std::mutex> lock( m_profileMutex );
+		m_vThreadNames[pBuffer->index] = name;
+	}
 
-		if( fill )
+	int GetThreadIndex()
+	{
+		return ( t_pBuffer ? t_pBuffer : RegisterThread() )->index;
+	}
+
+	void CollectEvents()
+	{
+		for( ThreadBuffer* pBuffer : m_vThreadBuffers )
 		{
-			for( int x = x1; x < x2; x++ )
+			if( !pBuffer )
+				continue;
+
+			uint32_t read = pBuffer->read.load( std::memory_order_relaxed );
+			uint32_t written = pBuffer->written.load( std::memory_order_acquire );
+
+			for( ; read != written; read++ )
 			{
-				for( int y = y1; y < y2; y++ )
-					DrawPixel({ x, y }, pix);
+				ProfileEvent event = pBuffer->events[read % EVENT_BUFFER_SIZE];
+				event.begin = TicksToTime( event.begin );
+				event.end = TicksToTime( event.end );
+				m_currentFrame.vEvents.push_back( event );
+
+				if( m_bTracing && m_vTrace.size() < MAX_TRACE_EVENTS )
+					m_vTrace.push_back( event );
+
+				// Timing bar segments are only for the bar and traces
+				if( event.depth < 0 )
+					continue;
+
+				double ms = static_cast<double>( event.end - event.begin ) / 1000000.0;
+				ScopeTotals& totals = m_scopeTotals[event.name];
+				if( totals.calls == 0 || ms < totals.minMs )
+					totals.minMs = ms;
+				if( totals.calls == 0 || ms > totals.maxMs )
+					totals.maxMs = ms;
+				totals.name = event.name;
+				totals.calls++;
+				totals.totalMs += ms;
+				totals.frameCalls++;
+				totals.frameMs += ms;
 			}
+
+			pBuffer->read.store( written, std::memory_order_release );
 		}
-		else
+	}
+
+	void NewFrame()
+	{
+		long long nowTicks = GetTicks();
+		long long now = TicksToTime( nowTicks );
+
+		// Split the game thread's timing bar segment, so that each frame's bar is complete
+		if( t_segmentBegin >= 0 )
 		{
-			Render::DrawLine( x1, y1, x2, y1, pix );
-			Render::DrawLine( x2, y1, x2, y2, pix );
-			Render::DrawLine( x2, y2, x1, y2, pix );
-			Render::DrawLine( x1, y2, x1, y1, pix );
+			RecordEvent( TIMING_SEGMENT_NAME, t_segmentBegin, nowTicks, -1, t_segmentColour );
+			t_segmentBegin = nowTicks;
+		}
+
+		std::lock_guard<std::mutex> lock( m_profileMutex );
+
+		for( auto& [name, totals] : m_scopeTotals )
+		{
+			totals.frameCalls = 0;
+			totals.frameMs = 0.0;
+		}
+
+		CollectEvents();
+
+		// The buffers of threads which have exited aren't needed now that their last events have been collected
+		for( ThreadBuffer* pBuffer : m_vThreadBuffers )
+		{
+			if( pBuffer && pBuffer->bExited )
+				FreeThreadBuffer( pBuffer );
 		}
+		m_bFreeOnExit = false;
+
+		m_currentFrame.end = now;
+		std::swap( m_lastFrame, m_currentFrame );
+		m_currentFrame.begin = now;
+		m_currentFrame.vEvents.clear();
 	}
 
-	// Private function called by DrawCircle
-	void DrawCircleOctants( int posX, int posY, int offX, int offY, Pixel pix )
+	const FrameProfile& GetLastFrame()
 	{
-		ASSERT_GRAPHICS;
-		DrawPixel( { posX + offX , posY + offY }, pix );
-		DrawPixel( { posX - offX , posY + offY }, pix );
-		DrawPixel( { posX + offX , posY - offY }, pix );
-		DrawPixel( { posX - offX , posY - offY }, pix );
-		DrawPixel( { posX - offY , posY + offX }, pix );
-		DrawPixel( { posX + offY , posY - offX }, pix );
-		DrawPixel( { posX - offY , posY - offX }, pix );
-		DrawPixel( { posX + offY , posY + offX }, pix );
+		return m_lastFrame;
 	}
 
-	void DrawCircle( Point2f pos, int radius, Pixel pix )
+	std::vector<ScopeStats> GetScopeStats()
 	{
-		ASSERT_GRAPHICS;
-		// Convert floating point co-ordinates to pixels
-		int x = static_cast<int>( pos.x + 0.5f );
-		int y = static_cast<int>( pos.y + 0.5f );
-
-		int dx = 0;
-		int dy = radius;
+		std::lock_guard<std::mutex> lock( m_profileMutex );
 
-		int d = 3 - 2 * radius;
-		DrawCircleOctants( x, y, dx, dy, pix );
+		std::vector<const ScopeTotals*> vSorted;
+		for( const auto& [name, totals] : m_scopeTotals )
+			vSorted.push_back( &totals );
+		std::sort( vSorted.begin(), vSorted.end(), []( const ScopeTotals* a, const ScopeTotals* b ) { return strcmp( a->name, b->name ) < 0; } );
 
-		while( dy >= dx )
+		std::vector<ScopeStats> vStats;
+		double totalMs = 0.0;
+		for( const ScopeTotals* pTotals : vSorted )
 		{
-			dx++;
-			if( d > 0 )
-			{
-				dy--;
-				d = static_cast<int>( d + 4 * ( dx - dy ) + 10 );
-			}
-			else
+			if( vStats.empty() || strcmp( vStats.back().name, pTotals->name ) != 0 )
 			{
-				d = static_cast<int>( d + 4 * dx + 6 );
+				vStats.emplace_back().name = pTotals->name;
+				vStats.back().minMs = static_cast<float>( pTotals->minMs );
+				totalMs = 0.0;
 			}
-			DrawCircleOctants( x, y, dx, dy, pix );
+
+			ScopeStats& stats = vStats.back();
+			stats.calls += pTotals->calls;
+			stats.minMs = std::min( stats.minMs, static_cast<float>( pTotals->minMs ) );
+			stats.maxMs = std::max( stats.maxMs, static_cast<float>( pTotals->maxMs ) );
+			stats.frameCalls += pTotals->frameCalls;
+			stats.frameMs += static_cast<float>( pTotals->frameMs );
+			totalMs += pTotals->totalMs;
+			stats.avgMs = static_cast<float>( totalMs / stats.calls );
 		}
-	};
+		return vStats;
+	}
 
-	void DrawPixelData( PixelData* pixelData, Point2f pos, float alpha )
+	void ResetScopeStats()
 	{
-		ASSERT_GRAPHICS;
-		if( !pixelData->preMultiplied )
+		std::lock_guard<std::mutex> lock( m_profileMutex );
+		m_scopeTotals.clear();
+	}
+
+	int GetDroppedEventCount()
+	{
+		std::lock_guard<std::mutex> lock( m_profileMutex );
+
+		int dropped = m_freedDroppedEvents;
+		for( ThreadBuffer* pBuffer : m_vThreadBuffers )
 		{
-			PreMultiplyAlpha( pixelData->pPixels, pixelData->pPixels, pixelData->width, pixelData->height, pixelData->width );
-			pixelData->preMultiplied = true;
+			if( pBuffer )
+				dropped += pBuffer->dropped.load( std::memory_order_relaxed );
 		}
-		Render::BlitPixels<Render::AlphaBlendPolicy>(*pixelData, 0, static_cast<int>(pos.x), static_cast<int>(pos.y), pixelData->width, pixelData->height, { alpha, 1.0f, 1.0f, 1.0f });
+		return dropped;
+	}
+
+	void FreeThreadBuffers()
+	{
+		std::lock_guard<std::mutex> lock( m_profileMutex );
+
+		// The events are collected first, so that a trace still being kept has them
+		CollectEvents();
+
+		for( ThreadBuffer* pBuffer : m_vThreadBuffers )
+		{
+			if( pBuffer && ( pBuffer->bExited || pBuffer == t_pBuffer ) )
+				FreeThreadBuffer( pBuffer );
+		}
+
+		t_registration.pBuffer = nullptr;
+		t_pBuffer = nullptr;
+		m_bFreeOnExit = true;
 	}
 
 	//********************************************************************************************************************************
-	// Debug font functions
+	// Trace functions
 	//********************************************************************************************************************************
+	void StartTrace()
+	{
+		std::lock_guard<std::mutex> lock( m_profileMutex );
 
-	// Settings for the embedded debug font
-	#define FONT_IMAGE_WIDTH	96
-	#define FONT_IMAGE_HEIGHT	36
-	#define FONT_CHAR_WIDTH		6
-	#define FONT_CHAR_HEIGHT	12
+		// Events recorded before now but not collected yet belong to the frames before the trace
+		CollectEvents();
+		m_vTrace.clear();
+		m_traceBegin = GetTime();
+		m_bTracing = true;
+	}
 
-	// A 96x36 font image @ 1bpp containing basic ASCII characters from 0x30 (0) to 0x5F (underscore) at 6x12 pixels each
-	uint32_t debugFontData[] =
+	bool SaveTrace( const char* filename )
 	{
-		0x87304178, 0x0800861F, 0xFFFFFFE1, 0x7BBFBE79, 0xF7FE79EF, 0xFFFFFFFE, 0x7BBFBE79, 0xF7FE79EC, 0xFFFFFFFE, 0x7BBFBE79, 0xF7FE79EC, 0xFFFFFFFE, 0x7BBFBE79, 0xF7FE79EF, 0xFFEE3DFE, 0x6BB86080,	0x1078860F, 0xE3DFFEFE, 
-		0x5BB7FEFB, 0xE7BE7BEF, 0xFFBFFF41, 0x7BB7FEFB, 0xE7BE7BEC, 0xFFDFFEDF, 0x7BB7FEFB, 0xE7BE7BEC, 0xFFEE3DDF, 0x7BB7FEFB, 0xE7BE7BEF, 0xFFFFFFFF, 0x7BB7BEF9, 0xE7BE7BEF,	0xFFFFFFDF, 0x87B001F8, 0x187E87EF, 0xFFFFFFDF, 
-		0x86106104, 0x00007A30, 0x1E7C5061, 0x79E79E79, 0xF7DF7B7F, 0x5E7DA79E, 0x79E79F79, 0xF7DF7B7F, 0x5E7DA79E, 0x79E79F79, 0xF7DF7B7F, 0x5E7DA79E,	0x59E79F79, 0xF7DF7B7F, 0x597DA79E, 0x58005F78, 0x30D0037F, 0x477DA79E, 
-		0x59E79F79, 0xF7DE7B7F, 0x597DA79E, 0x59E79F79, 0xF7DE7B7F, 0x5E7DA79E, 0x41E79F79, 0xF7DE7B7F, 0x5E7DA79E, 0x7DE79F79,	0xF7DE7B7F, 0x5E7DA79E, 0x7DE79E79, 0xF7DE7B7F, 0x5E7DA79E, 0x81E06104, 0x07C17A38, 0xDE01A7A1, 
-		0x06106101, 0xE79E79E0, 0x337F3FFF, 0x79E79EED, 0xE79E79EF, 0xB77FBFFF, 0x79E79FED, 0xE79E79EF,	0xB7BFBFFF, 0x79E79FED, 0xE79A79EF, 0xB7BFBFFF, 0x79E75FED, 0xE79AB5EF, 0x77DFBFFF, 0x05E0E1ED, 0xE79ACC0E, 0xF7DFBFFF, 
-		0x7DE77EED, 0xE79AB7ED, 0xF7EFBFFF, 0x7DE7BEED, 0xE79A7BEB, 0xF7EFBFFF,	0x7DE7BEED, 0xE79A7BE7, 0xF7F7BFFF, 0x7DA7BEED, 0xE79A7BE7, 0xF7F7BCFF, 0x7DD79EED, 0xEB5A7BE7, 0xF7FBBCFF, 0x7C27A1EE, 0x1CE57810, 0x33FB3EC0
-	};
+		std::lock_guard<std::mutex> lock( m_profileMutex );
 
-	void DecompressDubugFont( void )
-	{
-		ASSERT_GRAPHICS;
+		if( !m_bTracing )
+			return false;
 
-		m_pDebugFontBuffer = new uint8_t[FONT_IMAGE_WIDTH * FONT_IMAGE_HEIGHT];
+		CollectEvents();
+		m_bTracing = false;
 
-		for( int y = 0; y < FONT_IMAGE_HEIGHT; y++ )
+		std::ofstream file( filename );
+		if( !file )
+			return false;
+
+		char number[64];
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+		bool bFirst = true;
+		for( int index = 0; index < static_cast<int>( m_vThreadNames.size() ); index++ )
 		{
-			for( int x = 0; x < FONT_IMAGE_WIDTH; x++ )
-			{
-				int bufferIndex = ( y * FONT_IMAGE_WIDTH ) + x;
-				int dataIndex = bufferIndex / 32;
-				int dataShift = 31 - ( bufferIndex % 32 );
+			if( m_vThreadNames[index].empty() )
+				continue;
 
-				// Convert 1bpp to an 8-bit array for easy data access
-				if( ( debugFontData[dataIndex] >> dataShift ) & 0x01 )
-					m_pDebugFontBuffer[( y * FONT_IMAGE_WIDTH ) + x] = 0; // not ARGB just 0 (no pixel)
-				else
-					m_pDebugFontBuffer[( y * FONT_IMAGE_WIDTH ) + x] = 1; // not ARGB just 1 (a pixel)
-			}
+			file << ( bFirst ? "" : ",\n" ) << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << index << ",\"args\":{\"name\":";
+			WriteJsonString( file, m_vThreadNames[index].c_str() );
+			file << "}}";
+			bFirst = false;
 		}
-	}
 
-	int DrawDebugCharacter( Point2f pos, char c, Pixel pix )
-	{
-		ASSERT_GRAPHICS;
-		// Limited character set in the font (0x30-0x5F) so includes translation of useful chars outside that range
-		switch( c )
+		// Complete ("X") events in microseconds from the start of the trace
+		for( const ProfileEvent& event : m_vTrace )
 		{
-			case 0x2C: c = 0x5E; break; // Map full stop to comma (nearly the same!)
-			case 0x2D: c = 0x3B; break; // Map minus to semi-colon (rarely used)
-			case 0x28: c = 0x5B; break; // Map brackets to square brackets
-			case 0x29: c = 0x5D; break; // Map brackets to square brackets
-			case 0x2E: c = 0x5E; break; // Map full stop to carot (never used)
+			file << ( bFirst ? "" : ",\n" ) << "{\"name\":";
+			WriteJsonString( file, event.name );
+			snprintf( number, sizeof( number ), ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f", ( event.begin - m_traceBegin ) / 1000.0, ( event.end - event.begin ) / 1000.0 );
+			file << number << ",\"pid\":1,\"tid\":" << event.thread;
+			if( event.depth < 0 )
+			{
+				snprintf( number, sizeof( number ), ",\"args\":{\"colour\":\"#%06X\"}", event.colour & 0xFFFFFF );
+				file << number;
+			}
+			file << "}";
+			bFirst = false;
 		}
 
-		if( c < 0x30 || c > 0x5F )
-			return FONT_CHAR_WIDTH;
+		file << "\n]}\n";
+		m_vTrace.clear();
+		m_vTrace.shrink_to_fit();
+		return file.good();
+	}
 
-		int sourceX = ( ( c - 0x30 ) % 16 ) * FONT_CHAR_WIDTH;
-		int sourceY = ( ( c - 0x30 ) / 16 ) * FONT_CHAR_HEIGHT;
+	bool IsTracing()
+	{
+		std::lock_guard<std::mutex> lock( m_profileMutex );
+		return m_bTracing;
+	}
 
-		// Loop over the bounding box of the glyph
-		for( int x = 0; x < FONT_CHAR_WIDTH; x++ )
+	void WriteJsonString( std::ofstream& file, const char* s )
+	{
+		file << '"';
+		for( ; *s; s++ )
 		{
-			for( int y = 0; y < FONT_CHAR_HEIGHT; y++ )
+			if( *s == '"' || *s == '\\' )
+				file << '\\' << *s;
+			else if( static_cast<unsigned char>( *s ) < 0x20 )
 			{
-				if( m_pDebugFontBuffer[( ( sourceY + y ) * FONT_IMAGE_WIDTH ) + ( sourceX + x )] > 0 )
-					DrawPixel( { pos.x + x, pos.y + (FONT_CHAR_HEIGHT - y - 1) }, pix ); 
+				char escaped[8];
+				snprintf( escaped, sizeof( escaped ), "\\u%04x", *s );
+				file << escaped;
 			}
+			else
+				file << *s;
 		}
-		return FONT_CHAR_WIDTH;
+		file << '"';
 	}
+}
+//********************************************************************************************************************************
+// File:		PlayManager.cpp
+// Description:	A manager for providing simplified access to the PlayBuffer framework
+// Platform:	Independent
+// Notes:		The GameObject management is "opt in" as many will want to create their own GameObject class
+//********************************************************************************************************************************
 
-	int DrawDebugString( Point2f pos, const std::string& s, Pixel pix, bool centred )
-	{
-		ASSERT_GRAPHICS;
+namespace Play
+{
+	// A set of default colour definitions
+	Colour cBlack{ 0.0f, 0.0f, 0.0f };
+	Colour cRed{ 100.0f, 0.0f, 0.0f };
+	Colour cGreen{ 0.0f, 100.0f, 0.0f };
+	Colour cBlue{ 0.0f, 0.0f, 100.0f };
+	Colour cMagenta{ 100.0f, 0.0f, 100.0f };
+	Colour cCyan{ 0.0f, 100.0f, 100.0f };
+	Colour cYellow{ 100.0f, 100.0f, 0.0f };
+	Colour cOrange{ 100.0f, 50.0f, 0.0f };
+	Colour cWhite{ 100.0f, 100.0f, 100.0f };
+	Colour cGrey{ 50.0f, 50.0f, 50.0f };
 
-		if( m_pDebugFontBuffer == nullptr )
-			DecompressDubugFont();
+	int frameCount = 0; // Updated in Play::Present
 
-		if( centred )
-			pos.x -= GetDebugStringWidth( s ) / 2;
+	// The camera
+	Point2f cameraPos{ 0.0f, 0.0f };
+	// Spaces and co-ordinate systems
+	DrawingSpace drawSpace = DrawingSpace::WORLD;
 
-		pos.y -= 6; // half the height of the debug font
+	// The fixed timestep simulation
+	struct FixedTimestep
+	{
+		double tickTime{ 0.0 }; // 0 when the fixed timestep is off
+		int maxTicksPerFrame{ 4 };
+		double accumulator{ 0.0 };
+		float interpolation{ 1.0f };
+		int tick{ 0 }; // The number of the latest tick, which GameObjects use to tell if they were updated in it
+		bool bInTick{ false };
+		TickStats stats;
+	};
+	static FixedTimestep fixedTimestep;
 
-		for( char c : s )
-			pos.x += DrawDebugCharacter( pos, static_cast<char>( toupper( c ) ), pix ) + 1;
+#ifdef PLAY_USING_GAMEOBJECT_MANAGER
+	// Internal (private) function which deletes the GameObjects destroyed this frame
+	void FlushDestroyedGameObjects();
+#endif
 
-		// Return horizontal position at the end of the string so strings can be concatenated easily
-		return static_cast<int>( pos.x );
+	//**************************************************************************************************
+	// Manager creation and deletion
+	//**************************************************************************************************
+
+	void CreateManager( int displayWidth, int displayHeight, int displayScale )
+	{
+		Play::Graphics::CreateManager( displayWidth, displayHeight, "Data/Sprites/" );
+		Play::Window::CreateManager( Play::Graphics::GetDrawingBuffer(), displayScale );
+		Play::Window::RegisterMouse( Play::Input::CreateManager() );
+		Play::Audio::CreateManager( "Data/Audio/" );
+		Play::Jobs::CreateManager();
+		// Seed the game's random number generator based on the time
+		srand( (int)time( NULL ) );
 	}
 
-	int GetDebugStringWidth( const std::string& s )
+	void DestroyManager()
 	{
-		ASSERT_GRAPHICS;
-		return static_cast<int>( s.length() ) * ( FONT_CHAR_WIDTH + 1 );
+		Play::Audio::DestroyManager();
+		Play::Graphics::DestroyManager();
+		Play::Window::DestroyManager();
+		Play::Input::DestroyManager();
+		Play::Jobs::DestroyManager();
+#ifdef PLAY_USING_GAMEOBJECT_MANAGER
+		Play::DestroyAllGameObjects();
+#endif
+		// After the managers, once their threads have stopped
+		Play::Profile::FreeThreadBuffers();
 	}
 
-	//********************************************************************************************************************************
-	// Miscellaneous functions
-	//********************************************************************************************************************************
-	PixelData* GetDrawingBuffer(void) 
-	{ 
-		ASSERT_GRAPHICS;
-		return &m_playBuffer; 
+	//**************************************************************************************************
+	// PlayGraphics functions
+	//**************************************************************************************************
+
+	void ClearDrawingBuffer( Colour c )
+	{
+		int r = static_cast<int>( c.red * 2.55f );
+		int g = static_cast<int>( c.green * 2.55f );
+		int b = static_cast<int>( c.blue * 2.55f );
+		Play::Graphics::ClearBuffer( { r, g, b } );
+	}
+
+	void DrawDebugText( Point2D pos, const char* text, Colour c, bool centred )
+	{
+		Play::Graphics::DrawDebugString( TRANSFORM_SPACE( pos ), text, { c.red * 2.55f, c.green * 2.55f, c.blue * 2.55f }, centred );
 	}
 
-	LARGE_INTEGER EndTimingSegment()
-	{
-		ASSERT_GRAPHICS;
+	void PresentDrawingBuffer()
+	{
+		static bool debugInfo = false;
+		DrawingSpace originalDrawSpace = drawSpace;
+
+		if( KeyPressed( KEY_F1 ) )
+			debugInfo = !debugInfo;
+#ifndef PLAY_DISABLE_RENDER_COUNTERS
+		if( KeyPressed( KEY_F2 ) )
+			Play::Graphics::SetOverdrawView( !Play::Graphics::GetOverdrawView() );
+#endif
+
+		if( debugInfo )
+		{
+			drawSpace = DrawingSpace::SCREEN;
 
-		int size = static_cast<int>( m_vTimings.size() );
+			int textX = 10;
+			int textY = 10;
+			auto drawInfo = [&]( const std::string& s )
+			{
+				Play::Graphics::DrawDebugString( { textX - 1, textY - 1 }, s, PIX_BLACK, false );
+				Play::Graphics::DrawDebugString( { textX + 1, textY + 1 }, s, PIX_BLACK, false );
+				Play::Graphics::DrawDebugString( { textX + 1, textY - 1 }, s, PIX_BLACK, false );
+				Play::Graphics::DrawDebugString( { textX - 1, textY + 1 }, s, PIX_BLACK, false );
+				Play::Graphics::DrawDebugString( { textX, textY }, s, PIX_YELLOW, false );
+				textY += 20;
+			};
+
+			drawInfo( "PlayBuffer Version:" + std::string( PLAY_VERSION ) );
+			if( Play::Graphics::GetDirtyRectTracking() )
+				drawInfo( "Dirty Pixels:" + std::to_string( Play::Graphics::GetDirtyPixelCount() ) );
+#ifndef PLAY_DISABLE_RENDER_COUNTERS
+			// The debug font only has upper case letters, digits and a little punctuation
+			Play::Render::RenderCounters counters = Play::Graphics::GetRenderCounters();
+			auto draws = [&counters]( int blend ) { return counters.blits[blend] + counters.transforms[blend]; };
+			long long blended = counters.pixelsWritten + counters.pixelsSkipped;
+			char info[128];
+			snprintf( info, sizeof( info ), "Draws Normal:%d Add:%d Multiply:%d Pixels:%d", draws( Play::Graphics::BLEND_NORMAL ), draws( Play::Graphics::BLEND_ADD ),
+				draws( Play::Graphics::BLEND_MULTIPLY ), counters.pixelDraws[0] + counters.pixelDraws[1] + counters.pixelDraws[2] );
+			drawInfo( info );
+			snprintf( info, sizeof( info ), "Pixels Written:%lld Skipped:%lld Cleared:%lld", counters.pixelsWritten, counters.pixelsSkipped, counters.pixelsCleared );
+			drawInfo( info );
+			snprintf( info, sizeof( info ), "Skip Ratio:%.2f Overdraw:%.2f", blended > 0 ? static_cast<float>( counters.pixelsSkipped ) / blended : 0.0f, Play::Graphics::GetOverdraw() );
+			drawInfo( info );
+#endif
 
-		LARGE_INTEGER now, freq;
-		QueryPerformanceCounter( &now );
-		QueryPerformanceFrequency( &freq );
+			drawSpace = DrawingSpace::WORLD;
 
-		if( size > 0 )
-		{
-			m_vTimings[size - 1].end = now.QuadPart;
-			m_vTimings[size - 1].millisecs = static_cast<float>( m_vTimings[size - 1].end - m_vTimings[size - 1].begin );
-			m_vTimings[size - 1].millisecs = static_cast<float>( ( m_vTimings[size - 1].millisecs * 1000.0f ) / freq.QuadPart );
+#ifdef PLAY_USING_GAMEOBJECT_MANAGER	
+			DrawGameObjectsDebug();
+#endif
 		}
-		return now;
-	}
 
-	int SetTimingBarColour( Pixel pix )
-	{
-		ASSERT_GRAPHICS;
+		Play::Graphics::PresentFrame();
+#ifdef PLAY_USING_GAMEOBJECT_MANAGER	
+		FlushDestroyedGameObjects();
+#endif
+		frameCount++;
 
-		TimingSegment newData;
-		newData.pix = pix;
-		newData.begin = EndTimingSegment().QuadPart;
+		drawSpace = originalDrawSpace;
+	}
 
-		m_vTimings.push_back( newData );
+	//**************************************************************************************************
+	// Fixed timestep functions
+	//**************************************************************************************************
 
-		return static_cast<int>( m_vTimings.size() );
-	};
+	void SetFixedTimestep( int ticksPerSecond, int maxTicksPerFrame )
+	{
+		PLAY_ASSERT_MSG( ticksPerSecond >= 0, "Invalid tick rate: must be 0 or more" );
+		PLAY_ASSERT_MSG( maxTicksPerFrame > 0, "Invalid maximum ticks per frame: must be at least 1" );
+		int tick = fixedTimestep.tick; // Keep counting so no GameObject looks like it was updated in a later tick
+		fixedTimestep = FixedTimestep{};
+		fixedTimestep.tick = tick;
+		fixedTimestep.tickTime = ticksPerSecond > 0 ? 1.0 / ticksPerSecond : 0.0;
+		fixedTimestep.maxTicksPerFrame = maxTicksPerFrame;
+	}
 
-	void DrawTimingBar( Point2f pos, Point2f size )
+	int RunFixedTimestep( float elapsedTime, std::function<void( float )> tick )
 	{
-		ASSERT_GRAPHICS;
+		FixedTimestep& ft = fixedTimestep;
+		PLAY_ASSERT_MSG( ft.tickTime > 0.0, "The fixed timestep is off: call SetFixedTimestep first" );
+		PLAY_ASSERT_MSG( !ft.bInTick, "RunFixedTimestep can't be called from inside a tick" );
 
-		EndTimingSegment();
+		ft.accumulator += std::max( elapsedTime, 0.0f );
+		int due = static_cast<int>( ft.accumulator / ft.tickTime );
+		int run = std::min( due, ft.maxTicksPerFrame );
+		// Ticks over the limit are thrown away rather than carried over, or a slow machine would never catch up
+		ft.accumulator -= due * ft.tickTime;
+		ft.stats.droppedTicks += due - run;
 
-		int startPixel{ 0 };
-		int endPixel{ 0 };
-		for( const TimingSegment& t : m_vPrevTimings )
+		for( int n = 0; n < run; n++ )
 		{
-			endPixel += static_cast<int>( ( size.width * t.millisecs ) / 16.667f );
-			DrawRect( { pos.x + startPixel, pos.y }, { pos.x + endPixel, pos.y + size.height }, t.pix, true );
-			startPixel = endPixel;
+			ft.tick++;
+			ft.bInTick = true;
+			tick( static_cast<float>( ft.tickTime ) );
+			ft.bInTick = false;
 		}
 
-		DrawRect( { pos.x, pos.y }, { pos.x + size.width, pos.y + size.height }, PIX_BLACK, false );
-		DrawRect( { pos.x - 1, pos.y - 1 }, { pos.x + size.width + 1 , pos.y + size.height + 1 }, PIX_WHITE, false );
+		ft.stats.ticks += run;
+		ft.stats.maxTicksInFrame = std::max( ft.stats.maxTicksInFrame, run );
+		ft.interpolation = std::clamp( static_cast<float>( ft.accumulator / ft.tickTime ), 0.0f, 1.0f );
+		return run;
 	}
 
-	float GetTimingSegmentDuration( int id )
+	float GetTickInterpolation()
 	{
-		ASSERT_GRAPHICS;
-		PLAY_ASSERT_MSG( static_cast<size_t>(id) < m_vTimings.size(), "Invalid id for timing data." );
-		return m_vTimings[id].millisecs;
+		return fixedTimestep.tickTime > 0.0 ? fixedTimestep.interpolation : 1.0f;
 	}
 
-	void TimingBarBegin( Pixel pix )
+	TickStats GetTickStats()
 	{
-		ASSERT_GRAPHICS;
-		EndTimingSegment();
-		m_vPrevTimings = m_vTimings;
-		m_vTimings.clear();
-		SetTimingBarColour( pix );
+		return fixedTimestep.stats;
 	}
-}
-//********************************************************************************************************************************
-// File:		PlayAudio.cpp
-// Description:	Implementation of a very simple audio manager using XAudio2
-// Platform:	Windows
-// Notes:		Uses WAV format (uncompressed, so audio file sizes can be large)
-//********************************************************************************************************************************
-
-
-using namespace std;
 
-#define ASSERT_AUDIO PLAY_ASSERT_MSG( Play::Audio::m_bCreated, "Audio Manager not initialised. Call Audio::CreateManager() before using the Play::Audio library functions.")
+	//**************************************************************************************************
+	// PlayAudio functions
+	//**************************************************************************************************
 
-namespace Play::Audio
-{
-	// Flag to record whether the manager has been created
-	bool m_bCreated = false;
+	int PlayAudioPitch( const char* fileName, int minPercent, int maxPercent )
+	{
+		PLAY_ASSERT_MSG( minPercent > 1.0f && maxPercent < 10000.0f, "Invalid audio pitch range: must be between 1 and 10,000 %" );
+		float freq = (minPercent + rand() % (maxPercent - minPercent)) / 100.0f;
+		return Play::Audio::StartSound( fileName, false, 1.0f, freq);
+	}
 
-	// XAudio2 objects
-	IXAudio2* m_pXAudio2 = nullptr;
-	IXAudio2MasteringVoice* m_pMasterVoice = nullptr;
-	std::mutex m_voiceMutex; // XAudio2 is multi-threaded so we will need to take precautions!
+	//**************************************************************************************************
+	// PlayGraphics functions
+	//**************************************************************************************************
 
-	// Each WAV file in the audio directory is loaded into a SoundEffect structure
-	struct SoundEffect
+	void ColourSprite( const char* spriteName, Colour c )
 	{
-		std::string fileAndPath;
-		uint8_t* pFileBuffer{ nullptr }; // The whole file is loaded into here
-		bool isXWMA = false;
-		XAUDIO2_BUFFER xAudio2Buffer{ 0 }; // Pointer to the WAV data within the file buffer
-		XAUDIO2_BUFFER_WMA xAudio2BufferWMA{ 0 }; // Pointer to XWMA data.
-		WAVEFORMATEXTENSIBLE format{ 0 }; 
-	};
-	std::vector< SoundEffect > m_vSoundEffects; // Vector of all the loaded sound effects
+		int spriteId = Play::Graphics::GetSpriteId( spriteName );
+		Play::Graphics::ColourSprite( spriteId, static_cast<int>( c.red * 2.55f ), static_cast<int>( c.green * 2.55f), static_cast<int>( c.blue * 2.55f ) );
+	}
 
-	// A new audio voice is created each time you play a sound effect
-	struct AudioVoice
+	void CentreSpriteOrigin( const char* spriteName )
 	{
-		int id{ 0 };
-		IXAudio2SourceVoice* pSourceVoice{ nullptr };
-		SoundEffect* pSoundEffect{ nullptr };
-
-		AudioVoice()
-		{
-			static int uniqueId = 0;
-			id = uniqueId++;
-		}
-	};
-
-	// A map is used internally to store all the playing sound effects and their unique ids
-	static std::map<int, AudioVoice&> m_audioVoiceMap;
+		int spriteId = Play::Graphics::GetSpriteId( spriteName );
+		Play::Graphics::SetSpriteOrigin( spriteId, Play::Graphics::GetSpriteSize( spriteId ) / 2, false );
+	}
 
-	// Internal (private) functions
-	bool LoadSoundEffect( std::string& filename, SoundEffect& sf );
-	bool DestroyVoice( int voiceId );
-	
-	// An XAudio2 callback is required to clean up audio voices when they have finished playing
-	class VoiceCallback : public IXAudio2VoiceCallback
+	void CentreMatchingSpriteOrigins( const char* rootName )
 	{
-	public:
-		void STDMETHODCALLTYPE OnStreamEnd() override {}
-		void STDMETHODCALLTYPE OnVoiceProcessingPassEnd() override {}
-		void STDMETHODCALLTYPE OnVoiceProcessingPassStart( UINT32 ) override {}
-		void STDMETHODCALLTYPE OnBufferStart( void* ) override {}
-		void STDMETHODCALLTYPE OnLoopEnd( void* ) override {}
-		void STDMETHODCALLTYPE OnVoiceError( void*, HRESULT ) override {}
-		void STDMETHODCALLTYPE OnBufferEnd( void* pBufferContext ) override { DestroyVoice( *((int*)pBufferContext) ); }
-	};
+		int spriteId = Play::Graphics::GetSpriteId( rootName ); // Finds the first matching sprite and assumes same dimensions
+		Play::Graphics::SetSpriteOrigins( rootName, Play::Graphics::GetSpriteSize( spriteId ) / 2, false );
+	}
 
-	//********************************************************************************************************************************
-	// Create and Destroy functions
-	//********************************************************************************************************************************
-	bool CreateManager( const char* path )
+	void CentreAllSpriteOrigins()
 	{
-		PLAY_ASSERT_MSG( !m_bCreated, "Audio manager has already been created!" );
-
-		// Does the Audio folder exist?
-		if (std::filesystem::is_directory(path)) {
-
-			HRESULT hr;
-
-			// Initialise XAudio2
-			hr = CoInitializeEx( nullptr, COINIT_MULTITHREADED );
-			PLAY_ASSERT_MSG( hr == S_OK, "CoInitializeEx failed" );
-
-			hr = XAudio2Create( &m_pXAudio2, 0, XAUDIO2_DEFAULT_PROCESSOR );
-			PLAY_ASSERT_MSG( hr == S_OK, "XAudio2Create failed" );
-
-			hr = m_pXAudio2->CreateMasteringVoice( &m_pMasterVoice );
-			PLAY_ASSERT_MSG( hr == S_OK, "CreateMasteringVoice failed" );
-
-			// Iterate through the directory loading all the sound effects
-			for( auto& p : std::filesystem::directory_iterator( path ) )
-			{
-				// Switch everything to uppercase to avoid need to check case each time
-				std::string filename = p.path().string();
-				for( char& c : filename ) c = static_cast<char>(toupper( c ));
-
-				// Only load .wav files
-				if( filename.find( ".WAV" ) != std::string::npos )
-				{
-					SoundEffect soundEffect;
-					LoadSoundEffect( filename, soundEffect );
-					m_vSoundEffects.push_back( soundEffect );
-				}
-			}
-		}
-
-		m_bCreated = true;
-		return true;
+		for( int i = 0; i < Play::Graphics::GetTotalLoadedSprites(); i++ )
+			Play::Graphics::SetSpriteOrigin( i, Play::Graphics::GetSpriteSize( i ) / 2, false );
 	}
 
-	bool DestroyManager( void )
+	void MoveSpriteOrigin( const char* spriteName, int xOffset, int yOffset )
 	{
-		ASSERT_AUDIO;
-
-		// Stop and destroy all the voices
-		while( m_audioVoiceMap.size() > 0 )
-			DestroyVoice( m_audioVoiceMap.begin()->first );
-
-		// Delete all the sound effects
-		for( SoundEffect& soundEffect : m_vSoundEffects )
-			delete[] soundEffect.pFileBuffer; // The XAudio2Buffer is within the pFileBuffer data
+		int spriteId = Play::Graphics::GetSpriteId( spriteName );
+		Play::Graphics::SetSpriteOrigin( spriteId, { xOffset, yOffset }, true ); // relative option set
+	}
 
-		// Close down XAudio2
-		if( m_pMasterVoice )
-			m_pMasterVoice->DestroyVoice();
 
-		m_bCreated = false;
-		return true;
+	void MoveAllSpriteOrigins(int xoffset, int yoffset)
+	{
+		for (int i = 0; i < Play::Graphics::GetTotalLoadedSprites(); i++)
+			Play::Graphics::SetSpriteOrigin(i, { xoffset, yoffset }, true ); // relative option set
 	}
 
-	//********************************************************************************************************************************
-	// Sound playing functions
-	//********************************************************************************************************************************
-	int StartSound( const char* name, bool bLoop, float volume ,float freqMod )
+	void SetSpriteOrigin( const char* spriteName, int xOrigin, int yOrigin )
 	{
-		ASSERT_AUDIO;
-
-		static VoiceCallback voiceCallback;
-
-		// Switch everything to uppercase to avoid need to check case each time
-		std::string filename( name );
-		for( char& c : filename ) c = static_cast<char>(toupper( c ));
-
-		// Iterate through the sound effect data looking for the requested effect
-		for( SoundEffect& soundEffect : m_vSoundEffects )
-		{
-			if( soundEffect.fileAndPath.find( filename ) != std::string::npos )
-			{
-				m_voiceMutex.lock(); // XAudio2 is multi-threaded so we need to protect this code from being run in multiple threads at the same time.
-
-				// Create a new voice to play the sound
-				AudioVoice* pAudioVoice = new AudioVoice;
-				m_pXAudio2->CreateSourceVoice( &pAudioVoice->pSourceVoice, (WAVEFORMATEX*)&soundEffect.format, 0u, 2.0f, &voiceCallback );
-				pAudioVoice->pSoundEffect = &soundEffect;
-				soundEffect.xAudio2Buffer.pContext = &pAudioVoice->id;
-				soundEffect.xAudio2Buffer.LoopCount = bLoop ? XAUDIO2_LOOP_INFINITE : 0;
-				pAudioVoice->pSourceVoice->SubmitSourceBuffer( &soundEffect.xAudio2Buffer, soundEffect.isXWMA? &soundEffect.xAudio2BufferWMA : 0);
-				pAudioVoice->pSourceVoice->SetVolume( volume );
-				pAudioVoice->pSourceVoice->SetFrequencyRatio( freqMod );
-				pAudioVoice->pSourceVoice->Start( 0 );
-
-				m_audioVoiceMap.insert( std::map<int, AudioVoice&>::value_type( pAudioVoice->id, *pAudioVoice ) );// Copy voice data pointer to the persistent map
-
-				m_voiceMutex.unlock(); // Should be fine for concurrent threads to operate safely from this point
-				return pAudioVoice->id;
-			}
-		}
-		PLAY_ASSERT_MSG( false, std::string( "Trying to play unknown sound effect: " + std::string( name ) + "\nTry checking the 'Audio' folder").c_str());
-		return -1;
+		int spriteId = Play::Graphics::GetSpriteId( spriteName );
+		Play::Graphics::SetSpriteOrigin( spriteId, { xOrigin, yOrigin } ); 
 	}
-
-	bool StopSound( int voiceId )
+	
+	void DrawSpriteTransparent(const char* spriteName, Point2D pos, int frameIndex, float opacity, Colour colour)
 	{
-		ASSERT_AUDIO;
-		return DestroyVoice( voiceId );
+		Graphics::DrawTransparent(Graphics::GetSpriteId(spriteName), TRANSFORM_SPACE(pos), frameIndex, { opacity, colour.red / 100.0f, colour.green / 100.0f, colour.blue / 100.0f });
 	}
 
-	bool StopSound( const char* name )
+	void DrawSpriteTransparent(int spriteID, Point2D pos, int frameIndex, float opacity, Colour colour)
 	{
-		ASSERT_AUDIO;
-
-		// Switch everything to uppercase to avoid need to check case each time
-		std::string filename = name;
-		for( char& c : filename ) c = static_cast<char>(toupper( c ));
+		Graphics::DrawTransparent(spriteID, TRANSFORM_SPACE(pos), frameIndex, { opacity, colour.red / 100.0f, colour.green / 100.0f, colour.blue / 100.0f } );
+	}
 
-		// Iterate through all the audio voices and stop the requested effect
-		for( std::pair<const int, AudioVoice&>& i : m_audioVoiceMap )
-		{
-			PLAY_ASSERT( i.second.pSoundEffect && i.second.pSourceVoice );
+	void DrawSpriteRotated( const char* spriteName, Point2D pos, int frameIndex, float angle, float scale, float opacity, Colour colour)
+	{
+		Play::Graphics::DrawRotated( Play::Graphics::GetSpriteId( spriteName ), TRANSFORM_SPACE( pos ), frameIndex, angle, scale, { opacity, colour.red / 100.0f, colour.green / 100.0f, colour.blue / 100.0f });
+	}
 
-			if( i.second.pSoundEffect->fileAndPath.find( filename ) != std::string::npos )
-				return DestroyVoice( i.first );
-		}
-		return false;
+	void DrawSpriteRotated( int spriteID, Point2D pos, int frameIndex, float angle, float scale, float opacity, Colour colour )
+	{
+		Play::Graphics::DrawRotated( spriteID, TRANSFORM_SPACE( pos ), frameIndex, angle, scale, { opacity, colour.red / 100.0f, colour.green / 100.0f, colour.blue / 100.0f });
 	}
 
-	void SetLoopingSoundVolume( const char* name, float volume )
+	void DrawSpriteTransformed( int spriteID, const Matrix2D& transform, int frameIndex, float opacity, Colour colour )
 	{
-		ASSERT_AUDIO;
+		Play::Graphics::DrawTransformed( spriteID, TRANSFORM_MATRIX_SPACE( transform ), frameIndex, { opacity, colour.red / 100.0f, colour.green / 100.0f, colour.blue / 100.0f });
+	}
 
-		// Switch everything to uppercase to avoid need to check case each time
-		std::string filename(name);
-		for (char& c : filename) c = static_cast<char>(toupper(c));
+	void DrawLine( Point2f start, Point2f end, Colour c )
+	{
+		return Play::Graphics::DrawLine( TRANSFORM_SPACE( start), TRANSFORM_SPACE( end ), { c.red * 2.55f, c.green * 2.55f, c.blue * 2.55f }  );
+	}
 
-		// Iterate through all the audio voices and stop the requested effect
-		for( std::pair<const int, AudioVoice&>& i : m_audioVoiceMap )
-		{
-			PLAY_ASSERT( i.second.pSoundEffect && i.second.pSourceVoice );
+	void DrawCircle( Point2D pos, int radius, Colour c )
+	{
+		Play::Graphics::DrawCircle( TRANSFORM_SPACE( pos ), radius, { c.red * 2.55f, c.green * 2.55f, c.blue * 2.55f } );
+	}
 
-			if( i.second.pSoundEffect->fileAndPath.find( filename ) != std::string::npos )
-				i.second.pSourceVoice->SetVolume(volume);
-		}
+	void DrawRect(  Point2D bottomLeft, Point2D topRight, Colour c, bool fill )
+	{
+		Play::Graphics::DrawRect( TRANSFORM_SPACE( bottomLeft ), TRANSFORM_SPACE( topRight ), { c.red * 2.55f, c.green * 2.55f, c.blue * 2.55f }, fill );
 	}
 
-	void SetLoopingSoundVolume(int voiceId, float volume)
+	void DrawSpriteLine( Point2D startPos, Point2D endPos, const char* penSprite, Colour col /*= cWhite */ )
 	{
-		ASSERT_AUDIO;
+		int spriteId = Play::Graphics::GetSpriteId( penSprite );
+		ColourSprite( penSprite, col );
 
-		// Try and find the voice to see if it exists
-		if( m_audioVoiceMap.find( voiceId ) == m_audioVoiceMap.end() )
-			return;
+		//Draws a line in any angle
+		int x1 = static_cast<int>( startPos.x );
+		int y1 = static_cast<int>( startPos.y );
+		int x2 = static_cast<int>( endPos.x );
+		int y2 = static_cast<int>( endPos.y );
 
-		AudioVoice* voice = &m_audioVoiceMap.find( voiceId )->second;
-		voice->pSourceVoice->SetVolume(volume);
-	}
+		//Implementation of Bresenham's Line Drawing Algorithm
+		int dx = abs( x2 - x1 );
+		int sx = 1;
+		if( x2 < x1 ) { sx = -1; }
 
-	void SetLoopingSoundPitch( const char* name, float freqMod )
-	{
-		ASSERT_AUDIO;
+		int dy = -abs( y2 - y1 );
+		int sy = 1;
+		if( y2 < y1 ) { sy = -1; }
+		
+		int err = dx + dy;
 
-		// Switch everything to uppercase to avoid need to check case each time
-		std::string filename(name);
-		for (char& c : filename) c = static_cast<char>(toupper(c));
+		if( dx == 0 && dy == 0 ) return;
 
-		// Iterate through all the audio voices and stop the requested effect
-		for( std::pair<const int, AudioVoice&>& i : m_audioVoiceMap )
+		while( true )
 		{
-			PLAY_ASSERT( i.second.pSoundEffect && i.second.pSourceVoice );
+			Play::DrawSprite( spriteId, { x1, y1 }, 0 );
+			
+			if( x1 == x2 && y1 == y2 )
+				break;
 
-			if( i.second.pSoundEffect->fileAndPath.find( filename ) != std::string::npos )
+			int e2 = 2 * err;
+			if( e2 >= dy )
+			{
+				err += dy;
+				x1 += sx;
+			}
+			if( e2 <= dx )
 			{
-				i.second.pSourceVoice->SetFrequencyRatio(freqMod);
+				err += dx;
+				y1 += sy;
 			}
 		}
 	}
 
-	void SetLoopingSoundPitch(int voiceId, float freqMod)
+	// Not exposed externally
+	void DrawCircleOctants( int spriteId, int x, int y, int ox, int oy )
 	{
-		ASSERT_AUDIO;
-
-		// Try and find the voice to see if it exists
-		if( m_audioVoiceMap.find( voiceId ) == m_audioVoiceMap.end() )
-			return;
-
-		AudioVoice* voice = &m_audioVoiceMap.find( voiceId )->second;
-		voice->pSourceVoice->SetFrequencyRatio(freqMod);
+		//displaying all 8 coordinates of(x,y) residing in 8-octants
+		Play::DrawSprite( spriteId, { x + ox, y + oy }, 0 );
+		Play::DrawSprite( spriteId, { x - ox, y + oy }, 0 );
+		Play::DrawSprite( spriteId, { x + ox, y - oy }, 0 );
+		Play::DrawSprite( spriteId, { x - ox, y - oy }, 0 );
+		Play::DrawSprite( spriteId, { x + oy, y + ox }, 0 );
+		Play::DrawSprite( spriteId, { x - oy, y + ox }, 0 );
+		Play::DrawSprite( spriteId, { x + oy, y - ox }, 0 );
+		Play::DrawSprite( spriteId, { x - oy, y - ox }, 0 );
 	}
 
-	bool LoadSoundEffect( std::string& filename, SoundEffect& soundEffect )
+	void DrawSpriteCircle( Point2D pos, int radius, const char* penSprite, Colour col )
 	{
-		// RIFF (Resource Interchange File Format) is a tagged file structure for multimedia resource files. 
-		// The RIFF structure identifies supported file formats using four-character codes, and groups their data into chunks. 
-		struct RiffChunk
-		{
-			uint32_t m_id; // The type of data (4x char)
-			uint32_t m_size; // The size of the chunk
-		};
-
-		// Open the file
-		std::ifstream file;
-		file.open( filename, std::ios::binary ); 
-		PLAY_ASSERT( file.is_open() );
-
-		// Get the size of file
-		file.seekg( 0, std::ios::end );
-		int fileSize = static_cast<int>(file.tellg());
-		file.seekg( 0, std::ios::beg );
-
-		// Allocate and read in the file
-		soundEffect.pFileBuffer = new uint8_t[ fileSize ];
-		file.read( (char*)soundEffect.pFileBuffer, fileSize );
-		file.close();
-
-		// Start working through the file data using a pointer
-		const BYTE* p( static_cast<const BYTE*>(soundEffect.pFileBuffer) );
-		const BYTE* pEnd( p + fileSize );
+		int spriteId = Play::Graphics::GetSpriteId( penSprite );
+		ColourSprite( penSprite, col );
 
-		// The first chunk is the root entry and must have a ID of 'RIFF' 
-		const RiffChunk* pRiffChunk( reinterpret_cast<const RiffChunk*>(p) ); 
-		PLAY_ASSERT_MSG( pRiffChunk->m_id == 'FFIR', "RIFF chunk invalid" ); // Reverse byte order = 'FFIR'
-		p += sizeof( RiffChunk );
+		pos = TRANSFORM_SPACE( pos );
 
+		int ox = 0, oy = radius;
+		int d = 3 - 2 * radius;
+		DrawCircleOctants( spriteId, static_cast<int>(pos.x), static_cast<int>(pos.y), ox, oy );
 
-		// Next we're looking for a WAVE chunk (.WAV file) or a XWMA chunk (xWMA compressed audio).
-		const uint32_t* pWave( reinterpret_cast<const uint32_t*>(p) ); // WAVE
-		PLAY_ASSERT_MSG( *pWave == 'EVAW' || *pWave == 'AMWX', "WAVE/XWMA chunk invalid" );
+		while( oy >= ox )
+		{
+			ox++;
+			if( d > 0 )
+			{
+				oy--;
+				d = d + 4 * ( ox - oy ) + 10;
+			}
+			else
+			{
+				d = d + 4 * ox + 6;
+			}
+			DrawCircleOctants( spriteId, static_cast<int>(pos.x), static_cast<int>(pos.y), ox, oy );
+		}
+	};
 
-		p += sizeof( uint32_t );
+	void DrawFontText( const char* fontId, std::string text, Point2D pos, Align justify )
+	{
+		int font = Play::Graphics::GetSpriteId( fontId );
 
-		// Subsequent chunks should be the sound data
-		const RiffChunk* pChunk( reinterpret_cast<const RiffChunk*>(p) );
-		p += sizeof( RiffChunk );
+		int totalWidth{ 0 };
 
-		bool bFoundFormat = false;
-		bool bFoundData = false;
-		bool bFounddpds = false;
+		for( char c : text )
+			totalWidth += Play::Graphics::GetFontCharWidth( font, c );
 
-		// Work through all the data
-		while( p < pEnd )
+		switch( justify )
 		{
-			switch( pChunk->m_id )
-			{
-			case ' tmf': // format chunk (fmt backwards)
-
-				PLAY_ASSERT_MSG( sizeof( PCMWAVEFORMAT ) <= pChunk->m_size, "_fmt chunk invalid" );
-				memcpy( &soundEffect.format, p, sizeof( PCMWAVEFORMAT ) );
-				if (soundEffect.format.Format.wFormatTag == WAVE_FORMAT_WMAUDIO2 || soundEffect.format.Format.wFormatTag == WAVE_FORMAT_WMAUDIO3)
-					soundEffect.isXWMA = true;
-				bFoundFormat = true;
+			case Align::CENTRE:
+				pos.x -= totalWidth / 2;
 				break;
-
-			case 'atad': // Data chunk (data backwards)
-				soundEffect.xAudio2Buffer.pAudioData = p;
-				soundEffect.xAudio2Buffer.AudioBytes = pChunk->m_size;
-				bFoundData = true;
+			case Align::RIGHT:
+				pos.x -= totalWidth;
+				break;
+			default:
 				break;
-			case 'sdpd': // DPDS XWMA chunk 
-				{
-					if (soundEffect.isXWMA)
-					{
-						soundEffect.xAudio2BufferWMA.pDecodedPacketCumulativeBytes = reinterpret_cast<const uint32_t*>(p);
-						soundEffect.xAudio2BufferWMA.PacketCount = pChunk->m_size / 4;
-						bFounddpds = true;
-					}
-					break;
-				}
-			}
-
-			p += pChunk->m_size;
-
-			pChunk = reinterpret_cast<const RiffChunk*>(p);
-			p += sizeof( RiffChunk );
 		}
 
-		
-		PLAY_ASSERT_MSG( bFoundFormat && bFoundData, "Invalid Sound Data" );
-		if (soundEffect.isXWMA)
-			PLAY_ASSERT_MSG( bFounddpds, "Invalid XWMA sound")
-
-		// Initialise typical flags (some overwritten on play)
-		soundEffect.xAudio2Buffer.Flags = XAUDIO2_END_OF_STREAM;
-		soundEffect.xAudio2Buffer.LoopBegin = 0u;
-		soundEffect.xAudio2Buffer.LoopLength = 0u;
-		soundEffect.xAudio2Buffer.LoopCount = 0;
-		soundEffect.fileAndPath = filename;
-
-		return true;
+		pos.x += Play::Graphics::GetSpriteOrigin( font ).x;
+		Play::Graphics::DrawString( font, TRANSFORM_SPACE( pos ), text );
 	}
 
-	bool DestroyVoice( int voiceId )
+	void DrawPixel(Point2D pos, Colour col)
 	{
-		// Only delete audio voices that exist!
-		if( m_audioVoiceMap.find( voiceId ) == m_audioVoiceMap.end() )
-			return false;
-
-		m_voiceMutex.lock(); // XAudio2 is multi-threaded so we need to protect this code from being run in multiple threads at the same time.
+		return Play::Graphics::DrawPixel(TRANSFORM_SPACE( pos ), { col.red * 2.55f, col.green * 2.55f, col.blue * 2.55f });
+	}
 
-		AudioVoice* voice = &m_audioVoiceMap.find( voiceId )->second;
+	void BeginTimingBar( Colour c )
+	{
+		Play::Graphics::TimingBarBegin( Pixel( c.red*2.55f, c.green*2.55f, c.blue*2.55f ) );
+	}
 
-		// Stop and destroy the audio voice
-		voice->pSourceVoice->Stop();
-		voice->pSourceVoice->FlushSourceBuffers();
-		voice->pSoundEffect = nullptr;
-		voice->pSourceVoice->DestroyVoice();
-		m_audioVoiceMap.erase( m_audioVoiceMap.find( voiceId ) );
-		delete voice;
+	int ColourTimingBar( Colour c )
+	{
+		return Play::Graphics::SetTimingBarColour( Pixel( c.red * 2.55f, c.green * 2.55f, c.blue * 2.55f ) );
+	}
 
-		m_voiceMutex.unlock(); // Should be fine for concurrent threads to operate safely from this point
+	//**************************************************************************************************
+	// Miscellaneous functions
+	//**************************************************************************************************
 
-		return true;
+	int RandomRollRange( int begin, int end )
+	{
+		int range = abs( end - begin );
+		int rnd = ( rand() % ( range + 1 ) );
+		if( end > begin )
+			return begin + rnd;
+		else
+			return end + rnd;
 	}
 }
 //********************************************************************************************************************************
-// File:		PlayInput.cpp
-// Description:	Manages keyboard and mouse input 
-// Platform:	Windows
-// Notes:		Obtains mouse data from PlayWindow via MouseData structure
+// File:		PlayManager.cpp
+// Description:	A manager for providing simplified access to the PlayBuffer framework
+// Platform:	Independent
+// Notes:		The GameObject management is "opt in" as many will want to create their own GameObject class
 //********************************************************************************************************************************
 
-
-#define ASSERT_INPUT PLAY_ASSERT_MSG( Play::Input::m_bCreated, "Input Manager not initialised. Call Input::CreateManager() before using the Play::Input library functions.")
-
-namespace Play::Input
+// Define this to opt in to the PlayManager
+#ifdef PLAY_USING_GAMEOBJECT_MANAGER
+namespace Play
 {
-	// Flag to record whether the manager has been created
-	bool m_bCreated = false;
-	// The state of the mouse
-	MouseData m_mouseData;
+	// The id the next GameObject will be given (saved and restored with world snapshots)
+	static int nextGameObjectId = 0;
 
-	//********************************************************************************************************************************
-	// Create and Destroy functions
-	//********************************************************************************************************************************
-	MouseData* CreateManager(void)
+	// Constructor for the GameObject struct - kept as simple as possible
+	GameObject::GameObject(int type, Point2f newPos, int collisionRadius, int spriteId = 0)
 	{
-		PLAY_ASSERT_MSG(!m_bCreated, "Input manager has already been created!");
-		m_bCreated = true;
-		return &m_mouseData;
+		// Member variables are assigned default values in the class header
+		this->type = type;
+		this->pos = newPos;
+		this->radius = collisionRadius;
+		this->spriteId = spriteId;
+		m_id = nextGameObjectId++;
 	}
 
-	bool DestroyManager(void) 
-	{
-		ASSERT_INPUT;
-		m_bCreated = false;
-		return true;
-	}
+	// A vector is used internally to store all the GameObjects, kept in order of their unique ids
+	// > New ids are always higher than existing ones, so creating an object just adds it to the end
+	static std::vector<GameObject*> objectList;
+	// The ids of GameObjects which have been destroyed this frame, waiting to be deleted by FlushDestroyedGameObjects()
+	static std::vector<int> destroyedIds;
 
-	//********************************************************************************************************************************
-	// Mouse functions
-	//********************************************************************************************************************************
-	bool GetMouseDown(MouseButton button)
-	{
-		ASSERT_INPUT;
-		PLAY_ASSERT_MSG(button == MouseButton::BUTTON_LEFT || button == MouseButton::BUTTON_RIGHT, "Invalid mouse button selected.");
+	// Used instead of Null return values, PlayMangager operations performed on this GameObject should fail transparently
+	static GameObject noObject{ -1,{ 0, 0 }, 0, -1 };
 
-		if (button == MouseButton::BUTTON_LEFT)
-			return m_mouseData.left;
-		else
-			return m_mouseData.right;
+	// The spatial hash divides the world into a uniform grid of square cells, each holding a list of the GameObjects
+	// whose collision circles overlap it. Only objects which share a cell need to be tested against each other.
+	struct SpatialCellRange
+	{
+		int minX{ 0 }, minY{ 0 }, maxX{ -1 }, maxY{ -1 };
+		bool operator==(const SpatialCellRange& rhs) const { return minX == rhs.minX && minY == rhs.minY && maxX == rhs.maxX && maxY == rhs.maxY; }
+		bool operator!=(const SpatialCellRange& rhs) const { return !(*this == rhs); }
 	};
 
-	bool KeyPress( KeyboardButton key, int frame)
+	struct SpatialCellEntry
 	{
-		ASSERT_INPUT;
-		static std::map< int, int > keyMap;
-
-		int& previous_frame = keyMap[key];
-
-		// Returns true if key wasn't pressed the last time we checked or if this is the same frame as the last check
-		if (KeyHeld(key) && (previous_frame == 0 || (previous_frame == frame && frame != -1)))
-		{
-			previous_frame = frame;
-			return true;
-		}
+		GameObject* pObj{ nullptr };
+		SpatialCellRange range; // A copy of the object's full range, used to avoid reporting the same pair from more than one cell
+	};
 
-		if (!KeyHeld(key))
-			previous_frame = 0;
+	static int spatialCellSize = 64;
+	static std::unordered_map<int64_t, std::vector<SpatialCellEntry>> spatialCells;
+	static std::unordered_map<int, SpatialCellRange> spatialRanges; // The cells each object was last added to, by object id
 
-		return false;
-	}
+	// Internal (private) spatial hash functions
+	void RefreshSpatialHash();
+	void RemoveFromSpatialHash(GameObject& obj);
 
-	bool KeyHeld( KeyboardButton key)
+	// Internal (private) function which finds a GameObject (including destroyed ones) by binary search
+	static GameObject* FindGameObject(int id)
 	{
-		ASSERT_INPUT;
-		return GetAsyncKeyState(key) & 0x8000; // Don't want multiple calls to KeyState
-	}
-
-	Point2f GetMousePos() 
-	{ 
-		ASSERT_INPUT;
-		return m_mouseData.pos; 
-	}
-}
-//********************************************************************************************************************************
-// File:		PlayManager.cpp
-// Description:	A manager for providing simplified access to the PlayBuffer framework
-// Platform:	Independent
-// Notes:		The GameObject management is "opt in" as many will want to create their own GameObject class
-//********************************************************************************************************************************
+		std::vector<GameObject*>::iterator i = std::lower_bound(objectList.begin(), objectList.end(), id, [](GameObject* pObj, int id) { return pObj->GetId() < id; });
 
-namespace Play
-{
-	// A set of default colour definitions
-	Colour cBlack{ 0.0f, 0.0f, 0.0f };
-	Colour cRed{ 100.0f, 0.0f, 0.0f };
-	Colour cGreen{ 0.0f, 100.0f, 0.0f };
-	Colour cBlue{ 0.0f, 0.0f, 100.0f };
-	Colour cMagenta{ 100.0f, 0.0f, 100.0f };
-	Colour cCyan{ 0.0f, 100.0f, 100.0f };
-	Colour cYellow{ 100.0f, 100.0f, 0.0f };
-	Colour cOrange{ 100.0f, 50.0f, 0.0f };
-	Colour cWhite{ 100.0f, 100.0f, 100.0f };
-	Colour cGrey{ 50.0f, 50.0f, 50.0f };
+		if (i == objectList.end() || (*i)->GetId() != id)
+			return nullptr;
 
-	int frameCount = 0; // Updated in Play::Present
+		return *i;
+	}
 
-	// The camera
-	Point2f cameraPos{ 0.0f, 0.0f };
-	// Spaces and co-ordinate systems
-	DrawingSpace drawSpace = DrawingSpace::WORLD;
 
 	//**************************************************************************************************
-	// Manager creation and deletion
+	// GameObject functions
 	//**************************************************************************************************
-
-	void CreateManager( int displayWidth, int displayHeight, int displayScale )
+	int CreateGameObject(int type, Point2f newPos, int collisionRadius, const char* spriteName)
 	{
-		Play::Graphics::CreateManager( displayWidth, displayHeight, "Data\\Sprites\\" );
-		Play::Window::CreateManager( Play::Graphics::GetDrawingBuffer(), displayScale );
-		Play::Window::RegisterMouse( Play::Input::CreateManager() );
-		Play::Audio::CreateManager( "Data\\Audio\\" );
-		// Seed the game's random number generator based on the time
-		srand( (int)time( NULL ) );
+		int spriteId = Play::Graphics::GetSpriteId(spriteName);
+		// Deletion is handled in DestroyGameObject()
+		GameObject* pObj = new GameObject(type, newPos, collisionRadius, spriteId);
+		objectList.push_back(pObj);
+		return pObj->GetId();
 	}
 
-	void DestroyManager()
+	GameObject& GetGameObject(int ID)
 	{
-		Play::Audio::DestroyManager();
-		Play::Graphics::DestroyManager();
-		Play::Window::DestroyManager();
-		Play::Input::DestroyManager();
-#ifdef PLAY_USING_GAMEOBJECT_MANAGER
-		Play::DestroyAllGameObjects();
-#endif
+		GameObject* pObj = FindGameObject(ID);
+
+		if (pObj == nullptr || pObj->type == -1)
+			return noObject;
+
+		return *pObj;
 	}
 
-	//**************************************************************************************************
-	// PlayGraphics functions
-	//**************************************************************************************************
+	GameObject& GetGameObjectByType(int type)
+	{
+		if (type == -1)
+			return noObject;
+
+		GameObject* pFound = nullptr;
+
+		for (GameObject* pObj : objectList)
+		{
+			if (pObj->type == type)
+			{
+				PLAY_ASSERT_MSG(pFound == nullptr, "Multiple objects of type found, use CollectGameObjectIDsByType instead");
+				if (pFound == nullptr)
+					pFound = pObj;
+			}
+		}
 
-	void ClearDrawingBuffer( Colour c )
+		return pFound ? *pFound : noObject;
+	}
+
+	std::vector<int> CollectGameObjectIDsByType(int type)
 	{
-		int r = static_cast<int>( c.red * 2.55f );
-		int g = static_cast<int>( c.green * 2.55f );
-		int b = static_cast<int>( c.blue * 2.55f );
-		Play::Graphics::ClearBuffer( { r, g, b } );
+		std::vector<int> vec;
+
+		if (type == -1)
+			return vec;
+
+		for (GameObject* pObj : objectList)
+		{
+			if (pObj->type == type)
+				vec.push_back(pObj->GetId());
+		}
+		return vec; // Returning a copy of the vector
 	}
 
-	void DrawDebugText( Point2D pos, const char* text, Colour c, bool centred )
+	std::vector<int> CollectAllGameObjectIDs()
 	{
-		Play::Graphics::DrawDebugString( TRANSFORM_SPACE( pos ), text, { c.red * 2.55f, c.green * 2.55f, c.blue * 2.55f }, centred );
+		std::vector<int> vec;
+
+		for (GameObject* pObj : objectList)
+		{
+			if (pObj->type != -1) // Skip objects destroyed this frame
+				vec.push_back(pObj->GetId());
+		}
+
+		return vec; // Returning a copy of the vector
 	}
 
-	void PresentDrawingBuffer()
+	void UpdateGameObject(GameObject& obj, bool bWrap, int wrapBorderSize, bool allowMultipleUpdatesPerFrame)
 	{
-		static bool debugInfo = false;
-		DrawingSpace originalDrawSpace = drawSpace;
+		if (obj.type == -1) return; // Don't update noObject
 
-		if( KeyPressed( KEY_F1 ) )
-			debugInfo = !debugInfo;
+		// We allow multiple updates if the object type has changed, and one update in each fixed timestep tick
+		bool bNewTick = fixedTimestep.bInTick && obj.lastTickUpdated != fixedTimestep.tick;
+		PLAY_ASSERT_MSG(obj.lastFrameUpdated != Play::frameCount || bNewTick || obj.type != obj.oldType || allowMultipleUpdatesPerFrame, "Trying to update the same GameObject more than once in the same frame!");
+		obj.lastFrameUpdated = Play::frameCount;
+		obj.lastTickUpdated = fixedTimestep.bInTick ? fixedTimestep.tick : -1;
 
-		if( debugInfo )
+		// Save the current position in case we need to go back
+		obj.oldPos = obj.pos;
+		obj.oldRot = obj.rotation;
+
+		// Move the object according to a very simple physical model
+		obj.velocity += obj.acceleration;
+		obj.pos += obj.velocity;
+		obj.rotation += obj.rotSpeed;
+
+		// Handle the animation frame update
+		obj.framePos += obj.animSpeed;
+		if (obj.framePos > 1.0f)
 		{
-			drawSpace = DrawingSpace::SCREEN;
+			obj.frame++;
+			obj.framePos -= 1.0f;
+		}
 
-			int textX = 10;
-			int textY = 10;
-			std::string s = "PlayBuffer Version:" + std::string( PLAY_VERSION );
-			Play::Graphics::DrawDebugString( { textX - 1, textY - 1 }, s, PIX_BLACK, false );
-			Play::Graphics::DrawDebugString( { textX + 1, textY + 1 }, s, PIX_BLACK, false );
-			Play::Graphics::DrawDebugString( { textX + 1, textY - 1 }, s, PIX_BLACK, false );
-			Play::Graphics::DrawDebugString( { textX - 1, textY + 1 }, s, PIX_BLACK, false );
-			Play::Graphics::DrawDebugString( { textX, textY }, s, PIX_YELLOW, false );
+		// Wrap objects around the screen
+		if (bWrap)
+		{
+			int dWidth = Play::Window::GetWidth();
+			int dHeight = Play::Window::GetHeight();
+			Vector2f origin = Play::Graphics::GetSpriteOrigin(obj.spriteId);
+			Vector2f spriteSize = Play::Graphics::GetSpriteSize(obj.spriteId);
+			Point2f unwrappedPos = obj.pos;
 
-			drawSpace = DrawingSpace::WORLD;
+			if (obj.pos.x - origin.x + spriteSize.x - wrapBorderSize > dWidth)
+				obj.pos.x = 0.0f - wrapBorderSize + origin.x;
+			else if (obj.pos.x - origin.x + wrapBorderSize < 0)
+				obj.pos.x = dWidth + wrapBorderSize + origin.x - spriteSize.x;
 
-#ifdef PLAY_USING_GAMEOBJECT_MANAGER	
-			DrawGameObjectsDebug();
-#endif
-		}
+			if (obj.pos.y - origin.y + spriteSize.y - wrapBorderSize > dHeight)
+				obj.pos.y = 0.0f - wrapBorderSize + origin.y;
+			else if (obj.pos.y - origin.y + wrapBorderSize < 0)
+				obj.pos.y = dHeight + wrapBorderSize + origin.y - spriteSize.y;
 
-		Play::Window::Present();
-		frameCount++;
+			// Don't draw a wrapped object sliding back across the screen (it still counts as updated in this tick)
+			if (obj.pos.x != unwrappedPos.x || obj.pos.y != unwrappedPos.y)
+				obj.oldPos = obj.pos;
+		}
 
-		drawSpace = originalDrawSpace;
 	}
 
-	//**************************************************************************************************
-	// PlayAudio functions
-	//**************************************************************************************************
+	// The number of GameObjects in each chunk of work given to the job system
+	constexpr int GAMEOBJECT_JOB_CHUNK_SIZE = 256;
 
-	int PlayAudioPitch( const char* fileName, int minPercent, int maxPercent )
+	void ParallelForEachGameObject(int type, std::function<void(GameObject&)> fn)
 	{
-		PLAY_ASSERT_MSG( minPercent > 1.0f && maxPercent < 10000.0f, "Invalid audio pitch range: must be between 1 and 10,000 %" );
-		float freq = (minPercent + rand() % (maxPercent - minPercent)) / 100.0f;
-		return Play::Audio::StartSound( fileName, false, 1.0f, freq);
-	}
+		if (type == -1)
+			return;
 
-	//**************************************************************************************************
-	// PlayGraphics functions
-	//**************************************************************************************************
+		// Gather the objects in id order so each chunk is a run of neighbouring objects and the chunks are always the same
+		// > Each call has its own list, as calls can be nested inside jobs or made from more than one thread
+		std::vector<GameObject*> vObjects;
 
-	void ColourSprite( const char* spriteName, Colour c )
-	{
-		int spriteId = Play::Graphics::GetSpriteId( spriteName );
-		Play::Graphics::ColourSprite( spriteId, static_cast<int>( c.red * 2.55f ), static_cast<int>( c.green * 2.55f), static_cast<int>( c.blue * 2.55f ) );
+		for (GameObject* pObj : objectList)
+		{
+			if (pObj->type == type)
+				vObjects.push_back(pObj);
+		}
+
+		Play::Jobs::ParallelFor(static_cast<int>(vObjects.size()), GAMEOBJECT_JOB_CHUNK_SIZE, [&fn, &vObjects](int begin, int end)
+		{
+			for (int n = begin; n < end; n++)
+				fn(*vObjects[n]);
+		});
 	}
 
-	void CentreSpriteOrigin( const char* spriteName )
+	void DestroyGameObject(int ID)
 	{
-		int spriteId = Play::Graphics::GetSpriteId( spriteName );
-		Play::Graphics::SetSpriteOrigin( spriteId, Play::Graphics::GetSpriteSize( spriteId ) / 2, false );
+		GameObject* pObj = FindGameObject(ID);
+
+		if (pObj == nullptr || pObj->type == -1)
+		{
+			PLAY_ASSERT_MSG(false, "Unable to find object with given ID");
+		}
+		else
+		{
+			// The object is hidden straight away, but not deleted until the end of the frame
+			pObj->type = -1;
+			destroyedIds.push_back(ID);
+		}
 	}
 
-	void CentreMatchingSpriteOrigins( const char* rootName )
+	void DestroyAllGameObjects(void)
 	{
-		int spriteId = Play::Graphics::GetSpriteId( rootName ); // Finds the first matching sprite and assumes same dimensions
-		Play::Graphics::SetSpriteOrigins( rootName, Play::Graphics::GetSpriteSize( spriteId ) / 2, false );
+		for (GameObject* pObj : objectList)
+			delete pObj;
+		objectList.clear();
+		destroyedIds.clear();
+		spatialCells.clear();
+		spatialRanges.clear();
 	}
 
-	void CentreAllSpriteOrigins()
+	void DestroyGameObjectsByType(int objType)
 	{
-		for( int i = 0; i < Play::Graphics::GetTotalLoadedSprites(); i++ )
-			Play::Graphics::SetSpriteOrigin( i, Play::Graphics::GetSpriteSize( i ) / 2, false );
+		if (objType == -1)
+			return;
+
+		for (GameObject* pObj : objectList)
+		{
+			if (pObj->type == objType)
+			{
+				pObj->type = -1;
+				destroyedIds.push_back(pObj->GetId());
+			}
+		}
 	}
 
-	void MoveSpriteOrigin( const char* spriteName, int xOffset, int yOffset )
+	void FlushDestroyedGameObjects()
 	{
-		int spriteId = Play::Graphics::GetSpriteId( spriteName );
-		Play::Graphics::SetSpriteOrigin( spriteId, { xOffset, yOffset }, true ); // relative option set
-	}
+		if (destroyedIds.empty())
+			return;
 
+		// Both lists are then in id order, so the destroyed objects can be removed in a single pass
+		std::sort(destroyedIds.begin(), destroyedIds.end());
 
-	void MoveAllSpriteOrigins(int xoffset, int yoffset)
-	{
-		for (int i = 0; i < Play::Graphics::GetTotalLoadedSprites(); i++)
-			Play::Graphics::SetSpriteOrigin(i, { xoffset, yoffset }, true ); // relative option set
-	}
+		size_t next = 0;
+		std::vector<GameObject*>::iterator kept = objectList.begin();
 
-	void SetSpriteOrigin( const char* spriteName, int xOrigin, int yOrigin )
-	{
-		int spriteId = Play::Graphics::GetSpriteId( spriteName );
-		Play::Graphics::SetSpriteOrigin( spriteId, { xOrigin, yOrigin } ); 
-	}
-	
-	void DrawSpriteTransparent(const char* spriteName, Point2D pos, int frameIndex, float opacity, Colour colour)
-	{
-		Graphics::DrawTransparent(Graphics::GetSpriteId(spriteName), TRANSFORM_SPACE(pos), frameIndex, { opacity, colour.red / 100.0f, colour.green / 100.0f, colour.blue / 100.0f });
-	}
+		for (GameObject* pObj : objectList)
+		{
+			if (next < destroyedIds.size() && pObj->GetId() == destroyedIds[next])
+			{
+				RemoveFromSpatialHash(*pObj);
+				delete pObj;
+				next++;
+			}
+			else
+			{
+				*kept++ = pObj;
+			}
+		}
 
-	void DrawSpriteTransparent(int spriteID, Point2D pos, int frameIndex, float opacity, Colour colour)
-	{
-		Graphics::DrawTransparent(spriteID, TRANSFORM_SPACE(pos), frameIndex, { opacity, colour.red / 100.0f, colour.green / 100.0f, colour.blue / 100.0f } );
+		objectList.erase(kept, objectList.end());
+		destroyedIds.clear();
 	}
 
-	void DrawSpriteRotated( const char* spriteName, Point2D pos, int frameIndex, float angle, float scale, float opacity, Colour colour)
+	bool IsColliding(GameObject& object1, GameObject& object2)
 	{
-		Play::Graphics::DrawRotated( Play::Graphics::GetSpriteId( spriteName ), TRANSFORM_SPACE( pos ), frameIndex, angle, scale, { opacity, colour.red / 100.0f, colour.green / 100.0f, colour.blue / 100.0f });
-	}
+		//Don't collide with noObject
+		if (object1.type == -1 || object2.type == -1)
+			return false;
 
-	void DrawSpriteRotated( int spriteID, Point2D pos, int frameIndex, float angle, float scale, float opacity, Colour colour )
-	{
-		Play::Graphics::DrawRotated( spriteID, TRANSFORM_SPACE( pos ), frameIndex, angle, scale, { opacity, colour.red / 100.0f, colour.green / 100.0f, colour.blue / 100.0f });
+		int xDiff = int(object1.pos.x) - int(object2.pos.x);
+		int yDiff = int(object1.pos.y) - int(object2.pos.y);
+		int radii = object2.radius + object1.radius;
+
+		// Game progammers don't do square root!
+		return((xDiff * xDiff) + (yDiff * yDiff) < radii * radii);
 	}
 
-	void DrawSpriteTransformed( int spriteID, const Matrix2D& transform, int frameIndex, float opacity, Colour colour )
+	//**************************************************************************************************
+	// Spatial hash functions
+	//**************************************************************************************************
+
+	// Packs a pair of cell co-ordinates into a single key for the hash map
+	static inline int64_t SpatialCellKey(int cellX, int cellY)
 	{
-		Play::Graphics::DrawTransformed( spriteID, TRANSFORM_MATRIX_SPACE( transform ), frameIndex, { opacity, colour.red / 100.0f, colour.green / 100.0f, colour.blue / 100.0f });
+		// Shifted as unsigned, as shifting a negative value left is undefined
+		return static_cast<int64_t>((static_cast<uint64_t>(static_cast<uint32_t>(cellX)) << 32) | static_cast<uint32_t>(cellY));
 	}
 
-	void DrawLine( Point2f start, Point2f end, Colour c )
+	// Gets the entries in a cell, or nullptr if the cell is empty
+	// > Reading with operator[] would add an empty cell for every cell a query touched
+	static inline const std::vector<SpatialCellEntry>* FindSpatialCell(int cellX, int cellY)
 	{
-		return Play::Graphics::DrawLine( TRANSFORM_SPACE( start), TRANSFORM_SPACE( end ), { c.red * 2.55f, c.green * 2.55f, c.blue * 2.55f }  );
+		std::unordered_map<int64_t, std::vector<SpatialCellEntry>>::const_iterator i = spatialCells.find(SpatialCellKey(cellX, cellY));
+		return i == spatialCells.end() ? nullptr : &i->second;
 	}
 
-	void DrawCircle( Point2D pos, int radius, Colour c )
+	// Calculates the range of cells overlapped by a circle, using the same integer positions as IsColliding
+	static SpatialCellRange GetSpatialCellRange(Point2f pos, int radius)
 	{
-		Play::Graphics::DrawCircle( TRANSFORM_SPACE( pos ), radius, { c.red * 2.55f, c.green * 2.55f, c.blue * 2.55f } );
+		SpatialCellRange range;
+		float size = static_cast<float>(spatialCellSize);
+		range.minX = static_cast<int>(floor((int(pos.x) - radius) / size));
+		range.minY = static_cast<int>(floor((int(pos.y) - radius) / size));
+		range.maxX = static_cast<int>(floor((int(pos.x) + radius) / size));
+		range.maxY = static_cast<int>(floor((int(pos.y) + radius) / size));
+		return range;
 	}
 
-	void DrawRect(  Point2D bottomLeft, Point2D topRight, Colour c, bool fill )
+	static void RemoveFromSpatialCells(GameObject* pObj, const SpatialCellRange& range)
 	{
-		Play::Graphics::DrawRect( TRANSFORM_SPACE( bottomLeft ), TRANSFORM_SPACE( topRight ), { c.red * 2.55f, c.green * 2.55f, c.blue * 2.55f }, fill );
+		for (int cy = range.minY; cy <= range.maxY; cy++)
+		{
+			for (int cx = range.minX; cx <= range.maxX; cx++)
+			{
+				std::unordered_map<int64_t, std::vector<SpatialCellEntry>>::iterator i = spatialCells.find(SpatialCellKey(cx, cy));
+				if (i == spatialCells.end())
+					continue;
+
+				std::vector<SpatialCellEntry>& cell = i->second;
+				for (size_t n = 0; n < cell.size(); n++)
+				{
+					if (cell[n].pObj == pObj)
+					{
+						// Order within a cell doesn't matter, so swap with the last entry rather than shuffling everything down
+						cell[n] = cell.back();
+						cell.pop_back();
+						break;
+					}
+				}
+
+				// Empty cells are erased, otherwise the map keeps growing as objects move into new areas
+				if (cell.empty())
+					spatialCells.erase(i);
+			}
+		}
 	}
 
-	void DrawSpriteLine( Point2D startPos, Point2D endPos, const char* penSprite, Colour col /*= cWhite */ )
+	void RemoveFromSpatialHash(GameObject& obj)
 	{
-		int spriteId = Play::Graphics::GetSpriteId( penSprite );
-		ColourSprite( penSprite, col );
+		std::unordered_map<int, SpatialCellRange>::iterator i = spatialRanges.find(obj.GetId());
+		if (i == spatialRanges.end())
+			return;
 
-		//Draws a line in any angle
-		int x1 = static_cast<int>( startPos.x );
-		int y1 = static_cast<int>( startPos.y );
-		int x2 = static_cast<int>( endPos.x );
-		int y2 = static_cast<int>( endPos.y );
+		RemoveFromSpatialCells(&obj, i->second);
+		spatialRanges.erase(i);
+	}
 
-		//Implementation of Bresenham's Line Drawing Algorithm
-		int dx = abs( x2 - x1 );
-		int sx = 1;
-		if( x2 < x1 ) { sx = -1; }
+	// Brings the spatial hash up to date with the current GameObjects
+	// > Only objects which have moved into a different set of cells since the last refresh are touched
+	void RefreshSpatialHash()
+	{
+		for (GameObject* pObj : objectList)
+		{
+			GameObject& obj = *pObj;
+			if (obj.type == -1) // Destroyed objects are removed when they are deleted
+				continue;
 
-		int dy = -abs( y2 - y1 );
-		int sy = 1;
-		if( y2 < y1 ) { sy = -1; }
-		
-		int err = dx + dy;
+			SpatialCellRange newRange = GetSpatialCellRange(obj.pos, obj.radius);
+			SpatialCellRange& oldRange = spatialRanges[obj.GetId()]; // Defaults to an empty range for new objects
 
-		if( dx == 0 && dy == 0 ) return;
+			if (newRange == oldRange)
+				continue;
 
-		while( true )
-		{
-			Play::DrawSprite( spriteId, { x1, y1 }, 0 );
-			
-			if( x1 == x2 && y1 == y2 )
-				break;
+			RemoveFromSpatialCells(&obj, oldRange);
 
-			int e2 = 2 * err;
-			if( e2 >= dy )
-			{
-				err += dy;
-				x1 += sx;
-			}
-			if( e2 <= dx )
+			for (int cy = newRange.minY; cy <= newRange.maxY; cy++)
 			{
-				err += dx;
-				y1 += sy;
+				for (int cx = newRange.minX; cx <= newRange.maxX; cx++)
+					spatialCells[SpatialCellKey(cx, cy)].push_back({ &obj, newRange });
 			}
+			oldRange = newRange;
 		}
 	}
 
-	// Not exposed externally
-	void DrawCircleOctants( int spriteId, int x, int y, int ox, int oy )
+	// A pair of objects can share several cells, so they are only reported from the first cell where their ranges overlap
+	static inline bool IsFirstSharedCell(int cellX, int cellY, const SpatialCellRange& a, const SpatialCellRange& b)
 	{
-		//displaying all 8 coordinates of(x,y) residing in 8-octants
-		Play::DrawSprite( spriteId, { x + ox, y + oy }, 0 );
-		Play::DrawSprite( spriteId, { x - ox, y + oy }, 0 );
-		Play::DrawSprite( spriteId, { x + ox, y - oy }, 0 );
-		Play::DrawSprite( spriteId, { x - ox, y - oy }, 0 );
-		Play::DrawSprite( spriteId, { x + oy, y + ox }, 0 );
-		Play::DrawSprite( spriteId, { x - oy, y + ox }, 0 );
-		Play::DrawSprite( spriteId, { x + oy, y - ox }, 0 );
-		Play::DrawSprite( spriteId, { x - oy, y - ox }, 0 );
+		return cellX == std::max(a.minX, b.minX) && cellY == std::max(a.minY, b.minY);
 	}
 
-	void DrawSpriteCircle( Point2D pos, int radius, const char* penSprite, Colour col )
+	void QueryCollisions(int typeA, int typeB, std::function<void(GameObject&, GameObject&)> callback)
 	{
-		int spriteId = Play::Graphics::GetSpriteId( penSprite );
-		ColourSprite( penSprite, col );
+		RefreshSpatialHash();
 
-		pos = TRANSFORM_SPACE( pos );
-
-		int ox = 0, oy = radius;
-		int d = 3 - 2 * radius;
-		DrawCircleOctants( spriteId, static_cast<int>(pos.x), static_cast<int>(pos.y), ox, oy );
+		// Objects created during the query aren't in the hash, so only the objects which existed at the start are visited
+		size_t objectCount = objectList.size();
 
-		while( oy >= ox )
+		for (size_t n = 0; n < objectCount; n++)
 		{
-			ox++;
-			if( d > 0 )
-			{
-				oy--;
-				d = d + 4 * ( ox - oy ) + 10;
-			}
-			else
+			GameObject& objA = *objectList[n];
+			if (objA.type != typeA || typeA == -1)
+				continue;
+
+			const SpatialCellRange& rangeA = spatialRanges[objA.GetId()];
+
+			for (int cy = rangeA.minY; cy <= rangeA.maxY; cy++)
 			{
-				d = d + 4 * ox + 6;
+				for (int cx = rangeA.minX; cx <= rangeA.maxX; cx++)
+				{
+					const std::vector<SpatialCellEntry>* pCell = FindSpatialCell(cx, cy);
+					if (!pCell)
+						continue;
+
+					for (const SpatialCellEntry& entry : *pCell)
+					{
+						GameObject& objB = *entry.pObj;
+
+						if (objB.type != typeB || &objB == &objA)
+							continue;
+
+						// The first object may have been destroyed by the callback
+						if (objA.type != typeA)
+							break;
+
+						// Pairs of the same type would otherwise be reported twice (once each way round)
+						if (typeA == typeB && objB.GetId() < objA.GetId())
+							continue;
+
+						if (IsFirstSharedCell(cx, cy, rangeA, entry.range) && IsColliding(objA, objB))
+							callback(objA, objB);
+					}
+				}
 			}
-			DrawCircleOctants( spriteId, static_cast<int>(pos.x), static_cast<int>(pos.y), ox, oy );
 		}
-	};
+	}
 
-	void DrawFontText( const char* fontId, std::string text, Point2D pos, Align justify )
+	// Internal (private) function shared by both versions of CollectGameObjectIDsInRadius
+	static std::vector<int> CollectIDsInRadius(Point2f pos, int radius, bool matchType, int type)
 	{
-		int font = Play::Graphics::GetSpriteId( fontId );
-
-		int totalWidth{ 0 };
+		RefreshSpatialHash();
 
-		for( char c : text )
-			totalWidth += Play::Graphics::GetFontCharWidth( font, c );
+		std::vector<int> vec;
+		SpatialCellRange range = GetSpatialCellRange(pos, radius);
 
-		switch( justify )
+		for (int cy = range.minY; cy <= range.maxY; cy++)
 		{
-			case Align::CENTRE:
-				pos.x -= totalWidth / 2;
-				break;
-			case Align::RIGHT:
-				pos.x -= totalWidth;
-				break;
-			default:
-				break;
+			for (int cx = range.minX; cx <= range.maxX; cx++)
+			{
+				const std::vector<SpatialCellEntry>* pCell = FindSpatialCell(cx, cy);
+				if (!pCell)
+					continue;
+
+				for (const SpatialCellEntry& entry : *pCell)
+				{
+					GameObject& obj = *entry.pObj;
+
+					if (obj.type == -1 || (matchType && obj.type != type))
+						continue;
+
+					if (!IsFirstSharedCell(cx, cy, range, entry.range))
+						continue;
+
+					// The same test as IsColliding, so the results are consistent
+					int xDiff = int(pos.x) - int(obj.pos.x);
+					int yDiff = int(pos.y) - int(obj.pos.y);
+					int radii = radius + obj.radius;
+
+					if ((xDiff * xDiff) + (yDiff * yDiff) < radii * radii)
+						vec.push_back(obj.GetId());
+				}
+			}
 		}
 
-		pos.x += Play::Graphics::GetSpriteOrigin( font ).x;
-		Play::Graphics::DrawString( font, TRANSFORM_SPACE( pos ), text );
+		std::sort(vec.begin(), vec.end());
+		return vec; // Returning a copy of the vector
 	}
 
-	void DrawPixel(Point2D pos, Colour col)
+	std::vector<int> CollectGameObjectIDsInRadius(Point2f pos, int radius)
 	{
-		return Play::Graphics::DrawPixel(TRANSFORM_SPACE( pos ), { col.red * 2.55f, col.green * 2.55f, col.blue * 2.55f });
+		return CollectIDsInRadius(pos, radius, false, -1);
 	}
 
-	void BeginTimingBar( Colour c )
+	std::vector<int> CollectGameObjectIDsInRadius(int type, Point2f pos, int radius)
 	{
-		Play::Graphics::TimingBarBegin( Pixel( c.red*2.55f, c.green*2.55f, c.blue*2.55f ) );
+		return CollectIDsInRadius(pos, radius, true, type);
 	}
 
-	int ColourTimingBar( Colour c )
+	void SetCollisionCellSize(int cellSize)
 	{
-		return Play::Graphics::SetTimingBarColour( Pixel( c.red * 2.55f, c.green * 2.55f, c.blue * 2.55f ) );
+		PLAY_ASSERT_MSG(cellSize > 0, "Collision cell size must be greater than zero");
+
+		if (cellSize == spatialCellSize)
+			return;
+
+		// Every object's cells change, so start again from scratch
+		spatialCellSize = cellSize;
+		spatialCells.clear();
+		spatialRanges.clear();
 	}
 
 	//**************************************************************************************************
-	// Miscellaneous functions
+	// World snapshot functions
 	//**************************************************************************************************
 
-	int RandomRollRange( int begin, int end )
-	{
-		int range = abs( end - begin );
-		int rnd = ( rand() % ( range + 1 ) );
-		if( end > begin )
-			return begin + rnd;
-		else
-			return end + rnd;
-	}
-}
-//********************************************************************************************************************************
-// File:		PlayManager.cpp
-// Description:	A manager for providing simplified access to the PlayBuffer framework
-// Platform:	Independent
-// Notes:		The GameObject management is "opt in" as many will want to create their own GameObject class
-//********************************************************************************************************************************
-
-// Define this to opt in to the PlayManager
-#ifdef PLAY_USING_GAMEOBJECT_MANAGER
-namespace Play
-{
-	// Constructor for the GameObject struct - kept as simple as possible
-	GameObject::GameObject(int type, Point2f newPos, int collisionRadius, int spriteId = 0)
-		: type(type), pos(newPos), radius(collisionRadius), spriteId(spriteId)
+	// A snapshot is this header followed by one record for each GameObject, in id order
+	// > Full record: the id, then a copy of the GameObject's state
+	// > Delta record: the id, a bit mask of the state's 32-bit words which differ from the previous snapshot, then just those words
+	struct SnapshotHeader
 	{
-		// Member variables are assigned default values in the class header
-		static int uniqueId = 0;
-		m_id = uniqueId++;
-	}
-
-	// A map is used internally to store all the GameObjects and their unique ids
-	static std::map<int, GameObject&> objectMap;
+		uint32_t magic;
+		uint32_t objectSize; // Snapshots can only be restored by code with the same GameObjectState struct
+		int32_t nextId;
+		int32_t objectCount;
+		int32_t isDelta;
+	};
 
-	// Used instead of Null return values, PlayMangager operations performed on this GameObject should fail transparently
-	static GameObject noObject{ -1,{ 0, 0 }, 0, -1 };
+	static_assert(sizeof(GameObjectState) % sizeof(uint32_t) == 0, "GameObject snapshots are compared a 32-bit word at a time");
 
+	constexpr uint32_t SNAPSHOT_MAGIC = 0x31535750; // "PWS1"
+	constexpr int SNAPSHOT_WORDS = sizeof(GameObjectState) / sizeof(uint32_t);
+	constexpr int SNAPSHOT_MASK_WORDS = (SNAPSHOT_WORDS + 31) / 32;
+	constexpr size_t SNAPSHOT_FULL_RECORD_SIZE = sizeof(int32_t) + sizeof(GameObjectState);
 
-	//**************************************************************************************************
-	// GameObject functions
-	//**************************************************************************************************
-	int CreateGameObject(int type, Point2f newPos, int collisionRadius, const char* spriteName)
+	static inline int32_t ReadSnapshotId(const uint8_t* pRecord)
 	{
-		int spriteId = Play::Graphics::GetSpriteId(spriteName);
-		// Deletion is handled in DestroyGameObject()
-		GameObject* pObj = new GameObject(type, newPos, collisionRadius, spriteId);
-		int id = pObj->GetId();
-		objectMap.insert(std::map<int, GameObject&>::value_type(id, *pObj));
+		int32_t id;
+		memcpy(&id, pRecord, sizeof(id));
 		return id;
 	}
 
-	GameObject& GetGameObject(int ID)
+	// Internal (private) function which checks a snapshot's header and the length of every record before anything relies on them
+	// > Snapshots can come from anywhere (a file or the network), so a truncated or corrupt one is rejected rather than read past its end
+	static bool ValidateSnapshot(const std::vector<uint8_t>& buffer, SnapshotHeader& header)
 	{
-		std::map<int, GameObject&>::iterator i = objectMap.find(ID);
+		if (buffer.size() < sizeof(SnapshotHeader))
+			return false;
 
-		if (i == objectMap.end())
-			return noObject;
+		memcpy(&header, buffer.data(), sizeof(SnapshotHeader));
+		if (header.magic != SNAPSHOT_MAGIC || header.objectSize != sizeof(GameObjectState) || header.nextId < 0 || header.objectCount < 0 || (header.isDelta != 0 && header.isDelta != 1))
+			return false;
 
-		return i->second;
-	}
+		const uint8_t* pRecord = buffer.data() + sizeof(SnapshotHeader);
+		size_t bytesLeft = buffer.size() - sizeof(SnapshotHeader);
+		int32_t lastId = -1;
 
-	GameObject& GetGameObjectByType(int type)
-	{
-		int count = 0;
+		// The records are matched up with the GameObjects in id order, so the ids must increase (and be below the next id)
+		for (int n = 0; n < header.objectCount; n++)
+		{
+			if (bytesLeft < sizeof(int32_t))
+				return false;
+
+			int32_t id = ReadSnapshotId(pRecord);
+			if (id <= lastId || id >= header.nextId)
+				return false;
+			lastId = id;
+
+			size_t recordSize = SNAPSHOT_FULL_RECORD_SIZE;
+			if (header.isDelta)
+			{
+				if (bytesLeft < sizeof(int32_t) + SNAPSHOT_MASK_WORDS * sizeof(uint32_t))
+					return false;
 
-		for (std::pair<const int, GameObject&>& i : objectMap)
-			if (i.second.type == type) { count++; }
+				uint32_t mask[SNAPSHOT_MASK_WORDS];
+				memcpy(mask, pRecord + sizeof(int32_t), sizeof(mask));
 
-		PLAY_ASSERT_MSG(count <= 1, "Multiple objects of type found, use CollectGameObjectIDsByType instead");
+				// Bits past the last word don't stand for anything
+				if (SNAPSHOT_WORDS % 32 != 0 && (mask[SNAPSHOT_MASK_WORDS - 1] >> (SNAPSHOT_WORDS % 32)) != 0)
+					return false;
 
-		for (std::pair<const int, GameObject&>& i : objectMap)
-		{
-			if (i.second.type == type)
-				return i.second;
+				size_t words = 0;
+				for (int w = 0; w < SNAPSHOT_WORDS; w++)
+					words += (mask[w / 32] >> (w % 32)) & 1;
+
+				recordSize = sizeof(int32_t) + (SNAPSHOT_MASK_WORDS + words) * sizeof(uint32_t);
+			}
+
+			if (bytesLeft < recordSize)
+				return false;
+
+			pRecord += recordSize;
+			bytesLeft -= recordSize;
 		}
 
-		return noObject;
+		return bytesLeft == 0;
 	}
 
-	std::vector<int> CollectGameObjectIDsByType(int type)
+	// Internal (private) function which steps through a full snapshot's records to the one with the given id (or nullptr)
+	// > Ids are only ever looked up in increasing order, so the search carries on from where the last one finished. The
+	//   snapshot must have been validated, which checks that there are recordsLeft whole records.
+	static const uint8_t* FindSnapshotRecord(const uint8_t*& pRecord, int& recordsLeft, int32_t id)
 	{
-		std::vector<int> vec;
-		for (std::pair<const int, GameObject&>& i : objectMap)
+		while (recordsLeft > 0 && ReadSnapshotId(pRecord) < id)
 		{
-			if (i.second.type == type)
-				vec.push_back(i.first);
+			pRecord += SNAPSHOT_FULL_RECORD_SIZE;
+			recordsLeft--;
 		}
-		return vec; // Returning a copy of the vector
-	}
-
-	std::vector<int> CollectAllGameObjectIDs()
-	{
-		std::vector<int> vec;
 
-		for (std::pair<const int, GameObject&>& i : objectMap)
-			vec.push_back(i.first);
+		if (recordsLeft > 0 && ReadSnapshotId(pRecord) == id)
+			return pRecord + sizeof(int32_t);
 
-		return vec; // Returning a copy of the vector
+		return nullptr;
 	}
 
-	void UpdateGameObject(GameObject& obj, bool bWrap, int wrapBorderSize, bool allowMultipleUpdatesPerFrame)
+	void SaveWorldSnapshot(std::vector<uint8_t>& buffer, const std::vector<uint8_t>* pPrevious)
 	{
-		if (obj.type == -1) return; // Don't update noObject
+		SnapshotHeader baseHeader{};
+		const uint8_t* pBaseRecord = nullptr;
+		int baseRecordsLeft = 0;
 
-		// We allow multiple updates if the object type has changed
-		PLAY_ASSERT_MSG(obj.lastFrameUpdated != Play::frameCount || obj.type != obj.oldType || allowMultipleUpdatesPerFrame, "Trying to update the same GameObject more than once in the same frame!");
-		obj.lastFrameUpdated = Play::frameCount;
-
-		// Save the current position in case we need to go back
-		obj.oldPos = obj.pos;
-		obj.oldRot = obj.rotation;
+		if (pPrevious)
+		{
+			bool bValidBase = ValidateSnapshot(*pPrevious, baseHeader) && !baseHeader.isDelta;
+			PLAY_ASSERT_MSG(bValidBase, "Delta snapshots must be saved against a valid full snapshot");
 
-		// Move the object according to a very simple physical model
-		obj.velocity += obj.acceleration;
-		obj.pos += obj.velocity;
-		obj.rotation += obj.rotSpeed;
+			// A full snapshot is saved instead if the assert is ignored, as it doesn't need the previous one to restore it
+			if (bValidBase)
+			{
+				pBaseRecord = pPrevious->data() + sizeof(SnapshotHeader);
+				baseRecordsLeft = baseHeader.objectCount;
+			}
+			else
+			{
+				pPrevious = nullptr;
+			}
+		}
 
-		// Handle the animation frame update
-		obj.framePos += obj.animSpeed;
-		if (obj.framePos > 1.0f)
+		int count = 0;
+		for (GameObject* pObj : objectList)
 		{
-			obj.frame++;
-			obj.framePos -= 1.0f;
+			if (pObj->type != -1) // Objects destroyed this frame aren't saved
+				count++;
 		}
 
-		// Wrap objects around the screen
-		if (bWrap)
+		// Make the buffer as big as it could possibly need to be, then trim it at the end
+		size_t maxRecordSize = pPrevious ? sizeof(int32_t) + (SNAPSHOT_MASK_WORDS + SNAPSHOT_WORDS) * sizeof(uint32_t) : SNAPSHOT_FULL_RECORD_SIZE;
+		buffer.resize(sizeof(SnapshotHeader) + count * maxRecordSize);
+
+		SnapshotHeader header{ SNAPSHOT_MAGIC, sizeof(GameObjectState), nextGameObjectId, count, pPrevious ? 1 : 0 };
+		memcpy(buffer.data(), &header, sizeof(SnapshotHeader));
+		uint8_t* pOut = buffer.data() + sizeof(SnapshotHeader);
+
+		for (GameObject* pObj : objectList)
 		{
-			int dWidth = Play::Window::GetWidth();
-			int dHeight = Play::Window::GetHeight();
-			Vector2f origin = Play::Graphics::GetSpriteOrigin(obj.spriteId);
-			Vector2f spriteSize = Play::Graphics::GetSpriteSize(obj.spriteId);
+			if (pObj->type == -1)
+				continue;
 
-			if (obj.pos.x - origin.x + spriteSize.x - wrapBorderSize > dWidth)
-				obj.pos.x = 0.0f - wrapBorderSize + origin.x;
-			else if (obj.pos.x - origin.x + wrapBorderSize < 0)
-				obj.pos.x = dWidth + wrapBorderSize + origin.x - spriteSize.x;
+			int32_t id = pObj->GetId();
+			memcpy(pOut, &id, sizeof(id));
+			pOut += sizeof(id);
 
-			if (obj.pos.y - origin.y + spriteSize.y - wrapBorderSize > dHeight)
-				obj.pos.y = 0.0f - wrapBorderSize + origin.y;
-			else if (obj.pos.y - origin.y + wrapBorderSize < 0)
-				obj.pos.y = dHeight + wrapBorderSize + origin.y - spriteSize.y;
+			const GameObjectState& state = *pObj;
+
+			if (!pPrevious)
+			{
+				memcpy(pOut, &state, sizeof(GameObjectState));
+				pOut += sizeof(GameObjectState);
+				continue;
+			}
+
+			// Objects which weren't in the previous snapshot have every word saved
+			const uint8_t* pOld = FindSnapshotRecord(pBaseRecord, baseRecordsLeft, id);
+			const uint8_t* pNew = reinterpret_cast<const uint8_t*>(&state);
+
+			uint32_t mask[SNAPSHOT_MASK_WORDS] = {};
+			uint8_t* pMask = pOut;
+			pOut += sizeof(mask);
+
+			for (int w = 0; w < SNAPSHOT_WORDS; w++)
+			{
+				uint32_t word;
+				memcpy(&word, pNew + w * sizeof(uint32_t), sizeof(uint32_t));
+
+				if (pOld)
+				{
+					uint32_t oldWord;
+					memcpy(&oldWord, pOld + w * sizeof(uint32_t), sizeof(uint32_t));
+					if (word == oldWord)
+						continue;
+				}
+
+				mask[w / 32] |= 1u << (w % 32);
+				memcpy(pOut, &word, sizeof(uint32_t));
+				pOut += sizeof(uint32_t);
+			}
+
+			memcpy(pMask, mask, sizeof(mask));
 		}
 
+		buffer.resize(pOut - buffer.data());
 	}
 
-	void DestroyGameObject(int ID)
+	bool RestoreWorldSnapshot(const std::vector<uint8_t>& buffer, const std::vector<uint8_t>* pPrevious)
 	{
-		if (objectMap.find(ID) == objectMap.end())
+		// Everything is checked before any GameObjects are changed, so a rejected snapshot leaves the world as it was
+		SnapshotHeader header;
+		if (!ValidateSnapshot(buffer, header))
+			return false;
+
+		const uint8_t* pBaseRecord = nullptr;
+		int baseRecordsLeft = 0;
+
+		if (header.isDelta)
 		{
-			PLAY_ASSERT_MSG(false, "Unable to find object with given ID");
+			SnapshotHeader baseHeader;
+			if (!pPrevious || !ValidateSnapshot(*pPrevious, baseHeader) || baseHeader.isDelta)
+				return false;
+
+			pBaseRecord = pPrevious->data() + sizeof(SnapshotHeader);
+			baseRecordsLeft = baseHeader.objectCount;
 		}
-		else
+
+		// Both the current objects and the snapshot are in id order, so they can be matched up in a single pass
+		// > Existing objects are reused where possible, so restoring doesn't have to allocate every object again
+		static std::vector<GameObject*> vRestored;
+		vRestored.clear();
+		vRestored.reserve(header.objectCount);
+
+		std::vector<GameObject*>::iterator existing = objectList.begin();
+		const uint8_t* pIn = buffer.data() + sizeof(SnapshotHeader);
+
+		for (int n = 0; n < header.objectCount; n++)
 		{
-			GameObject* go = &objectMap.find(ID)->second;
-			delete go;
-			objectMap.erase(ID);
-		}
-	}
+			int32_t id = ReadSnapshotId(pIn);
+			pIn += sizeof(id);
 
-	void DestroyAllGameObjects(void)
-	{
-		for (std::pair<const int, GameObject&>& p : objectMap)
-			delete& p.second;
-		objectMap.clear();
-	}
+			while (existing != objectList.end() && (*existing)->GetId() < id)
+				delete *existing++;
 
-	void DestroyGameObjectsByType(int objType)
-	{
-		std::vector<int> typeVec = CollectGameObjectIDsByType(objType);
-		for (size_t i = 0; i < typeVec.size(); i++)
-			DestroyGameObject(typeVec[i]);
-	}
+			GameObject* pObj;
+			if (existing != objectList.end() && (*existing)->GetId() == id)
+				pObj = *existing++;
+			else
+				pObj = new GameObject(-1, { 0, 0 }, 0, 0); // Its state and id are set below
 
-	bool IsColliding(GameObject& object1, GameObject& object2)
-	{
-		//Don't collide with noObject
-		if (object1.type == -1 || object2.type == -1)
-			return false;
+			GameObjectState state;
 
-		int xDiff = int(object1.pos.x) - int(object2.pos.x);
-		int yDiff = int(object1.pos.y) - int(object2.pos.y);
-		int radii = object2.radius + object1.radius;
+			if (!header.isDelta)
+			{
+				memcpy(&state, pIn, sizeof(GameObjectState));
+				pIn += sizeof(GameObjectState);
+			}
+			else
+			{
+				// Objects which weren't in the previous snapshot have every word in the delta, so the defaults are all overwritten
+				const uint8_t* pOld = FindSnapshotRecord(pBaseRecord, baseRecordsLeft, id);
+				if (pOld)
+					memcpy(&state, pOld, sizeof(GameObjectState));
 
-		// Game progammers don't do square root!
-		return((xDiff * xDiff) + (yDiff * yDiff) < radii * radii);
+				uint32_t mask[SNAPSHOT_MASK_WORDS];
+				memcpy(mask, pIn, sizeof(mask));
+				pIn += sizeof(mask);
+
+				uint8_t* pState = reinterpret_cast<uint8_t*>(&state);
+				for (int w = 0; w < SNAPSHOT_WORDS; w++)
+				{
+					if (mask[w / 32] & (1u << (w % 32)))
+					{
+						memcpy(pState + w * sizeof(uint32_t), pIn, sizeof(uint32_t));
+						pIn += sizeof(uint32_t);
+					}
+				}
+			}
+
+			static_cast<GameObjectState&>(*pObj) = state;
+			pObj->m_id = id;
+			vRestored.push_back(pObj);
+		}
+
+		while (existing != objectList.end())
+			delete *existing++;
+
+		objectList.swap(vRestored);
+		vRestored.clear();
+		destroyedIds.clear();
+		nextGameObjectId = header.nextId;
+
+		// Objects may have been deleted, so the spatial hash is rebuilt the next time it is used
+		spatialCells.clear();
+		spatialRanges.clear();
+		return true;
 	}
 
 	bool IsVisible(GameObject& obj)
@@ -5243,29 +12123,138 @@ namespace Play
 	}
 
 
+	// Whether a GameObject should be drawn between its old and current positions, because it moved in the latest fixed timestep tick
+	static bool IsInterpolated(const GameObject& obj)
+	{
+		return fixedTimestep.tickTime > 0.0 && obj.lastTickUpdated == fixedTimestep.tick;
+	}
+
+	static Point2f GetDrawPos(const GameObject& obj)
+	{
+		if (!IsInterpolated(obj)) return obj.pos;
+		return obj.oldPos + (obj.pos - obj.oldPos) * fixedTimestep.interpolation;
+	}
+
+	static float GetDrawRotation(const GameObject& obj)
+	{
+		if (!IsInterpolated(obj)) return obj.rotation;
+		return obj.oldRot + (obj.rotation - obj.oldRot) * fixedTimestep.interpolation;
+	}
+
 	void DrawObject(GameObject& obj)
 	{
 		if (obj.type == -1) return; // Don't draw noObject
-		Play::Graphics::Draw(obj.spriteId, TRANSFORM_SPACE( obj.pos ), obj.frame);
+		Play::Graphics::Draw(obj.spriteId, TRANSFORM_SPACE( GetDrawPos( obj ) ), obj.frame);
 	}
 
 	void DrawObjectTransparent(GameObject& obj, float opacity)
 	{
 		if (obj.type == -1) return; // Don't draw noObject
-		Play::Graphics::DrawTransparent(obj.spriteId, TRANSFORM_SPACE( obj.pos ), obj.frame, { opacity, 1.0f, 1.0f, 1.0f });
+		Play::Graphics::DrawTransparent(obj.spriteId, TRANSFORM_SPACE( GetDrawPos( obj ) ), obj.frame, { opacity, 1.0f, 1.0f, 1.0f });
 	}
 
 	void DrawObjectRotated(GameObject& obj, float opacity)
 	{
 		if (obj.type == -1) return; // Don't draw noObject
-		Play::Graphics::DrawRotated(obj.spriteId, TRANSFORM_SPACE( obj.pos ), obj.frame, obj.rotation, obj.scale, { opacity, 1.0f, 1.0f, 1.0f });
+		Play::Graphics::DrawRotated(obj.spriteId, TRANSFORM_SPACE( GetDrawPos( obj ) ), obj.frame, GetDrawRotation( obj ), obj.scale, { opacity, 1.0f, 1.0f, 1.0f });
+	}
+
+	void DrawAllGameObjects()
+	{
+		struct DrawItem
+		{
+			int order;
+			int spriteId;
+			int id;
+			GameObject* pObj;
+			Point2f pos; // Already transformed into the current drawing space
+			float rotation;
+		};
+
+		// The extents of each sprite relative to its origin, worked out the first time it's needed during each call
+		struct SpriteExtents
+		{
+			Vector2f min;
+			Vector2f max;
+			float radius; // The furthest distance from the origin to a corner, for rotated and scaled objects
+			int stamp;
+		};
+
+		static std::vector<DrawItem> vItems;
+		static std::vector<SpriteExtents> vExtents;
+		static int stamp = 0;
+
+		stamp++;
+		vItems.clear();
+
+		int totalSprites = Play::Graphics::GetTotalLoadedSprites();
+		if (static_cast<int>(vExtents.size()) < totalSprites)
+			vExtents.resize(totalSprites, { { 0, 0 }, { 0, 0 }, 0.0f, 0 });
+
+		Point2f offset = drawSpace == DrawingSpace::WORLD ? cameraPos : Point2f{ 0.0f, 0.0f };
+		float viewWidth = static_cast<float>(Window::GetWidth());
+		float viewHeight = static_cast<float>(Window::GetHeight());
+
+		for (GameObject* pObj : objectList)
+		{
+			GameObject& obj = *pObj;
+			if (obj.type == -1 || obj.spriteId < 0 || obj.spriteId >= totalSprites) continue;
+
+			SpriteExtents& ext = vExtents[obj.spriteId];
+			if (ext.stamp != stamp)
+			{
+				Vector2f size = Play::Graphics::GetSpriteSize(obj.spriteId);
+				Vector2f origin = Play::Graphics::GetSpriteOrigin(obj.spriteId);
+				ext.min = -origin;
+				ext.max = size - origin;
+				ext.radius = sqrt(std::max(ext.min.x * ext.min.x, ext.max.x * ext.max.x) + std::max(ext.min.y * ext.min.y, ext.max.y * ext.max.y));
+				ext.stamp = stamp;
+			}
+
+			Point2f pos = GetDrawPos(obj) - offset;
+			float rotation = GetDrawRotation(obj);
+
+			if (rotation == 0.0f && obj.scale == 1.0f)
+			{
+				if (pos.x + ext.max.x <= 0 || pos.x + ext.min.x >= viewWidth || pos.y + ext.max.y <= 0 || pos.y + ext.min.y >= viewHeight)
+					continue;
+			}
+			else
+			{
+				float radius = ext.radius * std::abs(obj.scale);
+				if (pos.x + radius <= 0 || pos.x - radius >= viewWidth || pos.y + radius <= 0 || pos.y - radius >= viewHeight)
+					continue;
+			}
+
+			vItems.push_back({ obj.order, obj.spriteId, obj.GetId(), pObj, pos, rotation });
+		}
+
+		// Sorting by sprite within each order keeps the same sprite data in the cache, and the id keeps the order stable
+		std::sort(vItems.begin(), vItems.end(), [](const DrawItem& a, const DrawItem& b)
+		{
+			if (a.order != b.order) return a.order < b.order;
+			if (a.spriteId != b.spriteId) return a.spriteId < b.spriteId;
+			return a.id < b.id;
+		});
+
+		for (const DrawItem& item : vItems)
+		{
+			const GameObject& obj = *item.pObj;
+
+			if (item.rotation == 0.0f && obj.scale == 1.0f)
+				Play::Graphics::Draw(item.spriteId, item.pos, obj.frame);
+			else
+				Play::Graphics::DrawRotated(item.spriteId, item.pos, obj.frame, item.rotation, obj.scale);
+		}
 	}
 
 	void DrawGameObjectsDebug()
 	{
-		for( std::pair<const int, GameObject&>& i : objectMap )
+		for( GameObject* pObj : objectList )
 		{
-			GameObject& obj = i.second;
+			GameObject& obj = *pObj;
+			if( obj.type == -1 ) continue; // Skip objects destroyed this frame
+
 			int id = obj.spriteId;
 			Play::Vector2D size = Play::Graphics::GetSpriteSize( obj.spriteId );
 			Play::Vector2D origin = Play::Graphics::GetSpriteOrigin( id );